@@ -66,6 +66,9 @@ ber_pvt_log_printf LDAP_P((
 LBER_F( ber_slen_t )
 ber_pvt_sb_do_write LDAP_P(( Sockbuf_IO_Desc *sbiod, Sockbuf_Buf *buf_out ));
 
+LBER_F( ber_slen_t )
+ber_pvt_sb_writev LDAP_P(( Sockbuf *sb, struct berval *bvs, int nbvs ));
+
 LBER_F( void )
 ber_pvt_sb_buf_init LDAP_P(( Sockbuf_Buf *buf ));
 
@@ -34,6 +34,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #if defined( HAVE_SYS_FILIO_H )
 #include <sys/filio.h>
 #elif defined( HAVE_SYS_IOCTL_H )
@@ -51,6 +55,9 @@
 #ifndef LBER_DEFAULT_READAHEAD
 #define LBER_DEFAULT_READAHEAD	16384
 #endif
+#ifndef LBER_MAX_WRITEV
+#define LBER_MAX_WRITEV			64
+#endif
 
 Sockbuf *
 ber_sockbuf_alloc( void )
@@ -453,6 +460,67 @@ ber_int_sb_write( Sockbuf *sb, void *buf, ber_len_t len )
 	return ret;
 }
 
+/*
+ * Write several buffers with one system call. This is only possible
+ * when every layer above the TCP provider passes data through
+ * unchanged; otherwise only the first buffer is written, through the
+ * installed layers. Returns the number of bytes written, which may
+ * span any number of the buffers.
+ */
+ber_slen_t
+ber_pvt_sb_writev( Sockbuf *sb, struct berval *bvs, int nbvs )
+{
+	ber_slen_t		ret;
+
+	assert( sb != NULL);
+	assert( sb->sb_iod != NULL );
+	assert( SOCKBUF_VALID( sb ) );
+	assert( bvs != NULL );
+	assert( nbvs > 0 );
+
+#if defined( HAVE_SYS_UIO_H ) && !defined( HAVE_WINSOCK )
+	if ( nbvs > 1 ) {
+		Sockbuf_IO_Desc	*p;
+
+		for ( p = sb->sb_iod; p != NULL; p = p->sbiod_next ) {
+			if ( p->sbiod_io != &ber_sockbuf_io_debug &&
+				p->sbiod_io != &ber_sockbuf_io_readahead )
+			{
+				break;
+			}
+		}
+
+		if ( p != NULL && p->sbiod_io == &ber_sockbuf_io_tcp ) {
+			struct iovec	iov[LBER_MAX_WRITEV];
+			int		i;
+
+			if ( nbvs > LBER_MAX_WRITEV ) nbvs = LBER_MAX_WRITEV;
+			for ( i = 0; i < nbvs; i++ ) {
+				iov[i].iov_base = bvs[i].bv_val;
+				iov[i].iov_len = bvs[i].bv_len;
+			}
+
+			for (;;) {
+				ret = writev( sb->sb_fd, iov, nbvs );
+#ifdef EINTR
+				if ( ( ret < 0 ) && ( errno == EINTR ) ) continue;
+#endif
+				break;
+			}
+
+			if ( sb->sb_debug ) {
+				ber_log_printf( LDAP_DEBUG_TRACE, sb->sb_debug,
+					"ber_pvt_sb_writev: %d buffers to sd %ld, written=%ld\n",
+					nbvs, (long) sb->sb_fd, (long) ret );
+			}
+			return ret;
+		}
+	}
+#endif
+
+	return ber_int_sb_write( sb, bvs[0].bv_val, bvs[0].bv_len );
+}
+
 /*
  * Support for TCP
  */
@@ -47,12 +47,18 @@ typedef struct ldap_int_tpool_key_s {
 /* Max number of threads */
 #define	LDAP_MAXTHR	1024	/* must be a power of 2 */
 
+/* Max number of work queues */
+#define	LDAP_MAXQUEUES	64
+
 /* (Theoretical) max number of pending requests */
 #define MAX_PENDING (INT_MAX/2)	/* INT_MAX - (room to avoid overflow) */
 
-/* Context: thread ID and thread-specific key/data pairs */
+struct ldap_int_thread_poolq_s;
+
+/* Context: thread ID, work queue and thread-specific key/data pairs */
 typedef struct ldap_int_thread_userctx_s {
 	ldap_pvt_thread_t ltu_id;
+	struct ldap_int_thread_poolq_s *ltu_pq;	/* NULL if not a pool thread */
 	ldap_int_tpool_key_t ltu_key[MAXKEYS];
 } ldap_int_thread_userctx_t;
 
@@ -88,18 +94,21 @@ typedef struct ldap_int_thread_task_s {
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
 
-struct ldap_int_thread_pool_s {
-	LDAP_STAILQ_ENTRY(ldap_int_thread_pool_s) ltp_next;
+/* A work queue.  Each pool thread belongs to one queue, and
+ * pool_submit() spreads tasks over the queues, so that submitters
+ * and threads mostly contend for different mutexes.  A thread
+ * whose own queue is empty steals tasks from the other queues
+ * before it goes idle.
+ */
+struct ldap_int_thread_poolq_s {
+	struct ldap_int_thread_pool_s *ltp_pool;
 
-	/* protect members below, and protect thread_keys[] during pauses */
+	/* protect members below */
 	ldap_pvt_thread_mutex_t ltp_mutex;
 
-	/* not paused and something to do for pool_<wrapper/pause/destroy>() */
+	/* something to do for the idle threads of this queue */
 	ldap_pvt_thread_cond_t ltp_cond;
 
-	/* ltp_active_count <= 1 && ltp_pause */
-	ldap_pvt_thread_cond_t ltp_pcond;
-
 	/* ltp_pause == 0 ? &ltp_pending_list : &empty_pending_list,
 	 * maintaned to reduce work for pool_wrapper()
 	 */
@@ -109,16 +118,60 @@ struct ldap_int_thread_pool_s {
 	ldap_int_tpool_plist_t ltp_pending_list;
 	LDAP_SLIST_HEAD(tcl, ldap_int_thread_task_s) ltp_free_list;
 
+	/* Max number of pending + paused requests in this queue,
+	 * negated when the pool is finishing
+	 */
+	int ltp_max_pending;
+
+	/* This queue's share of the pool's max number of threads */
+	int ltp_max_count;
+
+	/* A submitter found no thread for its task in another queue */
+	int ltp_steal;
+	int ltp_steal_count;		/* Threads looking in other queues */
+
+	int ltp_pending_count;		/* Pending or paused requests */
+	int ltp_active_count;		/* Active, not paused requests */
+	int ltp_idle_count;			/* Threads waiting on ltp_cond */
+	int ltp_open_count;			/* Threads of this queue, incl. starting */
+};
+
+struct ldap_int_thread_pool_s {
+	LDAP_STAILQ_ENTRY(ldap_int_thread_pool_s) ltp_next;
+
+	/* The work queues.  Only pool_queues() changes them,
+	 * before the pool has opened any thread.
+	 */
+	struct ldap_int_thread_poolq_s *ltp_wqs;
+	int ltp_numqs;
+
+	/* Queue where pool_submit() starts looking.  Updated without
+	 * locking; a lost update only skews the spread of the tasks.
+	 */
+	unsigned ltp_nextq;
+
+	/* protect members below, and protect thread_keys[] during pauses.
+	 * Locked before, never while holding, a queue's ltp_mutex.
+	 */
+	ldap_pvt_thread_mutex_t ltp_mutex;
+
+	/* not paused, or no threads left, for pool_<wrapper/pause/destroy>() */
+	ldap_pvt_thread_cond_t ltp_cond;
+
+	/* some thread went idle while ltp_pause */
+	ldap_pvt_thread_cond_t ltp_pcond;
+
 	/* The pool is finishing, waiting for its threads to close.
-	 * They close when ltp_pending_list is done.  pool_submit()
+	 * They close when the pending lists are done.  pool_submit()
 	 * rejects new tasks.  ltp_max_pending = -(its old value).
 	 */
 	int ltp_finishing;
 
 	/* Some active task needs to be the sole active task.
 	 * Atomic variable so ldap_pvt_thread_pool_pausing() can read it.
-	 * Note: Pauses adjust ltp_<open_count/vary_open_count/work_list>,
-	 * so pool_<submit/wrapper>() mostly can avoid testing ltp_pause.
+	 * Note: Pauses adjust ltp_<open_count/vary_open_count> and the
+	 * queues' ltp_work_list, so pool_<submit/wrapper>() mostly can
+	 * avoid testing ltp_pause.
 	 */
 	volatile sig_atomic_t ltp_pause;
 
@@ -128,8 +181,6 @@ struct ldap_int_thread_pool_s {
 	/* Max number of pending + paused requests, negated when ltp_finishing */
 	int ltp_max_pending;
 
-	int ltp_pending_count;		/* Pending or paused requests */
-	int ltp_active_count;		/* Active, not paused requests */
 	int ltp_open_count;			/* Number of threads, negated when ltp_pause */
 	int ltp_starting;			/* Currenlty starting threads */
 
@@ -157,7 +208,7 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
-static void *ldap_int_thread_pool_wrapper( void *pool );
+static void *ldap_int_thread_pool_wrapper( void *pq );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -186,6 +237,91 @@ ldap_int_thread_pool_shutdown ( void )
 }
 
 
+/* Allocate numqs work queues, sharing max_pending between them */
+static struct ldap_int_thread_poolq_s *
+ldap_int_thread_poolq_alloc(
+	struct ldap_int_thread_pool_s *pool,
+	int numqs,
+	int max_pending )
+{
+	struct ldap_int_thread_poolq_s *wqs, *pq;
+	int i;
+
+	wqs = (struct ldap_int_thread_poolq_s *) LDAP_CALLOC(numqs,
+		sizeof(struct ldap_int_thread_poolq_s));
+	if (wqs == NULL)
+		return(NULL);
+
+	for (i = 0; i < numqs; i++) {
+		pq = &wqs[i];
+		pq->ltp_pool = pool;
+		if (ldap_pvt_thread_mutex_init(&pq->ltp_mutex) != 0 ||
+			ldap_pvt_thread_cond_init(&pq->ltp_cond) != 0)
+		{
+			while (--i >= 0) {
+				ldap_pvt_thread_cond_destroy(&wqs[i].ltp_cond);
+				ldap_pvt_thread_mutex_destroy(&wqs[i].ltp_mutex);
+			}
+			LDAP_FREE(wqs);
+			return(NULL);
+		}
+		pq->ltp_max_pending = (max_pending + numqs - 1) / numqs;
+		LDAP_STAILQ_INIT(&pq->ltp_pending_list);
+		pq->ltp_work_list = &pq->ltp_pending_list;
+		LDAP_SLIST_INIT(&pq->ltp_free_list);
+	}
+
+	return(wqs);
+}
+
+/* Share out the max number of threads between the queues, at
+ * least one each.  Caller holds pool->ltp_mutex.
+ */
+static void
+ldap_int_thread_poolq_share( struct ldap_int_thread_pool_s *pool )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	int i, max_count;
+
+	max_count = pool->ltp_max_count ? pool->ltp_max_count : LDAP_MAXTHR;
+	max_count /= pool->ltp_numqs;
+	if (max_count < 1)
+		max_count = 1;
+
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_max_count = max_count;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+}
+
+/* Free work queues.  They must have no threads. */
+static void
+ldap_int_thread_poolq_free(
+	struct ldap_int_thread_poolq_s *wqs,
+	int numqs )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	ldap_int_thread_task_t *task;
+	int i;
+
+	for (i = 0; i < numqs; i++) {
+		pq = &wqs[i];
+		while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list)) != NULL) {
+			LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list, ltt_next.q);
+			LDAP_FREE(task);
+		}
+		while ((task = LDAP_SLIST_FIRST(&pq->ltp_free_list)) != NULL) {
+			LDAP_SLIST_REMOVE_HEAD(&pq->ltp_free_list, ltt_next.l);
+			LDAP_FREE(task);
+		}
+		ldap_pvt_thread_cond_destroy(&pq->ltp_cond);
+		ldap_pvt_thread_mutex_destroy(&pq->ltp_mutex);
+	}
+	LDAP_FREE(wqs);
+}
+
 /* Create a thread pool */
 int
 ldap_pvt_thread_pool_init (
@@ -210,6 +346,13 @@ ldap_pvt_thread_pool_init (
 
 	if (pool == NULL) return(-1);
 
+	pool->ltp_wqs = ldap_int_thread_poolq_alloc(pool, 1, max_pending);
+	if (pool->ltp_wqs == NULL) {
+		LDAP_FREE(pool);
+		return(-1);
+	}
+	pool->ltp_numqs = 1;
+
 	rc = ldap_pvt_thread_mutex_init(&pool->ltp_mutex);
 	if (rc != 0)
 		return(rc);
@@ -224,12 +367,9 @@ ldap_pvt_thread_pool_init (
 
 	pool->ltp_max_count = max_threads;
 	SET_VARY_OPEN_COUNT(pool);
+	ldap_int_thread_poolq_share(pool);
 	pool->ltp_max_pending = max_pending;
 
-	LDAP_STAILQ_INIT(&pool->ltp_pending_list);
-	pool->ltp_work_list = &pool->ltp_pending_list;
-	LDAP_SLIST_INIT(&pool->ltp_free_list);
-
 	ldap_pvt_thread_mutex_lock(&ldap_pvt_thread_pool_mutex);
 	LDAP_STAILQ_INSERT_TAIL(&ldap_int_thread_pool_list, pool, ltp_next);
 	ldap_pvt_thread_mutex_unlock(&ldap_pvt_thread_pool_mutex);
@@ -253,8 +393,10 @@ ldap_pvt_thread_pool_submit (
 	ldap_pvt_thread_start_t *start_routine, void *arg )
 {
 	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq, *oq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
+	int i, j, need;
 
 	if (tpool == NULL)
 		return(-1);
@@ -264,14 +406,35 @@ ldap_pvt_thread_pool_submit (
 	if (pool == NULL)
 		return(-1);
 
-	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+	/* Pick a queue, skipping those whose mutex is busy so that
+	 * submitters rarely wait for each other or for the threads.
+	 */
+	j = pool->ltp_nextq++ % pool->ltp_numqs;
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[(j + i) % pool->ltp_numqs];
+		if (ldap_pvt_thread_mutex_trylock(&pq->ltp_mutex) == 0)
+			break;
+	}
+	if (i == pool->ltp_numqs) {
+		pq = &pool->ltp_wqs[j];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	}
 
-	if (pool->ltp_pending_count >= pool->ltp_max_pending)
-		goto failed;
+	/* max_pending is shared out between the queues; when this
+	 * one is full, look for room in the others.
+	 */
+	for (i = 1; pq->ltp_pending_count >= pq->ltp_max_pending; i++) {
+		/* ltp_max_pending < 0 when finishing */
+		if (i == pool->ltp_numqs || pq->ltp_max_pending < 0)
+			goto failed;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		pq = &pool->ltp_wqs[(pq - pool->ltp_wqs + 1) % pool->ltp_numqs];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	}
 
-	task = LDAP_SLIST_FIRST(&pool->ltp_free_list);
+	task = LDAP_SLIST_FIRST(&pq->ltp_free_list);
 	if (task) {
-		LDAP_SLIST_REMOVE_HEAD(&pool->ltp_free_list, ltt_next.l);
+		LDAP_SLIST_REMOVE_HEAD(&pq->ltp_free_list, ltt_next.l);
 	} else {
 		task = (ldap_int_thread_task_t *) LDAP_MALLOC(sizeof(*task));
 		if (task == NULL)
@@ -281,22 +444,41 @@ ldap_pvt_thread_pool_submit (
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
 
-	pool->ltp_pending_count++;
-	LDAP_STAILQ_INSERT_TAIL(&pool->ltp_pending_list, task, ltt_next.q);
+	pq->ltp_pending_count++;
+	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
 
-	/* true if ltp_pause != 0 or we should open (create) a thread */
-	if (pool->ltp_vary_open_count > 0 &&
-		pool->ltp_open_count < pool->ltp_active_count+pool->ltp_pending_count)
-	{
-		if (pool->ltp_pause)
-			goto done;
+	if (pq->ltp_idle_count) {
+		ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		return(0);
+	}
+	need = pq->ltp_open_count < pq->ltp_max_count &&
+		pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count;
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+	/* true if ltp_pause != 0 or we may open (create) a thread */
+	if (need && pool->ltp_vary_open_count > 0) {
+		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+		if (pool->ltp_pause || pool->ltp_vary_open_count <= 0)
+			goto unlock;
+
+		/* recheck, another submitter may have opened a thread */
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		need = pq->ltp_open_count < pq->ltp_max_count &&
+			pq->ltp_open_count <
+			pq->ltp_active_count+pq->ltp_pending_count;
+		if (need)
+			pq->ltp_open_count++;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		if (!need)
+			goto unlock;
 
 		pool->ltp_starting++;
 		pool->ltp_open_count++;
 		SET_VARY_OPEN_COUNT(pool);
 
 		if (0 != ldap_pvt_thread_create(
-			&thr, 1, ldap_int_thread_pool_wrapper, pool))
+			&thr, 1, ldap_int_thread_pool_wrapper, pq))
 		{
 			/* couldn't create thread.  back out of
 			 * ltp_open_count and check for even worse things.
@@ -305,6 +487,8 @@ ldap_pvt_thread_pool_submit (
 			pool->ltp_open_count--;
 			SET_VARY_OPEN_COUNT(pool);
 
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+			pq->ltp_open_count--;
 			if (pool->ltp_open_count == 0) {
 				/* no open threads at all?!?
 				 */
@@ -313,34 +497,59 @@ ldap_pvt_thread_pool_submit (
 				/* let pool_destroy know there are no more threads */
 				ldap_pvt_thread_cond_signal(&pool->ltp_cond);
 
-				LDAP_STAILQ_FOREACH(ptr, &pool->ltp_pending_list, ltt_next.q)
+				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q)
 					if (ptr == task) break;
 				if (ptr == task) {
 					/* no open threads, task not handled, so
 					 * back out of ltp_pending_count, free the task,
 					 * report the error.
 					 */
-					pool->ltp_pending_count--;
-					LDAP_STAILQ_REMOVE(&pool->ltp_pending_list, task,
+					pq->ltp_pending_count--;
+					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list, task,
 						ldap_int_thread_task_s, ltt_next.q);
-					LDAP_SLIST_INSERT_HEAD(&pool->ltp_free_list, task,
+					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
 						ltt_next.l);
-					goto failed;
+					ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+					ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+					return(-1);
 				}
 			}
+			ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 			/* there is another open thread, so this
 			 * task will be handled eventually.
 			 */
 		}
+		ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+		return(0);
+
+ unlock:
+		ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
 	}
-	ldap_pvt_thread_cond_signal(&pool->ltp_cond);
 
- done:
-	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	/* All threads of this queue are busy, or it may not open
+	 * one.  Wake an idle thread of another queue, it will steal
+	 * the task.  The queue locks must not be skipped here: a
+	 * thread about to go idle counts itself in ltp_steal_count
+	 * before it looks for tasks to steal, so either it sees this
+	 * task or we see it and make it look again.
+	 */
+	for (i = 1; i < pool->ltp_numqs; i++) {
+		oq = &pool->ltp_wqs[(pq - pool->ltp_wqs + i) % pool->ltp_numqs];
+		ldap_pvt_thread_mutex_lock(&oq->ltp_mutex);
+		need = oq->ltp_idle_count + oq->ltp_steal_count;
+		if (need) {
+			oq->ltp_steal = 1;
+			if (oq->ltp_idle_count)
+				ldap_pvt_thread_cond_signal(&oq->ltp_cond);
+		}
+		ldap_pvt_thread_mutex_unlock(&oq->ltp_mutex);
+		if (need)
+			break;
+	}
 	return(0);
 
  failed:
-	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	return(-1);
 }
 
@@ -360,7 +569,9 @@ ldap_pvt_thread_pool_retract (
 	ldap_pvt_thread_start_t *start_routine, void *arg )
 {
 	struct ldap_int_thread_pool_s *pool;
-	ldap_int_thread_task_t *task;
+	struct ldap_int_thread_poolq_s *pq;
+	ldap_int_thread_task_t *task = NULL;
+	int i;
 
 	if (tpool == NULL)
 		return(-1);
@@ -370,18 +581,21 @@ ldap_pvt_thread_pool_retract (
 	if (pool == NULL)
 		return(-1);
 
-	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
-	LDAP_STAILQ_FOREACH(task, &pool->ltp_pending_list, ltt_next.q)
-		if (task->ltt_start_routine == start_routine &&
-			task->ltt_arg == arg) {
-			/* Could LDAP_STAILQ_REMOVE the task, but that
-			 * walks ltp_pending_list again to find it.
-			 */
-			task->ltt_start_routine = no_task;
-			task->ltt_arg = NULL;
-			break;
-		}
-	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	for (i = 0; i < pool->ltp_numqs && task == NULL; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list, ltt_next.q)
+			if (task->ltt_start_routine == start_routine &&
+				task->ltt_arg == arg) {
+				/* Could LDAP_STAILQ_REMOVE the task, but that
+				 * walks ltp_pending_list again to find it.
+				 */
+				task->ltt_start_routine = no_task;
+				task->ltt_arg = NULL;
+				break;
+			}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
 	return task != NULL;
 }
 
@@ -408,11 +622,71 @@ ldap_pvt_thread_pool_maxthreads(
 
 	pool->ltp_max_count = max_threads;
 	SET_VARY_OPEN_COUNT(pool);
+	ldap_int_thread_poolq_share(pool);
 
 	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
 	return(0);
 }
 
+/* Set #work queues.  value <= 0 means one queue.
+ * Fails if there would be more queues than threads, or once the
+ * pool has opened a thread or has pending tasks.
+ */
+int
+ldap_pvt_thread_pool_queues(
+	ldap_pvt_thread_pool_t *tpool,
+	int numqs )
+{
+	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *wqs;
+	int i, rc = 0;
+
+	if (numqs < 1)
+		numqs = 1;
+	else if (numqs > LDAP_MAXQUEUES)
+		numqs = LDAP_MAXQUEUES;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+
+	if (numqs == pool->ltp_numqs)
+		goto done;
+
+	if ((pool->ltp_max_count && numqs > pool->ltp_max_count) ||
+		pool->ltp_open_count != 0 || pool->ltp_finishing)
+	{
+		rc = -1;
+		goto done;
+	}
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		if (pool->ltp_wqs[i].ltp_pending_count) {
+			rc = -1;
+			goto done;
+		}
+	}
+
+	wqs = ldap_int_thread_poolq_alloc(pool, numqs, pool->ltp_max_pending);
+	if (wqs == NULL) {
+		rc = -1;
+		goto done;
+	}
+	ldap_int_thread_poolq_free(pool->ltp_wqs, pool->ltp_numqs);
+	pool->ltp_wqs = wqs;
+	pool->ltp_numqs = numqs;
+	ldap_int_thread_poolq_share(pool);
+
+ done:
+	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	return(rc);
+}
+
 /* Inspect the pool */
 int
 ldap_pvt_thread_pool_query(
@@ -421,7 +695,8 @@ ldap_pvt_thread_pool_query(
 	void *value )
 {
 	struct ldap_int_thread_pool_s	*pool;
-	int				count = -1;
+	struct ldap_int_thread_poolq_s	*pq;
+	int				count = -1, pending = 0, active = 0, i;
 
 	if ( tpool == NULL || value == NULL ) {
 		return -1;
@@ -434,6 +709,14 @@ ldap_pvt_thread_pool_query(
 	}
 
 	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+	for ( i = 0; i < pool->ltp_numqs; i++ ) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pending += pq->ltp_pending_count;
+		active += pq->ltp_active_count;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+
 	switch ( param ) {
 	case LDAP_PVT_THREAD_POOL_PARAM_MAX:
 		count = pool->ltp_max_count;
@@ -458,7 +741,7 @@ ldap_pvt_thread_pool_query(
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
-		count = pool->ltp_active_count;
+		count = active;
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_PAUSING:
@@ -466,11 +749,11 @@ ldap_pvt_thread_pool_query(
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
-		count = pool->ltp_pending_count;
+		count = pending;
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
-		count = pool->ltp_pending_count + pool->ltp_active_count;
+		count = pending + active;
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX:
@@ -486,7 +769,7 @@ ldap_pvt_thread_pool_query(
 		*((char **)value) =
 			pool->ltp_pause ? "pausing" :
 			!pool->ltp_finishing ? "running" :
-			pool->ltp_pending_count ? "finishing" : "stopping";
+			pending ? "finishing" : "stopping";
 		break;
 
 	case LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN:
@@ -537,12 +820,29 @@ ldap_pvt_thread_pool_backload ( ldap_pvt_thread_pool_t *tpool )
 	return rc;
 }
 
+/* Wake the idle threads of all queues.  Caller holds pool->ltp_mutex. */
+static void
+ldap_int_thread_pool_wakeup( struct ldap_int_thread_pool_s *pool )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	int i;
+
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+}
+
 /* Destroy the pool after making its threads finish */
 int
 ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 {
 	struct ldap_int_thread_pool_s *pool, *pptr;
+	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
+	int i;
 
 	if (tpool == NULL)
 		return(-1);
@@ -568,25 +868,28 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 	if (pool->ltp_max_pending > 0)
 		pool->ltp_max_pending = -pool->ltp_max_pending;
 
-	if (!run_pending) {
-		while ((task = LDAP_STAILQ_FIRST(&pool->ltp_pending_list)) != NULL) {
-			LDAP_STAILQ_REMOVE_HEAD(&pool->ltp_pending_list, ltt_next.q);
-			LDAP_FREE(task);
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		if (pq->ltp_max_pending > 0)
+			pq->ltp_max_pending = -pq->ltp_max_pending;
+		if (!run_pending) {
+			while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list)) != NULL) {
+				LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list, ltt_next.q);
+				LDAP_FREE(task);
+			}
+			pq->ltp_pending_count = 0;
 		}
-		pool->ltp_pending_count = 0;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	}
 
 	while (pool->ltp_open_count) {
 		if (!pool->ltp_pause)
-			ldap_pvt_thread_cond_broadcast(&pool->ltp_cond);
+			ldap_int_thread_pool_wakeup(pool);
 		ldap_pvt_thread_cond_wait(&pool->ltp_cond, &pool->ltp_mutex);
 	}
 
-	while ((task = LDAP_SLIST_FIRST(&pool->ltp_free_list)) != NULL)
-	{
-		LDAP_SLIST_REMOVE_HEAD(&pool->ltp_free_list, ltt_next.l);
-		LDAP_FREE(task);
-	}
+	ldap_int_thread_poolq_free(pool->ltp_wqs, pool->ltp_numqs);
 
 	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
 	ldap_pvt_thread_cond_destroy(&pool->ltp_pcond);
@@ -598,14 +901,62 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 	return(0);
 }
 
+/* Take a pending task from a queue other than home.  Skip queues
+ * which look empty, unless wait is set.  Return NULL if there is
+ * none, which is always the case while the pool is paused.
+ */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *home,
+	int wait )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j = home - pool->ltp_wqs;
+
+	for (i = 1; i < pool->ltp_numqs && task == NULL; i++) {
+		pq = &pool->ltp_wqs[(j + i) % pool->ltp_numqs];
+		/* unlocked peek, a stale count only delays the steal */
+		if (!wait && pq->ltp_pending_count == 0)
+			continue;
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		task = LDAP_STAILQ_FIRST(pq->ltp_work_list);
+		if (task != NULL) {
+			LDAP_STAILQ_REMOVE_HEAD(pq->ltp_work_list, ltt_next.q);
+			pq->ltp_pending_count--;
+		}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+
+	return(task);
+}
+
+/* Number of active threads in all queues.  Caller holds pool->ltp_mutex. */
+static int
+ldap_int_thread_pool_active( struct ldap_int_thread_pool_s *pool )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	int i, active = 0;
+
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		active += pq->ltp_active_count;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+
+	return(active);
+}
+
 /* Thread loop.  Accept and handle submitted tasks. */
 static void *
-ldap_int_thread_pool_wrapper ( 
-	void *xpool )
+ldap_int_thread_pool_wrapper (
+	void *xpq )
 {
-	struct ldap_int_thread_pool_s *pool = xpool;
+	struct ldap_int_thread_poolq_s *pq = xpq;
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
 	ldap_int_thread_task_t *task;
-	ldap_int_tpool_plist_t *work_list;
 	ldap_int_thread_userctx_t ctx, *kctx;
 	unsigned i, keyslot, hash;
 
@@ -616,6 +967,7 @@ ldap_int_thread_pool_wrapper (
 	}
 
 	ctx.ltu_id = ldap_pvt_thread_self();
+	ctx.ltu_pq = pq;
 	TID_HASH(ctx.ltu_id, hash);
 
 	ldap_pvt_thread_key_setdata( ldap_tpool_key, &ctx );
@@ -638,18 +990,38 @@ ldap_int_thread_pool_wrapper (
 	ldap_pvt_thread_mutex_unlock(&ldap_pvt_thread_pool_mutex);
 
 	pool->ltp_starting--;
-	pool->ltp_active_count++;
+	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	pq->ltp_active_count++;
+	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
 
 	for (;;) {
-		work_list = pool->ltp_work_list; /* help the compiler a bit */
-		task = LDAP_STAILQ_FIRST(work_list);
+		task = LDAP_STAILQ_FIRST(pq->ltp_work_list);
+		if (task != NULL) {
+			LDAP_STAILQ_REMOVE_HEAD(pq->ltp_work_list, ltt_next.q);
+			pq->ltp_pending_count--;
+
+		} else if (pool->ltp_numqs > 1) {
+			/* Our queue is empty, look in the others.  Count
+			 * ourselves meanwhile, so that a submitter which finds
+			 * no thread in its own queue tells us to look again.
+			 */
+			pq->ltp_steal_count++;
+			pq->ltp_steal = 0;
+			ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			task = ldap_int_thread_pool_steal(pool, pq,
+				pool->ltp_vary_open_count < 0);
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+			pq->ltp_steal_count--;
+			if (task == NULL && !LDAP_STAILQ_EMPTY(pq->ltp_work_list))
+				continue;
+		}
+
 		if (task == NULL) {	/* paused or no pending tasks */
-			if (--(pool->ltp_active_count) < 2) {
-				/* Notify pool_pause it is the sole active thread. */
-				ldap_pvt_thread_cond_signal(&pool->ltp_pcond);
-			}
+			pq->ltp_active_count--;
 
-			do {
+			if (pool->ltp_pause || pool->ltp_vary_open_count < 0) {
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+				ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
 				if (pool->ltp_vary_open_count < 0) {
 					/* Not paused, and either finishing or too many
 					 * threads running (can happen if ltp_max_count
@@ -657,35 +1029,41 @@ ldap_int_thread_pool_wrapper (
 					 */
 					goto done;
 				}
+				/* Notify pool_pause we are no longer active. */
+				ldap_pvt_thread_cond_signal(&pool->ltp_pcond);
+				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+				ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+			}
 
-				/* We could check an idle timer here, and let the
-				 * thread die if it has been inactive for a while.
-				 * Only die if there are other open threads (i.e.,
-				 * always have at least one thread open).
-				 * The check should be like this:
-				 *   if (pool->ltp_open_count>1 && pool->ltp_starting==0)
-				 *       check timer, wait if ltp_pause, leave thread;
-				 *
-				 * Just use pthread_cond_timedwait() if we want to
-				 * check idle time.
-				 */
-				ldap_pvt_thread_cond_wait(&pool->ltp_cond, &pool->ltp_mutex);
-
-				work_list = pool->ltp_work_list;
-				task = LDAP_STAILQ_FIRST(work_list);
-			} while (task == NULL);
+			/* We could check an idle timer here, and let the
+			 * thread die if it has been inactive for a while.
+			 * Only die if there are other open threads (i.e.,
+			 * always have at least one thread open).
+			 * The check should be like this:
+			 *   if (pool->ltp_open_count>1 && pool->ltp_starting==0)
+			 *       check timer, wait if ltp_pause, leave thread;
+			 *
+			 * Just use pthread_cond_timedwait() if we want to
+			 * check idle time.
+			 */
+			if (LDAP_STAILQ_EMPTY(pq->ltp_work_list) &&
+				!pq->ltp_steal && pool->ltp_vary_open_count >= 0)
+			{
+				pq->ltp_idle_count++;
+				ldap_pvt_thread_cond_wait(&pq->ltp_cond, &pq->ltp_mutex);
+				pq->ltp_idle_count--;
+			}
 
-			pool->ltp_active_count++;
+			pq->ltp_active_count++;
+			continue;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
-		pool->ltp_pending_count--;
-		ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
 
-		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
-		LDAP_SLIST_INSERT_HEAD(&pool->ltp_free_list, task, ltt_next.l);
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task, ltt_next.l);
 	}
  done:
 
@@ -699,6 +1077,10 @@ ldap_int_thread_pool_wrapper (
 	thread_keys[keyslot].ctx = DELETED_THREAD_CTX;
 	ldap_pvt_thread_mutex_unlock(&ldap_pvt_thread_pool_mutex);
 
+	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	pq->ltp_open_count--;
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
 	pool->ltp_open_count--;
 	SET_VARY_OPEN_COUNT(pool);
 	/* let pool_destroy know we're all done */
@@ -715,6 +1097,9 @@ static int
 handle_pause( ldap_pvt_thread_pool_t *tpool, int do_pause )
 {
 	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	ldap_int_thread_userctx_t *ctx;
+	int i;
 
 	if (tpool == NULL)
 		return(-1);
@@ -727,20 +1112,27 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int do_pause )
 	if (! (do_pause || pool->ltp_pause))
 		return(0);
 
+	/* The queue which counts us as active */
+	ctx = ldap_pvt_thread_pool_context();
+	pq = ctx->ltu_pq ? ctx->ltu_pq : &pool->ltp_wqs[0];
+
 	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
 
 	/* If someone else has already requested a pause, we have to wait */
 	if (pool->ltp_pause) {
-		pool->ltp_pending_count++;
-		pool->ltp_active_count--;
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_pending_count++;
+		pq->ltp_active_count--;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 		/* let the other pool_pause() know when it can proceed */
-		if (pool->ltp_active_count < 2)
-			ldap_pvt_thread_cond_signal(&pool->ltp_pcond);
+		ldap_pvt_thread_cond_signal(&pool->ltp_pcond);
 		do {
 			ldap_pvt_thread_cond_wait(&pool->ltp_cond, &pool->ltp_mutex);
 		} while (pool->ltp_pause);
-		pool->ltp_pending_count--;
-		pool->ltp_active_count++;
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_pending_count--;
+		pq->ltp_active_count++;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	}
 
 	if (do_pause) {
@@ -751,9 +1143,14 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int do_pause )
 		pool->ltp_open_count = -pool->ltp_open_count;
 		SET_VARY_OPEN_COUNT(pool);
 		/* Hide pending tasks from ldap_pvt_thread_pool_wrapper() */
-		pool->ltp_work_list = &empty_pending_list;
+		for (i = 0; i < pool->ltp_numqs; i++) {
+			pq = &pool->ltp_wqs[i];
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+			pq->ltp_work_list = &empty_pending_list;
+			ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		}
 
-		while (pool->ltp_active_count > 1) {
+		while (ldap_int_thread_pool_active(pool) > 1) {
 			ldap_pvt_thread_cond_wait(&pool->ltp_pcond, &pool->ltp_mutex);
 		}
 	}
@@ -782,10 +1179,12 @@ ldap_pvt_thread_pool_pause( ldap_pvt_thread_pool_t *tpool )
 
 /* End a pause */
 int
-ldap_pvt_thread_pool_resume ( 
+ldap_pvt_thread_pool_resume (
 	ldap_pvt_thread_pool_t *tpool )
 {
 	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	int i;
 
 	if (tpool == NULL)
 		return(-1);
@@ -802,7 +1201,13 @@ ldap_pvt_thread_pool_resume (
 	if (pool->ltp_open_count <= 0) /* true when paused, but be paranoid */
 		pool->ltp_open_count = -pool->ltp_open_count;
 	SET_VARY_OPEN_COUNT(pool);
-	pool->ltp_work_list = &pool->ltp_pending_list;
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		pq = &pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_work_list = &pq->ltp_pending_list;
+		ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
 
 	ldap_pvt_thread_cond_broadcast(&pool->ltp_cond);
 
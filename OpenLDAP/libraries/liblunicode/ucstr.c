@@ -25,6 +25,10 @@
 #include <ldap_utf8.h>
 #include <ldap_pvt_uc.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #if 0
 #define	malloc(x)	ber_memalloc_x(x,ctx)
 #define	realloc(x,y)	ber_memrealloc_x(x,y,ctx)
@@ -103,6 +107,111 @@ void ucstr2upper(
 	}
 }
 
+/* ASCII only, locale independent */
+#define UCSTR_ASCII_LOWER(c) \
+	( (unsigned char)((c) - 'A') < 26 ? (c) + ('a' - 'A') : (c) )
+
+#define UCSTR_WORD_HIGH	( ~(unsigned long)0 / 0xff * 0x80 )
+
+/* length of the leading run of ASCII characters of s */
+static int
+ucstr_ascii_span( const char *s, int len )
+{
+	int i = 0;
+	unsigned long w;
+
+#ifdef __SSE2__
+	for ( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)( s + i ) );
+		int m = _mm_movemask_epi8( v );
+
+		if ( m ) {
+			for ( ; !( m & 1 ); m >>= 1 ) i++;
+			return i;
+		}
+	}
+#endif
+	for ( ; i + (int)sizeof(w) <= len; i += sizeof(w) ) {
+		AC_MEMCPY( &w, s + i, sizeof(w) );
+		if ( w & UCSTR_WORD_HIGH ) {
+			break;
+		}
+	}
+	for ( ; i < len && LDAP_UTF8_ISASCII( s + i ); i++ ) {
+		/* empty */
+	}
+
+	return i;
+}
+
+/* lowercase the n ASCII characters of s into out */
+static void
+ucstr_ascii_lower( char *out, const char *s, int n )
+{
+	int i = 0;
+
+#ifdef __SSE2__
+	const __m128i bias = _mm_set1_epi8( 0x80 - 'A' );
+	const __m128i top = _mm_set1_epi8( -128 + 26 );
+	const __m128i bit = _mm_set1_epi8( 'a' - 'A' );
+
+	for ( ; i + 16 <= n; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)( s + i ) );
+		/* 'A'..'Z' map to the 26 smallest signed bytes */
+		__m128i up = _mm_cmplt_epi8( _mm_add_epi8( v, bias ), top );
+
+		_mm_storeu_si128( (__m128i *)( out + i ),
+			_mm_or_si128( v, _mm_and_si128( up, bit ) ) );
+	}
+#endif
+	for ( ; i < n; i++ ) {
+		out[i] = UCSTR_ASCII_LOWER( s[i] );
+	}
+}
+
+/*
+ * Quick check: true if the code points u[0..n) are known to be in
+ * normalization form KC already, so that UTF8bvnormalize() can skip
+ * the decomposition and composition passes.  This holds when every
+ * character is a starter that either does not decompose, or is a
+ * base character plus one mark which composes back to it, and none
+ * combines with the one before.  Hangul is left to the full algorithm.
+ */
+static int
+ucstr_quick_check( const ac_uint4 *u, int n )
+{
+	int i;
+	ac_uint4 c, num, *decomp, comp;
+
+	for ( i = 0; i < n; i++ ) {
+		/* ASCII and C1 controls are always stable */
+		if ( u[i] < 0xa0 ) {
+			continue;
+		}
+		if ( ( u[i] >= 0x1100 && u[i] < 0x1200 ) ||
+			( u[i] >= 0xac00 && u[i] < 0xd7a4 ) ||
+			uccombining_class( u[i] ) != 0 )
+		{
+			return 0;
+		}
+
+		c = u[i];
+		if ( uckdecomp( u[i], &num, &decomp ) ) {
+			if ( num != 2 || !uccomp( decomp[0], decomp[1], &comp ) ||
+				comp != u[i] )
+			{
+				return 0;
+			}
+			c = decomp[0];
+		}
+		if ( i > 0 && uccomp( u[i-1], c, &comp ) ) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 struct berval * UTF8bvnormalize(
 	struct berval *bv,
 	struct berval *newbv,
@@ -135,56 +244,44 @@ struct berval * UTF8bvnormalize(
 		if ( !newbv ) return NULL;
 	}
 
-	/* Should first check to see if string is already in proper
-	 * normalized form. This is almost as time consuming as
-	 * the normalization though.
+	/* Runs of non-ascii characters already in normalized form are
+	 * detected by ucstr_quick_check() and copied as they are.  This
+	 * does not apply to approximate matching, which must always
+	 * decompose so that the base characters of precomposed ones
+	 * are kept.
 	 */
 
 	/* finish off everything up to character before first non-ascii */
-	if ( LDAP_UTF8_ISASCII( s ) ) {
-		if ( casefold ) {
-			outsize = len + 7;
-			out = (char *) ber_memalloc_x( outsize, ctx );
-			if ( out == NULL ) {
-				return NULL;
-			}
-			outpos = 0;
-
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				out[outpos++] = TOLOWER( s[i-1] );
-			}
-			if ( i == len ) {
-				out[outpos++] = TOLOWER( s[len-1] );
-				out[outpos] = '\0';
-				newbv->bv_val = out;
-				newbv->bv_len = outpos;
-				return newbv;
-			}
-		} else {
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				/* empty */
-			}
-
-			if ( i == len ) {
-				return ber_str2bv_x( s, len, 1, newbv, ctx );
-			}
-				
-			outsize = len + 7;
-			out = (char *) ber_memalloc_x( outsize, ctx );
-			if ( out == NULL ) {
-				return NULL;
-			}
-			outpos = i - 1;
-			memcpy(out, s, outpos);
+	i = ucstr_ascii_span( s, len );
+	if ( i == len ) {
+		if ( !casefold ) {
+			return ber_str2bv_x( s, len, 1, newbv, ctx );
 		}
-	} else {
-		outsize = len + 7;
-		out = (char *) ber_memalloc_x( outsize, ctx );
+
+		out = (char *) ber_memalloc_x( len + 1, ctx );
 		if ( out == NULL ) {
 			return NULL;
 		}
-		outpos = 0;
-		i = 0;
+		ucstr_ascii_lower( out, s, len );
+		out[len] = '\0';
+		newbv->bv_val = out;
+		newbv->bv_len = len;
+		return newbv;
+	}
+
+	outsize = len + 7;
+	out = (char *) ber_memalloc_x( outsize, ctx );
+	if ( out == NULL ) {
+		return NULL;
+	}
+	outpos = 0;
+	if ( i > 0 ) {
+		outpos = i - 1;
+		if ( casefold ) {
+			ucstr_ascii_lower( out, s, outpos );
+		} else {
+			AC_MEMCPY( out, s, outpos );
+		}
 	}
 
 	p = ucs = ber_memalloc_x( len * sizeof(*ucs), ctx );
@@ -195,7 +292,7 @@ struct berval * UTF8bvnormalize(
 
 	/* convert character before first non-ascii to ucs-4 */
 	if ( i > 0 ) {
-		*p = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+		*p = casefold ? UCSTR_ASCII_LOWER( s[i-1] ) : s[i-1];
 		p++;
 	}
 
@@ -232,7 +329,16 @@ struct berval * UTF8bvnormalize(
 			p++;
 		}
 		/* normalize ucs of length p - ucs */
-		uccompatdecomp( ucs, p - ucs, &ucsout, &ucsoutlen, ctx );
+		ucsoutlen = p - ucs;
+		if ( !approx && ucstr_quick_check( ucs, ucsoutlen ) ) {
+			/* already normalized */
+			ucsout = ucs;
+		} else {
+			uccompatdecomp( ucs, p - ucs, &ucsout, &ucsoutlen, ctx );
+			if ( !approx ) {
+				ucsoutlen = uccanoncomp( ucsout, ucsoutlen );
+			}
+		}
 		if ( approx ) {
 			for ( j = 0; j < ucsoutlen; j++ ) {
 				if ( ucsout[j] < 0x80 ) {
@@ -240,7 +346,6 @@ struct berval * UTF8bvnormalize(
 				}
 			}
 		} else {
-			ucsoutlen = uccanoncomp( ucsout, ucsoutlen );
 			/* convert ucs to utf-8 and store in out */
 			for ( j = 0; j < ucsoutlen; j++ ) {
 				/* allocate more space if not enough room for
@@ -249,7 +354,9 @@ struct berval * UTF8bvnormalize(
 					outsize = ucsoutlen - j + outpos + 6;
 					outtmp = (char *) ber_memrealloc_x( out, outsize, ctx );
 					if ( outtmp == NULL ) {
-						ber_memfree_x( ucsout, ctx );
+						if ( ucsout != ucs ) {
+							ber_memfree_x( ucsout, ctx );
+						}
 						ber_memfree_x( ucs, ctx );
 						ber_memfree_x( out, ctx );
 						return NULL;
@@ -260,7 +367,9 @@ struct berval * UTF8bvnormalize(
 			}
 		}
 
-		ber_memfree_x( ucsout, ctx );
+		if ( ucsout != ucs ) {
+			ber_memfree_x( ucsout, ctx );
+		}
 		ucsout = NULL;
 		
 		if ( i == len ) {
@@ -283,16 +392,24 @@ struct berval * UTF8bvnormalize(
 
 		/* s[i] is ascii */
 		/* finish off everything up to char before next non-ascii */
-		for ( i++; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-			out[outpos++] = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+		i += ucstr_ascii_span( s + i, len - i );
+		if ( i == len ) {
+			j = len - last;
+		} else {
+			j = i - 1 - last;
+		}
+		if ( casefold ) {
+			ucstr_ascii_lower( &out[outpos], &s[last], j );
+		} else {
+			AC_MEMCPY( &out[outpos], &s[last], j );
 		}
+		outpos += j;
 		if ( i == len ) {
-			out[outpos++] = casefold ? TOLOWER( s[len-1] ) : s[len-1];
 			break;
 		}
 
 		/* convert character before next non-ascii to ucs-4 */
-		*ucs = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+		*ucs = casefold ? UCSTR_ASCII_LOWER( s[i-1] ) : s[i-1];
 		p = ucs + 1;
 	}
 
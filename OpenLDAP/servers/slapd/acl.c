@@ -39,6 +39,71 @@
 
 #define ACL_BUF_SIZE 	1024	/* use most appropriate size */
 
+/*
+ * Cache of compiled regular expressions, keyed by the pattern text
+ * after $N expansion.  Each shard holds at most ACL_REGEX_CACHE_SIZE
+ * expressions (see keycache.c).  An expression in use by some thread
+ * is pinned by its reference count; matching itself is done without
+ * holding the shard lock.
+ */
+#define ACL_REGEX_CACHE_SHARDS	16
+#define ACL_REGEX_CACHE_SIZE	32
+
+static slap_keycache_t	acl_regex_cache;
+
+static void
+acl_regex_free( slap_keycache_entry_t *ke )
+{
+	regfree( ke->ke_data );
+	ch_free( ke->ke_data );
+	ch_free( ke->ke_key.bv_val );
+}
+
+/*
+ * Cache of the outcome of the <who> part of "by" clauses that do not
+ * depend on the target entry (see acl_cache_prepare()), so that it is
+ * evaluated once rather than for every attribute of every entry.
+ * Each thread keeps its own table of acl_cache_size slots, indexed by
+ * the address of the clause.  The table is only good for one
+ * connection, identity and set of security strength factors, and
+ * until acl_cache_gen changes: it is bumped when access controls are
+ * added or freed, and after every write if some cached clause checks
+ * group membership.
+ */
+unsigned	acl_cache_size;		/* slots per thread, 0 disables */
+int		acl_cache_content;	/* some clause depends on groups */
+static unsigned long		acl_cache_gen;
+static ldap_pvt_thread_mutex_t	acl_cache_mutex;
+
+typedef struct acl_cache_slot_t {
+	Access		*acs_access;
+	unsigned long	acs_epoch;
+	int		acs_match;
+} acl_cache_slot_t;
+
+typedef struct acl_cache_t {
+	unsigned long	ac_gen;
+	unsigned long	ac_epoch;	/* slots of older epochs are empty */
+	unsigned long	ac_connid;
+	struct berval	ac_ndn;
+	struct berval	ac_realndn;
+	slap_ssf_t	ac_ssf;
+	slap_ssf_t	ac_transport_ssf;
+	slap_ssf_t	ac_tls_ssf;
+	slap_ssf_t	ac_sasl_ssf;
+	unsigned	ac_size;
+	acl_cache_slot_t	*ac_slots;
+} acl_cache_t;
+
+#define ACL_CACHE_SLOT(ac, b) \
+	(&(ac)->ac_slots[ ( (unsigned long)(b) >> 4 ) % (ac)->ac_size ])
+
+/* record the outcome, unless a nested check took over the slot */
+#define ACL_CACHE_SET(acs, b, epoch, match) do { \
+		if ( (acs)->acs_access == (b) && (acs)->acs_epoch == (epoch) ) \
+			(acs)->acs_match = (match); \
+	} while ( 0 )
+
 static const struct berval	acl_bv_ip_eq = BER_BVC( "IP=" );
 #ifdef LDAP_PF_INET6
 static const struct berval	acl_bv_ipv6_eq = BER_BVC( "IP=[" );
@@ -73,6 +138,8 @@ static int	regex_matches(
 	struct berval *dn_matches, struct berval *val_matches,
 	AclRegexMatches *matches);
 
+static acl_cache_t *acl_cache_get( Operation *op, unsigned long *epochp );
+
 typedef	struct AclSetCookie {
 	SetCookie	asc_cookie;
 #define	asc_op		asc_cookie.set_op
@@ -540,6 +607,27 @@ slap_acl_get(
 
  retry:
 	for ( ; a != NULL; prev = a, a = a->acl_next ) {
+		if ( acl_index_use && a->acl_index != NULL ) {
+			AccessControl *next, *last = prev;
+
+			/* skip the acls whose target cannot match */
+			next = acl_index_next( a, &e->e_nname, &last );
+			if ( next != a ) {
+				int skipped = ( next ? next->acl_pos
+					: last->acl_pos + 1 ) - a->acl_pos;
+
+				(*count) += skipped;
+				if ( state->as_fe_done ) {
+					state->as_fe_done += skipped
+						- ( a == frontendDB->be_acl );
+				}
+				prev = last;
+				a = next;
+				if ( a == NULL )
+					break;
+			}
+		}
+
 		(*count) ++;
 
 		if ( a != frontendDB->be_acl && state->as_fe_done )
@@ -1130,6 +1218,10 @@ slap_acl_mask(
 #ifdef SLAP_DYNACL
 	slap_mask_t	a2pmask = ACL_ACCESS2PRIV( access );
 #endif /* SLAP_DYNACL */
+	acl_cache_t	*ac = NULL;
+	acl_cache_slot_t	*pending = NULL;
+	Access		*pendb = NULL;
+	unsigned long	epoch = 0;
 
 	assert( a != NULL );
 	assert( mask != NULL );
@@ -1150,6 +1242,10 @@ slap_acl_mask(
 		accessmask2str( *mask, accessmaskbuf, 1 ) );
 
 
+	if ( acl_cache_size && e->e_dn != NULL ) {
+		ac = acl_cache_get( op, &epoch );
+	}
+
 	b = a->acl_access;
 	i = 1;
 
@@ -1158,6 +1254,35 @@ slap_acl_mask(
 
 		ACL_INVALIDATE( modmask );
 
+		/* the <who> part of the previous clause did not match */
+		if ( pending != NULL ) {
+			ACL_CACHE_SET( pending, pendb, epoch, 0 );
+			pending = NULL;
+		}
+
+		if ( ac != NULL && ( b->a_cache & ACL_CACHE_WHO ) ) {
+			acl_cache_slot_t	*acs = ACL_CACHE_SLOT( ac, b );
+
+			if ( acs->acs_access == b && acs->acs_epoch == epoch
+				&& acs->acs_match != -1 )
+			{
+				Debug( LDAP_DEBUG_ACL, "<= acl_mask: <who> of clause %d "
+					"%s (cached)\n",
+					i, acs->acs_match ? "matched" : "did not match", 0 );
+				if ( !acs->acs_match ) {
+					continue;
+				}
+				goto who_matched;
+			}
+
+			/* a nested check must not find it until it is known */
+			acs->acs_access = b;
+			acs->acs_epoch = epoch;
+			acs->acs_match = -1;
+			pending = acs;
+			pendb = b;
+		}
+
 		/* check for the "self" modifier in the <access> field */
 		if ( b->a_dn.a_self ) {
 			const char *dummy;
@@ -1759,6 +1884,12 @@ slap_acl_mask(
 			}
 		}
 
+		if ( pending != NULL ) {
+			ACL_CACHE_SET( pending, pendb, epoch, 1 );
+			pending = NULL;
+		}
+
+who_matched:;
 #ifdef SLAP_DYNACL
 		if ( b->a_dynacl ) {
 			slap_dynacl_t	*da;
@@ -1883,6 +2014,10 @@ slap_acl_mask(
 		}
 	}
 
+	if ( pending != NULL ) {
+		ACL_CACHE_SET( pending, pendb, epoch, 0 );
+	}
+
 	/* implicit "by * none" clause */
 	ACL_INIT(*mask);
 
@@ -2510,6 +2645,10 @@ acl_init( void )
 {
 	int	i, rc;
 
+	slap_keycache_init( &acl_regex_cache, "ACL Regex",
+		ACL_REGEX_CACHE_SHARDS, ACL_REGEX_CACHE_SIZE, acl_regex_free );
+	ldap_pvt_thread_mutex_init( &acl_cache_mutex );
+
 	for ( i = 0; acl_init_func[ i ] != NULL; i++ ) {
 		rc = (*(acl_init_func[ i ]))();
 		if ( rc != 0 ) {
@@ -2643,6 +2782,220 @@ acl_string_expand(
 	return 0;
 }
 
+static void
+acl_cache_free( void *key, void *data )
+{
+	acl_cache_t	*ac = data;
+
+	if ( !BER_BVISNULL( &ac->ac_ndn ) ) {
+		ch_free( ac->ac_ndn.bv_val );
+	}
+	if ( !BER_BVISNULL( &ac->ac_realndn ) ) {
+		ch_free( ac->ac_realndn.bv_val );
+	}
+	if ( ac->ac_slots != NULL ) {
+		ch_free( ac->ac_slots );
+	}
+	ch_free( ac );
+}
+
+/*
+ * Return the ACL cache of the calling thread, emptied if it was
+ * filled for another connection, identity or generation.
+ */
+static acl_cache_t *
+acl_cache_get( Operation *op, unsigned long *epochp )
+{
+	acl_cache_t	*ac;
+	void		*data = NULL;
+	struct berval	realndn;
+	unsigned long	gen = acl_cache_gen;
+
+	if ( op->o_threadctx == NULL || op->o_conn == NULL ) {
+		return NULL;
+	}
+
+	if ( ldap_pvt_thread_pool_getkey( op->o_threadctx,
+			(void *)acl_cache_get, &data, NULL ) || data == NULL )
+	{
+		ac = ch_calloc( 1, sizeof( acl_cache_t ) );
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx,
+				(void *)acl_cache_get, (void *)ac, acl_cache_free,
+				NULL, NULL ) )
+		{
+			ch_free( ac );
+			return NULL;
+		}
+	} else {
+		ac = data;
+	}
+
+	if ( !BER_BVISNULL( &op->o_conn->c_ndn ) ) {
+		realndn = op->o_conn->c_ndn;
+	} else {
+		realndn = op->o_ndn;
+	}
+
+	if ( ac->ac_size != acl_cache_size ) {
+		if ( ac->ac_slots != NULL ) {
+			ch_free( ac->ac_slots );
+		}
+		ac->ac_slots = ch_calloc( acl_cache_size,
+			sizeof( acl_cache_slot_t ) );
+		ac->ac_size = acl_cache_size;
+		ac->ac_epoch++;
+
+	} else if ( ac->ac_gen == gen
+		&& ac->ac_connid == op->o_conn->c_connid
+		&& ac->ac_ssf == op->o_ssf
+		&& ac->ac_transport_ssf == op->o_transport_ssf
+		&& ac->ac_tls_ssf == op->o_tls_ssf
+		&& ac->ac_sasl_ssf == op->o_sasl_ssf
+		&& bvmatch( &ac->ac_ndn, &op->o_ndn )
+		&& bvmatch( &ac->ac_realndn, &realndn ) )
+	{
+		*epochp = ac->ac_epoch;
+		return ac;
+
+	} else {
+		ac->ac_epoch++;
+	}
+
+	if ( !BER_BVISNULL( &ac->ac_ndn ) ) {
+		ch_free( ac->ac_ndn.bv_val );
+	}
+	ber_dupbv( &ac->ac_ndn, &op->o_ndn );
+	if ( !BER_BVISNULL( &ac->ac_realndn ) ) {
+		ch_free( ac->ac_realndn.bv_val );
+	}
+	ber_dupbv( &ac->ac_realndn, &realndn );
+
+	ac->ac_gen = gen;
+	ac->ac_connid = op->o_conn->c_connid;
+	ac->ac_ssf = op->o_ssf;
+	ac->ac_transport_ssf = op->o_transport_ssf;
+	ac->ac_tls_ssf = op->o_tls_ssf;
+	ac->ac_sasl_ssf = op->o_sasl_ssf;
+
+	*epochp = ac->ac_epoch;
+	return ac;
+}
+
+void
+acl_cache_invalidate( void )
+{
+	ldap_pvt_thread_mutex_lock( &acl_cache_mutex );
+	acl_cache_gen++;
+	ldap_pvt_thread_mutex_unlock( &acl_cache_mutex );
+}
+
+/* whether acl_string_expand() would substitute anything in pat */
+static int
+acl_pat_expands( struct berval *pat )
+{
+	char	*p;
+
+	for ( p = strchr( pat->bv_val, '$' ); p != NULL; p = strchr( p, '$' ) ) {
+		p++;
+		if ( *p == '$' ) {
+			p++;
+		} else if ( *p == '{' /*'}'*/ || ( *p >= '0' && *p <= '9' ) ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+acl_cache_dn( slap_dn_access *bdn )
+{
+	if ( BER_BVISEMPTY( &bdn->a_pat ) ) {
+		return 1;
+	}
+
+	switch ( bdn->a_style ) {
+	case ACL_STYLE_ANONYMOUS:
+	case ACL_STYLE_USERS:
+		return 1;
+
+	case ACL_STYLE_SELF:
+		return 0;
+
+	case ACL_STYLE_REGEX:
+		/* unless it refers to the target */
+		return !acl_pat_expands( &bdn->a_pat );
+
+	default:
+		return !bdn->a_expand;
+	}
+}
+
+static int
+acl_cache_pat( slap_style_t style, struct berval *pat )
+{
+	if ( BER_BVISEMPTY( pat ) ) {
+		return 1;
+	}
+
+	if ( style == ACL_STYLE_EXPAND ) {
+		return 0;
+	}
+
+	return style != ACL_STYLE_REGEX || !acl_pat_expands( pat );
+}
+
+/*
+ * Mark the "by" clauses of an ACL whose <who> part only depends
+ * on the operation and its connection, and can be cached.
+ */
+void
+acl_cache_prepare( AccessControl *a )
+{
+	Access	*b;
+
+	for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+		b->a_cache = 0;
+
+		if ( b->a_dn_self
+			|| b->a_realdn_self
+			|| b->a_dn_at != NULL
+			|| b->a_realdn_at != NULL
+			|| !BER_BVISEMPTY( &b->a_set_pat )
+			|| !acl_cache_dn( &b->a_dn )
+			|| !acl_cache_dn( &b->a_realdn )
+			|| !acl_cache_pat( b->a_sockurl_style, &b->a_sockurl_pat )
+			|| !acl_cache_pat( b->a_peername_style, &b->a_peername_pat )
+			|| !acl_cache_pat( b->a_sockname_style, &b->a_sockname_pat )
+			|| ( b->a_domain_expand && !BER_BVISEMPTY( &b->a_domain_pat ) )
+			|| !acl_cache_pat( b->a_domain_style, &b->a_domain_pat ) )
+		{
+			continue;
+		}
+
+		if ( !BER_BVISEMPTY( &b->a_group_pat ) ) {
+			if ( b->a_group_style == ACL_STYLE_EXPAND ) {
+				continue;
+			}
+			b->a_cache |= ACL_CACHE_CONTENT;
+			acl_cache_content = 1;
+		}
+
+		b->a_cache |= ACL_CACHE_WHO;
+	}
+
+	/* clauses freed or added may reuse the address of cached ones */
+	acl_cache_invalidate();
+}
+
+void
+acl_cache_destroy( void )
+{
+	slap_keycache_destroy( &acl_regex_cache );
+
+	/* acl_cache_mutex is kept, config_destroy() still frees ACLs */
+}
+
 static int
 regex_matches(
 	struct berval	*pat,		/* pattern to expand and match against */
@@ -2652,9 +3005,12 @@ regex_matches(
 	AclRegexMatches	*matches	/* offsets in buffer for $N expansion variables */
 )
 {
+	slap_keycache_shard_t	*ks;
+	slap_keycache_entry_t	*ke = NULL;
 	regex_t re;
 	char newbuf[ACL_BUF_SIZE];
 	struct berval bv;
+	unsigned	hash;
 	int	rc;
 
 	bv.bv_len = sizeof( newbuf ) - 1;
@@ -2665,6 +3021,31 @@ regex_matches(
 	};
 
 	acl_string_expand( &bv, pat, dn_matches, val_matches, matches );
+
+	ks = slap_keycache_shard( &acl_regex_cache, &bv, &hash );
+	if ( ks != NULL ) {
+		ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+		ke = slap_keycache_find( &acl_regex_cache, ks, &bv, hash );
+		if ( ke != NULL ) {
+			ke->ke_refcnt++;
+			ke->ke_used = 1;
+			ks->ks_hits++;
+		} else {
+			ks->ks_misses++;
+		}
+		ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+	}
+
+	if ( ke != NULL ) {
+		rc = regexec( ke->ke_data, str, 0, NULL, 0 );
+
+		ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+		ke->ke_refcnt--;
+		ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+
+		goto done;
+	}
+
 	rc = regcomp( &re, newbuf, REG_EXTENDED|REG_ICASE );
 	if ( rc ) {
 		char error[ACL_BUF_SIZE];
@@ -2677,8 +3058,27 @@ regex_matches(
 	}
 
 	rc = regexec( &re, str, 0, NULL, 0 );
-	regfree( &re );
 
+	/* keep the compiled pattern, unless another thread
+	 * got there first or every slot is busy */
+	if ( ks != NULL ) {
+		ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+		if ( slap_keycache_find( &acl_regex_cache, ks, &bv, hash ) == NULL ) {
+			ke = slap_keycache_slot( &acl_regex_cache, ks, hash );
+		}
+		if ( ke != NULL ) {
+			ber_dupbv( &ke->ke_key, &bv );
+			ke->ke_data = ch_malloc( sizeof( regex_t ) );
+			*(regex_t *)ke->ke_data = re;
+		}
+		ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+	}
+
+	if ( ke == NULL ) {
+		regfree( &re );
+	}
+
+done:;
 	Debug( LDAP_DEBUG_TRACE,
 	    "=> regex_matches: string:	 %s\n", str, 0, 0 );
 	Debug( LDAP_DEBUG_TRACE,
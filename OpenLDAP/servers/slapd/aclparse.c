@@ -2349,17 +2349,264 @@ access_append( Access **l, Access *a )
 	*l = a;
 }
 
+/*
+ * Index of the targets of a list of access controls, shared by all
+ * its members.  The base, one, children and subtree DN patterns are
+ * stored in a trie of their RDNs, read from the suffix; the other
+ * access controls (regex, filter only, "*") are kept aside, since
+ * they have to be tried against every entry.  slap_acl_get() uses
+ * acl_index_next() to skip the access controls whose target cannot
+ * match; the candidates it returns are still checked in full, in
+ * list order, so the first match is unchanged.
+ */
+typedef struct AclIndexList {
+	int		*al_pos;
+	int		al_num;
+} AclIndexList;
+
+typedef struct AclIndexNode {
+	struct berval	an_rdn;
+	Avlnode		*an_kids;
+	AclIndexList	an_base;	/* base */
+	AclIndexList	an_below;	/* one, children */
+	AclIndexList	an_sub;		/* subtree */
+} AclIndexNode;
+
+typedef struct AclIndex {
+	int		ai_refcnt;
+	int		ai_count;
+	AccessControl	**ai_acls;
+	AclIndexList	ai_other;
+	AclIndexNode	ai_root;
+} AclIndex;
+
+int	acl_index_use = 1;	/* "acl_index off" checks every access control */
+
+static int
+acl_index_cmp( const void *v_l, const void *v_r )
+{
+	const AclIndexNode *l = v_l, *r = v_r;
+
+	return ber_bvcmp( &l->an_rdn, &r->an_rdn );
+}
+
+static void
+acl_index_list_add( AclIndexList *al, int pos )
+{
+	al->al_pos = ch_realloc( al->al_pos, ( al->al_num + 1 ) * sizeof( int ) );
+	al->al_pos[ al->al_num++ ] = pos;
+}
+
+/* first position >= pos in the list, or max */
+static int
+acl_index_list_next( AclIndexList *al, int pos, int max )
+{
+	int lo = 0, hi = al->al_num;
+
+	while ( lo < hi ) {
+		int mid = ( lo + hi ) / 2;
+
+		if ( al->al_pos[ mid ] < pos ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return ( lo < al->al_num && al->al_pos[ lo ] < max ) ? al->al_pos[ lo ] : max;
+}
+
+/* the rightmost RDN of dn[0..end) starts at the returned offset */
+static ber_len_t
+acl_index_rdn( struct berval *dn, ber_len_t end )
+{
+	while ( end > 0 && !DN_SEPARATOR( dn->bv_val[ end - 1 ] ) ) {
+		end--;
+	}
+
+	return end;
+}
+
+static AclIndexNode *
+acl_index_node( AclIndex *ai, struct berval *dn )
+{
+	AclIndexNode	*an = &ai->ai_root, key, *kid;
+	ber_len_t	start, end = dn->bv_len;
+
+	while ( end > 0 ) {
+		start = acl_index_rdn( dn, end );
+		key.an_rdn.bv_val = &dn->bv_val[ start ];
+		key.an_rdn.bv_len = end - start;
+
+		kid = avl_find( an->an_kids, &key, acl_index_cmp );
+		if ( kid == NULL ) {
+			kid = ch_calloc( 1, sizeof( AclIndexNode ) );
+			ber_dupbv( &kid->an_rdn, &key.an_rdn );
+			avl_insert( &an->an_kids, kid, acl_index_cmp, avl_dup_error );
+		}
+		an = kid;
+		end = start ? start - 1 : 0;
+	}
+
+	return an;
+}
+
+static void acl_index_node_free( void *v_an );
+
+static void
+acl_index_node_clean( AclIndexNode *an )
+{
+	avl_free( an->an_kids, acl_index_node_free );
+	ch_free( an->an_base.al_pos );
+	ch_free( an->an_below.al_pos );
+	ch_free( an->an_sub.al_pos );
+}
+
+static void
+acl_index_node_free( void *v_an )
+{
+	AclIndexNode *an = v_an;
+
+	acl_index_node_clean( an );
+	ch_free( an->an_rdn.bv_val );
+	ch_free( an );
+}
+
+static void
+acl_index_release( AclIndex *ai )
+{
+	if ( --ai->ai_refcnt > 0 ) {
+		return;
+	}
+
+	acl_index_node_clean( &ai->ai_root );
+	ch_free( ai->ai_other.al_pos );
+	ch_free( ai->ai_acls );
+	ch_free( ai );
+}
+
+/*
+ * (Re)build the index of a list of access controls; must be called
+ * whenever the list is modified.
+ */
+void
+acl_index_build( AccessControl *l )
+{
+	AclIndex	*ai;
+	AccessControl	*a;
+	AclIndexNode	*an;
+	int		i;
+
+	if ( l == NULL ) {
+		return;
+	}
+
+	ai = ch_calloc( 1, sizeof( AclIndex ) );
+	for ( a = l; a != NULL; a = a->acl_next ) {
+		ai->ai_count++;
+	}
+	ai->ai_refcnt = ai->ai_count;
+	ai->ai_acls = ch_malloc( ai->ai_count * sizeof( AccessControl * ) );
+
+	for ( i = 0, a = l; a != NULL; a = a->acl_next, i++ ) {
+		if ( a->acl_index != NULL ) {
+			acl_index_release( a->acl_index );
+		}
+		a->acl_index = ai;
+		a->acl_pos = i;
+		ai->ai_acls[ i ] = a;
+
+		switch ( a->acl_dn_style ) {
+		case ACL_STYLE_BASE:
+			an = acl_index_node( ai, &a->acl_dn_pat );
+			acl_index_list_add( &an->an_base, i );
+			break;
+
+		/* the exact depth of one is left to slap_acl_get() */
+		case ACL_STYLE_ONE:
+		case ACL_STYLE_CHILDREN:
+			an = acl_index_node( ai, &a->acl_dn_pat );
+			acl_index_list_add( &an->an_below, i );
+			break;
+
+		case ACL_STYLE_SUBTREE:
+			an = acl_index_node( ai, &a->acl_dn_pat );
+			acl_index_list_add( &an->an_sub, i );
+			break;
+
+		default:
+			acl_index_list_add( &ai->ai_other, i );
+			break;
+		}
+	}
+}
+
+/*
+ * Return the first access control, starting from a, whose target may
+ * match ndn, or NULL if there is none; when a is skipped, *prevp is
+ * set to the access control preceding the returned one (or to the
+ * last one of the list).
+ */
+AccessControl *
+acl_index_next( AccessControl *a, struct berval *ndn, AccessControl **prevp )
+{
+	AclIndex	*ai = a->acl_index;
+	AclIndexNode	*an = &ai->ai_root, key;
+	ber_len_t	start, end = ndn->bv_len;
+	int		pos = a->acl_pos, next;
+
+	next = acl_index_list_next( &ai->ai_other, pos, ai->ai_count );
+
+	/* an is a suffix of ndn, followed by ndn[0..end) */
+	for ( ;; ) {
+		next = acl_index_list_next( &an->an_sub, pos, next );
+		if ( end == 0 ) {
+			next = acl_index_list_next( &an->an_base, pos, next );
+			break;
+		}
+		next = acl_index_list_next( &an->an_below, pos, next );
+
+		if ( an->an_kids == NULL || next == pos ) {
+			break;
+		}
+
+		start = acl_index_rdn( ndn, end );
+		key.an_rdn.bv_val = &ndn->bv_val[ start ];
+		key.an_rdn.bv_len = end - start;
+
+		an = avl_find( an->an_kids, &key, acl_index_cmp );
+		if ( an == NULL ) {
+			break;
+		}
+		end = start ? start - 1 : 0;
+	}
+
+	if ( next == pos ) {
+		return a;
+	}
+
+	*prevp = ai->ai_acls[ next - 1 ];
+
+	return next < ai->ai_count ? ai->ai_acls[ next ] : NULL;
+}
+
 void
 acl_append( AccessControl **l, AccessControl *a, int pos )
 {
+	AccessControl **head = l;
 	int i;
 
+	if ( a )
+		acl_cache_prepare( a );
+
 	for (i=0 ; i != pos && *l != NULL; l = &(*l)->acl_next, i++ ) {
 		;	/* Empty */
 	}
 	if ( *l && a )
 		a->acl_next = *l;
 	*l = a;
+
+	acl_index_build( *head );
 }
 
 static void
@@ -2441,7 +2688,13 @@ acl_free( AccessControl *a )
 		n = a->acl_access->a_next;
 		access_free( a->acl_access );
 	}
+	if ( a->acl_index ) {
+		acl_index_release( a->acl_index );
+	}
 	free( a );
+
+	/* the ACL cache may still refer to its clauses */
+	acl_cache_invalidate();
 }
 
 void
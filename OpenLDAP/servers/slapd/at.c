@@ -256,6 +256,9 @@ at_delete( AttributeType *at )
 	LDAP_STAILQ_REMOVE(&attr_list, at, AttributeType, sat_next);
 
 	at_delete_names( at );
+
+	/* DNs naming it no longer normalize the same way */
+	dn_cache_invalidate();
 }
 
 static void
@@ -576,6 +579,8 @@ at_insert(
 		LDAP_STAILQ_INSERT_TAIL( &attr_list, sat, sat_next );
 	}
 
+	dn_cache_invalidate();
+
 	return 0;
 }
 
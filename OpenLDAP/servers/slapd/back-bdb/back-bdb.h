@@ -67,10 +67,29 @@ typedef struct bdb_idl_cache_entry_s {
 	ID      *idl;
 	DB      *db;
 	int		idl_flags;
+	int		idl_list;	/* which ARC list, see below */
 	struct bdb_idl_cache_entry_s* idl_lru_prev;
 	struct bdb_idl_cache_entry_s* idl_lru_next;
 } bdb_idl_cache_entry_t;
 
+/* Lists of the ARC IDL cache policy. Ghosts only keep their key. */
+#define	IDL_CACHE_T1	0	/* cached, seen once */
+#define	IDL_CACHE_T2	1	/* cached, seen more than once */
+#define	IDL_CACHE_B1	2	/* ghost, evicted from T1 */
+#define	IDL_CACHE_B2	3	/* ghost, evicted from T2 */
+#define	IDL_CACHE_LISTS	4
+
+/* IDL cache lookups are counted in stripes picked by thread, so
+ * that they don't serialize on one lock; cn=Monitor sums them.
+ */
+#define	IDL_COUNT_STRIPES	16
+
+typedef struct bdb_idl_count {
+	unsigned long	ic_hits;
+	unsigned long	ic_misses;
+	ldap_pvt_thread_mutex_t ic_mutex;
+} bdb_idl_count;
+
 /* BDB backend specific entry info */
 typedef struct bdb_entry_info {
 	struct bdb_entry_info *bei_parent;
@@ -92,7 +111,10 @@ typedef struct bdb_entry_info {
 #define	CACHE_ENTRY_ONELEVEL	0x40
 #define	CACHE_ENTRY_REFERENCED	0x80
 #define	CACHE_ENTRY_NOT_CACHED	0x100
+#define	CACHE_ENTRY_COLD	0x200	/* ARC: not referenced since loaded */
+#define	CACHE_ENTRY_GHOST	0x400	/* ARC: entry freed at bei_evicted */
 	int bei_finders;
+	unsigned bei_evicted;	/* shard eviction count when entry was freed */
 
 	/*
 	 * remaining fields require backend cache lock to access
@@ -118,29 +140,51 @@ typedef struct bdb_entry_info {
 #undef BEI
 #define BEI(e)	((EntryInfo *) ((e)->e_private))
 
+/* One partition of the in-core entry cache. Each EntryInfo lives in
+ * the shard selected by its ID, so lookups, LRU maintenance and purges
+ * in different shards do not contend with each other.
+ */
+typedef struct bdb_cache_shard {
+	Avlnode		*cs_idtree;
+	EntryInfo	*cs_lruhead;	/* lru - add accessed entries here */
+	EntryInfo	*cs_lrutail;	/* lru - rem lru entries from here */
+	ID		cs_cursize;
+	ID		cs_eiused;	/* EntryInfo's in use */
+	ID		cs_leaves;	/* EntryInfo leaf nodes */
+	ID		cs_cold;	/* ARC: entries not referenced since loaded */
+	ID		cs_target;	/* ARC: adaptive target for cs_cold */
+	unsigned	cs_evictions;	/* ARC: entries freed, for ghost ages */
+	unsigned long	cs_hits;	/* entry found in cache */
+	unsigned long	cs_misses;	/* entry loaded from the database */
+	int		cs_purging;
+	DB_TXN	*cs_txn;	/* used by lru cleaner */
+	ldap_pvt_thread_rdwr_t cs_rwlock;	/* protects idtree, eiused, leaves */
+	ldap_pvt_thread_mutex_t cs_lru_mutex;
+	ldap_pvt_thread_mutex_t cs_count_mutex;	/* cursize, hits, misses */
+} CacheShard;
+
 /* for the in-core cache of entries */
 typedef struct bdb_cache {
 	EntryInfo	*c_eifree;	/* free list */
-	Avlnode		*c_idtree;
-	EntryInfo	*c_lruhead;	/* lru - add accessed entries here */
-	EntryInfo	*c_lrutail;	/* lru - rem lru entries from here */
+	CacheShard	*c_shards;
+	unsigned	c_shardmask;	/* number of shards in use, minus 1 */
+	int		c_nshards;	/* configured number, 0 for automatic */
 	EntryInfo	c_dntree;
 	ID		c_maxsize;
-	ID		c_cursize;
 	ID		c_minfree;
 	ID		c_eimax;
-	ID		c_eiused;	/* EntryInfo's in use */
-	ID		c_leaves;	/* EntryInfo leaf nodes */
-	int		c_purging;
-	DB_TXN	*c_txn;	/* used by lru cleaner */
-	ldap_pvt_thread_rdwr_t c_rwlock;
-	ldap_pvt_thread_mutex_t c_lru_mutex;
-	ldap_pvt_thread_mutex_t c_count_mutex;
+	DB_TXN	*c_txn;	/* used by tools */
 	ldap_pvt_thread_mutex_t c_eifree_mutex;
 #ifdef SLAP_ZONE_ALLOC
 	void *c_zctx;
 #endif
 } Cache;
+
+#define	BDB_CACHE_SHARD(c, id)	(&(c)->c_shards[(id) & (c)->c_shardmask])
+/* a shard's part of a cache-wide limit, rounded up */
+#define	BDB_CACHE_SHARE(c, n)	\
+	(((n) + (c)->c_shardmask) / ((c)->c_shardmask + 1))
+#define	BDB_CACHE_SHARDS_MAX	256
  
 #define CACHE_READ_LOCK                0
 #define CACHE_WRITE_LOCK       1
@@ -206,9 +250,17 @@ struct bdb_info {
 	ldap_pvt_thread_mutex_t	bi_lastid_mutex;
 	ID	bi_idl_cache_max_size;
 	ID		bi_idl_cache_size;
+	int		bi_idl_bitmap;
+	int		bi_cache_policy;
+#define	BDB_CACHE_CLOCK	0
+#define	BDB_CACHE_ARC	1
 	Avlnode		*bi_idl_tree;
 	bdb_idl_cache_entry_t	*bi_idl_lru_head;
 	bdb_idl_cache_entry_t	*bi_idl_lru_tail;
+	bdb_idl_cache_entry_t	*bi_idl_arc[IDL_CACHE_LISTS];
+	ID		bi_idl_arc_len[IDL_CACHE_LISTS];
+	ID		bi_idl_arc_p;	/* adaptive target length of T1 */
+	bdb_idl_count	bi_idl_counts[IDL_COUNT_STRIPES];
 	ldap_pvt_thread_rdwr_t bi_idl_tree_rwlock;
 	ldap_pvt_thread_mutex_t bi_idl_tree_lrulock;
 	alock_info_t	bi_alock_info;
@@ -31,14 +31,14 @@
 #ifdef BDB_HIER
 #define bdb_cache_lru_purge	hdb_cache_lru_purge
 #endif
-static void bdb_cache_lru_purge( struct bdb_info *bdb );
+static void bdb_cache_lru_purge( struct bdb_info *bdb, CacheShard *cs );
 
 static int	bdb_cache_delete_internal(Cache *cache, EntryInfo *e, int decr);
 #ifdef LDAP_DEBUG
 #define SLAPD_UNUSED
 #ifdef SLAPD_UNUSED
-static void	bdb_lru_print(Cache *cache);
-static void	bdb_idtree_print(Cache *cache);
+static void	bdb_lru_print(CacheShard *cs);
+static void	bdb_idtree_print(CacheShard *cs);
 #endif
 #endif
 
@@ -106,12 +106,12 @@ bdb_cache_entryinfo_free( Cache *cache, EntryInfo *ei )
 #endif
 }
 
-#define LRU_DEL( c, e ) do { \
+#define LRU_DEL( cs, e ) do { \
 	if ( e == e->bei_lruprev ) { \
-		(c)->c_lruhead = (c)->c_lrutail = NULL; \
+		(cs)->cs_lruhead = (cs)->cs_lrutail = NULL; \
 	} else { \
-		if ( e == (c)->c_lruhead ) (c)->c_lruhead = e->bei_lruprev; \
-		if ( e == (c)->c_lrutail ) (c)->c_lrutail = e->bei_lruprev; \
+		if ( e == (cs)->cs_lruhead ) (cs)->cs_lruhead = e->bei_lruprev; \
+		if ( e == (cs)->cs_lrutail ) (cs)->cs_lrutail = e->bei_lruprev; \
 		e->bei_lrunext->bei_lruprev = e->bei_lruprev; \
 		e->bei_lruprev->bei_lrunext = e->bei_lrunext; \
 	} \
@@ -125,30 +125,36 @@ bdb_cache_entryinfo_free( Cache *cache, EntryInfo *ei )
  * or deleting an entry. It's now a circular doubly-linked list.
  * We always append to the tail, but the head traverses the circle
  * during a purge operation.
+ *
+ * Each shard of the cache has its own circle, and an entry is only
+ * ever linked into the circle of the shard its ID maps to.
  */
 static void
 bdb_cache_lru_link( struct bdb_info *bdb, EntryInfo *ei )
 {
+	CacheShard *cs;
 
 	/* Already linked, ignore */
 	if ( ei->bei_lruprev )
 		return;
 
+	cs = BDB_CACHE_SHARD( &bdb->bi_cache, ei->bei_id );
+
 	/* Insert into circular LRU list */
-	ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_lru_mutex );
+	ldap_pvt_thread_mutex_lock( &cs->cs_lru_mutex );
 
-	ei->bei_lruprev = bdb->bi_cache.c_lrutail;
-	if ( bdb->bi_cache.c_lrutail ) {
-		ei->bei_lrunext = bdb->bi_cache.c_lrutail->bei_lrunext;
-		bdb->bi_cache.c_lrutail->bei_lrunext = ei;
+	ei->bei_lruprev = cs->cs_lrutail;
+	if ( cs->cs_lrutail ) {
+		ei->bei_lrunext = cs->cs_lrutail->bei_lrunext;
+		cs->cs_lrutail->bei_lrunext = ei;
 		if ( ei->bei_lrunext )
 			ei->bei_lrunext->bei_lruprev = ei;
 	} else {
 		ei->bei_lrunext = ei->bei_lruprev = ei;
-		bdb->bi_cache.c_lruhead = ei;
+		cs->cs_lruhead = ei;
 	}
-	bdb->bi_cache.c_lrutail = ei;
-	ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_lru_mutex );
+	cs->cs_lrutail = ei;
+	ldap_pvt_thread_mutex_unlock( &cs->cs_lru_mutex );
 }
 
 #ifdef NO_THREADS
@@ -331,7 +337,8 @@ bdb_id_dup_err( void *v1, void *v2 )
 	return -1;
 }
 
-/* Create an entryinfo in the cache. Caller must release the locks later.
+/* Create an entryinfo in the cache. Caller must release the locks later:
+ * the parent's entryinfo lock and the write lock on the shard of ei's ID.
  */
 static int
 bdb_entryinfo_add_internal(
@@ -339,6 +346,7 @@ bdb_entryinfo_add_internal(
 	EntryInfo *ei,
 	EntryInfo **res )
 {
+	CacheShard *cs = BDB_CACHE_SHARD( &bdb->bi_cache, ei->bei_id );
 	EntryInfo *ei2 = NULL;
 
 	*res = NULL;
@@ -346,7 +354,7 @@ bdb_entryinfo_add_internal(
 	ei2 = bdb_cache_entryinfo_new( &bdb->bi_cache );
 
 	bdb_cache_entryinfo_lock( ei->bei_parent );
-	ldap_pvt_thread_rdwr_wlock( &bdb->bi_cache.c_rwlock );
+	ldap_pvt_thread_rdwr_wlock( &cs->cs_rwlock );
 
 	ei2->bei_id = ei->bei_id;
 	ei2->bei_parent = ei->bei_parent;
@@ -358,7 +366,7 @@ bdb_entryinfo_add_internal(
 #endif
 
 	/* Add to cache ID tree */
-	if (avl_insert( &bdb->bi_cache.c_idtree, ei2, bdb_id_cmp,
+	if (avl_insert( &cs->cs_idtree, ei2, bdb_id_cmp,
 		bdb_id_dup_err )) {
 		EntryInfo *eix = ei2->bei_lrunext;
 		bdb_cache_entryinfo_free( &bdb->bi_cache, ei2 );
@@ -372,7 +380,7 @@ bdb_entryinfo_add_internal(
 	} else {
 		int rc;
 
-		bdb->bi_cache.c_eiused++;
+		cs->cs_eiused++;
 		ber_dupbv( &ei2->bei_nrdn, &ei->bei_nrdn );
 
 		/* This is a new leaf node. But if parent had no kids, then it was
@@ -380,7 +388,7 @@ bdb_entryinfo_add_internal(
 		 * the parent already has kids.
 		 */
 		if ( ei->bei_parent->bei_kids || !ei->bei_parent->bei_id )
-			bdb->bi_cache.c_leaves++;
+			cs->cs_leaves++;
 		rc = avl_insert( &ei->bei_parent->bei_kids, ei2, bdb_rdn_cmp,
 			avl_dup_error );
 #ifdef BDB_HIER
@@ -474,9 +482,10 @@ bdb_cache_find_ndn(
 			/* DN exists but needs to be added to cache */
 			ei.bei_nrdn.bv_len = len;
 			rc = bdb_entryinfo_add_internal( bdb, &ei, &ei2 );
-			/* add_internal left eip and c_rwlock locked */
+			/* add_internal left eip and the shard locked */
 			eip->bei_finders--;
-			ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+			ldap_pvt_thread_rdwr_wunlock(
+				&BDB_CACHE_SHARD( &bdb->bi_cache, ei.bei_id )->cs_rwlock );
 			if ( cursor ) cursor->c_close( cursor );
 			if ( rc ) {
 				*res = eip;
@@ -529,6 +538,7 @@ hdb_cache_find_parent(
 {
 	struct bdb_info *bdb = (struct bdb_info *) op->o_bd->be_private;
 	EntryInfo ei, eip, *ei2 = NULL, *ein = NULL, *eir = NULL;
+	CacheShard *cs, *ps;
 	int rc, add;
 
 	ei.bei_id = id;
@@ -566,19 +576,20 @@ hdb_cache_find_parent(
 			ein->bei_finders++;
 		}
 
+		cs = BDB_CACHE_SHARD( &bdb->bi_cache, ein->bei_id );
 again:
 		/* Insert this node into the ID tree */
-		ldap_pvt_thread_rdwr_wlock( &bdb->bi_cache.c_rwlock );
-		if ( avl_insert( &bdb->bi_cache.c_idtree, (caddr_t)ein,
+		ldap_pvt_thread_rdwr_wlock( &cs->cs_rwlock );
+		if ( avl_insert( &cs->cs_idtree, (caddr_t)ein,
 			bdb_id_cmp, bdb_id_dup_err ) ) {
 			EntryInfo *eix = ein->bei_lrunext;
 
 			if ( bdb_cache_entryinfo_trylock( eix )) {
-				ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+				ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
 				ldap_pvt_thread_yield();
 				goto again;
 			}
-			ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+			ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
 
 			/* Someone else created this node just before us.
 			 * Free our new copy and use the existing one.
@@ -603,25 +614,36 @@ again:
 		/* If there was a previous node, link it to this one */
 		if ( ei2 ) ei2->bei_parent = ein;
 
-		/* Look for this node's parent */
+		if ( add )
+			cs->cs_eiused++;
+		ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
+
+		/* Look for this node's parent. It may live in another
+		 * shard, so never hold two shard locks at once.
+		 */
+		ps = NULL;
 par2:
 		if ( eip.bei_id ) {
-			ei2 = (EntryInfo *) avl_find( bdb->bi_cache.c_idtree,
+			ps = BDB_CACHE_SHARD( &bdb->bi_cache, eip.bei_id );
+			ldap_pvt_thread_rdwr_rlock( &ps->cs_rwlock );
+			ei2 = (EntryInfo *) avl_find( ps->cs_idtree,
 					(caddr_t) &eip, bdb_id_cmp );
 		} else {
 			ei2 = &bdb->bi_cache.c_dntree;
 		}
 		if ( ei2 && bdb_cache_entryinfo_trylock( ei2 )) {
-			ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+			if ( ps )
+				ldap_pvt_thread_rdwr_runlock( &ps->cs_rwlock );
 			ldap_pvt_thread_yield();
-			ldap_pvt_thread_rdwr_wlock( &bdb->bi_cache.c_rwlock );
 			goto par2;
 		}
-		if ( add )
-			bdb->bi_cache.c_eiused++;
-		if ( ei2 && ( ei2->bei_kids || !ei2->bei_id ))
-			bdb->bi_cache.c_leaves++;
-		ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+		if ( ps )
+			ldap_pvt_thread_rdwr_runlock( &ps->cs_rwlock );
+		if ( ei2 && ( ei2->bei_kids || !ei2->bei_id )) {
+			ldap_pvt_thread_rdwr_wlock( &cs->cs_rwlock );
+			cs->cs_leaves++;
+			ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
+		}
 
 gotparent:
 		/* Got the parent, link in and we're done. */
@@ -678,7 +700,8 @@ int hdb_cache_load(
 
 		rc = bdb_entryinfo_add_internal( bdb, ei, res );
 		bdb_cache_entryinfo_unlock( ei->bei_parent );
-		ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
+		ldap_pvt_thread_rdwr_wunlock(
+			&BDB_CACHE_SHARD( &bdb->bi_cache, ei->bei_id )->cs_rwlock );
 	} else {
 		/* Found, return it */
 		*res = ei2;
@@ -691,25 +714,45 @@ int hdb_cache_load(
 /* This is best-effort only. If all entries in the cache are
  * busy, they will all be kept. This is unlikely to happen
  * unless the cache is very much smaller than the working set.
+ *
+ * Only the given shard is purged, against its share of the
+ * cache-wide limits.
+ *
+ * Under the ARC policy the circle holds two kinds of entries: cold
+ * ones, loaded once and not referenced since, and hot ones. A
+ * referenced cold entry is promoted to hot instead of being skipped,
+ * and only the side that exceeds the shard's adaptive target is
+ * evicted, so a one-time scan through the cache only displaces other
+ * cold entries. If that frees too little, a second pass takes any
+ * idle entry. Evicted entries keep their EntryInfo in the DN cache as
+ * long as usual, and remember when they were evicted so that an early
+ * reload can adjust the target.
  */
 static void
-bdb_cache_lru_purge( struct bdb_info *bdb )
+bdb_cache_lru_purge( struct bdb_info *bdb, CacheShard *cs )
 {
+	Cache *cache = &bdb->bi_cache;
 	DB_LOCK		lock, *lockp;
 	EntryInfo *elru, *elnext = NULL;
 	int islocked;
 	ID eicount, ecount;
 	ID count, efree, eifree = 0;
+	ID maxsize, minfree;
+	ID cold = 0, target = 0, promoted = 0, coldfreed = 0;
+	int arc = bdb->bi_cache_policy == BDB_CACHE_ARC, sweeps = 0;
 #ifdef LDAP_DEBUG
 	int iter;
 #endif
 
 	/* Wait for the mutex; we're the only one trying to purge. */
-	ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_lru_mutex );
+	ldap_pvt_thread_mutex_lock( &cs->cs_lru_mutex );
 
-	if ( bdb->bi_cache.c_cursize > bdb->bi_cache.c_maxsize ) {
-		efree = bdb->bi_cache.c_cursize - bdb->bi_cache.c_maxsize;
-		efree += bdb->bi_cache.c_minfree;
+	maxsize = BDB_CACHE_SHARE( cache, cache->c_maxsize );
+	minfree = BDB_CACHE_SHARE( cache, cache->c_minfree );
+
+	if ( cs->cs_cursize > maxsize ) {
+		efree = cs->cs_cursize - maxsize;
+		efree += minfree;
 	} else {
 		efree = 0;
 	}
@@ -719,26 +762,33 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 	 */
 
 	if ( slapMode & SLAP_TOOL_READONLY ) {
-		eifree = bdb->bi_cache.c_leaves;
-	} else if ( bdb->bi_cache.c_eimax &&
-		bdb->bi_cache.c_leaves > bdb->bi_cache.c_eimax ) {
-		eifree = bdb->bi_cache.c_minfree * 10;
-		if ( eifree >= bdb->bi_cache.c_leaves )
+		eifree = cs->cs_leaves;
+	} else if ( cache->c_eimax &&
+		cs->cs_leaves > BDB_CACHE_SHARE( cache, cache->c_eimax )) {
+		eifree = minfree * 10;
+		if ( eifree >= cs->cs_leaves )
 			eifree /= 2;
 	}
 
 	if ( !efree && !eifree ) {
-		ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_lru_mutex );
-		bdb->bi_cache.c_purging = 0;
+		ldap_pvt_thread_mutex_unlock( &cs->cs_lru_mutex );
+		cs->cs_purging = 0;
 		return;
 	}
 
-	if ( bdb->bi_cache.c_txn ) {
+	if ( cs->cs_txn ) {
 		lockp = &lock;
 	} else {
 		lockp = NULL;
 	}
 
+	if ( arc ) {
+		ldap_pvt_thread_mutex_lock( &cs->cs_count_mutex );
+		cold = cs->cs_cold;
+		target = cs->cs_target;
+		ldap_pvt_thread_mutex_unlock( &cs->cs_count_mutex );
+	}
+
 	count = 0;
 	eicount = 0;
 	ecount = 0;
@@ -747,7 +797,7 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 #endif
 
 	/* Look for an unused entry to remove */
-	for ( elru = bdb->bi_cache.c_lruhead; elru; elru = elnext ) {
+	for ( elru = cs->cs_lruhead; elru; elru = elnext ) {
 		elnext = elru->bei_lrunext;
 
 		if ( bdb_cache_entryinfo_trylock( elru ))
@@ -756,6 +806,20 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 		/* This flag implements the clock replacement behavior */
 		if ( elru->bei_state & ( CACHE_ENTRY_REFERENCED )) {
 			elru->bei_state &= ~CACHE_ENTRY_REFERENCED;
+			if ( elru->bei_e && ( elru->bei_state & CACHE_ENTRY_COLD )) {
+				elru->bei_state ^= CACHE_ENTRY_COLD;
+				promoted++;
+				if ( cold )
+					cold--;
+			}
+			bdb_cache_entryinfo_unlock( elru );
+			goto bottom;
+		}
+
+		/* Only take entries from the side that is over target */
+		if ( arc && !sweeps && elru->bei_e &&
+			(( elru->bei_state & CACHE_ENTRY_COLD ) ?
+			cold <= target : cold > target )) {
 			bdb_cache_entryinfo_unlock( elru );
 			goto bottom;
 		}
@@ -783,7 +847,7 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 		 * the object is idle.
 		 */
 		if ( bdb_cache_entry_db_lock( bdb,
-			bdb->bi_cache.c_txn, elru, 1, 1, lockp ) == 0 ) {
+			cs->cs_txn, elru, 1, 1, lockp ) == 0 ) {
 
 			/* Free entry for this node if it's present */
 			if ( elru->bei_e ) {
@@ -792,10 +856,19 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 				/* the cache may have gone over the limit while we
 				 * weren't looking, so double check.
 				 */
-				if ( !efree && ecount > bdb->bi_cache.c_maxsize )
-					efree = bdb->bi_cache.c_minfree;
+				if ( !efree && ecount > maxsize )
+					efree = minfree;
 
 				if ( count < efree ) {
+					if ( arc ) {
+						if ( elru->bei_state & CACHE_ENTRY_COLD ) {
+							coldfreed++;
+							if ( cold )
+								cold--;
+						}
+						elru->bei_state |= CACHE_ENTRY_GHOST;
+						elru->bei_evicted = ++cs->cs_evictions;
+					}
 					elru->bei_e->e_private = NULL;
 #ifdef SLAP_ZONE_ALLOC
 					bdb_entry_return( bdb, elru->bei_e, elru->bei_zseq );
@@ -817,11 +890,11 @@ bdb_cache_lru_purge( struct bdb_info *bdb )
 			 */
 			if ( elru->bei_kids ) {
 				/* Drop from list, we ignore it... */
-				LRU_DEL( &bdb->bi_cache, elru );
+				LRU_DEL( cs, elru );
 			} else if ( eicount < eifree ) {
 				/* Too many leaf nodes, free this one */
-				bdb_cache_delete_internal( &bdb->bi_cache, elru, 0 );
-				bdb_cache_delete_cleanup( &bdb->bi_cache, elru );
+				bdb_cache_delete_internal( cache, elru, 0 );
+				bdb_cache_delete_cleanup( cache, elru );
 				islocked = 0;
 				eicount++;
 			}	/* Leave on list until we need to free it */
@@ -836,24 +909,67 @@ next:
 		if ( count >= efree && eicount >= eifree )
 			break;
 bottom:
-		if ( elnext == bdb->bi_cache.c_lruhead )
+		if ( elnext == cs->cs_lruhead ) {
+			if ( arc && !sweeps && count < efree ) {
+				sweeps = 1;
+				continue;
+			}
 			break;
+		}
 #ifdef LDAP_DEBUG
 		iter++;
 #endif
 	}
 
-	if ( count || ecount > bdb->bi_cache.c_cursize ) {
-		ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_count_mutex );
+	if ( count || ecount > cs->cs_cursize || promoted ) {
+		ldap_pvt_thread_mutex_lock( &cs->cs_count_mutex );
 		/* HACK: we seem to be losing track, fix up now */
-		if ( ecount > bdb->bi_cache.c_cursize )
-			bdb->bi_cache.c_cursize = ecount;
-		bdb->bi_cache.c_cursize -= count;
-		ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_count_mutex );
-	}
-	bdb->bi_cache.c_lruhead = elnext;
-	ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_lru_mutex );
-	bdb->bi_cache.c_purging = 0;
+		if ( ecount > cs->cs_cursize )
+			cs->cs_cursize = ecount;
+		cs->cs_cursize -= count;
+		if ( cs->cs_cold > promoted + coldfreed )
+			cs->cs_cold -= promoted + coldfreed;
+		else
+			cs->cs_cold = 0;
+		if ( cs->cs_cold > cs->cs_cursize )
+			cs->cs_cold = cs->cs_cursize;
+		ldap_pvt_thread_mutex_unlock( &cs->cs_count_mutex );
+	}
+	cs->cs_lruhead = elnext;
+	ldap_pvt_thread_mutex_unlock( &cs->cs_lru_mutex );
+	cs->cs_purging = 0;
+}
+
+/* Ghost list an entry was readmitted from, see bdb_cache_arc_admit() */
+#define	ARC_GHOST_COLD	1
+#define	ARC_GHOST_HOT	2
+
+/*
+ * Under the ARC policy, decide how a freshly loaded entry enters
+ * its shard. An entry whose ghost is younger than the shard's share
+ * of the cachesize was evicted too early and comes back hot; all
+ * others come back cold and must be referenced again before the next
+ * purge reaches them to be promoted. Which side the ghost was evicted
+ * from is returned so the caller can adapt the shard's cold target.
+ * Caller must hold the entryinfo lock.
+ */
+static int
+bdb_cache_arc_admit( Cache *cache, CacheShard *cs, EntryInfo *ei )
+{
+	int ghost = 0;
+
+	ei->bei_state &= ~CACHE_ENTRY_REFERENCED;
+	if (( ei->bei_state & CACHE_ENTRY_GHOST ) &&
+		cs->cs_evictions - ei->bei_evicted <
+		BDB_CACHE_SHARE( cache, cache->c_maxsize )) {
+		ghost = ( ei->bei_state & CACHE_ENTRY_COLD ) ?
+			ARC_GHOST_COLD : ARC_GHOST_HOT;
+		ei->bei_state &= ~( CACHE_ENTRY_GHOST | CACHE_ENTRY_COLD );
+	} else {
+		ei->bei_state &= ~CACHE_ENTRY_GHOST;
+		ei->bei_state |= CACHE_ENTRY_COLD;
+	}
+	return ghost;
 }
 
 /*
@@ -872,8 +988,9 @@ bdb_cache_find_id(
 	DB_LOCK		*lock )
 {
 	struct bdb_info *bdb = (struct bdb_info *) op->o_bd->be_private;
+	CacheShard *cs = BDB_CACHE_SHARD( &bdb->bi_cache, id );
 	Entry	*ep = NULL;
-	int	rc = 0, load = 0;
+	int	rc = 0, load = 0, cold = 0, ghost = 0;
 	EntryInfo ei = { 0 };
 
 	ei.bei_id = id;
@@ -883,14 +1000,14 @@ bdb_cache_find_id(
 #endif
 	/* If we weren't given any info, see if we have it already cached */
 	if ( !*eip ) {
-again:	ldap_pvt_thread_rdwr_rlock( &bdb->bi_cache.c_rwlock );
-		*eip = (EntryInfo *) avl_find( bdb->bi_cache.c_idtree,
+again:	ldap_pvt_thread_rdwr_rlock( &cs->cs_rwlock );
+		*eip = (EntryInfo *) avl_find( cs->cs_idtree,
 			(caddr_t) &ei, bdb_id_cmp );
 		if ( *eip ) {
 			/* If the lock attempt fails, the info is in use */
 			if ( bdb_cache_entryinfo_trylock( *eip )) {
 				int del = (*eip)->bei_state & CACHE_ENTRY_DELETED;
-				ldap_pvt_thread_rdwr_runlock( &bdb->bi_cache.c_rwlock );
+				ldap_pvt_thread_rdwr_runlock( &cs->cs_rwlock );
 				/* If this node is being deleted, treat
 				 * as if the delete has already finished
 				 */
@@ -906,19 +1023,23 @@ again:	ldap_pvt_thread_rdwr_rlock( &bdb->bi_cache.c_rwlock );
 			 */
 			if ( (*eip)->bei_state & CACHE_ENTRY_NOT_LINKED ) {
 				bdb_cache_entryinfo_unlock( *eip );
-				ldap_pvt_thread_rdwr_runlock( &bdb->bi_cache.c_rwlock );
+				ldap_pvt_thread_rdwr_runlock( &cs->cs_rwlock );
 				ldap_pvt_thread_yield();
 				goto again;
 			}
 			flag |= ID_LOCKED;
 		}
-		ldap_pvt_thread_rdwr_runlock( &bdb->bi_cache.c_rwlock );
+		ldap_pvt_thread_rdwr_runlock( &cs->cs_rwlock );
 	}
 
 	/* See if the ID exists in the database; add it to the cache if so */
 	if ( !*eip ) {
 #ifndef BDB_HIER
-		rc = bdb_id2entry( op->o_bd, tid, id, &ep );
+		if ( flag & ID_FILTER )
+			rc = bdb_id2entry_filter( op->o_bd, tid, id,
+				op->ors_filter, &ep );
+		else
+			rc = bdb_id2entry( op->o_bd, tid, id, &ep );
 		if ( rc == 0 ) {
 			rc = bdb_cache_find_ndn( op, tid,
 				&ep->e_nname, eip );
@@ -978,6 +1099,7 @@ load1:
 				if ( (*eip)->bei_state & CACHE_ENTRY_NOT_CACHED ) {
 					(*eip)->bei_state ^= CACHE_ENTRY_NOT_CACHED;
 					flag |= ID_CHKPURGE;
+					cold = (*eip)->bei_state & CACHE_ENTRY_COLD;
 				}
 			}
 
@@ -994,7 +1116,10 @@ load1:
 				bdb_cache_entryinfo_unlock( *eip );
 			} else if ( rc == 0 ) {
 				if ( load ) {
-					if ( !ep) {
+					if ( !ep && ( flag & ID_FILTER )) {
+						rc = bdb_id2entry_filter( op->o_bd, tid, id,
+							op->ors_filter, &ep );
+					} else if ( !ep ) {
 						rc = bdb_id2entry( op->o_bd, tid, id, &ep );
 					}
 					if ( rc == 0 ) {
@@ -1011,6 +1136,11 @@ load1:
 						(*eip)->bei_zseq = *((ber_len_t *)ep - 2);
 #endif
 						ep = NULL;
+						if ( bdb->bi_cache_policy == BDB_CACHE_ARC ) {
+							ghost = bdb_cache_arc_admit( &bdb->bi_cache,
+								cs, *eip );
+							cold = !ghost;
+						}
 						if ( flag & ID_NOCACHE ) {
 							/* Set the cached state only if no other thread
 							 * found the info while we were loading the entry.
@@ -1075,24 +1205,40 @@ load1:
 #endif
 	}
 	if ( rc == 0 ) {
+		Cache *cache = &bdb->bi_cache;
 		int purge = 0;
 
-		if (( flag & ID_CHKPURGE ) || bdb->bi_cache.c_eimax ) {
-			ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_count_mutex );
-			if ( flag & ID_CHKPURGE ) {
-				bdb->bi_cache.c_cursize++;
-				if ( !bdb->bi_cache.c_purging && bdb->bi_cache.c_cursize > bdb->bi_cache.c_maxsize ) {
-					purge = 1;
-					bdb->bi_cache.c_purging = 1;
-				}
-			} else if ( !bdb->bi_cache.c_purging && bdb->bi_cache.c_eimax && bdb->bi_cache.c_leaves > bdb->bi_cache.c_eimax ) {
+		ldap_pvt_thread_mutex_lock( &cs->cs_count_mutex );
+		if ( load )
+			cs->cs_misses++;
+		else
+			cs->cs_hits++;
+		if ( ghost == ARC_GHOST_COLD ) {
+			/* Cold entries are evicted too soon, keep more */
+			if ( cs->cs_target <
+				BDB_CACHE_SHARE( cache, cache->c_maxsize ))
+				cs->cs_target++;
+		} else if ( ghost == ARC_GHOST_HOT ) {
+			if ( cs->cs_target )
+				cs->cs_target--;
+		}
+		if ( flag & ID_CHKPURGE ) {
+			cs->cs_cursize++;
+			if ( cold )
+				cs->cs_cold++;
+			if ( !cs->cs_purging && cs->cs_cursize >
+				BDB_CACHE_SHARE( cache, cache->c_maxsize )) {
 				purge = 1;
-				bdb->bi_cache.c_purging = 1;
+				cs->cs_purging = 1;
 			}
-			ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_count_mutex );
+		} else if ( !cs->cs_purging && cache->c_eimax && cs->cs_leaves >
+			BDB_CACHE_SHARE( cache, cache->c_eimax )) {
+			purge = 1;
+			cs->cs_purging = 1;
 		}
+		ldap_pvt_thread_mutex_unlock( &cs->cs_count_mutex );
 		if ( purge )
-			bdb_cache_lru_purge( bdb );
+			bdb_cache_lru_purge( bdb, cs );
 	}
 
 #ifdef SLAP_ZONE_ALLOC
@@ -1135,6 +1281,7 @@ bdb_cache_add(
 	DB_TXN *txn,
 	DB_LOCK *lock )
 {
+	CacheShard *cs = BDB_CACHE_SHARD( &bdb->bi_cache, e->e_id );
 	EntryInfo *new, ei;
 	int rc, purge = 0;
 #ifdef BDB_HIER
@@ -1186,24 +1333,30 @@ bdb_cache_add(
 	new->bei_e = e;
 	e->e_private = new;
 	new->bei_state |= CACHE_ENTRY_NO_KIDS | CACHE_ENTRY_NO_GRANDKIDS;
+	if ( bdb->bi_cache_policy == BDB_CACHE_ARC )
+		new->bei_state = ( new->bei_state &
+			~( CACHE_ENTRY_REFERENCED | CACHE_ENTRY_GHOST )) |
+			CACHE_ENTRY_COLD;
 	eip->bei_state &= ~CACHE_ENTRY_NO_KIDS;
 	bdb_cache_entryinfo_unlock( eip );
 
-	ldap_pvt_thread_rdwr_wunlock( &bdb->bi_cache.c_rwlock );
-	ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_count_mutex );
-	++bdb->bi_cache.c_cursize;
-	if ( bdb->bi_cache.c_cursize > bdb->bi_cache.c_maxsize &&
-		!bdb->bi_cache.c_purging ) {
+	ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
+	ldap_pvt_thread_mutex_lock( &cs->cs_count_mutex );
+	++cs->cs_cursize;
+	if ( bdb->bi_cache_policy == BDB_CACHE_ARC )
+		++cs->cs_cold;
+	if ( cs->cs_cursize > BDB_CACHE_SHARE( &bdb->bi_cache,
+		bdb->bi_cache.c_maxsize ) && !cs->cs_purging ) {
 		purge = 1;
-		bdb->bi_cache.c_purging = 1;
+		cs->cs_purging = 1;
 	}
-	ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_count_mutex );
+	ldap_pvt_thread_mutex_unlock( &cs->cs_count_mutex );
 
 	new->bei_finders = 1;
 	bdb_cache_lru_link( bdb, new );
 
 	if ( purge )
-		bdb_cache_lru_purge( bdb );
+		bdb_cache_lru_purge( bdb, cs );
 
 	return rc;
 }
@@ -1361,6 +1514,7 @@ bdb_cache_delete(
     DB_LOCK	*lock )
 {
 	EntryInfo *ei = BEI(e);
+	CacheShard *cs = BDB_CACHE_SHARD( &bdb->bi_cache, e->e_id );
 	int	rc, busy = 0;
 
 	assert( e->e_private != NULL );
@@ -1403,7 +1557,7 @@ bdb_cache_delete(
 		e->e_id, 0, 0 );
 
 	/* set lru mutex */
-	ldap_pvt_thread_mutex_lock( &bdb->bi_cache.c_lru_mutex );
+	ldap_pvt_thread_mutex_lock( &cs->cs_lru_mutex );
 
 	bdb_cache_entryinfo_lock( ei->bei_parent );
 	bdb_cache_entryinfo_lock( ei );
@@ -1411,7 +1565,7 @@ bdb_cache_delete(
 	bdb_cache_entryinfo_unlock( ei );
 
 	/* free lru mutex */
-	ldap_pvt_thread_mutex_unlock( &bdb->bi_cache.c_lru_mutex );
+	ldap_pvt_thread_mutex_unlock( &cs->cs_lru_mutex );
 
 	return( rc );
 }
@@ -1440,12 +1594,14 @@ bdb_cache_delete_cleanup(
 	bdb_cache_entryinfo_free( cache, ei );
 }
 
+/* Caller must hold the lru mutex of e's shard */
 static int
 bdb_cache_delete_internal(
     Cache	*cache,
     EntryInfo		*e,
     int		decr )
 {
+	CacheShard *cs = BDB_CACHE_SHARD( cache, e->bei_id );
 	int rc = 0;	/* return code */
 	int decr_leaf = 0;
 
@@ -1469,27 +1625,29 @@ bdb_cache_delete_internal(
 	if ( e->bei_parent->bei_kids )
 		decr_leaf = 1;
 
-	ldap_pvt_thread_rdwr_wlock( &cache->c_rwlock );
+	ldap_pvt_thread_rdwr_wlock( &cs->cs_rwlock );
 	/* id tree */
-	if ( avl_delete( &cache->c_idtree, (caddr_t) e, bdb_id_cmp )) {
-		cache->c_eiused--;
+	if ( avl_delete( &cs->cs_idtree, (caddr_t) e, bdb_id_cmp )) {
+		cs->cs_eiused--;
 		if ( decr_leaf )
-			cache->c_leaves--;
+			cs->cs_leaves--;
 	} else {
 		rc = -1;
 		assert(0);
 	}
-	ldap_pvt_thread_rdwr_wunlock( &cache->c_rwlock );
+	ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
 	bdb_cache_entryinfo_unlock( e->bei_parent );
 
 	if ( rc == 0 ){
 		/* lru */
-		LRU_DEL( cache, e );
+		LRU_DEL( cs, e );
 
 		if ( e->bei_e ) {
-			ldap_pvt_thread_mutex_lock( &cache->c_count_mutex );
-			cache->c_cursize--;
-			ldap_pvt_thread_mutex_unlock( &cache->c_count_mutex );
+			ldap_pvt_thread_mutex_lock( &cs->cs_count_mutex );
+			cs->cs_cursize--;
+			if (( e->bei_state & CACHE_ENTRY_COLD ) && cs->cs_cold )
+				cs->cs_cold--;
+			ldap_pvt_thread_mutex_unlock( &cs->cs_count_mutex );
 		}
 	}
 
@@ -1514,44 +1672,130 @@ bdb_entryinfo_release( void *data )
 	bdb_cache_entryinfo_destroy( ei );
 }
 
+/* Don't spread a small cache over more shards than this share allows */
+#define	BDB_CACHE_SHARD_MIN	64
+
+/* Set up the shards of the entry cache, and a locker for each of their
+ * purges if the cache has one. Called when the database is opened.
+ */
+int
+bdb_cache_open( struct bdb_info *bdb )
+{
+	Cache *cache = &bdb->bi_cache;
+	CacheShard *cs;
+	unsigned i, n;
+	int rc;
+
+	n = cache->c_nshards;
+	if ( !n ) {
+		/* One per thread that can be looking up entries */
+		n = ( slapMode & SLAP_TOOL_MODE ) ?
+			slap_tool_thread_max : connection_pool_max;
+	}
+	for ( i = 1; i < n && i < BDB_CACHE_SHARDS_MAX; i <<= 1 )
+		;
+	if ( !cache->c_nshards ) {
+		while ( i > 1 && i * BDB_CACHE_SHARD_MIN > cache->c_maxsize )
+			i >>= 1;
+	}
+
+	cache->c_shards = ch_calloc( i, sizeof( CacheShard ));
+	cache->c_shardmask = i - 1;
+	for ( i = 0; i <= cache->c_shardmask; i++ ) {
+		cs = &cache->c_shards[i];
+		ldap_pvt_thread_rdwr_init( &cs->cs_rwlock );
+		ldap_pvt_thread_mutex_init( &cs->cs_lru_mutex );
+		ldap_pvt_thread_mutex_init( &cs->cs_count_mutex );
+		if ( cache->c_txn ) {
+			rc = TXN_BEGIN( bdb->bi_dbenv, NULL, &cs->cs_txn,
+				DB_READ_COMMITTED | DB_TXN_NOWAIT );
+			if ( rc )
+				return rc;
+		}
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "bdb_cache_open: %u entry cache shards\n",
+		cache->c_shardmask + 1, 0, 0 );
+	return 0;
+}
+
+/* Free the purge lockers. TXNs must all be closed before DBs. */
+void
+bdb_cache_txn_abort( Cache *cache )
+{
+	unsigned i;
+
+	if ( !cache->c_shards )
+		return;
+
+	for ( i = 0; i <= cache->c_shardmask; i++ ) {
+		if ( cache->c_shards[i].cs_txn ) {
+			TXN_ABORT( cache->c_shards[i].cs_txn );
+			cache->c_shards[i].cs_txn = NULL;
+		}
+	}
+}
+
 void
 bdb_cache_release_all( Cache *cache )
 {
-	/* set cache write lock */
-	ldap_pvt_thread_rdwr_wlock( &cache->c_rwlock );
-	/* set lru mutex */
-	ldap_pvt_thread_mutex_lock( &cache->c_lru_mutex );
+	CacheShard *cs;
+	unsigned i;
 
 	Debug( LDAP_DEBUG_TRACE, "====> bdb_cache_release_all\n", 0, 0, 0 );
 
+	if ( !cache->c_shards )
+		return;
+
+	/* set cache write locks and lru mutexes */
+	for ( i = 0; i <= cache->c_shardmask; i++ ) {
+		cs = &cache->c_shards[i];
+		ldap_pvt_thread_rdwr_wlock( &cs->cs_rwlock );
+		ldap_pvt_thread_mutex_lock( &cs->cs_lru_mutex );
+	}
+
 	avl_free( cache->c_dntree.bei_kids, NULL );
-	avl_free( cache->c_idtree, bdb_entryinfo_release );
-	for (;cache->c_eifree;cache->c_eifree = cache->c_lruhead) {
-		cache->c_lruhead = cache->c_eifree->bei_lrunext;
-		bdb_cache_entryinfo_destroy(cache->c_eifree);
-	}
-	cache->c_cursize = 0;
-	cache->c_eiused = 0;
-	cache->c_leaves = 0;
-	cache->c_idtree = NULL;
-	cache->c_lruhead = NULL;
-	cache->c_lrutail = NULL;
 	cache->c_dntree.bei_kids = NULL;
+	for ( i = 0; i <= cache->c_shardmask; i++ ) {
+		cs = &cache->c_shards[i];
+		avl_free( cs->cs_idtree, bdb_entryinfo_release );
+		cs->cs_idtree = NULL;
+		cs->cs_lruhead = NULL;
+		cs->cs_lrutail = NULL;
+		cs->cs_cursize = 0;
+		cs->cs_eiused = 0;
+		cs->cs_leaves = 0;
+		cs->cs_cold = 0;
+		cs->cs_target = 0;
+	}
+	while ( cache->c_eifree ) {
+		EntryInfo *ei = cache->c_eifree;
+		cache->c_eifree = ei->bei_lrunext;
+		bdb_cache_entryinfo_destroy( ei );
+	}
 
-	/* free lru mutex */
-	ldap_pvt_thread_mutex_unlock( &cache->c_lru_mutex );
-	/* free cache write lock */
-	ldap_pvt_thread_rdwr_wunlock( &cache->c_rwlock );
+	/* The shards only live as long as the database is open */
+	for ( i = 0; i <= cache->c_shardmask; i++ ) {
+		cs = &cache->c_shards[i];
+		ldap_pvt_thread_mutex_unlock( &cs->cs_lru_mutex );
+		ldap_pvt_thread_rdwr_wunlock( &cs->cs_rwlock );
+		ldap_pvt_thread_mutex_destroy( &cs->cs_count_mutex );
+		ldap_pvt_thread_mutex_destroy( &cs->cs_lru_mutex );
+		ldap_pvt_thread_rdwr_destroy( &cs->cs_rwlock );
+	}
+	ch_free( cache->c_shards );
+	cache->c_shards = NULL;
+	cache->c_shardmask = 0;
 }
 
 #ifdef LDAP_DEBUG
 static void
-bdb_lru_count( Cache *cache )
+bdb_lru_count( CacheShard *cs )
 {
 	EntryInfo	*e;
 	int ei = 0, ent = 0, nc = 0;
 
-	for ( e = cache->c_lrutail; ; ) {
+	for ( e = cs->cs_lrutail; ; ) {
 		ei++;
 		if ( e->bei_e ) {
 			ent++;
@@ -1560,16 +1804,16 @@ bdb_lru_count( Cache *cache )
 			fprintf( stderr, "ei %d entry %p dn %s\n", ei, (void *) e->bei_e, e->bei_e->e_name.bv_val );
 		}
 		e = e->bei_lrunext;
-		if ( e == cache->c_lrutail )
+		if ( e == cs->cs_lrutail )
 			break;
 	}
 	fprintf( stderr, "counted %d entryInfos and %d entries, %d notcached\n",
 		ei, ent, nc );
 	ei = 0;
-	for ( e = cache->c_lrutail; ; ) {
+	for ( e = cs->cs_lrutail; ; ) {
 		ei++;
 		e = e->bei_lruprev;
-		if ( e == cache->c_lrutail )
+		if ( e == cs->cs_lrutail )
 			break;
 	}
 	fprintf( stderr, "counted %d entryInfos (on lruprev)\n", ei );
@@ -1577,25 +1821,25 @@ bdb_lru_count( Cache *cache )
 
 #ifdef SLAPD_UNUSED
 static void
-bdb_lru_print( Cache *cache )
+bdb_lru_print( CacheShard *cs )
 {
 	EntryInfo	*e;
 
-	fprintf( stderr, "LRU circle head: %p\n", (void *) cache->c_lruhead );
+	fprintf( stderr, "LRU circle head: %p\n", (void *) cs->cs_lruhead );
 	fprintf( stderr, "LRU circle (tail forward):\n" );
-	for ( e = cache->c_lrutail; ; ) {
+	for ( e = cs->cs_lrutail; ; ) {
 		fprintf( stderr, "\t%p, %p id %ld rdn \"%s\"\n",
 			(void *) e, (void *) e->bei_e, e->bei_id, e->bei_nrdn.bv_val );
 		e = e->bei_lrunext;
-		if ( e == cache->c_lrutail )
+		if ( e == cs->cs_lrutail )
 			break;
 	}
 	fprintf( stderr, "LRU circle (tail backward):\n" );
-	for ( e = cache->c_lrutail; ; ) {
+	for ( e = cs->cs_lrutail; ; ) {
 		fprintf( stderr, "\t%p, %p id %ld rdn \"%s\"\n",
 			(void *) e, (void *) e->bei_e, e->bei_id, e->bei_nrdn.bv_val );
 		e = e->bei_lruprev;
-		if ( e == cache->c_lrutail )
+		if ( e == cs->cs_lrutail )
 			break;
 	}
 }
@@ -1610,9 +1854,9 @@ bdb_entryinfo_print(void *data, void *arg)
 }
 
 static void
-bdb_idtree_print(Cache *cache)
+bdb_idtree_print(CacheShard *cs)
 {
-	avl_apply( cache->c_idtree, bdb_entryinfo_print, NULL, -1, AVL_INORDER );
+	avl_apply( cs->cs_idtree, bdb_entryinfo_print, NULL, -1, AVL_INORDER );
 }
 #endif
 #endif
@@ -53,7 +53,9 @@ enum {
 	BDB_MODE,
 	BDB_PGSIZE,
 	BDB_CHECKSUM,
-	BDB_DISABLE_FULLFSYNC_MODE
+	BDB_DISABLE_FULLFSYNC_MODE,
+	BDB_CACHESHARDS,
+	BDB_CACHEPOLICY
 };
 
 static ConfigTable bdbcfg[] = {
@@ -67,11 +69,19 @@ static ConfigTable bdbcfg[] = {
 		"( OLcfgDbAt:1.11 NAME 'olcDbCacheFree' "
 			"DESC 'Number of extra entries to free when max is reached' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "cachepolicy", "policy", 2, 2, 0, ARG_MAGIC|BDB_CACHEPOLICY,
+		bdb_cf_gen, "( OLcfgDbAt:1.19 NAME 'olcDbCachePolicy' "
+			"DESC 'Replacement policy of the entry and IDL caches' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "cachesize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct bdb_info, bi_cache.c_maxsize),
 		"( OLcfgDbAt:1.1 NAME 'olcDbCacheSize' "
 			"DESC 'Entry cache size in entries' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "cacheshards", "count", 2, 2, 0, ARG_INT|ARG_MAGIC|BDB_CACHESHARDS,
+		bdb_cf_gen, "( OLcfgDbAt:1.18 NAME 'olcDbCacheShards' "
+			"DESC 'Number of entry cache partitions, 0 for automatic' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "checkpoint", "kbyte> <min", 3, 3, 0, ARG_MAGIC|BDB_CHKPT,
 		bdb_cf_gen, "( OLcfgDbAt:1.2 NAME 'olcDbCheckpoint' "
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
@@ -115,6 +125,11 @@ static ConfigTable bdbcfg[] = {
 		"( OLcfgDbAt:1.12 NAME 'olcDbDNcacheSize' "
 			"DESC 'DN cache size' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "idlbitmap", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct bdb_info, bi_idl_bitmap),
+		"( OLcfgDbAt:1.17 NAME 'olcDbIDLbitmap' "
+		"DESC 'Store large index slots as compressed bitmaps' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "idlcachesize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct bdb_info, bi_idl_cache_max_size),
 		"( OLcfgDbAt:1.6 NAME 'olcDbIDLcacheSize' "
@@ -173,9 +188,11 @@ static ConfigOCs bdbocs[] = {
 #endif
 		"SUP olcDatabaseConfig "
 		"MUST olcDbDirectory "
-		"MAY ( olcDbCacheSize $ olcDbCheckpoint $ olcDbConfig $ "
+		"MAY ( olcDbCacheSize $ olcDbCacheShards $ olcDbCachePolicy $ "
+		"olcDbCheckpoint $ "
+		"olcDbConfig $ "
 		"olcDbCryptFile $ olcDbCryptKey $ "
-		"olcDbNoSync $ olcDbDirtyRead $ olcDbIDLcacheSize $ "
+		"olcDbNoSync $ olcDbDirtyRead $ olcDbIDLcacheSize $ olcDbIDLbitmap $ "
 		"olcDbIndex $ olcDbLinearIndex $ olcDbLockDetect $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbShmKey $ "
 		"olcDbCacheFree $ olcDbDNcacheSize $ olcDbPageSize $ "
@@ -192,6 +209,12 @@ static slap_verbmasks bdb_lockd[] = {
 	{ BER_BVNULL, 0 }
 };
 
+static slap_verbmasks bdb_cachepolicy[] = {
+	{ BER_BVC("clock"), BDB_CACHE_CLOCK },
+	{ BER_BVC("arc"), BDB_CACHE_ARC },
+	{ BER_BVNULL, 0 }
+};
+
 /* perform periodic checkpoints */
 static void *
 bdb_checkpoint( void *ctx, void *arg )
@@ -516,6 +539,24 @@ bdb_cf_gen( ConfigArgs *c )
 			c->value_int = bdb->bi_search_stack_depth;
 			break;
 
+		case BDB_CACHESHARDS:
+			c->value_int = bdb->bi_cache.c_nshards;
+			break;
+
+		case BDB_CACHEPOLICY:
+			rc = 1;
+			if ( bdb->bi_cache_policy != BDB_CACHE_CLOCK ) {
+				int i;
+				for (i=0; !BER_BVISNULL(&bdb_cachepolicy[i].word); i++) {
+					if ( bdb->bi_cache_policy == bdb_cachepolicy[i].mask ) {
+						value_add_one( &c->rvalue_vals, &bdb_cachepolicy[i].word );
+						rc = 0;
+						break;
+					}
+				}
+			}
+			break;
+
 		case BDB_PGSIZE: {
 				struct bdb_db_pgsize *ps;
 				char buf[SLAP_TEXT_BUFLEN];
@@ -550,6 +591,18 @@ bdb_cf_gen( ConfigArgs *c )
 		case BDB_SSTACK:
 			break;
 
+		case BDB_CACHESHARDS:
+		case BDB_CACHEPOLICY:
+			if ( c->type == BDB_CACHESHARDS )
+				bdb->bi_cache.c_nshards = 0;
+			else
+				bdb->bi_cache_policy = BDB_CACHE_CLOCK;
+			if ( bdb->bi_flags & BDB_IS_OPEN ) {
+				bdb->bi_flags |= BDB_RE_OPEN;
+				c->cleanup = bdb_cf_cleanup;
+			}
+			break;
+
 		case BDB_CHKPT:
 			if ( bdb->bi_txn_cp_task ) {
 				struct re_s *re = bdb->bi_txn_cp_task;
@@ -929,6 +982,41 @@ bdb_cf_gen( ConfigArgs *c )
 		bdb->bi_search_stack_depth = c->value_int;
 		break;
 
+	case BDB_CACHESHARDS:
+		if ( c->value_int < 0 || c->value_int > BDB_CACHE_SHARDS_MAX ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: count must be between 0 and %d",
+				c->log, BDB_CACHE_SHARDS_MAX );
+			Debug( LDAP_DEBUG_ANY, "%s\n", c->cr_msg, 0, 0 );
+			return 1;
+		}
+		bdb->bi_cache.c_nshards = c->value_int;
+		/* The shards are only laid out when the database opens */
+		if ( bdb->bi_flags & BDB_IS_OPEN ) {
+			bdb->bi_flags |= BDB_RE_OPEN;
+			c->cleanup = bdb_cf_cleanup;
+		}
+		break;
+
+	case BDB_CACHEPOLICY:
+		rc = verb_to_mask( c->argv[1], bdb_cachepolicy );
+		if ( BER_BVISNULL(&bdb_cachepolicy[rc].word) ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: unknown policy \"%s\"",
+				c->log, c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s\n", c->cr_msg, 0, 0 );
+			return 1;
+		}
+		if ( bdb->bi_cache_policy != bdb_cachepolicy[rc].mask ) {
+			bdb->bi_cache_policy = bdb_cachepolicy[rc].mask;
+			/* Cached entries are not tracked for the other policy */
+			if ( bdb->bi_flags & BDB_IS_OPEN ) {
+				bdb->bi_flags |= BDB_RE_OPEN;
+				c->cleanup = bdb_cf_cleanup;
+			}
+		}
+		break;
+
 	case BDB_PGSIZE: {
 		struct bdb_db_pgsize *ps, **prev;
 		int i, s;
@@ -61,11 +61,30 @@ static int list_candidates(
 	Operation *op,
 	DB_TXN *rtxn,
 	Filter *flist,
-	int ftype,
 	ID *ids,
 	ID *tmp,
 	ID *stack );
 
+static int and_candidates(
+	Operation *op,
+	DB_TXN *rtxn,
+	Filter *flist,
+	ID *ids,
+	ID *tmp,
+	ID *stack );
+
+/* AND evaluation stops fetching index keys once the candidates left
+ * are few enough that testing them is cheaper than reading further
+ * IDLs: at most BDB_AND_TEST_MAX of them, or fewer than the estimated
+ * size of the next IDL divided by BDB_AND_TEST_RATIO.
+ */
+#define BDB_AND_TEST_MAX	16
+#define BDB_AND_TEST_RATIO	32
+
+/* Estimates for terms whose size cannot be probed */
+#define BDB_EST_UNKNOWN	(NOID-1)	/* indexed, size unknown */
+#define BDB_EST_ALL		NOID		/* matches every entry */
+
 static int
 ext_candidates(
         Operation *op,
@@ -195,14 +214,12 @@ bdb_filter_candidates(
 
 	case LDAP_FILTER_AND:
 		Debug( LDAP_DEBUG_FILTER, "\tAND\n", 0, 0, 0 );
-		rc = list_candidates( op, rtxn, 
-			f->f_and, LDAP_FILTER_AND, ids, tmp, stack );
+		rc = and_candidates( op, rtxn, f->f_and, ids, tmp, stack );
 		break;
 
 	case LDAP_FILTER_OR:
 		Debug( LDAP_DEBUG_FILTER, "\tOR\n", 0, 0, 0 );
-		rc = list_candidates( op, rtxn,
-			f->f_or, LDAP_FILTER_OR, ids, tmp, stack );
+		rc = list_candidates( op, rtxn, f->f_or, ids, tmp, stack );
 		break;
 	case LDAP_FILTER_EXT:
                 Debug( LDAP_DEBUG_FILTER, "\tEXT\n", 0, 0, 0 );
@@ -557,12 +574,304 @@ ext_candidates(
 	return 0;
 }
 
+/*
+ * Estimate the number of IDs an indexed assertion yields, from the
+ * sizes of its keys; as the keys are intersected, the smallest wins.
+ */
+static int
+keys_estimate(
+	Operation *op,
+	DB_TXN *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	MatchingRule *mr,
+	void *assertion,
+	ID *est )
+{
+	DB	*db;
+	int i;
+	int rc;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	ID n;
+
+	*est = BDB_EST_ALL;
+
+	rc = bdb_index_param( op->o_bd, desc, ftype, &db, &mask, &prefix );
+	if ( rc != LDAP_SUCCESS || mr == NULL || mr->smr_filter == NULL ) {
+		/* not indexed, all entries are candidates */
+		return 0;
+	}
+
+	*est = BDB_EST_UNKNOWN;
+
+	rc = (mr->smr_filter)( ftype, mask, desc->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL ) {
+		return 0;
+	}
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		rc = bdb_key_count( op->o_bd, db, rtxn, &keys[i], &n );
+		if ( rc == DB_NOTFOUND ) {
+			*est = 0;
+			rc = 0;
+			break;
+		} else if ( rc != 0 ) {
+			break;
+		}
+		if ( n < *est ) {
+			*est = n;
+		}
+		if ( n == 0 ) {
+			break;
+		}
+	}
+
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+
+	/* only a deadlock is worth reporting, the search will
+	 * find out about other errors on its own
+	 */
+	return rc == DB_LOCK_DEADLOCK ? rc : 0;
+}
+
+/*
+ * Cheaply estimate the number of candidates a filter yields,
+ * without reading any IDL
+ */
+static int
+filter_estimate(
+	Operation *op,
+	DB_TXN *rtxn,
+	Filter *f,
+	ID *est )
+{
+	AttributeDescription *desc;
+	struct berval prefix = {0, NULL};
+	slap_mask_t mask;
+	MatchingRule *mr;
+	DB *db;
+	ID n;
+	int rc = 0;
+
+	*est = BDB_EST_UNKNOWN;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		*est = 0;
+		return 0;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_TRUE ) {
+			*est = BDB_EST_ALL;
+		} else if ( f->f_result != LDAP_SUCCESS ) {
+			*est = 0;
+		}
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		*est = BDB_EST_ALL;
+		if ( f->f_desc == slap_schema.si_ad_objectClass ) {
+			break;
+		}
+		rc = bdb_index_param( op->o_bd, f->f_desc, LDAP_FILTER_PRESENT,
+			&db, &mask, &prefix );
+		if ( rc != LDAP_SUCCESS ) {
+			rc = 0;
+			break;
+		}
+		rc = bdb_key_count( op->o_bd, db, rtxn, &prefix, &n );
+		if ( rc == 0 ) {
+			*est = n;
+		} else if ( rc == DB_NOTFOUND ) {
+			*est = 0;
+			rc = 0;
+		} else if ( rc != DB_LOCK_DEADLOCK ) {
+			*est = BDB_EST_UNKNOWN;
+			rc = 0;
+		}
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+		desc = f->f_ava->aa_desc;
+		if ( desc == slap_schema.si_ad_entryDN ) {
+			*est = 1;
+			break;
+		}
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( desc ) ) {
+			break;
+		}
+#endif
+		rc = keys_estimate( op, rtxn, desc, LDAP_FILTER_EQUALITY,
+			desc->ad_type->sat_equality, &f->f_ava->aa_value, est );
+		break;
+
+	case LDAP_FILTER_APPROX:
+		desc = f->f_ava->aa_desc;
+		mr = desc->ad_type->sat_approx;
+		if ( !mr ) {
+			mr = desc->ad_type->sat_equality;
+		}
+		rc = keys_estimate( op, rtxn, desc, LDAP_FILTER_APPROX,
+			mr, &f->f_ava->aa_value, est );
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		rc = keys_estimate( op, rtxn, desc, LDAP_FILTER_SUBSTRINGS,
+			desc->ad_type->sat_substr, f->f_sub, est );
+		break;
+
+	case LDAP_FILTER_NOT:
+		*est = BDB_EST_ALL;
+		break;
+
+	default:
+		/* nested ANDs and ORs are not descended into, probing
+		 * them would cost about as much as evaluating them;
+		 * inequalities and extensible matches are not probed
+		 */
+		break;
+	}
+
+	return rc;
+}
+
+typedef struct bdb_and_term {
+	Filter	*at_f;
+	ID	at_est;
+} bdb_and_term;
+
+/*
+ * Intersect the candidates of the terms of an AND, smallest
+ * estimated first, and stop once the intersection is small
+ * enough that the remaining terms are better left to the
+ * filter test of each candidate.
+ */
+static int
+and_candidates(
+	Operation *op,
+	DB_TXN *rtxn,
+	Filter	*flist,
+	ID *ids,
+	ID *tmp,
+	ID *save )
+{
+	struct bdb_info *bdb = (struct bdb_info *) op->o_bd->be_private;
+	bdb_and_term *terms, t;
+	Filter	*f;
+	int rc = 0, i, j, n = 0, nterms, empty = 1;
+
+	Debug( LDAP_DEBUG_FILTER, "=> bdb_and_candidates\n", 0, 0, 0 );
+
+	for ( f = flist; f != NULL; f = f->f_next ) {
+		/* a precomputed scope is already in ids */
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS ) {
+			empty = 0;
+			continue;
+		}
+		n++;
+	}
+
+	terms = op->o_tmpalloc( ( n ? n : 1 ) * sizeof( bdb_and_term ),
+		op->o_tmpmemctx );
+
+	/* estimate each term, insertion sort by estimate; a single
+	 * term has nothing to be ordered against
+	 */
+	nterms = n;
+	for ( n = 0, f = flist; f != NULL; f = f->f_next ) {
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS ) {
+			continue;
+		}
+		t.at_f = f;
+		t.at_est = BDB_EST_UNKNOWN;
+		if ( nterms > 1 ) {
+			rc = filter_estimate( op, rtxn, f, &t.at_est );
+			if ( rc == DB_LOCK_DEADLOCK ) {
+				goto done;
+			}
+		}
+		for ( j = n++; j > 0 && terms[j - 1].at_est > t.at_est; j-- ) {
+			terms[j] = terms[j - 1];
+		}
+		terms[j] = t;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( terms[i].at_est == 0 ) {
+			BDB_IDL_ZERO( ids );
+			empty = 0;
+			break;
+		}
+
+		/* the remaining terms match all entries */
+		if ( terms[i].at_est == BDB_EST_ALL ) {
+			break;
+		}
+
+		if ( !empty ) {
+			ID left = BDB_IDL_N( ids );
+
+			if ( left <= BDB_AND_TEST_MAX ||
+				( terms[i].at_est != BDB_EST_UNKNOWN &&
+					terms[i].at_est / BDB_AND_TEST_RATIO > left ) )
+			{
+				Debug( LDAP_DEBUG_FILTER,
+					"bdb_and_candidates: %ld candidates left, "
+					"skipping %d terms\n", (long) left, n - i, 0 );
+				break;
+			}
+		}
+
+		BDB_IDL_ZERO( save );
+		rc = bdb_filter_candidates( op, rtxn, terms[i].at_f, save, tmp,
+			save+BDB_IDL_UM_SIZE );
+
+		if ( rc != 0 ) {
+			if ( rc == DB_LOCK_DEADLOCK )
+				goto done;
+			rc = 0;
+			continue;
+		}
+
+		if ( empty ) {
+			BDB_IDL_CPY( ids, save );
+			empty = 0;
+		} else {
+			bdb_idl_intersection( ids, save );
+		}
+		if( BDB_IDL_IS_ZERO( ids ) )
+			break;
+	}
+
+	/* nothing narrowed the candidates */
+	if ( empty ) {
+		BDB_IDL_ALL( bdb, ids );
+	}
+
+	Debug( LDAP_DEBUG_FILTER,
+		"<= bdb_and_candidates: id=%ld first=%ld last=%ld\n",
+		(long) ids[0],
+		(long) BDB_IDL_FIRST(ids),
+		(long) BDB_IDL_LAST(ids) );
+
+done:
+	op->o_tmpfree( terms, op->o_tmpmemctx );
+	return rc;
+}
+
 static int
 list_candidates(
 	Operation *op,
 	DB_TXN *rtxn,
 	Filter	*flist,
-	int		ftype,
 	ID *ids,
 	ID *tmp,
 	ID *save )
@@ -570,7 +879,9 @@ list_candidates(
 	int rc = 0;
 	Filter	*f;
 
-	Debug( LDAP_DEBUG_FILTER, "=> bdb_list_candidates 0x%x\n", ftype, 0, 0 );
+	/* ANDs are handled by and_candidates() */
+	Debug( LDAP_DEBUG_FILTER, "=> bdb_list_candidates 0x%lx\n",
+		(unsigned long) LDAP_FILTER_OR, 0, 0 );
 	for ( f = flist; f != NULL; f = f->f_next ) {
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
@@ -582,31 +893,13 @@ list_candidates(
 			save+BDB_IDL_UM_SIZE );
 
 		if ( rc != 0 ) {
-			if ( rc == DB_LOCK_DEADLOCK )
-				return rc;
-
-			if ( ftype == LDAP_FILTER_AND ) {
-				rc = 0;
-				continue;
-			}
 			break;
 		}
 
-		
-		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
-				BDB_IDL_CPY( ids, save );
-			} else {
-				bdb_idl_intersection( ids, save );
-			}
-			if( BDB_IDL_IS_ZERO( ids ) )
-				break;
+		if ( f == flist ) {
+			BDB_IDL_CPY( ids, save );
 		} else {
-			if ( f == flist ) {
-				BDB_IDL_CPY( ids, save );
-			} else {
-				bdb_idl_union( ids, save );
-			}
+			bdb_idl_union( ids, save );
 		}
 	}
 
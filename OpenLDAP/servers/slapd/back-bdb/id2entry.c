@@ -90,10 +90,176 @@ int bdb_id2entry_update(
 	return bdb_id2entry_put(be, tid, e, 0);
 }
 
-int bdb_id2entry(
+/* Records up to this size are read with a single lookup into a
+ * buffer kept by each thread, and copied from there into the entry.
+ * Larger ones are sized first and read straight into the entry.
+ */
+#define	BDB_ID2ENTRY_BUFSIZE	(16*1024)
+
+static void
+bdb_id2entry_buf_free( void *key, void *data )
+{
+	ch_free( data );
+}
+
+static char *
+bdb_id2entry_buf( void *ctx )
+{
+	void *buf = NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)bdb_id2entry_buf,
+		&buf, NULL )) {
+		buf = ch_malloc( BDB_ID2ENTRY_BUFSIZE );
+		if ( ldap_pvt_thread_pool_setkey( ctx, (void *)bdb_id2entry_buf,
+			buf, bdb_id2entry_buf_free, NULL, NULL )) {
+			ch_free( buf );
+			buf = NULL;
+		}
+	}
+	return buf;
+}
+
+/* free up the buffer used by the main thread */
+void
+bdb_id2entry_flush( void )
+{
+	void *data;
+	void *ctx = ldap_pvt_thread_pool_context();
+
+	if ( !ldap_pvt_thread_pool_getkey( ctx, (void *)bdb_id2entry_buf,
+		&data, NULL )) {
+		ldap_pvt_thread_pool_setkey( ctx, (void *)bdb_id2entry_buf,
+			NULL, 0, NULL, NULL );
+		bdb_id2entry_buf_free( NULL, data );
+	}
+}
+
+/* The most attribute types a filter may use to be checked
+ * before the entry is decoded
+ */
+#define	BDB_FILTER_TYPES	32
+
+static int
+bdb_filter_addtype( AttributeType *at, BerVarray types, int *ntypes )
+{
+	int i;
+
+	for ( i = 0; i < *ntypes; i++ ) {
+		if ( types[i].bv_val == at->sat_cname.bv_val )
+			return 0;
+	}
+	if ( *ntypes == BDB_FILTER_TYPES )
+		return -1;
+	types[(*ntypes)++] = at->sat_cname;
+
+	/* values of subtypes match the supertype too */
+	if ( at->sat_subtypes ) {
+		for ( i = 0; at->sat_subtypes[i]; i++ ) {
+			if ( bdb_filter_addtype( at->sat_subtypes[i], types, ntypes ))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Collect the attribute types the filter uses. Returns -1 if the
+ * filter can't be evaluated on the stored attributes alone.
+ */
+static int
+bdb_filter_types( Filter *f, BerVarray types, int *ntypes )
+{
+	AttributeDescription *ad;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( bdb_filter_types( f, types, ntypes ))
+				return -1;
+		}
+		return 0;
+
+	case LDAP_FILTER_NOT:
+		return bdb_filter_types( f->f_not, types, ntypes );
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs )
+			return -1;
+		ad = f->f_mr_desc;
+		break;
+
+	default:
+		return -1;
+	}
+
+	/* hasSubordinates is computed, and undefined types
+	 * may be stored under any name
+	 */
+	if ( !ad || ad == slap_schema.si_ad_hasSubordinates ||
+		ad->ad_type == slap_schema.si_at_undefined ||
+		ad->ad_type == slap_schema.si_at_proxied )
+		return -1;
+
+	return bdb_filter_addtype( ad->ad_type, types, ntypes );
+}
+
+/* Check the stored entry against the filter, decoding only the
+ * attributes it uses. Returns LDAP_COMPARE_FALSE if the entry cannot
+ * match and is not a referral, which search returns regardless.
+ */
+static int
+bdb_id2entry_test( EntryHeader *eh, Filter *f )
+{
+	struct berval types[BDB_FILTER_TYPES + 1];
+	Entry *e;
+	int ntypes = 0, rc;
+
+	types[ntypes++] = slap_schema.si_ad_objectClass->ad_cname;
+	if ( bdb_filter_types( f, types, &ntypes ))
+		return LDAP_COMPARE_TRUE;
+	BER_BVZERO( &types[ntypes] );
+
+	if ( entry_decode_attrs( eh, &e, types ))
+		return LDAP_COMPARE_TRUE;
+
+	/* Without ACLs the result can only be more defined, so an
+	 * entry that doesn't match here won't match the real test.
+	 */
+	rc = test_filter( NULL, e, f );
+	if ( rc == LDAP_COMPARE_TRUE || is_entry_referral( e ))
+		rc = LDAP_COMPARE_TRUE;
+	else
+		rc = LDAP_COMPARE_FALSE;
+
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+	entry_free( e );
+	return rc;
+}
+
+static int bdb_id2entry_get(
 	BackendDB *be,
 	DB_TXN *tid,
 	ID id,
+	Filter *f,
 	Entry **e )
 {
 	struct bdb_info *bdb = (struct bdb_info *) be->be_private;
@@ -101,7 +267,7 @@ int bdb_id2entry(
 	DBT key, data;
 	DBC *cursor;
 	EntryHeader eh;
-	char buf[16];
+	char hdr[16], *buf;
 	int rc = 0, off;
 	ID nid;
 
@@ -119,19 +285,38 @@ int bdb_id2entry(
 	rc = db->cursor( db, tid, &cursor, bdb->bi_db_opflags );
 	if ( rc ) return rc;
 
-	/* Get the nattrs / nvals counts first */
-	data.ulen = data.dlen = sizeof(buf);
-	data.data = buf;
+	/* Get the nattrs / nvals counts first, and the rest of
+	 * the record along with them if it is small enough.
+	 */
+	buf = bdb_id2entry_buf( ldap_pvt_thread_pool_context() );
+	if ( buf ) {
+		data.ulen = data.dlen = BDB_ID2ENTRY_BUFSIZE;
+		data.data = buf;
+	} else {
+		data.ulen = data.dlen = sizeof(hdr);
+		data.data = hdr;
+	}
 	rc = cursor->c_get( cursor, &key, &data, DB_SET );
 	if ( rc ) goto finish;
 
 
-	eh.bv.bv_val = buf;
+	eh.bv.bv_val = data.data;
 	eh.bv.bv_len = data.size;
 	rc = entry_header( &eh );
 	if ( rc ) goto finish;
 
-	if ( eh.nvals ) {
+	if ( eh.nvals && data.size < data.dlen ) {
+		/* We got all of it, no need to look it up again */
+		off = eh.data - eh.bv.bv_val;
+		eh.bv.bv_len = eh.nvals * sizeof( struct berval ) + data.size;
+		eh.bv.bv_val = ch_malloc( eh.bv.bv_len );
+		eh.data = eh.bv.bv_val + eh.nvals * sizeof( struct berval );
+		AC_MEMCPY( eh.data, data.data, data.size );
+
+		/* skip past already parsed nattr/nvals */
+		eh.data += off;
+
+	} else if ( eh.nvals ) {
 		/* Get the size */
 		data.flags ^= DB_DBT_PARTIAL;
 		data.ulen = 0;
@@ -159,6 +344,12 @@ finish:
 		return rc;
 	}
 
+	if ( eh.nvals && f &&
+		bdb_id2entry_test( &eh, f ) == LDAP_COMPARE_FALSE ) {
+		ch_free( eh.bv.bv_val );
+		return LDAP_COMPARE_FALSE;
+	}
+
 	if ( eh.nvals ) {
 #ifdef SLAP_ZONE_ALLOC
 		rc = entry_decode(&eh, e, bdb->bi_cache.c_zctx);
@@ -186,6 +377,28 @@ finish:
 	return rc;
 }
 
+int bdb_id2entry(
+	BackendDB *be,
+	DB_TXN *tid,
+	ID id,
+	Entry **e )
+{
+	return bdb_id2entry_get( be, tid, id, NULL, e );
+}
+
+/* Like bdb_id2entry, but returns LDAP_COMPARE_FALSE without
+ * decoding the whole entry if it cannot match the filter.
+ */
+int bdb_id2entry_filter(
+	BackendDB *be,
+	DB_TXN *tid,
+	ID id,
+	Filter *f,
+	Entry **e )
+{
+	return bdb_id2entry_get( be, tid, id, f, e );
+}
+
 int bdb_id2entry_delete(
 	BackendDB *be,
 	DB_TXN *tid,
@@ -215,7 +428,8 @@ int bdb_entry_return(
 	/* Our entries are allocated in two blocks; the data comes from
 	 * the db itself and the Entry structure and associated pointers
 	 * are allocated in entry_decode. The db data pointer is saved
-	 * in e_bv.
+	 * in e_bv. Tool mode entries own their read buffer as well, since
+	 * reindex batches and slapcat keep several entries at a time.
 	 */
 	if ( e->e_bv.bv_val ) {
 		/* See if the DNs were changed by modrdn */
@@ -226,10 +440,7 @@ int bdb_entry_return(
 		}
 		e->e_name.bv_val = NULL;
 		e->e_nname.bv_val = NULL;
-		/* In tool mode the e_bv buffer is realloc'd, leave it alone */
-		if( !(slapMode & SLAP_TOOL_MODE) ) {
-			free( e->e_bv.bv_val );
-		}
+		free( e->e_bv.bv_val );
 		BER_BVZERO( &e->e_bv );
 	}
 	entry_free( e );
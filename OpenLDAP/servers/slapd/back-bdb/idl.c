@@ -167,6 +167,10 @@ int bdb_idl_insert( ID *ids, ID id )
 	idl_check( ids );
 #endif
 
+	/* Bitmaps aren't updated in place, fall back to their bounds */
+	if (BDB_IDL_IS_BITMAP( ids ))
+		ids[0] = NOID;
+
 	if (BDB_IDL_IS_RANGE( ids )) {
 		/* if already in range, treat as a dup */
 		if (id >= BDB_IDL_RANGE_FIRST(ids) && id <= BDB_IDL_RANGE_LAST(ids))
@@ -228,6 +232,9 @@ int bdb_idl_delete( ID *ids, ID id )
 	idl_check( ids );
 #endif
 
+	if (BDB_IDL_IS_BITMAP( ids ))
+		ids[0] = NOID;
+
 	if (BDB_IDL_IS_RANGE( ids )) {
 		/* If deleting a range boundary, adjust */
 		if ( ids[1] == id )
@@ -288,6 +295,218 @@ bdb_show_key(
 	}
 }
 
+/*
+ * The ARC policy (in its CAR form, with clocks instead of LRU lists)
+ * keeps cached IDLs on two circular lists: T1 for keys seen once and
+ * T2 for keys seen again. Evicted keys stay in the tree without their
+ * IDL on the ghost lists B1 and B2. A lookup that finds a ghost moves
+ * the target length of T1 towards the side it was evicted from, so a
+ * scan of many one-time keys only cycles through T1. All lists are
+ * linked through the same pointers as the clock list, with the oldest
+ * entry at the head. Callers must hold both IDL cache locks.
+ */
+static void
+idl_arc_add( struct bdb_info *bdb, bdb_idl_cache_entry_t *ee, int list )
+{
+	bdb_idl_cache_entry_t **head = &bdb->bi_idl_arc[list];
+
+	if ( *head ) {
+		ee->idl_lru_next = *head;
+		ee->idl_lru_prev = (*head)->idl_lru_prev;
+		(*head)->idl_lru_prev->idl_lru_next = ee;
+		(*head)->idl_lru_prev = ee;
+	} else {
+		ee->idl_lru_next = ee->idl_lru_prev = ee;
+		*head = ee;
+	}
+	ee->idl_list = list;
+	bdb->bi_idl_arc_len[list]++;
+}
+
+static void
+idl_arc_del( struct bdb_info *bdb, bdb_idl_cache_entry_t *ee )
+{
+	bdb_idl_cache_entry_t **head = &bdb->bi_idl_arc[ee->idl_list];
+
+	if ( ee->idl_lru_next == ee ) {
+		*head = NULL;
+	} else {
+		if ( *head == ee )
+			*head = ee->idl_lru_next;
+		ee->idl_lru_next->idl_lru_prev = ee->idl_lru_prev;
+		ee->idl_lru_prev->idl_lru_next = ee->idl_lru_next;
+	}
+	bdb->bi_idl_arc_len[ee->idl_list]--;
+}
+
+/* Free one cached IDL, turning its entry into a ghost */
+static void
+idl_arc_replace( struct bdb_info *bdb )
+{
+	bdb_idl_cache_entry_t *ee;
+	int list;
+
+	for (;;) {
+		if ( bdb->bi_idl_arc_len[IDL_CACHE_T1] >=
+			IDL_MAX( 1, bdb->bi_idl_arc_p ))
+			list = IDL_CACHE_T1;
+		else
+			list = IDL_CACHE_T2;
+		if ( !bdb->bi_idl_arc[list] )
+			list ^= 1;
+		ee = bdb->bi_idl_arc[list];
+		if ( !ee )
+			return;
+
+		/* Referenced entries get another round on T2 */
+		if ( ee->idl_flags & CACHE_ENTRY_REFERENCED ) {
+			ee->idl_flags ^= CACHE_ENTRY_REFERENCED;
+			idl_arc_del( bdb, ee );
+			idl_arc_add( bdb, ee, IDL_CACHE_T2 );
+			continue;
+		}
+		idl_arc_del( bdb, ee );
+		ch_free( ee->idl );
+		ee->idl = NULL;
+		idl_arc_add( bdb, ee, list + IDL_CACHE_B1 );
+		--bdb->bi_idl_cache_size;
+		return;
+	}
+}
+
+/* Drop the oldest ghost of a list */
+static void
+idl_arc_forget( struct bdb_info *bdb, int list )
+{
+	bdb_idl_cache_entry_t *ee = bdb->bi_idl_arc[list];
+
+	if ( !ee )
+		return;
+	idl_arc_del( bdb, ee );
+	if ( avl_delete( &bdb->bi_idl_tree, (caddr_t) ee,
+		bdb_idl_entry_cmp ) == NULL ) {
+		Debug( LDAP_DEBUG_ANY, "=> bdb_idl_cache_put: "
+			"AVL delete failed\n",
+			0, 0, 0 );
+	}
+	ch_free( ee->kstr.bv_val );
+	ch_free( ee );
+}
+
+static void
+bdb_idl_cache_arc_put(
+	struct bdb_info	*bdb,
+	DB			*db,
+	struct berval	*kstr,
+	ID			*ids )
+{
+	bdb_idl_cache_entry_t idl_tmp, *ee;
+	ID *len = bdb->bi_idl_arc_len, c = bdb->bi_idl_cache_max_size;
+	ID *idl, delta;
+
+	idl = (ID*) ch_malloc( BDB_IDL_SIZEOF ( ids ) );
+	BDB_IDL_CPY( idl, ids );
+
+	idl_tmp.db = db;
+	idl_tmp.kstr = *kstr;
+	ldap_pvt_thread_rdwr_wlock( &bdb->bi_idl_tree_rwlock );
+	ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
+	ee = avl_find( bdb->bi_idl_tree, &idl_tmp, bdb_idl_entry_cmp );
+	if ( ee && ee->idl ) {
+		/* Another thread cached it first */
+		ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
+		ldap_pvt_thread_rdwr_wunlock( &bdb->bi_idl_tree_rwlock );
+		ch_free( idl );
+		return;
+	}
+
+	if ( bdb->bi_idl_cache_size >= c )
+		idl_arc_replace( bdb );
+
+	if ( ee ) {
+		/* Evicted too soon, grow the side it was evicted from */
+		if ( ee->idl_list == IDL_CACHE_B1 ) {
+			delta = IDL_MAX( 1, len[IDL_CACHE_B2] / len[IDL_CACHE_B1] );
+			bdb->bi_idl_arc_p = IDL_MIN( c, bdb->bi_idl_arc_p + delta );
+		} else {
+			delta = IDL_MAX( 1, len[IDL_CACHE_B1] / len[IDL_CACHE_B2] );
+			bdb->bi_idl_arc_p = bdb->bi_idl_arc_p > delta ?
+				bdb->bi_idl_arc_p - delta : 0;
+		}
+		idl_arc_del( bdb, ee );
+		idl_arc_add( bdb, ee, IDL_CACHE_T2 );
+	} else {
+		/* Keep at most c ghosts, and c keys seen once */
+		if ( len[IDL_CACHE_T1] + len[IDL_CACHE_B1] >= c ) {
+			idl_arc_forget( bdb, IDL_CACHE_B1 );
+		} else if ( len[IDL_CACHE_T1] + len[IDL_CACHE_T2] +
+			len[IDL_CACHE_B1] + len[IDL_CACHE_B2] >= 2 * c ) {
+			idl_arc_forget( bdb, IDL_CACHE_B2 );
+		}
+		ee = (bdb_idl_cache_entry_t *) ch_malloc(
+			sizeof( bdb_idl_cache_entry_t ) );
+		ee->db = db;
+		ber_dupbv( &ee->kstr, kstr );
+		avl_insert( &bdb->bi_idl_tree, (caddr_t) ee,
+			bdb_idl_entry_cmp, avl_dup_error );
+		idl_arc_add( bdb, ee, IDL_CACHE_T1 );
+	}
+	ee->idl = idl;
+	ee->idl_flags = 0;
+	bdb->bi_idl_cache_size++;
+	ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
+	ldap_pvt_thread_rdwr_wunlock( &bdb->bi_idl_tree_rwlock );
+}
+
+/* Unlink an entry from the replacement lists. Caller must hold both
+ * IDL cache locks.
+ */
+static void
+bdb_idl_cache_unlink(
+	struct bdb_info	*bdb,
+	bdb_idl_cache_entry_t *ee )
+{
+	if ( ee->idl )
+		--bdb->bi_idl_cache_size;
+	if ( bdb->bi_cache_policy == BDB_CACHE_ARC ) {
+		idl_arc_del( bdb, ee );
+	} else {
+		IDL_LRU_DELETE( bdb, ee );
+	}
+}
+
+/* The counting stripe of the calling thread.  Thread contexts live
+ * on distinct thread stacks; a multiplicative hash spreads them.
+ */
+static bdb_idl_count *
+bdb_idl_count_stripe( struct bdb_info *bdb )
+{
+	unsigned long h = (unsigned long) ldap_pvt_thread_pool_context();
+
+	h = ( h >> 4 ) * 0x9e3779b1UL;
+	return &bdb->bi_idl_counts[ ( h >> 28 ) % IDL_COUNT_STRIPES ];
+}
+
+/* Sum the hits and misses of all stripes */
+void
+bdb_idl_cache_counts(
+	struct bdb_info	*bdb,
+	unsigned long	*hits,
+	unsigned long	*misses )
+{
+	bdb_idl_count *ic;
+	int i;
+
+	*hits = *misses = 0;
+	for ( i = 0; i < IDL_COUNT_STRIPES; i++ ) {
+		ic = &bdb->bi_idl_counts[i];
+		ldap_pvt_thread_mutex_lock( &ic->ic_mutex );
+		*hits += ic->ic_hits;
+		*misses += ic->ic_misses;
+		ldap_pvt_thread_mutex_unlock( &ic->ic_mutex );
+	}
+}
+
 /* Find a db/key pair in the IDL cache. If ids is non-NULL,
  * copy the cached IDL into it, otherwise just return the status.
  */
@@ -300,6 +519,7 @@ bdb_idl_cache_get(
 {
 	bdb_idl_cache_entry_t idl_tmp;
 	bdb_idl_cache_entry_t *matched_idl_entry;
+	bdb_idl_count *ic;
 	int rc = LDAP_NO_SUCH_OBJECT;
 
 	DBT2bv( key, &idl_tmp.kstr );
@@ -307,7 +527,9 @@ bdb_idl_cache_get(
 	ldap_pvt_thread_rdwr_rlock( &bdb->bi_idl_tree_rwlock );
 	matched_idl_entry = avl_find( bdb->bi_idl_tree, &idl_tmp,
 				      bdb_idl_entry_cmp );
-	if ( matched_idl_entry != NULL ) {
+	/* Ghosts only remember the key */
+	if ( matched_idl_entry != NULL &&
+		matched_idl_entry->idl_list < IDL_CACHE_B1 ) {
 		if ( matched_idl_entry->idl && ids )
 			BDB_IDL_CPY( ids, matched_idl_entry->idl );
 		matched_idl_entry->idl_flags |= CACHE_ENTRY_REFERENCED;
@@ -318,6 +540,47 @@ bdb_idl_cache_get(
 	}
 	ldap_pvt_thread_rdwr_runlock( &bdb->bi_idl_tree_rwlock );
 
+	ic = bdb_idl_count_stripe( bdb );
+	ldap_pvt_thread_mutex_lock( &ic->ic_mutex );
+	if ( rc == LDAP_NO_SUCH_OBJECT )
+		ic->ic_misses++;
+	else
+		ic->ic_hits++;
+	ldap_pvt_thread_mutex_unlock( &ic->ic_mutex );
+
+	return rc;
+}
+
+/* Count the IDs of a cached IDL, without copying it */
+static int
+bdb_idl_cache_count(
+	struct bdb_info	*bdb,
+	DB			*db,
+	DBT			*key,
+	ID			*count )
+{
+	bdb_idl_cache_entry_t idl_tmp;
+	bdb_idl_cache_entry_t *matched_idl_entry;
+	int rc = LDAP_NO_SUCH_OBJECT;
+
+	DBT2bv( key, &idl_tmp.kstr );
+	idl_tmp.db = db;
+	ldap_pvt_thread_rdwr_rlock( &bdb->bi_idl_tree_rwlock );
+	matched_idl_entry = avl_find( bdb->bi_idl_tree, &idl_tmp,
+				      bdb_idl_entry_cmp );
+	/* Ghosts only remember the key */
+	if ( matched_idl_entry != NULL &&
+		matched_idl_entry->idl_list < IDL_CACHE_B1 ) {
+		if ( matched_idl_entry->idl ) {
+			*count = BDB_IDL_N( matched_idl_entry->idl );
+			rc = 0;
+		} else {
+			*count = 0;
+			rc = DB_NOTFOUND;
+		}
+	}
+	ldap_pvt_thread_rdwr_runlock( &bdb->bi_idl_tree_rwlock );
+
 	return rc;
 }
 
@@ -337,6 +600,11 @@ bdb_idl_cache_put(
 
 	DBT2bv( key, &idl_tmp.kstr );
 
+	if ( bdb->bi_cache_policy == BDB_CACHE_ARC ) {
+		bdb_idl_cache_arc_put( bdb, db, &idl_tmp.kstr, ids );
+		return;
+	}
+
 	ee = (bdb_idl_cache_entry_t *) ch_malloc(
 		sizeof( bdb_idl_cache_entry_t ) );
 	ee->db = db;
@@ -346,6 +614,7 @@ bdb_idl_cache_put(
 	ee->idl_lru_prev = NULL;
 	ee->idl_lru_next = NULL;
 	ee->idl_flags = 0;
+	ee->idl_list = IDL_CACHE_T1;
 	ber_dupbv( &ee->kstr, &idl_tmp.kstr );
 	ldap_pvt_thread_rdwr_wlock( &bdb->bi_idl_tree_rwlock );
 	if ( avl_insert( &bdb->bi_idl_tree, (caddr_t) ee,
@@ -427,9 +696,8 @@ bdb_idl_cache_del(
 				"AVL delete failed\n",
 				0, 0, 0 );
 		}
-		--bdb->bi_idl_cache_size;
 		ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
-		IDL_LRU_DELETE( bdb, matched_idl_entry );
+		bdb_idl_cache_unlink( bdb, matched_idl_entry );
 		ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
 		free( matched_idl_entry->kstr.bv_val );
 		if ( matched_idl_entry->idl )
@@ -439,6 +707,28 @@ bdb_idl_cache_del(
 	ldap_pvt_thread_rdwr_wunlock( &bdb->bi_idl_tree_rwlock );
 }
 
+/* Remove an entry from the IDL cache. Caller must hold the tree
+ * write lock.
+ */
+static void
+bdb_idl_cache_drop(
+	struct bdb_info	*bdb,
+	bdb_idl_cache_entry_t *cache_entry )
+{
+	if ( avl_delete( &bdb->bi_idl_tree, (caddr_t) cache_entry,
+				bdb_idl_entry_cmp ) == NULL ) {
+		Debug( LDAP_DEBUG_ANY, "=> bdb_idl_cache_del: "
+			"AVL delete failed\n",
+			0, 0, 0 );
+	}
+	ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
+	bdb_idl_cache_unlink( bdb, cache_entry );
+	ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
+	free( cache_entry->kstr.bv_val );
+	free( cache_entry->idl );
+	free( cache_entry );
+}
+
 void
 bdb_idl_cache_add_id(
 	struct bdb_info	*bdb,
@@ -452,7 +742,16 @@ bdb_idl_cache_add_id(
 	ldap_pvt_thread_rdwr_wlock( &bdb->bi_idl_tree_rwlock );
 	cache_entry = avl_find( bdb->bi_idl_tree, &idl_tmp,
 				      bdb_idl_entry_cmp );
-	if ( cache_entry != NULL ) {
+	if ( cache_entry != NULL && !cache_entry->idl )
+		cache_entry = NULL;
+	if ( cache_entry != NULL && ( BDB_IDL_IS_BITMAP( cache_entry->idl ) ||
+		( bdb->bi_idl_bitmap && ( BDB_IDL_IS_RANGE( cache_entry->idl ) ||
+		cache_entry->idl[0] >= BDB_IDL_DB_MAX - 1 )))) {
+		/* Don't degrade an exact set to a range; refetching
+		 * will pick up the bitmap instead.
+		 */
+		bdb_idl_cache_drop( bdb, cache_entry );
+	} else if ( cache_entry != NULL ) {
 		if ( !BDB_IDL_IS_RANGE( cache_entry->idl ) &&
 			cache_entry->idl[0] < BDB_IDL_DB_MAX ) {
 			size_t s = BDB_IDL_SIZEOF( cache_entry->idl ) + sizeof(ID);
@@ -476,27 +775,48 @@ bdb_idl_cache_del_id(
 	ldap_pvt_thread_rdwr_wlock( &bdb->bi_idl_tree_rwlock );
 	cache_entry = avl_find( bdb->bi_idl_tree, &idl_tmp,
 				      bdb_idl_entry_cmp );
-	if ( cache_entry != NULL ) {
-		bdb_idl_delete( cache_entry->idl, id );
-		if ( cache_entry->idl[0] == 0 ) {
-			if ( avl_delete( &bdb->bi_idl_tree, (caddr_t) cache_entry,
-						bdb_idl_entry_cmp ) == NULL ) {
-				Debug( LDAP_DEBUG_ANY, "=> bdb_idl_cache_del: "
-					"AVL delete failed\n",
-					0, 0, 0 );
-			}
-			--bdb->bi_idl_cache_size;
-			ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
-			IDL_LRU_DELETE( bdb, cache_entry );
-			ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
-			free( cache_entry->kstr.bv_val );
-			free( cache_entry->idl );
-			free( cache_entry );
-		}
+	if ( cache_entry != NULL && cache_entry->idl ) {
+		if ( !BDB_IDL_IS_BITMAP( cache_entry->idl ))
+			bdb_idl_delete( cache_entry->idl, id );
+		if ( BDB_IDL_IS_BITMAP( cache_entry->idl ) ||
+			cache_entry->idl[0] == 0 )
+			bdb_idl_cache_drop( bdb, cache_entry );
 	}
 	ldap_pvt_thread_rdwr_wunlock( &bdb->bi_idl_tree_rwlock );
 }
 
+static void
+bdb_idl_cache_entry_free( void *ptr )
+{
+	bdb_idl_cache_entry_t *ee = ptr;
+
+	ch_free( ee->kstr.bv_val );
+	if ( ee->idl )
+		ch_free( ee->idl );
+	ch_free( ee );
+}
+
+/* Free the whole IDL cache when the database is closed */
+void
+bdb_idl_cache_release_all( struct bdb_info *bdb )
+{
+	int i;
+
+	avl_free( bdb->bi_idl_tree, bdb_idl_cache_entry_free );
+	bdb->bi_idl_tree = NULL;
+	bdb->bi_idl_lru_head = bdb->bi_idl_lru_tail = NULL;
+	for ( i = 0; i < IDL_CACHE_LISTS; i++ ) {
+		bdb->bi_idl_arc[i] = NULL;
+		bdb->bi_idl_arc_len[i] = 0;
+	}
+	bdb->bi_idl_arc_p = 0;
+	bdb->bi_idl_cache_size = 0;
+	for ( i = 0; i < IDL_COUNT_STRIPES; i++ ) {
+		bdb->bi_idl_counts[i].ic_hits = 0;
+		bdb->bi_idl_counts[i].ic_misses = 0;
+	}
+}
+
 int
 bdb_idl_fetch_key(
 	BackendDB	*be,
@@ -517,6 +837,8 @@ bdb_idl_fetch_key(
 	int rc2;
 	int flags = bdb->bi_db_opflags | DB_MULTIPLE;
 	int opflag;
+	int nbm;
+	bdb_idl_bm_build bb;
 
 	/* If using BerkeleyDB 4.0, the buf must be large enough to
 	 * grab the entire IDL in one get(), otherwise BDB will leak
@@ -561,7 +883,7 @@ bdb_idl_fetch_key(
 	}
 
 	/* only non-range lookups can use the IDL cache */
-	if ( bdb->bi_idl_cache_size && opflag == DB_SET ) {
+	if ( bdb->bi_idl_cache_max_size && opflag == DB_SET ) {
 		rc = bdb_idl_cache_get( bdb, db, key, ids );
 		if ( rc != LDAP_NO_SUCH_OBJECT ) return rc;
 	}
@@ -615,18 +937,46 @@ bdb_idl_fetch_key(
 	}
 	if (rc == 0) {
 		i = ids;
+		nbm = 0;
 		while (rc == 0) {
 			u_int8_t *j;
 
 			DB_MULTIPLE_INIT( ptr, &data );
 			while (ptr) {
 				DB_MULTIPLE_NEXT(ptr, &data, j, len);
-				if (j) {
-					++i;
-					BDB_DISK2ID( j, i );
+				if (!j)
+					continue;
+				if (len != sizeof(ID)) {
+					/* A bitmap container, following the range bounds */
+					if (nbm == 0) {
+						if (i - ids != BDB_IDL_RANGE_SIZE || ids[1] != 0) {
+							rc = -1;
+							break;
+						}
+						bdb_idl_bm_build_init( &bb, ids, BDB_IDL_UM_SIZE );
+					}
+					if (nbm >= 0) {
+						rc2 = bdb_idl_bm_build_item( &bb, j, len );
+						if (rc2 < 0) {
+							rc = -1;
+							break;
+						}
+						/* Too big, settle for the range */
+						nbm = rc2 ? -1 : nbm + 1;
+					}
+					continue;
 				}
+				++i;
+				BDB_DISK2ID( j, i );
 			}
-			rc = cursor->c_get( cursor, key, &data, flags | DB_NEXT_DUP );
+			if (rc == 0)
+				rc = cursor->c_get( cursor, key, &data, flags | DB_NEXT_DUP );
+		}
+		if ( rc == -1 ) {
+			Debug( LDAP_DEBUG_ANY, "=> bdb_idl_fetch_key: "
+				"malformed bitmap container\n", 0, 0, 0 );
+			cursor->c_close( cursor );
+			return rc;
 		}
 		if ( rc == DB_NOTFOUND ) rc = 0;
 		ids[0] = i - ids;
@@ -640,6 +990,8 @@ bdb_idl_fetch_key(
 				return -1;
 			}
 			BDB_IDL_RANGE( ids, ids[2], ids[3] );
+			if ( nbm > 0 )
+				bdb_idl_bm_build_finish( &bb );
 		}
 		data.size = BDB_IDL_SIZEOF(ids);
 	}
@@ -688,6 +1040,99 @@ bdb_idl_fetch_key(
 	return rc;
 }
 
+/* Estimate how many IDs are stored under a key without reading them:
+ * the size of a cached IDL, the duplicate count of a list, the counts
+ * of the bitmap containers of a range, or else its bounds.
+ */
+int
+bdb_idl_count_key(
+	BackendDB	*be,
+	DB			*db,
+	DB_TXN		*txn,
+	DBT			*key,
+	ID			*count )
+{
+	struct bdb_info *bdb = (struct bdb_info *) be->be_private;
+	int rc, rc2;
+	DBT data;
+	DBC *cursor;
+	db_recno_t n;
+	ID lo, hi, card, nbm, buf[4];
+
+	*count = 0;
+
+	if ( bdb->bi_idl_cache_max_size ) {
+		rc = bdb_idl_cache_count( bdb, db, key, count );
+		if ( rc != LDAP_NO_SUCH_OBJECT ) return rc;
+	}
+
+	rc = db->cursor( db, txn, &cursor, bdb->bi_db_opflags );
+	if ( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY, "=> bdb_idl_count_key: "
+			"cursor failed: %s (%d)\n", db_strerror(rc), rc, 0 );
+		return rc;
+	}
+
+	/* Only the head of a bitmap container is needed */
+	DBTzero( &data );
+	data.data = buf;
+	data.ulen = data.dlen = sizeof(buf);
+	data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+	rc = cursor->c_get( cursor, key, &data, bdb->bi_db_opflags | DB_SET );
+	if ( rc == 0 ) {
+		BDB_DISK2ID( buf, &lo );
+		if ( data.size == sizeof(ID) && lo == 0 ) {
+			/* a range, the bounds follow the marker */
+			rc = cursor->c_get( cursor, key, &data,
+				bdb->bi_db_opflags | DB_NEXT_DUP );
+			if ( rc == 0 ) {
+				BDB_DISK2ID( buf, &lo );
+				rc = cursor->c_get( cursor, key, &data,
+					bdb->bi_db_opflags | DB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				BDB_DISK2ID( buf, &hi );
+				*count = hi - lo + 1;
+
+				/* Containers hold the exact count of each chunk:
+				 * NOID, chunk key, type and size, count
+				 */
+				nbm = 0;
+				while ( ( rc = cursor->c_get( cursor, key, &data,
+					bdb->bi_db_opflags | DB_NEXT_DUP )) == 0 )
+				{
+					if ( data.size < sizeof(buf) )
+						continue;
+					BDB_DISK2ID( &buf[3], &card );
+					nbm += card;
+				}
+				if ( rc == DB_NOTFOUND ) {
+					rc = 0;
+					if ( nbm ) *count = nbm;
+				}
+			}
+		} else {
+			rc = cursor->c_count( cursor, &n, 0 );
+			if ( rc == 0 ) {
+				*count = n;
+			}
+		}
+	}
+
+	rc2 = cursor->c_close( cursor );
+	if ( rc == 0 ) {
+		rc = rc2;
+	}
+
+	if ( rc != 0 && rc != DB_NOTFOUND ) {
+		Debug( LDAP_DEBUG_ANY, "=> bdb_idl_count_key: "
+			"get failed: %s (%d)\n", db_strerror(rc), rc, 0 );
+	}
+
+	return rc;
+}
+
 
 int
 bdb_idl_insert_key(
@@ -701,7 +1146,9 @@ bdb_idl_insert_key(
 	int	rc;
 	DBT data;
 	DBC *cursor;
-	ID lo, hi, nlo, nhi, nid;
+	ID lo, hi, nlo, nhi, nid, tmp;
+	ID *idl = NULL, one[2];
+	int bm;
 	char *err;
 
 	{
@@ -781,15 +1228,25 @@ bdb_idl_insert_key(
 					hi = id;
 					nhi = nid;
 				}
-				data.data = &nid;
-				/* Don't fetch anything, just position cursor */
-				data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
-				data.dlen = data.ulen = 0;
+				if ( bdb->bi_idl_bitmap ) {
+					/* Keep the exact list, to store it as a bitmap */
+					idl = ch_malloc( ( count + 2 ) * sizeof(ID) );
+					idl[0] = 0;
+					data.data = &tmp;
+					data.flags = DB_DBT_USERMEM;
+				} else {
+					data.data = &nid;
+					/* Don't fetch anything, just position cursor */
+					data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+					data.dlen = data.ulen = 0;
+				}
 				rc = cursor->c_get( cursor, key, &data, DB_SET );
 				if ( rc != 0 ) {
 					err = "c_get 2";
 					goto fail;
 				}
+				if ( idl )
+					BDB_DISK2ID( &tmp, &idl[++idl[0]] );
 				rc = cursor->c_del( cursor, 0 );
 				if ( rc != 0 ) {
 					err = "c_del range1";
@@ -802,6 +1259,8 @@ bdb_idl_insert_key(
 						err = "c_get next_dup";
 						goto fail;
 					}
+					if ( idl )
+						BDB_DISK2ID( &tmp, &idl[++idl[0]] );
 					rc = cursor->c_del( cursor, 0 );
 					if ( rc != 0 ) {
 						err = "c_del range";
@@ -809,6 +1268,7 @@ bdb_idl_insert_key(
 					}
 				}
 				/* Store the range marker */
+				data.data = &nid;
 				data.size = data.ulen = sizeof(ID);
 				data.flags = DB_DBT_USERMEM;
 				nid = 0;
@@ -829,6 +1289,23 @@ bdb_idl_insert_key(
 					err = "c_put hi";
 					goto fail;
 				}
+				if ( idl ) {
+					/* Add the new ID and store the containers */
+					unsigned x = bdb_idl_search( idl, id );
+					if ( x > idl[0] || idl[x] != id ) {
+						AC_MEMCPY( &idl[x+1], &idl[x],
+							( idl[0] - x + 1 ) * sizeof(ID) );
+						idl[x] = id;
+						idl[0]++;
+					}
+					rc = bdb_idl_bm_put( cursor, key, idl, BDB_IDL_BM_OR );
+					ch_free( idl );
+					idl = NULL;
+					if ( rc != 0 ) {
+						err = "bitmap put";
+						goto fail;
+					}
+				}
 			} else {
 			/* There's room, just store it */
 				goto put1;
@@ -868,6 +1345,17 @@ bdb_idl_insert_key(
 					goto fail;
 				}
 			}
+			/* Keep the exact contents in step, if present */
+			rc = bdb_idl_bm_check( cursor, key, &bm );
+			if ( rc == 0 && bm ) {
+				one[0] = 1;
+				one[1] = id;
+				rc = bdb_idl_bm_put( cursor, key, one, BDB_IDL_BM_OR );
+			}
+			if ( rc != 0 ) {
+				err = "bitmap";
+				goto fail;
+			}
 		}
 	} else if ( rc == DB_NOTFOUND ) {
 put1:		data.data = &nid;
@@ -882,6 +1370,8 @@ put1:		data.data = &nid;
 fail:
 		Debug( LDAP_DEBUG_ANY, "=> bdb_idl_insert_key: "
 			"%s failed: %s (%d)\n", err, db_strerror(rc), rc );
+		if ( idl )
+			ch_free( idl );
 		cursor->c_close( cursor );
 		return rc;
 	}
@@ -912,7 +1402,8 @@ bdb_idl_delete_key(
 	int	rc;
 	DBT data;
 	DBC *cursor;
-	ID lo, hi, tmp, nid, nlo, nhi;
+	ID lo, hi, tmp, nid, nlo, nhi, one[2];
+	int bm;
 	char *err;
 
 	{
@@ -981,6 +1472,8 @@ bdb_idl_delete_key(
 				goto fail;
 			}
 			BDB_DISK2ID( &nhi, &hi );
+			one[0] = 1;
+			one[1] = id;
 			if ( id == lo || id == hi ) {
 				if ( id == lo ) {
 					id++;
@@ -1018,6 +1511,17 @@ bdb_idl_delete_key(
 					}
 				}
 			}
+			/* Keep the exact contents in step, if present */
+			if ( lo < hi ) {
+				rc = bdb_idl_bm_check( cursor, key, &bm );
+				if ( rc == 0 && bm )
+					rc = bdb_idl_bm_put( cursor, key, one,
+						BDB_IDL_BM_ANDNOT );
+				if ( rc != 0 ) {
+					err = "bitmap";
+					goto fail;
+				}
+			}
 		}
 	} else {
 		/* initial c_get failed, nothing was done */
@@ -1069,6 +1573,39 @@ bdb_idl_intersection(
 		return 0;
 	}
 
+	if ( BDB_IDL_IS_BITMAP( a ) || BDB_IDL_IS_BITMAP( b ) ) {
+		if ( BDB_IDL_IS_RANGE( a ) && BDB_IDL_IS_RANGE( b ) ) {
+			/* Two bitmaps, or a bitmap and a range */
+			if ( bdb_idl_bm_op( a, b, BDB_IDL_BM_AND ) ) {
+				a[0] = NOID;
+				a[1] = idmin;
+				a[2] = idmax;
+			}
+			return 0;
+		}
+		/* A list and a bitmap: keep the list's members that are
+		 * also in the bitmap.
+		 */
+		if ( BDB_IDL_IS_RANGE( a ) ) {
+			ID *tmp = a;
+			a = b;
+			b = tmp;
+			swap = 1;
+		}
+		cursorc = 0;
+		for ( cursora = 1; cursora <= a[0]; cursora++ ) {
+			ida = a[cursora];
+			if ( ida < idmin )
+				continue;
+			if ( ida > idmax )
+				break;
+			if ( bdb_idl_bm_next( b, ida ) == ida )
+				a[++cursorc] = ida;
+		}
+		a[0] = cursorc;
+		goto done;
+	}
+
 	if ( BDB_IDL_IS_RANGE( a ) ) {
 		if ( BDB_IDL_IS_RANGE(b) ) {
 		/* If both are ranges, just shrink the boundaries */
@@ -1100,6 +1637,12 @@ bdb_idl_intersection(
 		goto done;
 	}
 
+	/* Two lists go to the vector kernels */
+	if ( !BDB_IDL_IS_RANGE( b ) ) {
+		bdb_idl_list_and( a, b );
+		goto done;
+	}
+
 	/* Fine, do the intersection one element at a time.
 	 * First advance to idmin in both IDLs.
 	 */
@@ -1148,6 +1691,13 @@ bdb_idl_union(
 		return 0;
 	}
 
+	/* Bitmaps stay exact unless the other side is a plain range */
+	if ( ( BDB_IDL_IS_BITMAP( a ) || BDB_IDL_IS_BITMAP( b ) )
+		&& a[0] != NOID && b[0] != NOID
+		&& bdb_idl_bm_op( a, b, BDB_IDL_BM_OR ) == 0 ) {
+		return 0;
+	}
+
 	if ( BDB_IDL_IS_RANGE( a ) || BDB_IDL_IS_RANGE(b) ) {
 over:		ida = IDL_MIN( BDB_IDL_FIRST(a), BDB_IDL_FIRST(b) );
 		idb = IDL_MAX( BDB_IDL_LAST(a), BDB_IDL_LAST(b) );
@@ -1157,6 +1707,10 @@ over:		ida = IDL_MIN( BDB_IDL_FIRST(a), BDB_IDL_FIRST(b) );
 		return 0;
 	}
 
+	if ( bdb_idl_list_or( a, b ) == 0 ) {
+		return 0;
+	}
+
 	ida = bdb_idl_first( a, &cursora );
 	idb = bdb_idl_first( b, &cursorb );
 
@@ -1166,6 +1720,9 @@ over:		ida = IDL_MIN( BDB_IDL_FIRST(a), BDB_IDL_FIRST(b) );
 	while( ida != NOID || idb != NOID ) {
 		if ( ida < idb ) {
 			if( ++cursorc > BDB_IDL_UM_MAX ) {
+				/* Too many for a list, try a bitmap */
+				if ( bdb_idl_bm_op( a, b, BDB_IDL_BM_OR ) == 0 )
+					return 0;
 				goto over;
 			}
 			b[cursorc] = ida;
@@ -1263,6 +1820,11 @@ ID bdb_idl_first( ID *ids, ID *cursor )
 		return NOID;
 	}
 
+	if ( BDB_IDL_IS_BITMAP( ids ) ) {
+		*cursor = bdb_idl_bm_next( ids, IDL_MAX( *cursor, ids[1] ) );
+		return *cursor;
+	}
+
 	if ( BDB_IDL_IS_RANGE( ids ) ) {
 		if( *cursor < ids[1] ) {
 			*cursor = ids[1];
@@ -1285,6 +1847,12 @@ ID bdb_idl_first( ID *ids, ID *cursor )
 
 ID bdb_idl_next( ID *ids, ID *cursor )
 {
+	if ( BDB_IDL_IS_BITMAP( ids ) ) {
+		if ( *cursor != NOID )
+			*cursor = bdb_idl_bm_next( ids, *cursor + 1 );
+		return *cursor;
+	}
+
 	if ( BDB_IDL_IS_RANGE( ids ) ) {
 		if( ids[2] < ++(*cursor) ) {
 			return NOID;
@@ -1307,6 +1875,8 @@ ID bdb_idl_next( ID *ids, ID *cursor )
  */
 int bdb_idl_append_one( ID *ids, ID id )
 {
+	if (BDB_IDL_IS_BITMAP( ids ))
+		ids[0] = NOID;
 	if (BDB_IDL_IS_RANGE( ids )) {
 		/* if already in range, treat as a dup */
 		if (id >= BDB_IDL_RANGE_FIRST(ids) && id <= BDB_IDL_RANGE_LAST(ids))
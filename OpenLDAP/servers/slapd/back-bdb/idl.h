@@ -29,11 +29,44 @@
 
 #define BDB_IDL_UM_MAX		(BDB_IDL_UM_SIZE-1)
 
-#define BDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
+/* A bitmap IDL holds an exact set that is too large for a list.
+ * Its header looks like a range, so code that doesn't know about
+ * bitmaps may treat it as the (inexact) range [first, last]:
+ *	ids[0]	BDB_IDL_BITMAP
+ *	ids[1]	first ID
+ *	ids[2]	last ID
+ *	ids[3]	total size, in IDs
+ *	ids[4]	number of IDs in the set
+ *	ids[5]	number of chunks
+ * followed by a directory of BDB_IDL_BM_DIR words per chunk and
+ * the chunk containers. See idlbitmap.c.
+ */
+#define BDB_IDL_BITMAP			((ID)~1)
+#define BDB_IDL_IS_BITMAP(ids)	((ids)[0] == BDB_IDL_BITMAP)
+#define BDB_IDL_BM_HDR			6
+#define BDB_IDL_BM_DIR			4
+
+/* A chunk covers 2^16 IDs; a full bitmap container takes BM_WORDS IDs */
+#define BDB_IDL_BM_BITS			(8 * sizeof(ID))
+#define BDB_IDL_BM_WORDS		(65536 / BDB_IDL_BM_BITS)
+/* Largest on-disk container item, in IDs */
+#define BDB_IDL_BM_ITEM			(BDB_IDL_BM_WORDS + 4)
+
+/* Set operations for bdb_idl_bm_op() and bdb_idl_bm_put() */
+#define BDB_IDL_BM_AND			1
+#define BDB_IDL_BM_OR			2
+#define BDB_IDL_BM_ANDNOT		3
+
+/* Kernel levels for bdb_idl_simd() */
+#define BDB_IDL_SIMD_NONE		0
+#define BDB_IDL_SIMD_SSE42		1
+#define BDB_IDL_SIMD_AVX2		2
+
+#define BDB_IDL_IS_RANGE(ids)	((ids)[0] >= BDB_IDL_BITMAP)
 #define BDB_IDL_RANGE_SIZE		(3)
 #define BDB_IDL_RANGE_SIZEOF	(BDB_IDL_RANGE_SIZE * sizeof(ID))
-#define BDB_IDL_SIZEOF(ids)		((BDB_IDL_IS_RANGE(ids) \
-	? BDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
+#define BDB_IDL_SIZEOF(ids)		((BDB_IDL_IS_BITMAP(ids) ? (ids)[3] \
+	: BDB_IDL_IS_RANGE(ids) ? BDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
 
 #define BDB_IDL_RANGE_FIRST(ids)	((ids)[1])
 #define BDB_IDL_RANGE_LAST(ids)		((ids)[2])
@@ -65,10 +98,23 @@
 #define BDB_IDL_LAST( ids )		( BDB_IDL_IS_RANGE(ids) \
 	? (ids)[2] : (ids)[(ids)[0]] )
 
-#define BDB_IDL_N( ids )		( BDB_IDL_IS_RANGE(ids) \
-	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
+#define BDB_IDL_N( ids )		( BDB_IDL_IS_BITMAP(ids) ? (ids)[4] \
+	: BDB_IDL_IS_RANGE(ids) ? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
 
 LDAP_BEGIN_DECL
+
+/* State for assembling a bitmap IDL one chunk at a time. Directory
+ * entries grow up from the header, container data grows down from
+ * the end of the buffer; bdb_idl_bm_build_finish() packs them.
+ */
+typedef struct bdb_idl_bm_build {
+	ID		*bb_ids;
+	ID		bb_max;		/* size of bb_ids, in IDs */
+	ID		bb_dir;		/* next free directory slot */
+	ID		bb_tail;	/* start of container data */
+	ID		bb_card;	/* IDs added so far */
+} bdb_idl_bm_build;
+
 LDAP_END_DECL
 
 #endif
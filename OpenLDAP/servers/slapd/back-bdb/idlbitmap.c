@@ -0,0 +1,797 @@
+/* idlbitmap.c - ldap bdb back-end compressed bitmap ID lists */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2011 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Bitmap IDLs split the ID space into chunks of 2^16 IDs, keyed by
+ * the high bits of the ID, in the manner of Roaring bitmaps. Each
+ * non-empty chunk uses whichever container is smallest:
+ *
+ *	BM_ARRAY	sorted 16 bit values, packed sizeof(ID)/2 to a word
+ *	BM_BITMAP	BDB_IDL_BM_WORDS words, one bit per ID
+ *	BM_RUN		one (start << 16 | length-1) per word
+ *
+ * Set operations expand one chunk at a time into a plain bitmap and
+ * combine whole words, rather than merging IDs one by one.
+ *
+ * A directory entry is four words: chunk key, container type plus
+ * (container size << 2), number of IDs in the chunk, and the offset
+ * of the container from the start of the container data.
+ *
+ * On disk, a range index slot may carry its exact contents as one
+ * extra data item per chunk, after the range marker and bounds:
+ *	NOID, chunk key, type|size<<2, count, container words...
+ * all in BDB_ID2DISK order. The leading NOID sorts these items after
+ * any real ID and tells them apart from the range bounds.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-bdb.h"
+#include "idl.h"
+
+#define BM_ARRAY	1
+#define BM_BITMAP	2
+#define BM_RUN		3
+
+#define BM_CHUNK	65536
+
+#define BM_VPW		(sizeof(ID) / 2)
+#define BM_AWORDS(n)	(((n) + BM_VPW - 1) / BM_VPW)
+#define BM_AGET(w,i)	((unsigned)((w)[(i) / BM_VPW] >> \
+	(((i) % BM_VPW) * 16)) & 0xffff)
+
+#define BM_SET(b,v)	((b)[(v) / BDB_IDL_BM_BITS] |= \
+	(ID)1 << ((v) % BDB_IDL_BM_BITS))
+#define BM_CLR(b,v)	((b)[(v) / BDB_IDL_BM_BITS] &= \
+	~((ID)1 << ((v) % BDB_IDL_BM_BITS)))
+
+#define BM_DIRENT(ids,i)	((ids) + BDB_IDL_BM_HDR + (i) * BDB_IDL_BM_DIR)
+#define BM_DATA(ids)	BM_DIRENT( ids, (ids)[5] )
+
+#define BM_KEY(d)	((d)[0])
+#define BM_TYPE(d)	((d)[1] & 3)
+#define BM_SIZE(d)	((d)[1] >> 2)
+#define BM_CARD(d)	((d)[2])
+#define BM_OFF(d)	((d)[3])
+
+static int
+bm_popcount( ID w )
+{
+#ifdef __GNUC__
+	return __builtin_popcountl( w );
+#else
+	int n;
+
+	for ( n = 0; w; n++ )
+		w &= w - 1;
+	return n;
+#endif
+}
+
+static int
+bm_ctz( ID w )
+{
+#ifdef __GNUC__
+	return __builtin_ctzl( w );
+#else
+	int n;
+
+	for ( n = 0; !( w & 1 ); n++ )
+		w >>= 1;
+	return n;
+#endif
+}
+
+/* Find the first bit at or after from that is set (or clear),
+ * BM_CHUNK if there is none.
+ */
+static unsigned
+bm_scan( ID *bits, unsigned from, int set )
+{
+	unsigned i;
+	ID w;
+
+	if ( from >= BM_CHUNK )
+		return BM_CHUNK;
+
+	i = from / BDB_IDL_BM_BITS;
+	w = set ? bits[i] : ~bits[i];
+	w &= ~(ID)0 << ( from % BDB_IDL_BM_BITS );
+	while ( !w ) {
+		if ( ++i == BDB_IDL_BM_WORDS )
+			return BM_CHUNK;
+		w = set ? bits[i] : ~bits[i];
+	}
+	return i * BDB_IDL_BM_BITS + bm_ctz( w );
+}
+
+/* Set bits lo through hi, inclusive */
+static void
+bm_setrange( ID *bits, unsigned lo, unsigned hi )
+{
+	unsigned i = lo / BDB_IDL_BM_BITS, j = hi / BDB_IDL_BM_BITS;
+	ID mlo = ~(ID)0 << ( lo % BDB_IDL_BM_BITS );
+	ID mhi = ~(ID)0 >> ( BDB_IDL_BM_BITS - 1 - hi % BDB_IDL_BM_BITS );
+
+	if ( i == j ) {
+		bits[i] |= mlo & mhi;
+		return;
+	}
+	bits[i++] |= mlo;
+	while ( i < j )
+		bits[i++] = ~(ID)0;
+	bits[j] |= mhi;
+}
+
+/* Pick the smallest container for the chunk in bits and write it
+ * to out. Returns the container size in words, 0 if the chunk is
+ * empty.
+ */
+static ID
+bm_encode( ID *bits, ID *out, ID *type, ID *card )
+{
+	ID i, n = 0, runs = 0, carry = 0, w;
+	unsigned v, e;
+
+	for ( i = 0; i < BDB_IDL_BM_WORDS; i++ ) {
+		w = bits[i];
+		n += bm_popcount( w );
+		runs += bm_popcount( w & ~(( w << 1 ) | carry ));
+		carry = w >> ( BDB_IDL_BM_BITS - 1 );
+	}
+	*card = n;
+	if ( !n )
+		return 0;
+
+	if ( runs <= BM_AWORDS( n ) && runs < BDB_IDL_BM_WORDS ) {
+		*type = BM_RUN;
+		i = 0;
+		for ( v = bm_scan( bits, 0, 1 ); v < BM_CHUNK;
+			v = bm_scan( bits, e, 1 )) {
+			e = bm_scan( bits, v, 0 );
+			out[i++] = ((ID)v << 16) | ( e - v - 1 );
+		}
+		return runs;
+	}
+
+	if ( BM_AWORDS( n ) < BDB_IDL_BM_WORDS ) {
+		*type = BM_ARRAY;
+		memset( out, 0, BM_AWORDS( n ) * sizeof(ID) );
+		i = 0;
+		for ( v = bm_scan( bits, 0, 1 ); v < BM_CHUNK;
+			v = bm_scan( bits, v+1, 1 ), i++ ) {
+			out[i / BM_VPW] |= (ID)v << (( i % BM_VPW ) * 16 );
+		}
+		return BM_AWORDS( n );
+	}
+
+	*type = BM_BITMAP;
+	AC_MEMCPY( out, bits, BDB_IDL_BM_WORDS * sizeof(ID) );
+	return BDB_IDL_BM_WORDS;
+}
+
+/* OR the container described by d into bits */
+static void
+bm_decode( ID *d, ID *words, ID *bits )
+{
+	ID i;
+
+	switch ( BM_TYPE( d )) {
+	case BM_ARRAY:
+		for ( i = 0; i < BM_CARD( d ); i++ )
+			BM_SET( bits, BM_AGET( words, i ));
+		break;
+	case BM_BITMAP:
+		for ( i = 0; i < BDB_IDL_BM_WORDS; i++ )
+			bits[i] |= words[i];
+		break;
+	case BM_RUN:
+		for ( i = 0; i < BM_SIZE( d ); i++ ) {
+			unsigned lo = words[i] >> 16;
+			bm_setrange( bits, lo, lo + ( words[i] & 0xffff ));
+		}
+		break;
+	}
+}
+
+/* Smallest value >= lo in a container, BM_CHUNK if none */
+static unsigned
+bm_chunk_next( ID *d, ID *words, unsigned lo )
+{
+	unsigned l, h, m, s;
+
+	switch ( BM_TYPE( d )) {
+	case BM_ARRAY:
+		l = 0;
+		h = BM_CARD( d );
+		while ( l < h ) {
+			m = ( l + h ) >> 1;
+			if ( BM_AGET( words, m ) < lo )
+				l = m + 1;
+			else
+				h = m;
+		}
+		return l < BM_CARD( d ) ? BM_AGET( words, l ) : BM_CHUNK;
+
+	case BM_BITMAP:
+		return bm_scan( words, lo, 1 );
+
+	case BM_RUN:
+		/* find the first run starting after lo */
+		l = 0;
+		h = BM_SIZE( d );
+		while ( l < h ) {
+			m = ( l + h ) >> 1;
+			if (( words[m] >> 16 ) <= lo )
+				l = m + 1;
+			else
+				h = m;
+		}
+		if ( l > 0 ) {
+			s = words[l-1] >> 16;
+			if ( lo <= s + ( words[l-1] & 0xffff ))
+				return lo;
+		}
+		return l < BM_SIZE( d ) ? words[l] >> 16 : BM_CHUNK;
+	}
+	return BM_CHUNK;
+}
+
+/* Largest value in a non-empty container */
+static unsigned
+bm_chunk_last( ID *d, ID *words )
+{
+	int i;
+	unsigned b;
+
+	switch ( BM_TYPE( d )) {
+	case BM_ARRAY:
+		return BM_AGET( words, BM_CARD( d ) - 1 );
+
+	case BM_BITMAP:
+		for ( i = BDB_IDL_BM_WORDS - 1; i > 0 && !words[i]; i-- )
+			;
+		for ( b = BDB_IDL_BM_BITS - 1; b && !( words[i] >> b ); b-- )
+			;
+		return i * BDB_IDL_BM_BITS + b;
+
+	case BM_RUN:
+		i = BM_SIZE( d ) - 1;
+		return ( words[i] >> 16 ) + ( words[i] & 0xffff );
+	}
+	return 0;
+}
+
+void
+bdb_idl_bm_build_init( bdb_idl_bm_build *bb, ID *ids, ID max )
+{
+	bb->bb_ids = ids;
+	bb->bb_max = max;
+	bb->bb_dir = BDB_IDL_BM_HDR;
+	bb->bb_tail = max;
+	bb->bb_card = 0;
+}
+
+/* Reserve a directory entry and size words of container data.
+ * Returns NULL if the buffer is full.
+ */
+static ID *
+bm_build_alloc( bdb_idl_bm_build *bb, ID key, ID type, ID size, ID card )
+{
+	ID *d;
+
+	if ( bb->bb_dir + BDB_IDL_BM_DIR + size > bb->bb_tail )
+		return NULL;
+
+	/* chunks must arrive in ascending order */
+	assert( bb->bb_dir == BDB_IDL_BM_HDR ||
+		BM_KEY( bb->bb_ids + bb->bb_dir - BDB_IDL_BM_DIR ) < key );
+
+	bb->bb_tail -= size;
+	d = bb->bb_ids + bb->bb_dir;
+	d[0] = key;
+	d[1] = type | ( size << 2 );
+	d[2] = card;
+	d[3] = bb->bb_tail;
+	bb->bb_dir += BDB_IDL_BM_DIR;
+	bb->bb_card += card;
+
+	return bb->bb_ids + bb->bb_tail;
+}
+
+/* Add the chunk in bits, if it isn't empty. Returns -1 if full. */
+static int
+bm_build_bits( bdb_idl_bm_build *bb, ID key, ID *bits )
+{
+	ID words[BDB_IDL_BM_WORDS], type, card, size, *out;
+
+	size = bm_encode( bits, words, &type, &card );
+	if ( !size )
+		return 0;
+
+	out = bm_build_alloc( bb, key, type, size, card );
+	if ( !out )
+		return -1;
+
+	AC_MEMCPY( out, words, size * sizeof(ID) );
+	return 0;
+}
+
+/* Add a container item as read from disk. Returns 0 on success,
+ * 1 if the buffer is full, -1 if the item is malformed.
+ */
+int
+bdb_idl_bm_build_item( bdb_idl_bm_build *bb, void *item, size_t len )
+{
+	unsigned char *p = item;
+	ID hdr[4], i, n, *out;
+
+	if ( len % sizeof(ID) || len < sizeof(hdr) )
+		return -1;
+
+	for ( i = 0; i < 4; i++, p += sizeof(ID) )
+		BDB_DISK2ID( p, &hdr[i] );
+
+	n = len / sizeof(ID) - 4;
+	if ( hdr[0] != NOID || BM_SIZE( hdr+1 ) != n || !n ||
+		n > BDB_IDL_BM_WORDS || BM_TYPE( hdr+1 ) == 0 ||
+		BM_CARD( hdr+1 ) == 0 || BM_CARD( hdr+1 ) > BM_CHUNK )
+		return -1;
+
+	out = bm_build_alloc( bb, hdr[1], BM_TYPE( hdr+1 ), n, BM_CARD( hdr+1 ));
+	if ( !out )
+		return 1;
+
+	for ( i = 0; i < n; i++, p += sizeof(ID) )
+		BDB_DISK2ID( p, &out[i] );
+
+	return 0;
+}
+
+/* Pack the directory and container data and fill in the header.
+ * An empty build yields an empty IDL.
+ */
+void
+bdb_idl_bm_build_finish( bdb_idl_bm_build *bb )
+{
+	ID *ids = bb->bb_ids, *d, len, i, n;
+
+	n = ( bb->bb_dir - BDB_IDL_BM_HDR ) / BDB_IDL_BM_DIR;
+	if ( !n ) {
+		BDB_IDL_ZERO( ids );
+		return;
+	}
+
+	len = bb->bb_max - bb->bb_tail;
+	AC_MEMCPY( ids + bb->bb_dir, ids + bb->bb_tail, len * sizeof(ID) );
+	for ( i = 0; i < n; i++ ) {
+		d = BM_DIRENT( ids, i );
+		BM_OFF( d ) -= bb->bb_tail;
+	}
+
+	ids[0] = BDB_IDL_BITMAP;
+	ids[3] = bb->bb_dir + len;
+	ids[4] = bb->bb_card;
+	ids[5] = n;
+
+	d = BM_DIRENT( ids, 0 );
+	ids[1] = ( BM_KEY( d ) << 16 ) |
+		bm_chunk_next( d, BM_DATA( ids ) + BM_OFF( d ), 0 );
+	d = BM_DIRENT( ids, n - 1 );
+	ids[2] = ( BM_KEY( d ) << 16 ) |
+		bm_chunk_last( d, BM_DATA( ids ) + BM_OFF( d ));
+}
+
+/* Index of the first chunk whose key is >= key */
+static ID
+bm_find( ID *ids, ID key )
+{
+	ID l = 0, h = ids[5], m;
+
+	while ( l < h ) {
+		m = ( l + h ) >> 1;
+		if ( BM_KEY( BM_DIRENT( ids, m )) < key )
+			l = m + 1;
+		else
+			h = m;
+	}
+	return l;
+}
+
+/* Return the smallest ID in the bitmap that is >= id, or NOID */
+ID
+bdb_idl_bm_next( ID *ids, ID id )
+{
+	ID i, key = id >> 16, *d;
+	unsigned v;
+
+	if ( id == NOID || id > ids[2] )
+		return NOID;
+
+	for ( i = bm_find( ids, key ); i < ids[5]; i++ ) {
+		d = BM_DIRENT( ids, i );
+		v = bm_chunk_next( d, BM_DATA( ids ) + BM_OFF( d ),
+			BM_KEY( d ) == key ? id & 0xffff : 0 );
+		if ( v < BM_CHUNK )
+			return ( BM_KEY( d ) << 16 ) | v;
+	}
+	return NOID;
+}
+
+/* Walks the chunks of a list, range, or bitmap IDL */
+typedef struct bm_src {
+	ID		*bs_ids;
+	int		bs_type;
+	ID		bs_pos;	/* list index, next range ID, or chunk index */
+} bm_src;
+
+#define BS_EMPTY	0
+#define BS_LIST		1
+#define BS_RANGE	2
+#define BS_BITMAP	3
+
+static void
+bm_src_init( bm_src *bs, ID *ids )
+{
+	bs->bs_ids = ids;
+	if ( BDB_IDL_IS_ZERO( ids )) {
+		bs->bs_type = BS_EMPTY;
+	} else if ( BDB_IDL_IS_BITMAP( ids )) {
+		bs->bs_type = BS_BITMAP;
+		bs->bs_pos = 0;
+	} else if ( BDB_IDL_IS_RANGE( ids )) {
+		bs->bs_type = BS_RANGE;
+		bs->bs_pos = ids[1];
+	} else {
+		bs->bs_type = BS_LIST;
+		bs->bs_pos = 1;
+	}
+}
+
+/* Key of the current chunk, NOID at the end */
+static ID
+bm_src_key( bm_src *bs )
+{
+	ID *ids = bs->bs_ids;
+
+	switch ( bs->bs_type ) {
+	case BS_LIST:
+		if ( bs->bs_pos <= ids[0] )
+			return ids[bs->bs_pos] >> 16;
+		break;
+	case BS_RANGE:
+		if ( bs->bs_pos && bs->bs_pos <= ids[2] )
+			return bs->bs_pos >> 16;
+		break;
+	case BS_BITMAP:
+		if ( bs->bs_pos < ids[5] )
+			return BM_KEY( BM_DIRENT( ids, bs->bs_pos ));
+		break;
+	}
+	return NOID;
+}
+
+/* Advance to the first chunk whose key is >= key */
+static void
+bm_src_skip( bm_src *bs, ID key )
+{
+	ID pos;
+
+	switch ( bs->bs_type ) {
+	case BS_LIST:
+		pos = bdb_idl_search( bs->bs_ids, key << 16 );
+		if ( pos > bs->bs_pos )
+			bs->bs_pos = pos;
+		break;
+	case BS_RANGE:
+		if (( bs->bs_pos >> 16 ) < key )
+			bs->bs_pos = key << 16;
+		break;
+	case BS_BITMAP:
+		pos = bm_find( bs->bs_ids, key );
+		if ( pos > bs->bs_pos )
+			bs->bs_pos = pos;
+		break;
+	}
+}
+
+/* OR the current chunk into bits and move past it */
+static void
+bm_src_get( bm_src *bs, ID *bits )
+{
+	ID *ids = bs->bs_ids, key, end, *d;
+
+	switch ( bs->bs_type ) {
+	case BS_LIST:
+		key = ids[bs->bs_pos] >> 16;
+		for ( ; bs->bs_pos <= ids[0] && ( ids[bs->bs_pos] >> 16 ) == key;
+			bs->bs_pos++ )
+			BM_SET( bits, ids[bs->bs_pos] & 0xffff );
+		break;
+	case BS_RANGE:
+		key = bs->bs_pos >> 16;
+		end = ( key << 16 ) | 0xffff;
+		if ( end > ids[2] )
+			end = ids[2];
+		bm_setrange( bits, bs->bs_pos & 0xffff, end & 0xffff );
+		/* wraps to 0 past the top of the ID space */
+		bs->bs_pos = end + 1;
+		break;
+	case BS_BITMAP:
+		d = BM_DIRENT( ids, bs->bs_pos );
+		bm_decode( d, BM_DATA( ids ) + BM_OFF( d ), bits );
+		bs->bs_pos++;
+		break;
+	}
+}
+
+/* Copy the contents of bitmap src into list dst */
+static void
+bm_tolist( ID *src, ID *dst )
+{
+	ID id, n = 0;
+
+	if ( !BDB_IDL_IS_ZERO( src )) {
+		for ( id = bdb_idl_bm_next( src, src[1] ); id != NOID;
+			id = bdb_idl_bm_next( src, id + 1 ))
+			dst[++n] = id;
+	}
+	dst[0] = n;
+}
+
+/* The result of bdb_idl_bm_op() is built in a buffer kept by each
+ * thread, rather than one allocated for every call.
+ */
+static void
+bdb_idl_bm_buf_free( void *key, void *data )
+{
+	ch_free( data );
+}
+
+static ID *
+bdb_idl_bm_buf( void *ctx )
+{
+	void *buf = NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)bdb_idl_bm_buf,
+		&buf, NULL )) {
+		buf = ch_malloc( BDB_IDL_UM_SIZEOF );
+		if ( ldap_pvt_thread_pool_setkey( ctx, (void *)bdb_idl_bm_buf,
+			buf, bdb_idl_bm_buf_free, NULL, NULL )) {
+			ch_free( buf );
+			buf = NULL;
+		}
+	}
+	return buf;
+}
+
+/* free up the buffer used by the main thread */
+void
+bdb_idl_bm_flush( void )
+{
+	void *data;
+	void *ctx = ldap_pvt_thread_pool_context();
+
+	if ( !ldap_pvt_thread_pool_getkey( ctx, (void *)bdb_idl_bm_buf,
+		&data, NULL )) {
+		ldap_pvt_thread_pool_setkey( ctx, (void *)bdb_idl_bm_buf,
+			NULL, 0, NULL, NULL );
+		bdb_idl_bm_buf_free( NULL, data );
+	}
+}
+
+/*
+ * bdb_idl_bm_op - return a = a op b, for any mix of lists, ranges
+ * and bitmaps. The result is a list if it is small enough, otherwise
+ * a bitmap. Returns -1, leaving a untouched, if the result doesn't
+ * fit in BDB_IDL_UM_SIZE.
+ */
+int
+bdb_idl_bm_op( ID *a, ID *b, int op )
+{
+	bdb_idl_bm_build bb;
+	bm_src sa, sb;
+	ID *out, ka, kb, key, i;
+	ID bits[BDB_IDL_BM_WORDS], tmp[BDB_IDL_BM_WORDS];
+	int rc = 0, tmpout = 0;
+
+	out = bdb_idl_bm_buf( ldap_pvt_thread_pool_context() );
+	if ( !out ) {
+		out = ch_malloc( BDB_IDL_UM_SIZEOF );
+		tmpout = 1;
+	}
+	bdb_idl_bm_build_init( &bb, out, BDB_IDL_UM_SIZE );
+	bm_src_init( &sa, a );
+	bm_src_init( &sb, b );
+
+	for (;;) {
+		ka = bm_src_key( &sa );
+		kb = bm_src_key( &sb );
+
+		if ( op == BDB_IDL_BM_OR ) {
+			if ( ka == NOID && kb == NOID )
+				break;
+		} else if ( ka == NOID || ( op == BDB_IDL_BM_AND && kb == NOID )) {
+			break;
+		}
+
+		/* Skip chunks that can't contribute */
+		if ( op == BDB_IDL_BM_AND && ka != kb ) {
+			if ( ka < kb )
+				bm_src_skip( &sa, kb );
+			else
+				bm_src_skip( &sb, ka );
+			continue;
+		}
+		if ( op == BDB_IDL_BM_ANDNOT && kb < ka ) {
+			bm_src_skip( &sb, ka );
+			continue;
+		}
+
+		key = ka < kb ? ka : kb;
+		memset( bits, 0, sizeof( bits ));
+		if ( ka == key )
+			bm_src_get( &sa, bits );
+		if ( kb == key ) {
+			if ( op == BDB_IDL_BM_OR ) {
+				bm_src_get( &sb, bits );
+			} else {
+				memset( tmp, 0, sizeof( tmp ));
+				bm_src_get( &sb, tmp );
+				if ( op == BDB_IDL_BM_AND ) {
+					for ( i = 0; i < BDB_IDL_BM_WORDS; i++ )
+						bits[i] &= tmp[i];
+				} else {
+					for ( i = 0; i < BDB_IDL_BM_WORDS; i++ )
+						bits[i] &= ~tmp[i];
+				}
+			}
+		}
+		if ( bm_build_bits( &bb, key, bits )) {
+			rc = -1;
+			break;
+		}
+	}
+
+	if ( rc == 0 ) {
+		bdb_idl_bm_build_finish( &bb );
+		if ( BDB_IDL_N( out ) <= BDB_IDL_DB_MAX ) {
+			bm_tolist( out, a );
+		} else {
+			BDB_IDL_CPY( a, out );
+		}
+	}
+	if ( tmpout )
+		ch_free( out );
+	return rc;
+}
+
+/* Read a container item at the cursor's position into native order.
+ * Returns the number of words in the item, 0 if malformed.
+ */
+static ID
+bm_item_get( ID *item, size_t len )
+{
+	ID i, n = len / sizeof(ID);
+
+	if ( len % sizeof(ID) || n < 5 || n > BDB_IDL_BM_ITEM )
+		return 0;
+	for ( i = 0; i < n; i++ )
+		BDB_DISK2ID( &item[i], &item[i] );
+	if ( item[0] != NOID || BM_SIZE( item+1 ) != n - 4 )
+		return 0;
+	return n;
+}
+
+/* Find out whether a range index slot carries bitmap containers */
+int
+bdb_idl_bm_check( DBC *cursor, DBT *key, int *found )
+{
+	ID item[BDB_IDL_BM_ITEM];
+	DBT data;
+	int rc;
+
+	DBTzero( &data );
+	data.data = item;
+	data.ulen = sizeof( item );
+	data.flags = DB_DBT_USERMEM;
+	data.size = sizeof( ID );
+	BDB_ID2DISK( NOID, item );
+
+	*found = 0;
+	rc = cursor->c_get( cursor, key, &data, DB_GET_BOTH_RANGE );
+	if ( rc == 0 ) {
+		*found = data.size > sizeof( ID );
+	} else if ( rc == DB_NOTFOUND ) {
+		rc = 0;
+	}
+	return rc;
+}
+
+/*
+ * bdb_idl_bm_put - add (BDB_IDL_BM_OR) or remove (BDB_IDL_BM_ANDNOT)
+ * the IDs of list ids to or from the bitmap containers of an index
+ * slot. Only the containers of chunks named in ids are rewritten.
+ * IDs should be sorted so each container is only visited once.
+ */
+int
+bdb_idl_bm_put( DBC *cursor, DBT *key, ID *ids, int op )
+{
+	ID item[BDB_IDL_BM_ITEM], bits[BDB_IDL_BM_WORDS];
+	ID i, j, ck, n, type, card;
+	DBT data;
+	int rc, found;
+
+	DBTzero( &data );
+	data.data = item;
+	data.ulen = sizeof( item );
+	data.flags = DB_DBT_USERMEM;
+
+	for ( i = 1; i <= ids[0]; ) {
+		ck = ids[i] >> 16;
+
+		/* Position on this chunk's container, if it has one */
+		BDB_ID2DISK( NOID, &item[0] );
+		BDB_ID2DISK( ck, &item[1] );
+		data.size = 2 * sizeof( ID );
+		rc = cursor->c_get( cursor, key, &data, DB_GET_BOTH_RANGE );
+		found = 0;
+		memset( bits, 0, sizeof( bits ));
+		if ( rc == 0 ) {
+			if ( !bm_item_get( item, data.size ))
+				return -1;
+			if ( item[1] == ck ) {
+				found = 1;
+				bm_decode( item+1, item+4, bits );
+			}
+		} else if ( rc != DB_NOTFOUND ) {
+			return rc;
+		}
+
+		for ( ; i <= ids[0] && ( ids[i] >> 16 ) == ck; i++ ) {
+			if ( op == BDB_IDL_BM_OR )
+				BM_SET( bits, ids[i] & 0xffff );
+			else
+				BM_CLR( bits, ids[i] & 0xffff );
+		}
+		if ( !found && op != BDB_IDL_BM_OR )
+			continue;
+
+		if ( found ) {
+			rc = cursor->c_del( cursor, 0 );
+			if ( rc )
+				return rc;
+		}
+
+		n = bm_encode( bits, item+4, &type, &card );
+		if ( !n )
+			continue;
+		item[0] = NOID;
+		item[1] = ck;
+		item[2] = type | ( n << 2 );
+		item[3] = card;
+		n += 4;
+		for ( j = 0; j < n; j++ )
+			BDB_ID2DISK( item[j], &item[j] );
+		data.size = n * sizeof( ID );
+		rc = cursor->c_put( cursor, key, &data, DB_KEYLAST );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
@@ -63,7 +63,7 @@ static int
 bdb_db_init( BackendDB *be, ConfigReply *cr )
 {
 	struct bdb_info	*bdb;
-	int rc;
+	int rc, i;
 
 	Debug( LDAP_DEBUG_TRACE,
 		LDAP_XSTRING(bdb_db_init) ": Initializing " BDB_UCTYPE " database\n",
@@ -89,13 +89,12 @@ bdb_db_init( BackendDB *be, ConfigReply *cr )
 #ifdef BDB_HIER
 	ldap_pvt_thread_mutex_init( &bdb->bi_modrdns_mutex );
 #endif
-	ldap_pvt_thread_mutex_init( &bdb->bi_cache.c_lru_mutex );
-	ldap_pvt_thread_mutex_init( &bdb->bi_cache.c_count_mutex );
 	ldap_pvt_thread_mutex_init( &bdb->bi_cache.c_eifree_mutex );
 	ldap_pvt_thread_mutex_init( &bdb->bi_cache.c_dntree.bei_kids_mutex );
-	ldap_pvt_thread_rdwr_init ( &bdb->bi_cache.c_rwlock );
 	ldap_pvt_thread_rdwr_init( &bdb->bi_idl_tree_rwlock );
 	ldap_pvt_thread_mutex_init( &bdb->bi_idl_tree_lrulock );
+	for ( i = 0; i < IDL_COUNT_STRIPES; i++ )
+		ldap_pvt_thread_mutex_init( &bdb->bi_idl_counts[i].ic_mutex );
 
 	be->be_private = bdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
@@ -551,6 +550,17 @@ shm_retry:
 		TXN_BEGIN(bdb->bi_dbenv, NULL, &bdb->bi_cache.c_txn, DB_READ_COMMITTED | DB_TXN_NOWAIT);
 	}
 
+	rc = bdb_cache_open( bdb );
+	if( rc != 0 ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"entry cache setup failed: %s (%d).",
+			be->be_suffix[0].bv_val, db_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(bdb_db_open) ": %s\n",
+			cr->msg, 0, 0 );
+		goto fail;
+	}
+
 	entry_prealloc( bdb->bi_cache.c_maxsize );
 	attr_prealloc( bdb->bi_cache.c_maxsize * 20 );
 
@@ -602,7 +612,6 @@ bdb_db_close( BackendDB *be, ConfigReply *cr )
 	int rc;
 	struct bdb_info *bdb = (struct bdb_info *) be->be_private;
 	struct bdb_db_info *db;
-	bdb_idl_cache_entry_t *entry, *next_entry;
 
 	/* monitor handling */
 	(void)bdb_monitor_db_close( be );
@@ -625,12 +634,15 @@ bdb_db_close( BackendDB *be, ConfigReply *cr )
 		/* Free cache locker if we enabled locking.
 		 * TXNs must all be closed before DBs...
 		 */
+		bdb_cache_txn_abort( &bdb->bi_cache );
 		if ( !( slapMode & SLAP_TOOL_QUICK ) && bdb->bi_cache.c_txn ) {
 			TXN_ABORT( bdb->bi_cache.c_txn );
 			bdb->bi_cache.c_txn = NULL;
 		}
 		bdb_reader_flush( bdb->bi_dbenv );
 	}
+	bdb_id2entry_flush();
+	bdb_idl_bm_flush();
 
 	while( bdb->bi_databases && bdb->bi_ndatabases-- ) {
 		db = bdb->bi_databases[bdb->bi_ndatabases];
@@ -645,19 +657,8 @@ bdb_db_close( BackendDB *be, ConfigReply *cr )
 
 	bdb_cache_release_all (&bdb->bi_cache);
 
-	if ( bdb->bi_idl_cache_size ) {
-		avl_free( bdb->bi_idl_tree, NULL );
-		bdb->bi_idl_tree = NULL;
-		entry = bdb->bi_idl_lru_head;
-		do {
-			next_entry = entry->idl_lru_next;
-			if ( entry->idl )
-				free( entry->idl );
-			free( entry->kstr.bv_val );
-			free( entry );
-			entry = next_entry;
-		} while ( entry != bdb->bi_idl_lru_head );
-		bdb->bi_idl_lru_head = bdb->bi_idl_lru_tail = NULL;
+	if ( bdb->bi_idl_cache_max_size ) {
+		bdb_idl_cache_release_all( bdb );
 	}
 
 	/* close db environment */
@@ -701,6 +702,7 @@ static int
 bdb_db_destroy( BackendDB *be, ConfigReply *cr )
 {
 	struct bdb_info *bdb = (struct bdb_info *) be->be_private;
+	int i;
 
 	/* stop and remove checkpoint task */
 	if ( bdb->bi_txn_cp_task ) {
@@ -721,9 +723,6 @@ bdb_db_destroy( BackendDB *be, ConfigReply *cr )
 
 	bdb_attr_index_destroy( bdb );
 
-	ldap_pvt_thread_rdwr_destroy ( &bdb->bi_cache.c_rwlock );
-	ldap_pvt_thread_mutex_destroy( &bdb->bi_cache.c_lru_mutex );
-	ldap_pvt_thread_mutex_destroy( &bdb->bi_cache.c_count_mutex );
 	ldap_pvt_thread_mutex_destroy( &bdb->bi_cache.c_eifree_mutex );
 	ldap_pvt_thread_mutex_destroy( &bdb->bi_cache.c_dntree.bei_kids_mutex );
 #ifdef BDB_HIER
@@ -733,6 +732,8 @@ bdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	ldap_pvt_thread_mutex_destroy( &bdb->bi_database_mutex );
 	ldap_pvt_thread_rdwr_destroy( &bdb->bi_idl_tree_rwlock );
 	ldap_pvt_thread_mutex_destroy( &bdb->bi_idl_tree_lrulock );
+	for ( i = 0; i < IDL_COUNT_STRIPES; i++ )
+		ldap_pvt_thread_mutex_destroy( &bdb->bi_idl_counts[i].ic_mutex );
 
 	ch_free( bdb );
 	be->be_private = NULL;
@@ -804,6 +805,9 @@ bdb_back_initialize(
 			": %s\n", version, 0, 0 );
 	}
 
+	/* pick the IDL kernels before any thread uses them */
+	(void)bdb_idl_simd( -1 );
+
 	db_env_set_func_free( ber_memfree );
 	db_env_set_func_malloc( (db_malloc *)ber_memalloc );
 	db_env_set_func_realloc( (db_realloc *)ber_memrealloc );
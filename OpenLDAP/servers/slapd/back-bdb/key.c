@@ -60,6 +60,26 @@ bdb_key_read(
 	return rc;
 }
 
+/* estimate the number of IDs under a key */
+int
+bdb_key_count(
+	Backend	*be,
+	DB *db,
+	DB_TXN *txn,
+	struct berval *k,
+	ID *count
+)
+{
+	DBT key;
+
+	DBTzero( &key );
+	bv2DBT(k,&key);
+	key.ulen = key.size;
+	key.flags = DB_DBT_USERMEM;
+
+	return bdb_idl_count_key( be, db, txn, &key, count );
+}
+
 /* Add or remove stuff from index files */
 int
 bdb_key_change(
@@ -33,6 +33,10 @@ static ObjectClass		*oc_olmBDBDatabase;
 
 static AttributeDescription	*ad_olmBDBEntryCache,
 	*ad_olmBDBDNCache, *ad_olmBDBIDLCache,
+	*ad_olmBDBEntryCacheHits, *ad_olmBDBEntryCacheMisses,
+	*ad_olmBDBEntryCacheShard, *ad_olmBDBCachePolicy,
+	*ad_olmBDBEntryCacheHitRatio, *ad_olmBDBIDLCacheHits,
+	*ad_olmBDBIDLCacheMisses, *ad_olmBDBIDLCacheHitRatio,
 	*ad_olmDbDirectory;
 
 #ifdef BDB_MONITOR_IDX
@@ -95,6 +99,70 @@ static struct {
 		"USAGE dSAOperation )",
 		&ad_olmBDBIDLCache },
 
+	{ "( olmBDBAttributes:4 "
+		"NAME ( 'olmBDBEntryCacheHits' ) "
+		"DESC 'Number of entry lookups answered from Entry Cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBEntryCacheHits },
+
+	{ "( olmBDBAttributes:5 "
+		"NAME ( 'olmBDBEntryCacheMisses' ) "
+		"DESC 'Number of entry lookups that read the database' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBEntryCacheMisses },
+
+	{ "( olmBDBAttributes:6 "
+		"NAME ( 'olmBDBEntryCacheShard' ) "
+		"DESC 'Items, hits and misses of each Entry Cache shard' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBEntryCacheShard },
+
+	{ "( olmBDBAttributes:7 "
+		"NAME ( 'olmBDBCachePolicy' ) "
+		"DESC 'Replacement policy of the Entry and IDL Caches' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBCachePolicy },
+
+	{ "( olmBDBAttributes:8 "
+		"NAME ( 'olmBDBEntryCacheHitRatio' ) "
+		"DESC 'Percentage of entry lookups answered from Entry Cache' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBEntryCacheHitRatio },
+
+	{ "( olmBDBAttributes:9 "
+		"NAME ( 'olmBDBIDLCacheHits' ) "
+		"DESC 'Number of index lookups answered from IDL Cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBIDLCacheHits },
+
+	{ "( olmBDBAttributes:10 "
+		"NAME ( 'olmBDBIDLCacheMisses' ) "
+		"DESC 'Number of index lookups that read the database' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBIDLCacheMisses },
+
+	{ "( olmBDBAttributes:11 "
+		"NAME ( 'olmBDBIDLCacheHitRatio' ) "
+		"DESC 'Percentage of index lookups answered from IDL Cache' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBDBIDLCacheHitRatio },
+
 	{ "( olmDatabaseAttributes:1 "
 		"NAME ( 'olmDbDirectory' ) "
 		"DESC 'Path name of the directory "
@@ -130,6 +198,14 @@ static struct {
 			"olmBDBEntryCache "
 			"$ olmBDBDNCache "
 			"$ olmBDBIDLCache "
+			"$ olmBDBEntryCacheHits "
+			"$ olmBDBEntryCacheMisses "
+			"$ olmBDBEntryCacheShard "
+			"$ olmBDBCachePolicy "
+			"$ olmBDBEntryCacheHitRatio "
+			"$ olmBDBIDLCacheHits "
+			"$ olmBDBIDLCacheMisses "
+			"$ olmBDBIDLCacheHitRatio "
 			"$ olmDbDirectory "
 #ifdef BDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
@@ -140,6 +216,19 @@ static struct {
 	{ NULL }
 };
 
+/* Format hits as a percentage of all lookups */
+static void
+bdb_monitor_ratio( Attribute *a, unsigned long hits, unsigned long misses )
+{
+	char		buf[ 16 ];
+	struct berval	bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%.2f", hits + misses ?
+		100.0 * hits / ( hits + misses ) : 0.0 );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+}
+
 static int
 bdb_monitor_update(
 	Operation	*op,
@@ -148,28 +237,94 @@ bdb_monitor_update(
 	void		*priv )
 {
 	struct bdb_info		*bdb = (struct bdb_info *) priv;
-	Attribute		*a;
+	Cache			*cache = &bdb->bi_cache;
+	CacheShard		*cs;
+	Attribute		*a, *as;
 
 	char			buf[ BUFSIZ ];
 	struct berval		bv;
+	ID			cursize = 0, eiused = 0;
+	unsigned long		hits = 0, misses = 0;
+	unsigned		i;
 
 	assert( ad_olmBDBEntryCache != NULL );
 
+	bv.bv_val = buf;
+	if ( cache->c_shards ) {
+		/* The shard count can change when the database is reopened */
+		as = attr_find( e->e_attrs, ad_olmBDBEntryCacheShard );
+		assert( as != NULL );
+		ber_bvarray_free( as->a_vals );
+		as->a_vals = as->a_nvals = NULL;
+		as->a_numvals = 0;
+
+		for ( i = 0; i <= cache->c_shardmask; i++ ) {
+			cs = &cache->c_shards[ i ];
+			cursize += cs->cs_cursize;
+			eiused += cs->cs_eiused;
+			hits += cs->cs_hits;
+			misses += cs->cs_misses;
+
+			bv.bv_len = snprintf( buf, sizeof( buf ),
+				"shard=%u entries=%lu hits=%lu misses=%lu",
+				i, cs->cs_cursize, cs->cs_hits, cs->cs_misses );
+			attr_valadd( as, &bv, NULL, 1 );
+		}
+	}
+
 	a = attr_find( e->e_attrs, ad_olmBDBEntryCache );
 	assert( a != NULL );
-	bv.bv_val = buf;
-	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", bdb->bi_cache.c_cursize );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", cursize );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
 	a = attr_find( e->e_attrs, ad_olmBDBDNCache );
 	assert( a != NULL );
-	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", bdb->bi_cache.c_eiused );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", eiused );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
+	a = attr_find( e->e_attrs, ad_olmBDBEntryCacheHits );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmBDBEntryCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmBDBEntryCacheHitRatio );
+	assert( a != NULL );
+	bdb_monitor_ratio( a, hits, misses );
+
 	a = attr_find( e->e_attrs, ad_olmBDBIDLCache );
 	assert( a != NULL );
 	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", bdb->bi_idl_cache_size );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	bdb_idl_cache_counts( bdb, &hits, &misses );
+
+	a = attr_find( e->e_attrs, ad_olmBDBIDLCacheHits );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmBDBIDLCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmBDBIDLCacheHitRatio );
+	assert( a != NULL );
+	bdb_monitor_ratio( a, hits, misses );
+
+	/* The policy can change when the database is reopened */
+	a = attr_find( e->e_attrs, ad_olmBDBCachePolicy );
+	assert( a != NULL );
+	if ( bdb->bi_cache_policy == BDB_CACHE_ARC )
+		BER_BVSTR( &bv, "arc" );
+	else
+		BER_BVSTR( &bv, "clock" );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 	
 #ifdef BDB_MONITOR_IDX
 	bdb_monitor_idx_entry_add( bdb, e );
@@ -367,7 +522,7 @@ bdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 4 );
+	a = attrs_alloc( 1 + 12 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -391,6 +546,43 @@ bdb_monitor_db_open( BackendDB *be )
 		next->a_desc = ad_olmBDBIDLCache;
 		attr_valadd( next, &bv, NULL, 1 );
 		next = next->a_next;
+
+		next->a_desc = ad_olmBDBEntryCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmBDBEntryCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		/* filled in by bdb_monitor_update() */
+		BER_BVSTR( &bv, "shard=0" );
+		next->a_desc = ad_olmBDBEntryCacheShard;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		BER_BVSTR( &bv, "0" );
+		next->a_desc = ad_olmBDBIDLCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmBDBIDLCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		BER_BVSTR( &bv, "0.00" );
+		next->a_desc = ad_olmBDBEntryCacheHitRatio;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmBDBIDLCacheHitRatio;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		BER_BVSTR( &bv, "clock" );
+		next->a_desc = ad_olmBDBCachePolicy;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
 	}
 
 	{
@@ -193,6 +193,8 @@ int bdb_filter_candidates(
 #define bdb_id2entry_add			BDB_SYMBOL(id2entry_add)
 #define bdb_id2entry_update			BDB_SYMBOL(id2entry_update)
 #define bdb_id2entry_delete			BDB_SYMBOL(id2entry_delete)
+#define bdb_id2entry_flush			BDB_SYMBOL(id2entry_flush)
+#define bdb_id2entry_filter			BDB_SYMBOL(id2entry_filter)
 
 int bdb_id2entry_add(
 	BackendDB *be,
@@ -209,6 +211,8 @@ int bdb_id2entry_delete(
 	DB_TXN *tid,
 	Entry *e);
 
+void bdb_id2entry_flush( void );
+
 #ifdef SLAP_ZONE_ALLOC
 #else
 int bdb_id2entry(
@@ -218,6 +222,13 @@ int bdb_id2entry(
 	Entry **e);
 #endif
 
+int bdb_id2entry_filter(
+	BackendDB *be,
+	DB_TXN *tid,
+	ID id,
+	Filter *f,
+	Entry **e);
+
 #define bdb_entry_free				BDB_SYMBOL(entry_free)
 #define bdb_entry_return			BDB_SYMBOL(entry_return)
 #define bdb_entry_release			BDB_SYMBOL(entry_release)
@@ -242,6 +253,8 @@ BI_entry_get_rw bdb_entry_get;
 #define bdb_idl_cache_del			BDB_SYMBOL(idl_cache_del)
 #define bdb_idl_cache_add_id		BDB_SYMBOL(idl_cache_add_id)
 #define bdb_idl_cache_del_id		BDB_SYMBOL(idl_cache_del_id)
+#define bdb_idl_cache_release_all	BDB_SYMBOL(idl_cache_release_all)
+#define bdb_idl_cache_counts		BDB_SYMBOL(idl_cache_counts)
 
 int bdb_idl_cache_get(
 	struct bdb_info *bdb,
@@ -277,6 +290,15 @@ bdb_idl_cache_del_id(
 	DBT		*key,
 	ID		id );
 
+void
+bdb_idl_cache_release_all( struct bdb_info *bdb );
+
+void
+bdb_idl_cache_counts(
+	struct bdb_info	*bdb,
+	unsigned long	*hits,
+	unsigned long	*misses );
+
 #define bdb_idl_first				BDB_SYMBOL(idl_first)
 #define bdb_idl_next				BDB_SYMBOL(idl_next)
 #define bdb_idl_search				BDB_SYMBOL(idl_search)
@@ -289,6 +311,7 @@ bdb_idl_cache_del_id(
 #define bdb_idl_append_one			BDB_SYMBOL(idl_append_one)
 
 #define bdb_idl_fetch_key			BDB_SYMBOL(idl_fetch_key)
+#define bdb_idl_count_key			BDB_SYMBOL(idl_count_key)
 #define bdb_idl_insert_key			BDB_SYMBOL(idl_insert_key)
 #define bdb_idl_delete_key			BDB_SYMBOL(idl_delete_key)
 
@@ -303,6 +326,13 @@ int bdb_idl_fetch_key(
 	DBC                     **saved_cursor,
 	int                     get_flag );
 
+int bdb_idl_count_key(
+	BackendDB	*be,
+	DB			*db,
+	DB_TXN		*txn,
+	DBT			*key,
+	ID			*count );
+
 int bdb_idl_insert( ID *ids, ID id );
 int bdb_idl_delete( ID *ids, ID id );
 
@@ -338,6 +368,47 @@ int bdb_idl_append( ID *a, ID *b );
 int bdb_idl_append_one( ID *ids, ID id );
 
 
+/*
+ * idlbitmap.c
+ */
+
+#define bdb_idl_bm_build_init		BDB_SYMBOL(idl_bm_build_init)
+#define bdb_idl_bm_build_item		BDB_SYMBOL(idl_bm_build_item)
+#define bdb_idl_bm_build_finish		BDB_SYMBOL(idl_bm_build_finish)
+#define bdb_idl_bm_next				BDB_SYMBOL(idl_bm_next)
+#define bdb_idl_bm_op				BDB_SYMBOL(idl_bm_op)
+#define bdb_idl_bm_flush			BDB_SYMBOL(idl_bm_flush)
+#define bdb_idl_bm_check			BDB_SYMBOL(idl_bm_check)
+#define bdb_idl_bm_put				BDB_SYMBOL(idl_bm_put)
+
+struct bdb_idl_bm_build;
+
+void bdb_idl_bm_build_init( struct bdb_idl_bm_build *bb, ID *ids, ID max );
+int bdb_idl_bm_build_item( struct bdb_idl_bm_build *bb, void *item,
+	size_t len );
+void bdb_idl_bm_build_finish( struct bdb_idl_bm_build *bb );
+ID bdb_idl_bm_next( ID *ids, ID id );
+int bdb_idl_bm_op( ID *a, ID *b, int op );
+void bdb_idl_bm_flush( void );
+int bdb_idl_bm_check( DBC *cursor, DBT *key, int *found );
+int bdb_idl_bm_put( DBC *cursor, DBT *key, ID *ids, int op );
+
+
+/*
+ * idlsimd.c
+ */
+
+#define bdb_idl_simd				BDB_SYMBOL(idl_simd)
+#define bdb_idl_simd_name			BDB_SYMBOL(idl_simd_name)
+#define bdb_idl_list_and			BDB_SYMBOL(idl_list_and)
+#define bdb_idl_list_or				BDB_SYMBOL(idl_list_or)
+
+int bdb_idl_simd( int level );
+const char *bdb_idl_simd_name( int level );
+void bdb_idl_list_and( ID *a, ID *b );
+int bdb_idl_list_or( ID *a, ID *b );
+
+
 /*
  * index.c
  */
@@ -399,6 +470,7 @@ int bdb_index_entry LDAP_P(( Operation *op, DB_TXN *t, int r, Entry *e ));
  * key.c
  */
 #define bdb_key_read				BDB_SYMBOL(key_read)
+#define bdb_key_count				BDB_SYMBOL(key_count)
 #define bdb_key_change				BDB_SYMBOL(key_change)
 
 extern int
@@ -411,6 +483,14 @@ bdb_key_read(
     DBC **saved_cursor,
         int get_flags );
 
+extern int
+bdb_key_count(
+	Backend	*be,
+	DB *db,
+	DB_TXN *txn,
+	struct berval *k,
+	ID *count );
+
 extern int
 bdb_key_change(
     Backend	 *be,
@@ -507,7 +587,9 @@ void bdb_unlocked_cache_return_entry_rw( struct bdb_info *bdb, Entry *e, int rw
 #define bdb_cache_find_parent		BDB_SYMBOL(cache_find_parent)
 #define bdb_cache_modify			BDB_SYMBOL(cache_modify)
 #define bdb_cache_modrdn			BDB_SYMBOL(cache_modrdn)
+#define bdb_cache_open				BDB_SYMBOL(cache_open)
 #define bdb_cache_release_all		BDB_SYMBOL(cache_release_all)
+#define bdb_cache_txn_abort			BDB_SYMBOL(cache_txn_abort)
 #define bdb_cache_delete_entry		BDB_SYMBOL(cache_delete_entry)
 #define bdb_cache_deref				BDB_SYMBOL(cache_deref)
 
@@ -551,6 +633,7 @@ int bdb_cache_find_ndn(
 #define	ID_NOCACHE	2
 #define	ID_NOENTRY	4
 #define	ID_CHKPURGE	8
+#define	ID_FILTER	16	/* skip entries that can't match the search filter */
 int bdb_cache_find_id(
 	Operation *op,
 	DB_TXN	*tid,
@@ -576,6 +659,8 @@ void bdb_cache_delete_cleanup(
 	Cache	*cache,
 	EntryInfo *ei
 );
+int bdb_cache_open( struct bdb_info *bdb );
+void bdb_cache_txn_abort( Cache *cache );
 void bdb_cache_release_all( Cache *cache );
 void bdb_cache_deref( EntryInfo *ei );
 
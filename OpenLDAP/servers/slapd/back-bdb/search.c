@@ -359,6 +359,7 @@ bdb_search( Operation *op, SlapReply *rs )
 	int		tentries = 0;
 	unsigned	nentries = 0;
 	int		idflag = 0;
+	FilterProg	*fprog = NULL;
 
 	DB_LOCK		lock;
 	struct	bdb_op_info	*opinfo = NULL;
@@ -626,6 +627,24 @@ cand_retry:
 		}
 	}
 
+	/* counted once the candidates are settled, so that a deadlock
+	 * retry above doesn't count them again */
+	rs->sr_ncandidates += BDB_IDL_N(candidates);
+
+	/* Entries that are loaded from the database can be tested on
+	 * the attributes the filter uses before they are fully decoded,
+	 * unless every candidate will match anyway.
+	 */
+	if ( op->oq_search.rs_scope != LDAP_SCOPE_BASE &&
+		!( op->ors_filter->f_choice == LDAP_FILTER_PRESENT &&
+			op->ors_filter->f_desc == slap_schema.si_ad_objectClass ))
+	{
+		idflag = ID_FILTER;
+	}
+
+	/* the filter is tested against every candidate */
+	fprog = filter_compile( op->oq_search.rs_filter, op->o_tmpmemctx );
+
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
@@ -727,8 +746,10 @@ loop_begin:
 		 * any subsequent entries
 		 */
 		nentries++;
-		if ( nentries > bdb->bi_cache.c_maxsize && !idflag ) {
-			idflag = ID_NOCACHE;
+		rs->sr_nexamined++;
+		if ( nentries > bdb->bi_cache.c_maxsize &&
+			!( idflag & ID_NOCACHE )) {
+			idflag |= ID_NOCACHE;
 		}
 
 fetch_entry_retry:
@@ -759,6 +780,10 @@ txnfail:
 			rs->sr_text = "internal error";
 			send_ldap_result( op, rs );
 			goto done;
+		} else if ( rs->sr_err == LDAP_COMPARE_FALSE ) {
+			/* the entry doesn't match the filter */
+			e = NULL;
+			goto loop_continue;
 		}
 
 		if ( ei && rs->sr_err == LDAP_SUCCESS ) {
@@ -768,8 +793,9 @@ txnfail:
 		}
 
 		if ( e == NULL ) {
-			if( !BDB_IDL_IS_RANGE(candidates) ) {
-				/* only complain for non-range IDLs */
+			if( !BDB_IDL_IS_RANGE(candidates) ||
+				BDB_IDL_IS_BITMAP(candidates) ) {
+				/* only complain for exact IDLs */
 				Debug( LDAP_DEBUG_TRACE,
 					LDAP_XSTRING(bdb_search)
 					": candidate %ld not found\n",
@@ -963,7 +989,10 @@ id_retry:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( fprog )
+			rs->sr_err = test_filter_prog( op, e, fprog );
+		else
+			rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1091,6 +1120,7 @@ done:
 		rs->sr_v2ref = NULL;
 	}
 	if( realbase.bv_val ) ch_free( realbase.bv_val );
+	filter_prog_free( fprog, op->o_tmpmemctx );
 
 	return rs->sr_err;
 }
@@ -45,12 +45,15 @@ static int index_nattrs;
 static struct berval	*tool_base;
 static int		tool_scope;
 static Filter		*tool_filter;
+static FilterProg	*tool_prog;
 static Entry		*tool_next_entry;
+static int		tool_rewind;
 
 #ifdef BDB_TOOL_IDL_CACHING
 #define bdb_tool_idl_cmp		BDB_SYMBOL(tool_idl_cmp)
 #define bdb_tool_idl_flush_one		BDB_SYMBOL(tool_idl_flush_one)
 #define bdb_tool_idl_flush		BDB_SYMBOL(tool_idl_flush)
+#define bdb_tool_idl_gather		BDB_SYMBOL(tool_idl_gather)
 
 static int bdb_tool_idl_flush( BackendDB *be );
 
@@ -98,6 +101,27 @@ static int bdb_tool_trickle_active;
 
 static void * bdb_tool_index_task( void *ctx, void *ptr );
 
+/* With index threads, added and reindexed entries are queued in
+ * batches: the threads index one batch, each handling its share of
+ * attributes, while the main thread reads and stores the next one.
+ */
+#define	BDB_TOOL_BATCH	256
+
+typedef struct bdb_tool_batch {
+	int bb_count;
+	Entry *bb_entries[BDB_TOOL_BATCH];
+	IndexRec *bb_recs;
+} bdb_tool_batch;
+
+static bdb_tool_batch bdb_tool_batches[2], *bdb_tool_ix_batch;
+static int bdb_tool_batch_fill;
+static Operation bdb_tool_batch_op;
+static Opheader bdb_tool_batch_ohdr;
+
+static int bdb_tool_batch_add( BackendDB *be, Entry *e );
+static int bdb_tool_batch_dispatch( void );
+static int bdb_tool_batch_wait( void );
+
 static int
 bdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
@@ -163,7 +187,19 @@ int bdb_tool_entry_open(
 int bdb_tool_entry_close(
 	BackendDB *be )
 {
+	int rc = 0;
+
 	if ( bdb_tool_info ) {
+		/* index what's left of a reindex */
+		if ( bdb_tool_batch_dispatch() )
+			rc = -1;
+		if ( bdb_tool_batch_wait() )
+			rc = -1;
+		ch_free( bdb_tool_batches[0].bb_recs );
+		ch_free( bdb_tool_batches[1].bb_recs );
+		bdb_tool_batches[0].bb_recs = NULL;
+		bdb_tool_batches[1].bb_recs = NULL;
+
 		slapd_shutdown = 1;
 #ifdef USE_TRICKLE
 		ldap_pvt_thread_mutex_lock( &bdb_tool_trickle_mutex );
@@ -206,6 +242,9 @@ int bdb_tool_entry_close(
 		slapd_shutdown = 0;
 	}
 
+	filter_prog_free( tool_prog, NULL );
+	tool_prog = NULL;
+
 	if( eh.bv.bv_val ) {
 		ch_free( eh.bv.bv_val );
 		eh.bv.bv_val = NULL;
@@ -230,7 +269,7 @@ int bdb_tool_entry_close(
 		return -1;
 	}
 			
-	return 0;
+	return rc;
 }
 
 ID
@@ -243,6 +282,11 @@ bdb_tool_entry_first_x(
 	tool_base = base;
 	tool_scope = scope;
 	tool_filter = f;
+	filter_prog_free( tool_prog, NULL );
+	tool_prog = filter_compile( f, NULL );
+
+	/* the cursor may be left anywhere by an earlier walk */
+	tool_rewind = 1;
 	
 	return bdb_tool_entry_next( be );
 }
@@ -265,7 +309,9 @@ next:;
 	data.ulen = data.dlen = sizeof( ehbuf );
 	data.data = ehbuf;
 	data.flags |= DB_DBT_PARTIAL;
-	rc = cursor->c_get( cursor, &key, &data, DB_NEXT );
+	rc = cursor->c_get( cursor, &key, &data,
+		tool_rewind ? DB_FIRST : DB_NEXT );
+	tool_rewind = 0;
 
 	if( rc ) {
 		/* If we're doing linear indexing and there are more attrs to
@@ -320,7 +366,9 @@ next:;
 		}
 #endif
 
-		if ( tool_filter && test_filter( NULL, tool_next_entry, tool_filter ) != LDAP_COMPARE_TRUE )
+		if ( tool_filter && ( tool_prog ?
+			test_filter_prog( NULL, tool_next_entry, tool_prog ) :
+			test_filter( NULL, tool_next_entry, tool_filter )) != LDAP_COMPARE_TRUE )
 		{
 			bdb_entry_release( &op, tool_next_entry, 0 );
 			tool_next_entry = NULL;
@@ -444,6 +492,9 @@ bdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep )
 
 	if( rc == LDAP_SUCCESS ) {
 		e->e_id = id;
+		/* The entry keeps the read buffer its values point into,
+		 * so that it outlives the next read */
+		BER_BVZERO( &eh.bv );
 #ifdef BDB_HIER
 		if ( slapMode & SLAP_TOOL_READONLY ) {
 			struct bdb_info *bdb = (struct bdb_info *) be->be_private;
@@ -691,7 +742,8 @@ ID bdb_tool_entry_put(
 	}
 #endif
 
-	if ( !bdb->bi_linear_index )
+	/* with index threads, the entry is indexed later, in a batch */
+	if ( !bdb->bi_linear_index && bdb_tool_threads < 2 )
 		rc = bdb_tool_index_add( &op, tid, e );
 	if( rc != 0 ) {
 		snprintf( text->bv_val, text->bv_len,
@@ -716,6 +768,22 @@ ID bdb_tool_entry_put(
 		goto done;
 	}
 
+	/* The batch gets its own copy, the caller frees the entry.
+	 * Errors are those of the earlier batches. */
+	if ( !bdb->bi_linear_index && bdb_tool_threads > 1 ) {
+		rc = bdb_tool_batch_add( be, entry_dup_bv( e ));
+		if( rc != 0 ) {
+			snprintf( text->bv_val, text->bv_len,
+					"index_entry_add failed: %s (%d)",
+					rc == LDAP_OTHER ? "Internal error" :
+					db_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				"=> " LDAP_XSTRING(bdb_tool_entry_put) ": %s\n",
+				text->bv_val, 0, 0 );
+			goto done;
+		}
+	}
+
 done:
 	if( rc == 0 ) {
 		if ( !( slapMode & SLAP_TOOL_QUICK )) {
@@ -748,6 +816,131 @@ done:
 	return e->e_id;
 }
 
+/* Index the entries of a batch, for the attributes of thread base */
+static int
+bdb_tool_batch_run( bdb_tool_batch *bb, int base )
+{
+	int i, rc = 0;
+
+	for ( i = 0; i < bb->bb_count; i++ ) {
+		rc = bdb_index_recrun( &bdb_tool_batch_op, bdb_tool_info,
+			bb->bb_recs + i * bdb_tool_info->bi_nattrs,
+			bb->bb_entries[i]->e_id, base );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"=> " LDAP_XSTRING(bdb_tool_batch_run)
+				": indexing id=%ld failed: %s (%d)\n",
+				(long) bb->bb_entries[i]->e_id,
+				rc == LDAP_OTHER ? "Internal error" : db_strerror(rc), rc );
+			break;
+		}
+	}
+	return rc;
+}
+
+/* Wait for the index threads to finish the running batch,
+ * and release its entries */
+static int
+bdb_tool_batch_wait( void )
+{
+	bdb_tool_batch *bb = bdb_tool_ix_batch;
+	int i, rc = 0;
+
+	if ( !bb )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &bdb_tool_index_mutex );
+	for ( i=1; i<bdb_tool_threads; i++ ) {
+		if ( bdb_tool_index_threads[i] == LDAP_BUSY ) {
+			ldap_pvt_thread_cond_wait( &bdb_tool_index_cond_main,
+				&bdb_tool_index_mutex );
+			i--;
+			continue;
+		}
+		if ( bdb_tool_index_threads[i] && !rc )
+			rc = bdb_tool_index_threads[i];
+	}
+	bdb_tool_ix_batch = NULL;
+	ldap_pvt_thread_mutex_unlock( &bdb_tool_index_mutex );
+
+	for ( i=0; i<bb->bb_count; i++ )
+		bdb_entry_release( &bdb_tool_batch_op, bb->bb_entries[i], 0 );
+	bb->bb_count = 0;
+
+	return rc;
+}
+
+/* Hand the filled batch to the index threads, and switch
+ * to the other one for reading */
+static int
+bdb_tool_batch_dispatch( void )
+{
+	bdb_tool_batch *bb = &bdb_tool_batches[ bdb_tool_batch_fill ];
+	int i, rc;
+
+	rc = bdb_tool_batch_wait();
+	if ( !bb->bb_count )
+		return rc;
+
+	ldap_pvt_thread_mutex_lock( &bdb_tool_index_mutex );
+	/* Wait for all threads to be ready */
+	while ( bdb_tool_index_tcount > 0 ) {
+		ldap_pvt_thread_cond_wait( &bdb_tool_index_cond_main,
+			&bdb_tool_index_mutex );
+	}
+	for ( i=1; i<bdb_tool_threads; i++ )
+		bdb_tool_index_threads[i] = LDAP_BUSY;
+	bdb_tool_ix_batch = bb;
+	bdb_tool_index_tcount = bdb_tool_threads - 1;
+	ldap_pvt_thread_cond_broadcast( &bdb_tool_index_cond_work );
+	ldap_pvt_thread_mutex_unlock( &bdb_tool_index_mutex );
+
+	bdb_tool_batch_fill ^= 1;
+
+	i = bdb_tool_batch_run( bb, 0 );
+	if ( i && !rc )
+		rc = i;
+	return rc;
+}
+
+/* Queue an entry for indexing. Errors of earlier batches
+ * are reported by the call that collects them. */
+static int
+bdb_tool_batch_add( BackendDB *be, Entry *e )
+{
+	struct bdb_info *bdb = (struct bdb_info *) be->be_private;
+	bdb_tool_batch *bb = &bdb_tool_batches[ bdb_tool_batch_fill ];
+	IndexRec *ir;
+	Attribute *a;
+	int rc;
+
+	if ( !bb->bb_recs ) {
+		bdb_tool_batch_op.o_hdr = &bdb_tool_batch_ohdr;
+		bdb_tool_batch_op.o_bd = be;
+		bdb_tool_batch_op.o_tmpmemctx = NULL;
+		bdb_tool_batch_op.o_tmpmfuncs = &ch_mfuncs;
+		bb->bb_recs = ch_malloc( BDB_TOOL_BATCH * bdb->bi_nattrs *
+			sizeof( IndexRec ));
+	}
+
+	ir = bb->bb_recs + bb->bb_count * bdb->bi_nattrs;
+	memset( ir, 0, bdb->bi_nattrs * sizeof( IndexRec ));
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		rc = bdb_index_recset( bdb, a, a->a_desc->ad_type,
+			&a->a_desc->ad_tags, ir );
+		if ( rc ) {
+			bdb_entry_release( &bdb_tool_batch_op, e, 0 );
+			return rc;
+		}
+	}
+
+	bb->bb_entries[ bb->bb_count++ ] = e;
+	if ( bb->bb_count < BDB_TOOL_BATCH )
+		return 0;
+
+	return bdb_tool_batch_dispatch();
+}
+
 int bdb_tool_entry_reindex(
 	BackendDB *be,
 	ID id,
@@ -830,6 +1023,12 @@ int bdb_tool_entry_reindex(
 		return -1;
 	}
 
+	/* The batch owns the entry from now on; linear indexing
+	 * switches attributes between passes, so it can't be queued */
+	if ( bdb_tool_threads > 1 && !bi->bi_linear_index ) {
+		return bdb_tool_batch_add( be, e );
+	}
+
 	if (! (slapMode & SLAP_TOOL_QUICK)) {
 	rc = TXN_BEGIN( bi->bi_dbenv, NULL, &tid, bi->bi_db_opflags );
 	if( rc != 0 ) {
@@ -990,6 +1189,21 @@ bdb_tool_idl_cmp( const void *v1, const void *v2 )
 	return memcmp( c1->kstr.bv_val, c2->kstr.bv_val, c1->kstr.bv_len );
 }
 
+/* Append the cached IDs of ic to list idl */
+static void
+bdb_tool_idl_gather( bdb_tool_idl_cache *ic, ID *idl )
+{
+	bdb_tool_idl_cache_entry *ice;
+	int i;
+
+	for ( ice = ic->head; ice; ice = ice->next ) {
+		for ( i=0; i<IDBLOCK; i++ ) {
+			if ( ice->ids[i] )
+				idl[++idl[0]] = ice->ids[i];
+		}
+	}
+}
+
 static int
 bdb_tool_idl_flush_one( void *v1, void *arg )
 {
@@ -999,8 +1213,8 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 	bdb_tool_idl_cache_entry *ice;
 	DBC *curs;
 	DBT key, data;
-	int i, rc;
-	ID id, nid;
+	int i, n, rc, bm;
+	ID id, nid, *idl = NULL;
 
 	/* Freshly allocated, ignore it */
 	if ( !ic->head && ic->count <= BDB_IDL_DB_SIZE ) {
@@ -1011,6 +1225,14 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 	if ( rc )
 		return -1;
 
+	/* A bitmap range keeps its IDs, to store them in containers */
+	if ( bdb->bi_idl_bitmap && ic->head && ic->count > BDB_IDL_DB_SIZE ) {
+		for ( ice = ic->head, n=0; ice; ice = ice->next, n++ )
+			/* counting */ ;
+		idl = ch_malloc( ( BDB_IDL_DB_SIZE + n * IDBLOCK + 1 ) * sizeof( ID ));
+		idl[0] = 0;
+	}
+
 	DBTzero( &key );
 	DBTzero( &data );
 
@@ -1025,9 +1247,14 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 	if ( rc == 0 && ic->count > BDB_IDL_DB_SIZE ) {
 		/* If it's not currently a range, must delete old info */
 		if ( nid ) {
+			if ( idl )
+				BDB_DISK2ID( &nid, &idl[++idl[0]] );
 			/* Skip lo */
-			while ( curs->c_get( curs, &key, &data, DB_NEXT_DUP ) == 0 )
+			while ( curs->c_get( curs, &key, &data, DB_NEXT_DUP ) == 0 ) {
+				if ( idl )
+					BDB_DISK2ID( &nid, &idl[++idl[0]] );
 				curs->c_del( curs, 0 );
+			}
 
 			nid = 0;
 			/* Store range marker */
@@ -1042,6 +1269,12 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 
 			/* Delete hi */
 			curs->c_del( curs, 0 );
+
+			/* Only add to containers that hold the whole set */
+			if ( idl && ( bdb_idl_bm_check( curs, &key, &bm ) || !bm )) {
+				ch_free( idl );
+				idl = NULL;
+			}
 		}
 		BDB_ID2DISK( ic->last, &nid );
 		curs->c_put( curs, &key, &data, DB_KEYLAST );
@@ -1064,11 +1297,9 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 			rc = -1;
 		}
 	} else {
-		int n;
-
 		/* Just a normal write */
 		rc = 0;
-		for ( ice = ic->head, n=0; ice; ice = ice->next, n++ ) {
+		for ( ice = ic->head; ice; ice = ice->next ) {
 			int end;
 			if ( ice->next ) {
 				end = IDBLOCK;
@@ -1095,13 +1326,23 @@ bdb_tool_idl_flush_one( void *v1, void *arg )
 				break;
 			}
 		}
-		if ( ic->head ) {
-			ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
-			ic->tail->next = bdb_tool_idl_free_list;
-			bdb_tool_idl_free_list = ic->head;
-			bdb->bi_idl_cache_size -= n;
-			ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
+	}
+	if ( idl ) {
+		if ( rc == 0 ) {
+			bdb_tool_idl_gather( ic, idl );
+			if ( bdb_idl_bm_put( curs, &key, idl, BDB_IDL_BM_OR ))
+				rc = -1;
 		}
+		ch_free( idl );
+	}
+	if ( ic->head ) {
+		for ( ice = ic->head, n=0; ice; ice = ice->next, n++ )
+			/* counting */ ;
+		ldap_pvt_thread_mutex_lock( &bdb->bi_idl_tree_lrulock );
+		ic->tail->next = bdb_tool_idl_free_list;
+		bdb_tool_idl_free_list = ic->head;
+		bdb->bi_idl_cache_size -= n;
+		ldap_pvt_thread_mutex_unlock( &bdb->bi_idl_tree_lrulock );
 	}
 	if ( ic != db->app_private ) {
 		ch_free( ic );
@@ -1205,8 +1446,11 @@ int bdb_tool_idl_add(
 		}
 		curs->c_close( curs );
 	}
+	/* bitmap ranges keep caching their IDs */
+	if ( ic->count >= BDB_IDL_DB_SIZE && bdb->bi_idl_bitmap ) {
+		ic->last = id;
 	/* are we a range already? */
-	if ( ic->count > BDB_IDL_DB_SIZE ) {
+	} else if ( ic->count > BDB_IDL_DB_SIZE ) {
 		ic->last = id;
 		return 0;
 	/* Are we at the limit, and converting to a range? */
@@ -1313,8 +1557,13 @@ bdb_tool_index_task( void *ctx, void *ptr )
 		}
 		ldap_pvt_thread_mutex_unlock( &bdb_tool_index_mutex );
 
-		bdb_tool_index_threads[base] = bdb_index_recrun( bdb_tool_ix_op,
-			bdb_tool_info, bdb_tool_index_rec, bdb_tool_ix_id, base );
+		if ( bdb_tool_ix_batch ) {
+			bdb_tool_index_threads[base] = bdb_tool_batch_run(
+				bdb_tool_ix_batch, base );
+		} else {
+			bdb_tool_index_threads[base] = bdb_index_recrun( bdb_tool_ix_op,
+				bdb_tool_info, bdb_tool_index_rec, bdb_tool_ix_id, base );
+		}
 	}
 
 	return NULL;
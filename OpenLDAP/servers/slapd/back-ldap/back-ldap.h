@@ -389,6 +389,13 @@ typedef struct ldapinfo_t {
 	/* must be between LDAP_BACK_CONN_PRIV_MIN
 	 * and LDAP_BACK_CONN_PRIV_MAX ! */
 #define	LDAP_BACK_CONN_PRIV_DEFAULT	(16)
+	/* operations multiplexed over a busy pooled connection
+	 * because the pool was full */
+	unsigned long		li_conn_priv_shared;
+	/* pooled connections found closed by the health check */
+	unsigned long		li_conn_priv_dropped;
+	time_t			li_conn_check;
+	void			*li_conn_check_task;
 
 	ldap_monitor_info_t	li_monitor_info;
 
@@ -34,6 +34,7 @@
 #include "back-ldap.h"
 #include "lutil.h"
 #include "lutil_ldap.h"
+#include "ldap_rq.h"
 
 #define LDAP_CONTROL_OBSOLETE_PROXY_AUTHZ	"2.16.840.1.113730.3.4.12"
 
@@ -907,13 +908,21 @@ ldap_back_getconn(
 retry_lock:
 		ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
 		if ( LDAP_BACK_PCONN_ISPRIV( &lc_curr ) ) {
-			/* lookup a conn that's not binding */
+			ldapconn_t	*lc_min = NULL;
+
+			/* lookup a conn that's not binding, and keep track
+			 * of the least loaded one in case all are in use */
 			LDAP_TAILQ_FOREACH( lc,
 				&li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv,
 				lc_q )
 			{
-				if ( !LDAP_BACK_CONN_BINDING( lc ) && lc->lc_refcnt == 0 ) {
-					break;
+				if ( !LDAP_BACK_CONN_BINDING( lc ) ) {
+					if ( lc->lc_refcnt == 0 ) {
+						break;
+					}
+					if ( lc_min == NULL || lc->lc_refcnt < lc_min->lc_refcnt ) {
+						lc_min = lc;
+					}
 				}
 			}
 
@@ -931,7 +940,16 @@ retry_lock:
 			} else if ( !LDAP_BACK_USE_TEMPORARIES( li )
 				&& li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_num == li->li_conn_priv_max )
 			{
-				lc = LDAP_TAILQ_FIRST( &li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv );
+				/* the pool is full: multiplex the operation
+				 * over the connection with the fewest
+				 * outstanding operations */
+				if ( lc_min != NULL ) {
+					lc = lc_min;
+					li->li_conn_priv_shared++;
+
+				} else {
+					lc = LDAP_TAILQ_FIRST( &li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv );
+				}
 			}
 			
 		} else {
@@ -1204,6 +1222,111 @@ ldap_back_release_conn_lock(
 	}
 }
 
+/*
+ * An idle connection has nothing to read: either the server
+ * closed it, or it sent an unsolicited notice before doing so
+ */
+static int
+ldap_back_conn_isdead( ldapconn_t *lc )
+{
+#ifdef MSG_DONTWAIT
+	ber_socket_t	s = AC_SOCKET_INVALID;
+	char		c;
+	int		rc;
+
+	if ( lc->lc_ld == NULL
+		|| ldap_get_option( lc->lc_ld, LDAP_OPT_DESC, &s ) != LDAP_OPT_SUCCESS
+		|| s == AC_SOCKET_INVALID )
+	{
+		return 1;
+	}
+
+	rc = recv( s, &c, 1, MSG_PEEK|MSG_DONTWAIT );
+	if ( rc < 0 ) {
+		int	err = sock_errno();
+
+		return !( err == EAGAIN || err == EWOULDBLOCK || err == EINTR );
+	}
+
+	return 1;
+#else /* ! MSG_DONTWAIT */
+	return 0;
+#endif /* ! MSG_DONTWAIT */
+}
+
+/*
+ * Periodically drop the idle pooled connections that are no longer
+ * usable, so that operations don't have to detect it and retry
+ */
+static void *
+ldap_back_conn_check( void *ctx, void *arg )
+{
+	struct re_s	*rtask = arg;
+	ldapinfo_t	*li = (ldapinfo_t *)rtask->arg;
+	int		i;
+
+	ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
+	for ( i = LDAP_BACK_PCONN_FIRST; i < LDAP_BACK_PCONN_LAST; i++ ) {
+		ldapconn_t	*lc, *next;
+
+		for ( lc = LDAP_TAILQ_FIRST( &li->li_conn_priv[ i ].lic_priv );
+			lc != NULL; lc = next )
+		{
+			next = LDAP_TAILQ_NEXT( lc, lc_q );
+			if ( lc->lc_refcnt != 0 || LDAP_BACK_CONN_BINDING( lc )
+				|| !ldap_back_conn_isdead( lc ) )
+			{
+				continue;
+			}
+
+			Debug( LDAP_DEBUG_TRACE,
+				"ldap_back_conn_check: dropping closed "
+				"pooled connection lc=%p\n", (void *)lc, 0, 0 );
+			li->li_conn_priv_dropped++;
+			ldap_back_freeconn( li, lc, 0 );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_conninfo.lai_mutex );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/*
+ * Start, reschedule or stop the pooled connections health check
+ * according to the current configuration
+ */
+void
+ldap_back_conn_check_schedule( ldapinfo_t *li, int stop )
+{
+	struct re_s	*rtask;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	rtask = li->li_conn_check_task;
+	if ( stop || li->li_conn_check == 0 ) {
+		if ( rtask != NULL ) {
+			if ( ldap_pvt_runqueue_isrunning( &slapd_rq, rtask ) ) {
+				ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+			}
+			ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+			li->li_conn_check_task = NULL;
+		}
+
+	} else if ( rtask != NULL ) {
+		rtask->interval.tv_sec = li->li_conn_check;
+
+	} else {
+		li->li_conn_check_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			li->li_conn_check, ldap_back_conn_check, li,
+			"ldap_back_conn_check",
+			li->li_uri != NULL ? li->li_uri : "" );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
 void
 ldap_back_quarantine(
 	Operation	*op,
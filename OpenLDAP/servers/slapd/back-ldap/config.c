@@ -66,6 +66,7 @@ enum {
 	LDAP_BACK_CFG_SINGLECONN,
 	LDAP_BACK_CFG_USETEMP,
 	LDAP_BACK_CFG_CONNPOOLMAX,
+	LDAP_BACK_CFG_CONNPOOLCHECK,
 	LDAP_BACK_CFG_CANCEL,
 	LDAP_BACK_CFG_QUARANTINE,
 	LDAP_BACK_CFG_ST_REQUEST,
@@ -299,6 +300,14 @@ static ConfigTable ldapcfg[] = {
 			"SYNTAX OMsInteger "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "conn-pool-check", "interval", 2, 2, 0,
+		ARG_MAGIC|LDAP_BACK_CFG_CONNPOOLCHECK,
+		ldap_back_cf_gen, "( OLcfgDbAt:3.28 "
+			"NAME 'olcDbConnectionPoolCheck' "
+			"DESC 'Interval between checks of idle pooled connections' "
+			"SYNTAX OMsDirectoryString "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 	{ "session-tracking-request", "true|FALSE", 2, 2, 0,
 		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_ST_REQUEST,
@@ -378,6 +387,7 @@ static ConfigOCs ldapocs[] = {
 			"$ olcDbQuarantine "
 			"$ olcDbUseTemporaryConn "
 			"$ olcDbConnectionPoolMax "
+			"$ olcDbConnectionPoolCheck "
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 			"$ olcDbSessionTrackingRequest "
 #endif /* SLAP_CONTROL_X_SESSION_TRACKING */
@@ -1326,6 +1336,18 @@ ldap_back_cf_gen( ConfigArgs *c )
 			c->value_int = li->li_conn_priv_max;
 			break;
 
+		case LDAP_BACK_CFG_CONNPOOLCHECK: {
+			char	buf[ SLAP_TEXT_BUFLEN ];
+
+			if ( li->li_conn_check == 0 ) {
+				return 1;
+			}
+
+			lutil_unparse_time( buf, sizeof( buf ), li->li_conn_check );
+			ber_str2bv( buf, 0, 0, &bv );
+			value_add_one( &c->rvalue_vals, &bv );
+			} break;
+
 		case LDAP_BACK_CFG_CANCEL: {
 			slap_mask_t	mask = LDAP_BACK_F_CANCEL_MASK2;
 
@@ -1507,6 +1529,13 @@ ldap_back_cf_gen( ConfigArgs *c )
 			li->li_conn_priv_max = LDAP_BACK_CONN_PRIV_MIN;
 			break;
 
+		case LDAP_BACK_CFG_CONNPOOLCHECK:
+			li->li_conn_check = 0;
+			if ( LDAP_BACK_ISOPEN( li ) ) {
+				ldap_back_conn_check_schedule( li, 0 );
+			}
+			break;
+
 		case LDAP_BACK_CFG_QUARANTINE:
 			if ( !LDAP_BACK_QUARANTINE( li ) ) {
 				break;
@@ -2106,6 +2135,22 @@ done_url:;
 		li->li_conn_priv_max = c->value_int;
 		break;
 
+	case LDAP_BACK_CFG_CONNPOOLCHECK: {
+		unsigned long	t;
+
+		if ( lutil_parse_time( c->argv[ 1 ], &t ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg),
+				"unable to parse conn pool check interval \"%s\"",
+				c->argv[ 1 ] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		li->li_conn_check = (time_t)t;
+		if ( LDAP_BACK_ISOPEN( li ) ) {
+			ldap_back_conn_check_schedule( li, 0 );
+		}
+		} break;
+
 	case LDAP_BACK_CFG_CANCEL: {
 		slap_mask_t		mask;
 
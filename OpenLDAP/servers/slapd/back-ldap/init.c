@@ -251,6 +251,8 @@ ldap_back_db_open( BackendDB *be, ConfigReply *cr )
 
 	li->li_flags |= LDAP_BACK_F_ISOPEN;
 
+	ldap_back_conn_check_schedule( li, 0 );
+
 	return rc;
 }
 
@@ -283,6 +285,7 @@ ldap_back_db_close( Backend *be, ConfigReply *cr )
 	int		rc = 0;
 
 	if ( be->be_private ) {
+		ldap_back_conn_check_schedule( (ldapinfo_t *)be->be_private, 1 );
 		rc = ldap_back_monitor_db_close( be );
 	}
 
@@ -298,6 +301,8 @@ ldap_back_db_destroy( Backend *be, ConfigReply *cr )
 
 		(void)ldap_back_monitor_db_destroy( be );
 
+		ldap_back_conn_check_schedule( li, 1 );
+
 		ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
 
 		if ( li->li_uri != NULL ) {
@@ -37,6 +37,11 @@
 static ObjectClass		*oc_olmLDAPDatabase;
 
 static AttributeDescription	*ad_olmDbURIList;
+static AttributeDescription	*ad_olmDbPoolConnections;
+static AttributeDescription	*ad_olmDbPoolBusyConnections;
+static AttributeDescription	*ad_olmDbPoolOperations;
+static AttributeDescription	*ad_olmDbPoolSharedOperations;
+static AttributeDescription	*ad_olmDbPoolDroppedConnections;
 
 /*
  * NOTE: there's some confusion in monitor OID arc;
@@ -70,6 +75,41 @@ static struct {
 		"DESC 'List of URIs a proxy is serving; can be modified run-time' "
 		"SUP managedInfo )",
 		&ad_olmDbURIList },
+	{ "( olmLDAPAttributes:2 "
+		"NAME ( 'olmDbPoolConnections' ) "
+		"DESC 'Number of pooled privileged connections' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPoolConnections },
+	{ "( olmLDAPAttributes:3 "
+		"NAME ( 'olmDbPoolBusyConnections' ) "
+		"DESC 'Number of pooled privileged connections in use' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPoolBusyConnections },
+	{ "( olmLDAPAttributes:4 "
+		"NAME ( 'olmDbPoolOperations' ) "
+		"DESC 'Number of operations outstanding on pooled privileged connections' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPoolOperations },
+	{ "( olmLDAPAttributes:5 "
+		"NAME ( 'olmDbPoolSharedOperations' ) "
+		"DESC 'Number of operations multiplexed over a busy pooled connection' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPoolSharedOperations },
+	{ "( olmLDAPAttributes:6 "
+		"NAME ( 'olmDbPoolDroppedConnections' ) "
+		"DESC 'Number of closed pooled connections dropped by the health check' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPoolDroppedConnections },
 
 	{ NULL }
 };
@@ -85,6 +125,11 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbURIList "
+			"$ olmDbPoolConnections "
+			"$ olmDbPoolBusyConnections "
+			"$ olmDbPoolOperations "
+			"$ olmDbPoolSharedOperations "
+			"$ olmDbPoolDroppedConnections "
 			") )",
 		&oc_olmLDAPDatabase },
 
@@ -108,6 +153,26 @@ ldap_back_monitor_info_destroy( ldapinfo_t * li )
 	return 0;
 }
 
+static void
+ldap_back_monitor_counter( Entry *e, AttributeDescription *ad, unsigned long n )
+{
+	Attribute	*a;
+	char		buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+	struct berval	bv;
+
+	a = attr_find( e->e_attrs, ad );
+	if ( a == NULL ) {
+		return;
+	}
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", n );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	if ( a->a_nvals != a->a_vals ) {
+		ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+	}
+}
+
 static int
 ldap_back_monitor_update(
 	Operation	*op,
@@ -118,6 +183,31 @@ ldap_back_monitor_update(
 	ldapinfo_t		*li = (ldapinfo_t *)priv;
 
 	Attribute		*a;
+	ldapconn_t		*lc;
+	unsigned long		nconns = 0, nbusy = 0, nops = 0,
+				nshared, ndropped;
+	int			i;
+
+	/* update pooled connections usage */
+	ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
+	for ( i = LDAP_BACK_PCONN_FIRST; i < LDAP_BACK_PCONN_LAST; i++ ) {
+		LDAP_TAILQ_FOREACH( lc, &li->li_conn_priv[ i ].lic_priv, lc_q ) {
+			nconns++;
+			if ( lc->lc_refcnt > 0 ) {
+				nbusy++;
+				nops += lc->lc_refcnt;
+			}
+		}
+	}
+	nshared = li->li_conn_priv_shared;
+	ndropped = li->li_conn_priv_dropped;
+	ldap_pvt_thread_mutex_unlock( &li->li_conninfo.lai_mutex );
+
+	ldap_back_monitor_counter( e, ad_olmDbPoolConnections, nconns );
+	ldap_back_monitor_counter( e, ad_olmDbPoolBusyConnections, nbusy );
+	ldap_back_monitor_counter( e, ad_olmDbPoolOperations, nops );
+	ldap_back_monitor_counter( e, ad_olmDbPoolSharedOperations, nshared );
+	ldap_back_monitor_counter( e, ad_olmDbPoolDroppedConnections, ndropped );
 
 	/* update olmDbURIList */
 	a = attr_find( e->e_attrs, ad_olmDbURIList );
@@ -562,6 +652,17 @@ ldap_back_monitor_db_open( BackendDB *be )
 			&bv, NULL );
 	}
 
+	/* pooled connections usage, filled in by ldap_back_monitor_update() */
+	{
+		struct berval	bv = BER_BVC( "0" );
+
+		attr_merge_one( e, ad_olmDbPoolConnections, &bv, NULL );
+		attr_merge_one( e, ad_olmDbPoolBusyConnections, &bv, NULL );
+		attr_merge_one( e, ad_olmDbPoolOperations, &bv, NULL );
+		attr_merge_one( e, ad_olmDbPoolSharedOperations, &bv, NULL );
+		attr_merge_one( e, ad_olmDbPoolDroppedConnections, &bv, NULL );
+	}
+
 	ber_dupbv( &li->li_monitor_info.lmi_nrdn, &e->e_nname );
 
 	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
@@ -47,6 +47,7 @@ extern BI_entry_get_rw		ldap_back_entry_get;
 
 void ldap_back_release_conn_lock( ldapinfo_t *li, ldapconn_t **lcp, int dolock );
 #define ldap_back_release_conn(li, lc) ldap_back_release_conn_lock((li), &(lc), 1)
+void ldap_back_conn_check_schedule( ldapinfo_t *li, int stop );
 int ldap_back_dobind( ldapconn_t **lcp, Operation *op, SlapReply *rs, ldap_back_send_t sendok );
 int ldap_back_retry( ldapconn_t **lcp, Operation *op, SlapReply *rs, ldap_back_send_t sendok );
 int ldap_back_map_result( SlapReply *rs );
@@ -131,6 +131,9 @@ typedef struct monitor_info_t {
 	AttributeDescription	*mi_ad_monitorUpdateRef;
 	AttributeDescription	*mi_ad_monitorRuntimeConfig;
 	AttributeDescription	*mi_ad_monitorSuperiorDN;
+	AttributeDescription	*mi_ad_monitorOpResponseTime;
+	AttributeDescription	*mi_ad_monitorCacheHits;
+	AttributeDescription	*mi_ad_monitorCacheMisses;
 
 	/*
 	 * Generic description attribute
@@ -147,6 +150,7 @@ typedef struct monitor_info_t {
 
 enum {
 	SLAPD_MONITOR_BACKEND = 0,
+	SLAPD_MONITOR_CACHES,
 	SLAPD_MONITOR_CONN,
 	SLAPD_MONITOR_DATABASE,
 	SLAPD_MONITOR_LISTENER,
@@ -171,6 +175,12 @@ enum {
 #define SLAPD_MONITOR_BACKEND_DN	\
 	SLAPD_MONITOR_BACKEND_RDN "," SLAPD_MONITOR_DN
 
+#define SLAPD_MONITOR_CACHES_NAME	"Caches"
+#define SLAPD_MONITOR_CACHES_RDN	\
+	SLAPD_MONITOR_AT "=" SLAPD_MONITOR_CACHES_NAME
+#define SLAPD_MONITOR_CACHES_DN	\
+	SLAPD_MONITOR_CACHES_RDN "," SLAPD_MONITOR_DN
+
 #define SLAPD_MONITOR_CONN_NAME		"Connections"
 #define SLAPD_MONITOR_CONN_RDN	\
 	SLAPD_MONITOR_AT "=" SLAPD_MONITOR_CONN_NAME
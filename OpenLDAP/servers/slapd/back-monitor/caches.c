@@ -0,0 +1,161 @@
+/* caches.c - deal with the caches subsystem */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2011 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "back-monitor.h"
+
+static int
+monitor_subsys_caches_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e );
+
+/*
+ * One entry for each of the slapd keycaches, named after it,
+ * showing its hits and misses.
+ */
+int
+monitor_subsys_caches_init(
+	BackendDB		*be,
+	monitor_subsys_t	*ms )
+{
+	monitor_info_t	*mi;
+
+	Entry		**ep, *e_caches;
+	monitor_entry_t	*mp;
+	slap_keycache_t	*kc;
+
+	assert( be != NULL );
+
+	ms->mss_update = monitor_subsys_caches_update;
+
+	mi = ( monitor_info_t * )be->be_private;
+
+	if ( monitor_cache_get( mi, &ms->mss_ndn, &e_caches ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_caches_init: "
+			"unable to get entry \"%s\"\n",
+			ms->mss_ndn.bv_val, 0, 0 );
+		return( -1 );
+	}
+
+	mp = ( monitor_entry_t * )e_caches->e_private;
+	mp->mp_children = NULL;
+	ep = &mp->mp_children;
+
+	for ( kc = slap_keycaches; kc; kc = kc->kc_next ) {
+		char			buf[ BACKMONITOR_BUFSIZE ];
+		struct berval		rdn, bv;
+		Entry			*e;
+
+		rdn.bv_val = buf;
+		rdn.bv_len = snprintf( buf, sizeof( buf ), "cn=%s", kc->kc_name );
+
+		e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn,
+			&rdn, mi->mi_oc_monitoredObject, mi, NULL, NULL );
+
+		if ( e == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_caches_init: "
+				"unable to create entry \"%s,%s\"\n",
+				rdn.bv_val, ms->mss_ndn.bv_val, 0 );
+			return( -1 );
+		}
+
+		BER_BVSTR( &bv, "0" );
+		attr_merge_one( e, mi->mi_ad_monitorCacheHits, &bv, NULL );
+		attr_merge_one( e, mi->mi_ad_monitorCacheMisses, &bv, NULL );
+
+		mp = monitor_entrypriv_create();
+		if ( mp == NULL ) {
+			return -1;
+		}
+		e->e_private = ( void * )mp;
+		mp->mp_info = ms;
+		mp->mp_flags = ms->mss_flags \
+			| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+
+		if ( monitor_cache_add( mi, e ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_caches_init: "
+				"unable to add entry \"%s,%s\"\n",
+				rdn.bv_val, ms->mss_ndn.bv_val, 0 );
+			return( -1 );
+		}
+
+		*ep = e;
+		ep = &mp->mp_next;
+	}
+
+	monitor_cache_release( mi, e_caches );
+
+	return( 0 );
+}
+
+static int
+monitor_subsys_caches_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e )
+{
+	monitor_info_t	*mi = ( monitor_info_t *)op->o_bd->be_private;
+
+	struct berval		rdn;
+	slap_keycache_t		*kc;
+	unsigned long		hits, misses;
+	char			buf[ SLAP_TEXT_BUFLEN ];
+	struct berval		bv;
+	Attribute		*a;
+
+	assert( mi != NULL );
+	assert( e != NULL );
+
+	dnRdn( &e->e_name, &rdn );
+
+	for ( kc = slap_keycaches; kc; kc = kc->kc_next ) {
+		if ( rdn.bv_len == STRLENOF( "cn=" ) + strlen( kc->kc_name ) &&
+			strcasecmp( rdn.bv_val + STRLENOF( "cn=" ), kc->kc_name ) == 0 )
+		{
+			break;
+		}
+	}
+
+	if ( kc == NULL ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	slap_keycache_counters( kc, &hits, &misses );
+
+	bv.bv_val = buf;
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorCacheHits );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	/* FIXME: touch modifyTimestamp? */
+
+	return SLAP_CB_CONTINUE;
+}
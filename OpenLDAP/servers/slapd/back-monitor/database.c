@@ -39,6 +39,12 @@ monitor_subsys_database_modify(
 	SlapReply	*rs,
 	Entry		*e );
 
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e );
+
 static struct restricted_ops_t {
 	struct berval	op;
 	unsigned int	tag;
@@ -554,6 +560,7 @@ monitor_subsys_database_init(
 	assert( be != NULL );
 
 	ms->mss_modify = monitor_subsys_database_modify;
+	ms->mss_update = monitor_subsys_database_update;
 
 	mi = ( monitor_info_t * )be->be_private;
 
@@ -623,6 +630,56 @@ monitor_subsys_database_init(
 	return( 0 );
 }
 
+/*
+ * Response times of the operations handled by each database,
+ * one monitorOpResponseTime value per operation type
+ */
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e )
+{
+	monitor_info_t		*mi = (monitor_info_t *)op->o_bd->be_private;
+	static struct berval	bv_frontend = BER_BVC( "cn=frontend" );
+	struct berval		rdn;
+	BackendDB		*be;
+	slap_histogram_t	hist[ SLAP_OP_LAST ];
+	BerVarray		vals = NULL;
+	int			n;
+
+	dnRdn( &e->e_nname, &rdn );
+
+	if ( dn_match( &rdn, &bv_frontend ) ) {
+		be = frontendDB;
+
+	} else if ( sscanf( e->e_nname.bv_val, "cn=database %d,", &n ) == 1 ) {
+		LDAP_STAILQ_FOREACH( be, &backendDB, be_next ) {
+			if ( n == 0 ) {
+				break;
+			}
+			n--;
+		}
+
+	} else {
+		return SLAP_CB_CONTINUE;
+	}
+
+	if ( be == NULL || be->be_statsid == 0 ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	memset( hist, 0, sizeof( hist ) );
+	monitor_counters_db_histograms( be->be_statsid, hist );
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorOpResponseTime );
+	monitor_histograms2vals( hist, &vals );
+	attr_merge_normalize( e, mi->mi_ad_monitorOpResponseTime, vals, NULL );
+	ber_bvarray_free( vals );
+
+	return SLAP_CB_CONTINUE;
+}
+
 /*
  * v: array of values
  * cur: must not contain the tags corresponding to the values in v
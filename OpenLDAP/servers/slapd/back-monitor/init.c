@@ -89,6 +89,17 @@ static struct monitor_subsys_t known_monitor_subsys[] = {
 		NULL,   /* update */
 		NULL,   /* create */
 		NULL	/* modify */
+       	}, { 
+		SLAPD_MONITOR_CACHES_NAME,
+		BER_BVNULL, BER_BVNULL, BER_BVNULL,
+		{ BER_BVC( "This subsystem contains information about caches." ),
+			BER_BVNULL },
+		MONITOR_F_PERSISTENT_CH,
+		monitor_subsys_caches_init,
+		NULL,	/* destroy */
+		NULL,   /* update */
+		NULL,   /* create */
+		NULL	/* modify */
        	}, { 
 		SLAPD_MONITOR_CONN_NAME,
 		BER_BVNULL, BER_BVNULL, BER_BVNULL,
@@ -1930,6 +1941,27 @@ monitor_back_initialize(
 			"NO-USER-MODIFICATION "
 			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
 			offsetof(monitor_info_t, mi_ad_monitorSuperiorDN) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.31 "
+			"NAME 'monitorOpResponseTime' "
+			"DESC 'monitor response time distribution, in microseconds' "
+			"SUP monitoredInfo "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorOpResponseTime) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.32 "
+			"NAME 'monitorCacheHits' "
+			"DESC 'number of lookups that found the value in a cache' "
+			"SUP monitorCounter "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorCacheHits) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.33 "
+			"NAME 'monitorCacheMisses' "
+			"DESC 'number of lookups that did not find the value in a cache' "
+			"SUP monitorCounter "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorCacheMisses) },
 		{ NULL, 0, -1 }
 	};
 
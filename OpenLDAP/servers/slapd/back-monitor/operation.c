@@ -25,6 +25,7 @@
 #include <ac/string.h>
 
 #include "slap.h"
+#include "lutil.h"
 #include "back-monitor.h"
 #include "lber_pvt.h"
 
@@ -45,6 +46,36 @@ struct monitor_ops_t {
 	{ BER_BVNULL,			BER_BVNULL }
 };
 
+/* NOTE: keep in sync with slap_op_t */
+struct berval	monitor_opnames[] = {
+	BER_BVC( "bind" ),
+	BER_BVC( "unbind" ),
+	BER_BVC( "search" ),
+	BER_BVC( "compare" ),
+	BER_BVC( "modify" ),
+	BER_BVC( "modrdn" ),
+	BER_BVC( "add" ),
+	BER_BVC( "delete" ),
+	BER_BVC( "abandon" ),
+	BER_BVC( "extended" ),
+	BER_BVNULL
+};
+
+static struct berval	monitor_slow_rdn = BER_BVC( "cn=Slow" );
+static struct berval	monitor_slow_nrdn = BER_BVC( "cn=slow" );
+
+static int
+monitor_subsys_ops_slow_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e );
+
+static int
+monitor_subsys_ops_modify(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e );
+
 static int
 monitor_subsys_ops_destroy(
 	BackendDB		*be,
@@ -63,7 +94,7 @@ monitor_subsys_ops_init(
 {
 	monitor_info_t	*mi;
 	
-	Entry		*e_op, **ep;
+	Entry		*e_op, *e, **ep;
 	monitor_entry_t	*mp;
 	int 		i;
 	struct berval	bv_zero = BER_BVC( "0" );
@@ -72,6 +103,7 @@ monitor_subsys_ops_init(
 
 	ms->mss_destroy = monitor_subsys_ops_destroy;
 	ms->mss_update = monitor_subsys_ops_update;
+	ms->mss_modify = monitor_subsys_ops_modify;
 
 	mi = ( monitor_info_t * )be->be_private;
 
@@ -95,7 +127,6 @@ monitor_subsys_ops_init(
 
 	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
 		struct berval	rdn;
-		Entry		*e;
 		struct berval bv;
 
 		/*
@@ -143,6 +174,44 @@ monitor_subsys_ops_init(
 		ep = &mp->mp_next;
 	}
 
+	/*
+	 * Slow operations
+	 */
+	e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn, &monitor_slow_rdn,
+		mi->mi_oc_monitoredObject, mi, NULL, NULL );
+
+	if ( e == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_ops_init: "
+			"unable to create entry \"%s,%s\"\n",
+			monitor_slow_rdn.bv_val,
+			ms->mss_ndn.bv_val, 0 );
+		return( -1 );
+	}
+
+	attr_merge_one( e, mi->mi_ad_monitorCounter, &bv_zero, NULL );
+
+	mp = monitor_entrypriv_create();
+	if ( mp == NULL ) {
+		return -1;
+	}
+	e->e_private = ( void * )mp;
+	mp->mp_info = ms;
+	mp->mp_flags = ms->mss_flags \
+		| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+
+	if ( monitor_cache_add( mi, e ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_ops_init: "
+			"unable to add entry \"%s,%s\"\n",
+			monitor_slow_rdn.bv_val,
+			ms->mss_ndn.bv_val, 0 );
+		return( -1 );
+	}
+
+	*ep = e;
+	ep = &mp->mp_next;
+
 	monitor_cache_release( mi, e_op );
 
 	return( 0 );
@@ -174,18 +243,33 @@ monitor_subsys_ops_update(
 
 	ldap_pvt_mp_t		nInitiated = LDAP_PVT_MP_INIT,
 				nCompleted = LDAP_PVT_MP_INIT;
-	struct berval		rdn;
+	struct berval		rdn, bv;
 	int 			i;
 	Attribute		*a;
 	slap_counters_t *sc;
 	static struct berval	bv_ops = BER_BVC( "cn=operations" );
+	slap_histogram_t	hist[ SLAP_OP_LAST ], all;
+	char			buf[ BACKMONITOR_BUFSIZE ];
 
 	assert( mi != NULL );
 	assert( e != NULL );
 
 	dnRdn( &e->e_nname, &rdn );
 
+	if ( dn_match( &rdn, &monitor_slow_nrdn ) ) {
+		return monitor_subsys_ops_slow_update( op, rs, e );
+	}
+
+	memset( hist, 0, sizeof( hist ) );
+	memset( &all, 0, sizeof( all ) );
+	monitor_counters_histograms( offsetof( slap_counters_t, sc_ops_time_ ),
+		hist, 0 );
+
 	if ( dn_match( &rdn, &bv_ops ) ) {
+		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+			slap_histogram_merge( &all, &hist[ i ] );
+		}
+
 		ldap_pvt_mp_init( nInitiated );
 		ldap_pvt_mp_init( nCompleted );
 
@@ -218,6 +302,7 @@ monitor_subsys_ops_update(
 					ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
 				}
 				ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+				all = hist[ i ];
 				break;
 			}
 		}
@@ -242,8 +327,292 @@ monitor_subsys_ops_update(
 	UI2BV( &a->a_vals[ 0 ], nCompleted );
 	ldap_pvt_mp_clear( nCompleted );
 
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorOpResponseTime );
+	monitor_histogram2bv( 0, NULL, &all, buf, sizeof( buf ), &bv );
+	attr_merge_one( e, mi->mi_ad_monitorOpResponseTime, &bv, NULL );
+
 	/* FIXME: touch modifyTimestamp? */
 
 	return SLAP_CB_CONTINUE;
 }
 
+
+/*
+ * One monitoredInfo value per slow operation, most recent first
+ */
+static int
+monitor_subsys_ops_slow_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e )
+{
+	monitor_info_t		*mi = ( monitor_info_t * )op->o_bd->be_private;
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	char			tbuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct tm		tm;
+	struct berval		bv;
+	BerVarray		vals = NULL;
+	Attribute		*a;
+	slap_slowop_t		*so;
+	unsigned long		total;
+	int			i, l, n = 0;
+
+	ldap_pvt_thread_mutex_lock( &slap_slowlog.sl_mutex );
+	for ( i = 0; slap_slowlog.sl_ring && i < slap_slowlog.sl_size; i++ ) {
+		so = &slap_slowlog.sl_ring[ ( slap_slowlog.sl_next +
+			slap_slowlog.sl_size - 1 - i ) % slap_slowlog.sl_size ];
+		if ( so->so_time == 0 ) {
+			/* the ring has not wrapped yet */
+			break;
+		}
+
+		ldap_pvt_gmtime( &so->so_time, &tm );
+		lutil_gentime( tbuf, sizeof( tbuf ), &tm );
+
+		l = snprintf( buf, sizeof( buf ),
+			"{%d}%s conn=%lu op=%lu %s etime=%lu.%06lu err=%d "
+			"db=\"%s\" base=\"%s\"",
+			n, tbuf, so->so_connid, so->so_opid,
+			monitor_opnames[ so->so_type ].bv_val,
+			so->so_usec / 1000000, so->so_usec % 1000000, so->so_err,
+			BER_BVISNULL( &so->so_suffix ) ? "" : so->so_suffix.bv_val,
+			BER_BVISNULL( &so->so_base ) ? "" : so->so_base.bv_val );
+		if ( so->so_type == SLAP_OP_SEARCH && l >= 0 && l < sizeof( buf ) ) {
+			l += snprintf( buf + l, sizeof( buf ) - l,
+				" scope=%d filter=\"%s\" nentries=%d "
+				"candidates=%d examined=%d",
+				so->so_scope,
+				BER_BVISNULL( &so->so_filter ) ? "" : so->so_filter.bv_val,
+				so->so_nentries, so->so_ncandidates, so->so_nexamined );
+		}
+		if ( l < 0 ) {
+			continue;
+		}
+
+		/* long filters are truncated */
+		bv.bv_val = buf;
+		bv.bv_len = l < sizeof( buf ) ? l : sizeof( buf ) - 1;
+		value_add_one( &vals, &bv );
+		n++;
+	}
+	total = slap_slowlog.sl_total;
+	ldap_pvt_thread_mutex_unlock( &slap_slowlog.sl_mutex );
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+	if ( vals ) {
+		attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorCounter );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", total );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	return SLAP_CB_CONTINUE;
+}
+
+/*
+ * Replacing managedInfo with the value "reset" clears the response
+ * times on cn=Operations, and the slow operations on cn=Slow.
+ */
+static int
+monitor_subsys_ops_modify(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e )
+{
+	monitor_info_t		*mi = ( monitor_info_t * )op->o_bd->be_private;
+	Modifications		*ml;
+	struct berval		rdn;
+	static struct berval	bv_ops = BER_BVC( "cn=operations" );
+	static struct berval	bv_reset = BER_BVC( "reset" );
+	int			slow, reset = 0;
+
+	dnRdn( &e->e_nname, &rdn );
+
+	slow = dn_match( &rdn, &monitor_slow_nrdn );
+	if ( !slow && !dn_match( &rdn, &bv_ops ) ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	for ( ml = op->orm_modlist; ml != NULL; ml = ml->sml_next ) {
+		Modification	*mod = &ml->sml_mod;
+
+		/* accept (and ignore) modifiersName, modifyTimestamp */
+		if ( is_at_operational( mod->sm_desc->ad_type ) ) {
+			continue;
+		}
+
+		if ( mod->sm_desc != mi->mi_ad_managedInfo ||
+			( mod->sm_op != LDAP_MOD_REPLACE &&
+				mod->sm_op != LDAP_MOD_DELETE ) ||
+			mod->sm_values == NULL ||
+			!BER_BVISNULL( &mod->sm_values[ 1 ] ) ||
+			!bvmatch( &mod->sm_values[ 0 ], &bv_reset ) )
+		{
+			rs->sr_text = "only \"managedInfo: reset\" is allowed";
+			return rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+		}
+		reset = 1;
+	}
+
+	if ( reset ) {
+		if ( slow ) {
+			slap_slowlog_resize( slap_slowlog.sl_size );
+
+		} else {
+			monitor_counters_histograms(
+				offsetof( slap_counters_t, sc_ops_time_ ), NULL, 1 );
+		}
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+/*
+ * Sum the per-thread histograms found at offset in slap_counters_t,
+ * one per operation type, into hist[], and optionally clear them.
+ */
+void
+monitor_counters_histograms(
+	size_t			offset,
+	slap_histogram_t	*hist,
+	int			reset )
+{
+	slap_counters_t		*sc;
+	slap_histogram_t	*h;
+	int			i;
+
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	for ( sc = &slap_counters; sc; sc = sc->sc_next ) {
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+		}
+		h = (slap_histogram_t *)( (char *)sc + offset );
+		if ( hist != NULL ) {
+			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+				slap_histogram_merge( &hist[ i ], &h[ i ] );
+			}
+		}
+		if ( reset ) {
+			memset( h, 0, SLAP_OP_LAST * sizeof( slap_histogram_t ) );
+		}
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+}
+
+/*
+ * Sum the per-thread response time histograms of database slot id
+ * into hist[], one per operation type.
+ */
+void
+monitor_counters_db_histograms(
+	int			id,
+	slap_histogram_t	*hist )
+{
+	slap_counters_t		*sc;
+	int			i;
+
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	for ( sc = &slap_counters; sc; sc = sc->sc_next ) {
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+		}
+		if ( id <= sc->sc_db_nslots ) {
+			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+				slap_histogram_merge( &hist[ i ],
+					&sc->sc_db_time_[ id - 1 ][ i ] );
+			}
+		}
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+}
+
+/*
+ * Format a histogram as
+ * "{<n>}<name> count=<n> p50=<us> p90=<us> p99=<us> p999=<us> max=<us>
+ *  buckets=<from>:<count>,..." listing the non-empty buckets;
+ * the "{<n>}<name> " prefix is omitted when name is NULL
+ */
+void
+monitor_histogram2bv(
+	int			n,
+	struct berval		*name,
+	slap_histogram_t	*h,
+	char			*buf,
+	size_t			size,
+	struct berval		*bv )
+{
+	char		*sep = " buckets=";
+	ber_len_t	len = 0;
+	int		i, l;
+
+	if ( name != NULL ) {
+		len = snprintf( buf, size, "{%d}%s ", n, name->bv_val );
+	}
+	len += snprintf( buf + len, size - len, "count=%lu p50=%lu p90=%lu "
+		"p99=%lu p999=%lu max=%lu", h->sh_count,
+		slap_histogram_quantile( h, 500 ),
+		slap_histogram_quantile( h, 900 ),
+		slap_histogram_quantile( h, 990 ),
+		slap_histogram_quantile( h, 999 ),
+		h->sh_max );
+
+	for ( i = 0; i < SLAP_HIST_BUCKETS; i++ ) {
+		if ( h->sh_buckets[ i ] == 0 ) {
+			continue;
+		}
+		l = snprintf( buf + len, size - len, "%s%lu:%lu", sep,
+			slap_histogram_bound( i ), h->sh_buckets[ i ] );
+		if ( l < 0 || len + l >= size ) {
+			/* out of room, drop the partial bucket */
+			buf[ len ] = '\0';
+			break;
+		}
+		len += l;
+		sep = ",";
+	}
+
+	bv->bv_val = buf;
+	bv->bv_len = len;
+}
+
+/*
+ * Append to *vals a "{0}all" value summing hist[], followed by
+ * a value for each operation type that has samples
+ */
+void
+monitor_histograms2vals(
+	slap_histogram_t	*hist,
+	BerVarray		*vals )
+{
+	static struct berval	bv_all = BER_BVC( "all" );
+	slap_histogram_t	all;
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+	int			i;
+
+	memset( &all, 0, sizeof( all ) );
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		slap_histogram_merge( &all, &hist[ i ] );
+	}
+	monitor_histogram2bv( 0, &bv_all, &all, buf, sizeof( buf ), &bv );
+	value_add_one( vals, &bv );
+
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		if ( hist[ i ].sh_count == 0 ) {
+			continue;
+		}
+		monitor_histogram2bv( i + 1, &monitor_opnames[ i ],
+			&hist[ i ], buf, sizeof( buf ), &bv );
+		value_add_one( vals, &bv );
+	}
+}
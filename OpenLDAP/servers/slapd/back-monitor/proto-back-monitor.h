@@ -83,6 +83,14 @@ monitor_back_release(
 	Entry *e,
 	int rw );
 
+/*
+ * caches
+ */
+extern int
+monitor_subsys_caches_init LDAP_P((
+	BackendDB		*be,
+	monitor_subsys_t	*ms ));
+
 /*
  * connections
  */
@@ -270,6 +278,28 @@ extern int
 monitor_subsys_ops_init LDAP_P((
 	BackendDB		*be,
 	monitor_subsys_t	*ms ));
+extern struct berval monitor_opnames[];
+extern void
+monitor_counters_histograms LDAP_P((
+	size_t			offset,
+	slap_histogram_t	*hist,
+	int			reset ));
+extern void
+monitor_counters_db_histograms LDAP_P((
+	int			id,
+	slap_histogram_t	*hist ));
+extern void
+monitor_histogram2bv LDAP_P((
+	int			n,
+	struct berval		*name,
+	slap_histogram_t	*h,
+	char			*buf,
+	size_t			size,
+	struct berval		*bv ));
+extern void
+monitor_histograms2vals LDAP_P((
+	slap_histogram_t	*hist,
+	BerVarray		*vals ));
 
 /*
  * overlay
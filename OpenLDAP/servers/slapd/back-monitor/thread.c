@@ -34,6 +34,8 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_WAITTIME,
+	MT_RUNTIME,
 
 	MT_LAST
 } monitor_thread_t;
@@ -88,6 +90,13 @@ static struct {
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
 
+	{ BER_BVC( "cn=Wait Time" ),
+		BER_BVC("Microseconds operations waited for a thread, by operation type"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_WAITTIME },
+	{ BER_BVC( "cn=Run Time" ),
+		BER_BVC("Microseconds threads spent running operations, by operation type"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_RUNTIME },
+
 	{ BER_BVNULL }
 };
 
@@ -96,6 +105,12 @@ monitor_subsys_thread_update(
 	Operation		*op,
 	SlapReply		*rs,
 	Entry 			*e );
+
+static int 
+monitor_subsys_thread_modify( 
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e );
 #endif /* ! NO_THREADS */
 
 /*
@@ -113,6 +128,7 @@ monitor_subsys_thread_init(
 	int		i;
 
 	ms->mss_update = monitor_subsys_thread_update;
+	ms->mss_modify = monitor_subsys_thread_modify;
 
 	mi = ( monitor_info_t * )be->be_private;
 
@@ -231,6 +247,7 @@ monitor_subsys_thread_update(
 	struct re_s		*re;
 	int			count = -1;
 	char			*state = NULL;
+	slap_histogram_t	hist[ SLAP_OP_LAST ];
 
 	assert( mi != NULL );
 
@@ -318,6 +335,20 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_WAITTIME:
+		case MT_RUNTIME:
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+
+			memset( hist, 0, sizeof( hist ) );
+			monitor_counters_histograms( mt[ which ].mt == MT_WAITTIME ?
+				offsetof( slap_counters_t, sc_ops_wait_ ) :
+				offsetof( slap_counters_t, sc_ops_run_ ), hist, 0 );
+			monitor_histograms2vals( hist, &vals );
+
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			break;
+
 		default:
 			assert( 0 );
 		}
@@ -355,4 +386,64 @@ monitor_subsys_thread_update(
 
 	return SLAP_CB_CONTINUE;
 }
+/*
+ * Replacing or deleting managedInfo with the value "reset"
+ * on cn=Wait Time or cn=Run Time clears its histograms.
+ */
+static int 
+monitor_subsys_thread_modify( 
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )op->o_bd->be_private;
+	Modifications	*ml;
+	struct berval	rdn;
+	static struct berval	bv_reset = BER_BVC( "reset" );
+	int		which, i, reset = 0;
+
+	dnRdn( &e->e_nname, &rdn );
+
+	for ( i = 0; !BER_BVISNULL( &mt[ i ].nrdn ); i++ ) {
+		if ( dn_match( &mt[ i ].nrdn, &rdn ) ) {
+			break;
+		}
+	}
+
+	which = i;
+	if ( BER_BVISNULL( &mt[ which ].nrdn ) ||
+		( mt[ which ].mt != MT_WAITTIME && mt[ which ].mt != MT_RUNTIME ) )
+	{
+		return SLAP_CB_CONTINUE;
+	}
+
+	for ( ml = op->orm_modlist; ml != NULL; ml = ml->sml_next ) {
+		Modification	*mod = &ml->sml_mod;
+
+		/* accept (and ignore) modifiersName, modifyTimestamp */
+		if ( is_at_operational( mod->sm_desc->ad_type ) ) {
+			continue;
+		}
+
+		if ( mod->sm_desc != mi->mi_ad_managedInfo ||
+			( mod->sm_op != LDAP_MOD_REPLACE &&
+				mod->sm_op != LDAP_MOD_DELETE ) ||
+			mod->sm_values == NULL ||
+			!BER_BVISNULL( &mod->sm_values[ 1 ] ) ||
+			!bvmatch( &mod->sm_values[ 0 ], &bv_reset ) )
+		{
+			rs->sr_text = "only \"managedInfo: reset\" is allowed";
+			return rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+		}
+		reset = 1;
+	}
+
+	if ( reset ) {
+		monitor_counters_histograms( mt[ which ].mt == MT_WAITTIME ?
+			offsetof( slap_counters_t, sc_ops_wait_ ) :
+			offsetof( slap_counters_t, sc_ops_run_ ), NULL, 1 );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
 #endif /* ! NO_THREADS */
@@ -439,6 +439,37 @@ backend_stopdown_one( BackendDB *bd )
 	}
 }
 
+/* Give the database the lowest response time slot not in use */
+void backend_db_stats_init( BackendDB *bd )
+{
+	BackendDB *b2;
+	int id = 1;
+
+retry:
+	if ( frontendDB && frontendDB->be_statsid == id ) {
+		id++;
+		goto retry;
+	}
+	LDAP_STAILQ_FOREACH( b2, &backendDB, be_next ) {
+		if ( b2->be_statsid == id ) {
+			id++;
+			goto retry;
+		}
+	}
+	bd->be_statsid = id;
+}
+
+void backend_db_stats_destroy( BackendDB *bd )
+{
+	if ( bd->be_statsid ) {
+#ifdef SLAPD_MONITOR
+		/* don't hand its samples to the next database in the slot */
+		slap_counters_db_clear( bd->be_statsid );
+#endif /* SLAPD_MONITOR */
+		bd->be_statsid = 0;
+	}
+}
+
 void backend_destroy_one( BackendDB *bd, int dynamic )
 {
 	if ( dynamic ) {
@@ -475,6 +506,7 @@ void backend_destroy_one( BackendDB *bd, int dynamic )
 	}
 
 	ldap_pvt_thread_mutex_destroy( &bd->be_pcl_mutex );
+	backend_db_stats_destroy( bd );
 
 	if ( dynamic ) {
 		free( bd );
@@ -519,6 +551,7 @@ int backend_destroy(void)
 			free( bd->be_rootpw.bv_val );
 		}
 		acl_destroy( bd->be_acl );
+		backend_db_stats_destroy( bd );
 		frontendDB = NULL;
 	}
 
@@ -599,6 +632,7 @@ backend_db_init(
 			idx = -1;
 		nbackends++;
 		backend_db_insert( be, idx );
+		backend_db_stats_init( be );
 	}
 
 	be->bd_info = bi;
@@ -626,6 +660,7 @@ backend_db_init(
 		if ( !b0 ) {
 			LDAP_STAILQ_REMOVE(&backendDB, be, BackendDB, be_next);
 			ldap_pvt_thread_mutex_destroy( &be->be_pcl_mutex );
+			backend_db_stats_destroy( be );
 			ch_free( be );
 			be = NULL;
 			nbackends--;
@@ -204,6 +204,10 @@ enum {
 	CFG_TLS_IDENTITY,
 	CFG_TLS_TRUSTED_CERTS,
 	CFG_ACCOUNTPOLICY_OVERRIDE,
+	CFG_THREADQS,
+	CFG_SLOWOP_THRESH,
+	CFG_SLOWOP_ENTRIES,
+	CFG_ACL_CACHE,
 	
 	CFG_LAST
 };
@@ -306,6 +310,14 @@ static ConfigTable config_back_cf_table[] = {
 			"DESC 'Access Control List' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "acl_cache_size", "slots", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_ACL_CACHE,
+		&config_generic, "( OLcfgGlAt:98 NAME 'olcAclCacheSize' "
+			"DESC 'Per-thread ACL cache slots, 0 to disable' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "acl_index", "on|off", 2, 2, 0, ARG_ON_OFF, &acl_index_use,
+		"( OLcfgGlAt:99 NAME 'olcAclIndex' "
+			"DESC 'Skip access controls whose target cannot match the entry' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "add_content_acl",	NULL, 0, 0, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_ACL_ADD,
 		&config_generic, "( OLcfgGlAt:86 NAME 'olcAddContentAcl' "
 			"DESC 'Check ACLs against content of Add ops' "
@@ -386,6 +398,10 @@ static ConfigTable config_back_cf_table[] = {
 		&config_extra_attrs, "( OLcfgDbAt:0.20 NAME 'olcExtraAttrs' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "filter_compile", "on|off", 2, 2, 0, ARG_ON_OFF, &filter_compile_use,
+		"( OLcfgGlAt:100 NAME 'olcFilterCompile' "
+			"DESC 'Compile search filters tested against many entries' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "gentlehup", "on|off", 2, 2, 0,
 #ifdef SIGHUP
 		ARG_ON_OFF, &global_gentlehup,
@@ -622,12 +638,23 @@ static ConfigTable config_back_cf_table[] = {
 	{ "sizelimit", "limit",	2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_sizelimit, "( OLcfgGlAt:60 NAME 'olcSizeLimit' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "slowop_entries", "count", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_SLOWOP_ENTRIES,
+		&config_generic, "( OLcfgGlAt:97 NAME 'olcSlowOpEntries' "
+			"DESC 'Number of slow operations kept for back-monitor' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "slowop_threshold", "milliseconds", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_SLOWOP_THRESH,
+		&config_generic, "( OLcfgGlAt:96 NAME 'olcSlowOpThreshold' "
+			"DESC 'Response time above which operations are kept as slow, 0 to disable' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sockbuf_max_incoming", "max", 2, 2, 0, ARG_BER_LEN_T,
 		&sockbuf_max_incoming, "( OLcfgGlAt:61 NAME 'olcSockbufMaxIncoming' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sockbuf_max_incoming_auth", "max", 2, 2, 0, ARG_BER_LEN_T,
 		&sockbuf_max_incoming_auth, "( OLcfgGlAt:62 NAME 'olcSockbufMaxIncomingAuth' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "sockbuf_max_outgoing", "max", 2, 2, 0, ARG_BER_LEN_T,
+		&sockbuf_max_outgoing, "( OLcfgGlAt:94 NAME 'olcSockbufMaxOutgoing' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sortvals", "attr", 2, 0, 0, ARG_MAGIC|CFG_SORTVALS,
 		&config_generic, "( OLcfgGlAt:83 NAME 'olcSortVals' "
 			"DESC 'Attributes whose values will always be sorted' "
@@ -665,6 +692,14 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:66 NAME 'olcThreads' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadqueues", "count", 2, 2, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_INT|ARG_MAGIC|CFG_THREADQS, &config_generic,
+#endif
+		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
@@ -853,11 +888,13 @@ static ConfigOCs cf_ocs[] = {
 		"NAME 'olcGlobal' "
 		"DESC 'OpenLDAP Global configuration options' "
 		"SUP olcConfig STRUCTURAL "
-		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
+		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAclCacheSize $ "
+		 "olcAclIndex $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcDisallows $ olcFilterCompile $ olcGentleHUP $ "
+		 "olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexIntLen $ "
 		 "olcLocalSSF $ olcLogFile $ olcLogLevel $ "
@@ -867,9 +904,11 @@ static ConfigOCs cf_ocs[] = {
 		 "olcRootDSE $ "
 		 "olcSaslAuxprops $ olcSaslHost $ olcSaslRealm $ olcSaslSecProps $ "
 		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
+		 "olcSlowOpEntries $ olcSlowOpThreshold $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
+		 "olcSockbufMaxOutgoing $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcTimeLimit $ olcTLSCACertificateFile $ "
+		 "olcThreads $ olcThreadQueues $ olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
          "olcTLSCertificatePassphrase $ olcTLSCertificateIdentityRef $ "
 		 "olcTLSIdentity $ olcTLSTrustedCerts $  "
@@ -975,6 +1014,18 @@ config_generic(ConfigArgs *c) {
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
+		case CFG_THREADQS:
+			c->value_int = connection_pool_queues;
+			break;
+		case CFG_SLOWOP_THRESH:
+			c->value_uint = slap_slowlog.sl_threshold;
+			break;
+		case CFG_SLOWOP_ENTRIES:
+			c->value_uint = slap_slowlog.sl_size;
+			break;
+		case CFG_ACL_CACHE:
+			c->value_uint = acl_cache_size;
+			break;
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
@@ -1285,6 +1336,7 @@ config_generic(ConfigArgs *c) {
 		case CFG_CONCUR:
 		case CFG_THREADS:
 		case CFG_TTHREADS:
+		case CFG_THREADQS:
 		case CFG_LTHREADS:
 		case CFG_RO:
 		case CFG_AZPOLICY:
@@ -1298,6 +1350,19 @@ config_generic(ConfigArgs *c) {
 		case CFG_SYNC_SUBENTRY:
 			break;
 
+		case CFG_SLOWOP_THRESH:
+			slap_slowlog.sl_threshold = 0;
+			break;
+
+		case CFG_SLOWOP_ENTRIES:
+			if ( slap_slowlog.sl_size != SLAP_SLOWOP_ENTRIES )
+				slap_slowlog_resize( SLAP_SLOWOP_ENTRIES );
+			break;
+
+		case CFG_ACL_CACHE:
+			acl_cache_size = 0;
+			break;
+
 		/* no-ops, requires slapd restart */
 		case CFG_PLUGIN:
 		case CFG_MODLOAD:
@@ -1368,6 +1433,7 @@ config_generic(ConfigArgs *c) {
 				a = *prev;
 				*prev = a->acl_next;
 				acl_free( a );
+				acl_index_build( c->be->be_acl );
 			}
 			if ( SLAP_CONFIG( c->be ) && !c->be->be_acl ) {
 				Debug( LDAP_DEBUG_CONFIG, "config_generic (CFG_ACL): "
@@ -1604,6 +1670,14 @@ config_generic(ConfigArgs *c) {
 					c->log, c->cr_msg, 0 );
 				return 1;
 
+			} else if ( c->value_int < connection_pool_queues ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"threads=%d smaller than threadqueues=%d",
+					c->value_int, connection_pool_queues );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				return 1;
+
 			} else if ( c->value_int > 2 * SLAP_MAX_WORKER_THREADS ) {
 				snprintf( c->cr_msg, sizeof( c->cr_msg ),
 					"warning, threads=%d larger than twice the default (2*%d=%d); YMMV",
@@ -1622,6 +1696,50 @@ config_generic(ConfigArgs *c) {
 			slap_tool_thread_max = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_THREADQS:
+			if ( c->value_int < 1 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"threadqueues=%d smaller than minimum value 1",
+					c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				return 1;
+
+			} else if ( c->value_int > connection_pool_max ) {
+				/* each queue needs a thread of its own */
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"threadqueues=%d larger than threads=%d",
+					c->value_int, connection_pool_max );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				return 1;
+			}
+			/* the queues are fixed once the pool has started threads */
+			if ( ldap_pvt_thread_pool_queues( &connection_pool,
+				c->value_int ) != 0 )
+			{
+				Debug(LDAP_DEBUG_ANY, "%s: threadqueues=%d takes effect "
+					"at the next restart.\n",
+					c->log, c->value_int, 0 );
+			}
+			connection_pool_queues = c->value_int;	/* save for reference */
+			break;
+
+		case CFG_SLOWOP_THRESH:
+			slap_slowlog.sl_threshold = c->value_uint;
+			break;
+
+		case CFG_SLOWOP_ENTRIES:
+			/* the slow operations recorded so far are dropped */
+			if ( slap_slowlog.sl_size != c->value_uint )
+				slap_slowlog_resize( c->value_uint );
+			break;
+
+		case CFG_ACL_CACHE:
+			/* each thread resizes its own cache when next used */
+			acl_cache_size = c->value_uint;
+			break;
+
 		case CFG_LTHREADS:
 			{ int mask = 0;
 			/* use a power of two */
@@ -56,6 +56,16 @@ static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
 
 static const char conn_lost_str[] = "connection lost";
 
+/* Closes after which queued output is not worth trying to write */
+static const char *const conn_hard_close[] = {
+	conn_lost_str,
+	"connection lost on write",
+	"writetimeout",
+	"TLS negotiation failure",
+	"SASL layer install failure",
+	NULL
+};
+
 const char *
 connection_state2str( int state )
 {
@@ -89,6 +99,7 @@ static void connection_op_queue( Operation *op );
 static int connection_resched( Connection *conn );
 static void connection_abandon( Connection *conn );
 static void connection_destroy( Connection *c );
+static int connection_flush_output( Connection *c );
 
 static ldap_pvt_thread_start_t connection_operation;
 
@@ -154,9 +165,7 @@ int connections_destroy(void)
 			ber_sockbuf_free( connections[i].c_sb );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_mutex );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_write1_mutex );
-			ldap_pvt_thread_mutex_destroy( &connections[i].c_write2_mutex );
 			ldap_pvt_thread_cond_destroy( &connections[i].c_write1_cv );
-			ldap_pvt_thread_cond_destroy( &connections[i].c_write2_cv );
 #ifdef LDAP_SLAPI
 			if ( slapi_plugins_used ) {
 				slapi_int_free_object_extensions( SLAPI_X_EXT_CONNECTION,
@@ -397,6 +406,7 @@ Connection * connection_init(
 
 		LDAP_STAILQ_INIT(&c->c_ops);
 		LDAP_STAILQ_INIT(&c->c_pending_ops);
+		LDAP_STAILQ_INIT(&c->c_outq);
 
 #ifdef LDAP_X_TXN
 		c->c_txn = CONN_TXN_INACTIVE;
@@ -423,9 +433,7 @@ Connection * connection_init(
 		/* should check status of thread calls */
 		ldap_pvt_thread_mutex_init( &c->c_mutex );
 		ldap_pvt_thread_mutex_init( &c->c_write1_mutex );
-		ldap_pvt_thread_mutex_init( &c->c_write2_mutex );
 		ldap_pvt_thread_cond_init( &c->c_write1_cv );
-		ldap_pvt_thread_cond_init( &c->c_write2_cv );
 
 #ifdef LDAP_SLAPI
 		if ( slapi_plugins_used ) {
@@ -461,6 +469,7 @@ Connection * connection_init(
 	assert( c->c_sasl_extra == NULL );
 	assert( c->c_sasl_bindop == NULL );
 	assert( c->c_currentber == NULL );
+	assert( LDAP_STAILQ_EMPTY(&c->c_outq) );
 	assert( c->c_writewaiter == 0);
 	assert( c->c_writers == 0);
 
@@ -661,6 +670,7 @@ connection_destroy( Connection *c )
 	assert( c->c_txn_backend == NULL );
 	assert( LDAP_STAILQ_EMPTY(&c->c_txn_ops) );
 #endif
+	assert( LDAP_STAILQ_EMPTY(&c->c_outq) );
 	assert( c->c_writewaiter == 0);
 	assert( c->c_writers == 0);
 
@@ -798,27 +808,49 @@ static void connection_abandon( Connection *c )
 static void
 connection_wake_writers( Connection *c )
 {
-	/* wake write blocked operations */
+	/* wake operations blocked on a full output queue */
 	ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
 	if ( c->c_writers > 0 ) {
 		c->c_writers = -c->c_writers;
 		ldap_pvt_thread_cond_broadcast( &c->c_write1_cv );
-		ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
-		if ( c->c_writewaiter ) {
-			ldap_pvt_thread_mutex_lock( &c->c_write2_mutex );
-			ldap_pvt_thread_cond_signal( &c->c_write2_cv );
-			slapd_clr_write( c->c_sd, 1 );
-			ldap_pvt_thread_mutex_unlock( &c->c_write2_mutex );
-		}
-		ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
 		while ( c->c_writers ) {
 			ldap_pvt_thread_cond_wait( &c->c_write1_cv, &c->c_write1_mutex );
 		}
-		ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
-	} else {
-		ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
-		slapd_clr_write( c->c_sd, 1 );
 	}
+	ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+}
+
+static int
+connection_hard_close( const char *why )
+{
+	int i;
+
+	if ( why == NULL )
+		return 0;
+
+	for ( i = 0; conn_hard_close[i] != NULL; i++ ) {
+		if ( strcmp( why, conn_hard_close[i] ) == 0 )
+			return 1;
+	}
+
+	return 0;
+}
+
+/* discard any output still queued for the client */
+static void
+connection_discard_output( Connection *c )
+{
+	SlapOutbuf *ob;
+
+	ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
+	while ( (ob = LDAP_STAILQ_FIRST( &c->c_outq )) != NULL ) {
+		LDAP_STAILQ_REMOVE_HEAD( &c->c_outq, ob_next );
+		ch_free( ob );
+	}
+	c->c_outq_bytes = 0;
+	c->c_writewaiter = 0;
+	ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+	slapd_clr_write( c->c_sd, 1 );
 }
 
 void connection_closing( Connection *c, const char *why )
@@ -849,6 +881,13 @@ void connection_closing( Connection *c, const char *why )
 		/* wake write blocked operations */
 		connection_wake_writers( c );
 
+		/* On a graceful close, e.g. after a Notice of Disconnection,
+		 * give the output still queued one chance to go out.
+		 */
+		if ( !connection_hard_close( why ) )
+			(void)connection_flush_output( c );
+		connection_discard_output( c );
+
 	} else if( why == NULL && c->c_close_reason == conn_lost_str ) {
 		/* Client closed connection after doing Unbind. */
 		c->c_close_reason = NULL;
@@ -983,9 +1022,15 @@ void connection_done( Connection *c )
 	} while (0)
 #define INCR_OP_COMPLETED(index) \
 	do { \
+		struct timeval done; \
+		gettimeofday( &done, NULL ); \
 		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
 		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed, 1); \
 		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed_[(index)], 1); \
+		slap_histogram_add( &op->o_counters->sc_ops_wait_[(index)], \
+			slap_timeval_diff( &op->o_qtime, &started ) ); \
+		slap_histogram_add( &op->o_counters->sc_ops_run_[(index)], \
+			slap_timeval_diff( &started, &done ) ); \
 		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
 	} while (0)
 #else /* !SLAPD_MONITOR */
@@ -1026,7 +1071,7 @@ conn_counter_destroy( void *key, void *data )
 	for ( prev = &slap_counters.sc_next, sc = slap_counters.sc_next; sc;
 		prev = &sc->sc_next, sc = sc->sc_next ) {
 		if ( sc == data ) {
-			int i;
+			int i, j;
 
 			*prev = sc->sc_next;
 			/* Copy data to main counter */
@@ -1040,6 +1085,14 @@ conn_counter_destroy( void *key, void *data )
 			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
 				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_initiated_[ i ] );
 				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_completed_[ i ] );
+				slap_histogram_merge( &slap_counters.sc_ops_wait_[ i ], &sc->sc_ops_wait_[ i ] );
+				slap_histogram_merge( &slap_counters.sc_ops_run_[ i ], &sc->sc_ops_run_[ i ] );
+				slap_histogram_merge( &slap_counters.sc_ops_time_[ i ], &sc->sc_ops_time_[ i ] );
+			}
+			for ( j = sc->sc_db_nslots; j > 0; j-- ) {
+				slap_histogram_t *h = slap_counters_db_time( &slap_counters, j );
+				for ( i = 0; i < SLAP_OP_LAST; i++ )
+					slap_histogram_merge( &h[ i ], &sc->sc_db_time_[ j - 1 ][ i ] );
 			}
 #endif /* SLAPD_MONITOR */
 			slap_counters_destroy( sc );
@@ -1084,6 +1137,11 @@ connection_operation( void *ctx, void *arg_v )
 	void *memctx = NULL;
 	void *memctx_null = NULL;
 	ber_len_t memsiz;
+#ifdef SLAPD_MONITOR
+	struct timeval started;
+
+	gettimeofday( &started, NULL );
+#endif /* SLAPD_MONITOR */
 
 	conn_counter_init( op, ctx );
 	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
@@ -1383,6 +1441,18 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 
 #ifdef HAVE_TLS
 	if ( c->c_is_tls && c->c_needs_tls_accept ) {
+		/* Don't start the handshake ahead of a queued StartTLS
+		 * response; connection_write() resumes reading once it
+		 * has been written.
+		 */
+		ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
+		rc = !LDAP_STAILQ_EMPTY( &c->c_outq );
+		ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+		if ( rc ) {
+			connection_return( c );
+			return 0;
+		}
+
 		rc = ldap_pvt_tls_accept( c->c_sb, slap_tls_ctx );
 		if ( rc < 0 ) {
 			Debug( LDAP_DEBUG_TRACE,
@@ -1917,10 +1987,75 @@ static int connection_op_activate( Operation *op )
 	return rc;
 }
 
+/*
+ * Write as much of the connection's output queue as the socket will
+ * take without blocking. Called with c_mutex held. Returns -1 on a
+ * hard write error, 1 if output is left queued, 0 otherwise.
+ */
+static int
+connection_flush_output( Connection *c )
+{
+	struct berval bvs[SLAP_OUTQ_IOV];
+	SlapOutbuf *ob;
+	ber_slen_t rc;
+	ber_len_t len;
+	int i, err, queued = 0;
+
+	ldap_pvt_thread_mutex_lock( &c->c_write1_mutex );
+	while ( !LDAP_STAILQ_EMPTY( &c->c_outq ) ) {
+		i = 0;
+		LDAP_STAILQ_FOREACH( ob, &c->c_outq, ob_next ) {
+			bvs[i].bv_val = ob->ob_buf + ob->ob_off;
+			bvs[i].bv_len = ob->ob_len - ob->ob_off;
+			if ( ++i == SLAP_OUTQ_IOV ) break;
+		}
+
+		rc = ber_pvt_sb_writev( c->c_sb, bvs, i );
+		if ( rc <= 0 ) {
+			/* the GnuTLS and MozNSS layers return 0 when blocked */
+			err = sock_errno();
+			if ( err != EWOULDBLOCK && err != EAGAIN ) {
+				Debug( LDAP_DEBUG_CONNS,
+					"connection_flush_output: conn=%lu write failed errno=%d reason=\"%s\"\n",
+					c->c_connid, err, sock_errstr(err) );
+				ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+				return -1;
+			}
+			break;
+		}
+
+		c->c_outq_bytes -= rc;
+		while ( rc > 0 ) {
+			ob = LDAP_STAILQ_FIRST( &c->c_outq );
+			len = ob->ob_len - ob->ob_off;
+			if ( (ber_len_t)rc < len ) {
+				ob->ob_off += rc;
+				break;
+			}
+			rc -= len;
+			LDAP_STAILQ_REMOVE_HEAD( &c->c_outq, ob_next );
+			ch_free( ob );
+		}
+	}
+
+	if ( LDAP_STAILQ_EMPTY( &c->c_outq ) ) {
+		c->c_writewaiter = 0;
+	} else {
+		slapd_set_write( c->c_sd, 2 );
+		queued = 1;
+	}
+
+	/* let writers waiting on a full queue proceed */
+	if ( c->c_writers > 0 )
+		ldap_pvt_thread_cond_broadcast( &c->c_write1_cv );
+	ldap_pvt_thread_mutex_unlock( &c->c_write1_mutex );
+
+	return queued;
+}
+
 int connection_write(ber_socket_t s)
 {
 	Connection *c;
-	Operation *op;
 
 	assert( connections != NULL );
 
@@ -1936,8 +2071,21 @@ int connection_write(ber_socket_t s)
 
 #ifdef HAVE_TLS
 	if ( c->c_is_tls && c->c_needs_tls_accept ) {
+		int rc;
+
+		/* The StartTLS response may still be queued; it must be
+		 * written in the clear before the handshake starts.
+		 */
+		rc = connection_flush_output( c );
+		if ( rc < 0 ) {
+			connection_closing( c, "connection lost on write" );
+			connection_close( c );
+			connection_return( c );
+			return -1;
+		}
 		connection_return( c );
-		connection_read_activate( s );
+		if ( rc == 0 )
+			connection_read_activate( s );
 		return 0;
 	}
 #endif
@@ -1945,11 +2093,14 @@ int connection_write(ber_socket_t s)
 	c->c_n_write++;
 
 	Debug( LDAP_DEBUG_TRACE,
-		"connection_write(%d): waking output for id=%lu\n",
+		"connection_write(%d): flushing output for id=%lu\n",
 		s, c->c_connid, 0 );
-	ldap_pvt_thread_mutex_lock( &c->c_write2_mutex );
-	ldap_pvt_thread_cond_signal( &c->c_write2_cv );
-	ldap_pvt_thread_mutex_unlock( &c->c_write2_mutex );
+	if ( connection_flush_output( c ) < 0 ) {
+		connection_closing( c, "connection lost on write" );
+		connection_close( c );
+		connection_return( c );
+		return -1;
+	}
 
 	if ( ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_NEEDS_READ, NULL ) ) {
 		slapd_set_read( s, 1 );
@@ -1958,25 +2109,11 @@ int connection_write(ber_socket_t s)
 		slapd_set_write( s, 1 );
 	}
 
-	/* If there are ops pending because of a writewaiter,
-	 * start one up.
+	/* If ops were deferred while output was queued and the
+	 * queue has drained, start them up.
 	 */
-	while ((op = LDAP_STAILQ_FIRST( &c->c_pending_ops )) != NULL) {
-		if ( !c->c_writewaiter ) break;
-		if ( c->c_n_ops_executing > connection_pool_max/2 ) break;
-
-		LDAP_STAILQ_REMOVE_HEAD( &c->c_pending_ops, o_next );
-		LDAP_STAILQ_NEXT(op, o_next) = NULL;
-
-		/* pending operations should not be marked for abandonment */
-		assert(!op->o_abandon);
-
-		c->c_n_ops_pending--;
-		c->c_n_ops_executing++;
-
-		connection_op_activate( op );
-
-		break;
+	if ( !c->c_writewaiter ) {
+		connection_resched( c );
 	}
 
 	connection_return( c );
@@ -2093,6 +2230,7 @@ connection_fake_init2(
 #endif /* LDAP_SLAPI */
 
 	slap_op_time( &op->o_time, &op->o_tincr );
+	gettimeofday( &op->o_qtime, NULL );
 }
 
 void
@@ -65,6 +65,23 @@ int deny_severity = LOG_NOTICE;
 # define LDAPI_MOD_URLEXT		"x-mod"
 #endif /* LDAP_PF_LOCAL */
 
+/* Listener sharding: one socket per daemon thread, with the kernel
+ * balancing incoming connections between them.
+ */
+#if defined(SO_REUSEPORT_LB)
+# define SLAP_SO_REUSEPORT		SO_REUSEPORT_LB
+#elif defined(SO_REUSEPORT)
+# define SLAP_SO_REUSEPORT		SO_REUSEPORT
+#endif
+#if defined(SLAP_SO_REUSEPORT) && !defined(HAVE_WINSOCK)
+# ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+# endif
+# ifdef F_DUPFD
+#  define SLAP_REUSEPORT_URLEXT	"x-reuseport"
+# endif
+#endif /* SLAP_SO_REUSEPORT */
+
 #ifdef LDAP_PF_INET6
 int slap_inet4or6 = AF_UNSPEC;
 #else /* ! INETv6 */
@@ -1299,7 +1316,7 @@ get_url_perms(
 	mode_t	*perms,
 	int	*crit )
 {
-	int	i;
+	int	i, rc = LDAP_OTHER;
 
 	assert( exts != NULL );
 	assert( perms != NULL );
@@ -1315,6 +1332,13 @@ get_url_perms(
 			type++;
 		}
 
+#ifdef SLAP_REUSEPORT_URLEXT
+		if ( strcasecmp( type, SLAP_REUSEPORT_URLEXT ) == 0 ) {
+			rc = LDAP_SUCCESS;
+			continue;
+		}
+#endif /* SLAP_REUSEPORT_URLEXT */
+
 		if ( strncasecmp( type, LDAPI_MOD_URLEXT "=",
 			sizeof(LDAPI_MOD_URLEXT "=") - 1 ) == 0 )
 		{
@@ -1369,7 +1393,7 @@ get_url_perms(
 		}
 	}
 
-	return LDAP_OTHER;
+	return rc;
 }
 #endif /* LDAP_PF_LOCAL || SLAP_X_LISTENER_MOD */
 
@@ -1521,6 +1545,120 @@ errexit:
 	return -1;
 }
 
+#ifdef SLAP_REUSEPORT_URLEXT
+static int
+get_url_reuseport(
+	char	**exts )
+{
+	int	i;
+
+	for ( i = 0; exts && exts[ i ]; i++ ) {
+		char	*type = exts[ i ];
+
+		if ( type[ 0 ] == '!' ) type++;
+		if ( strcasecmp( type, SLAP_REUSEPORT_URLEXT ) == 0 )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Open and bind one more socket on the address of a sharded listener.
+ * The shard only starts accepting once slapd_daemon_task() listens on
+ * it; shards beyond the number of daemon threads are closed there.
+ */
+static Listener *
+slap_open_listener_shard(
+	Listener *sl,
+	int shard )
+{
+	Listener *li;
+	ber_socket_t s;
+	socklen_t addrlen;
+	int tmp, rc, err;
+
+#ifdef LDAP_PF_INET6
+	if ( sl->sl_sa.sa_addr.sa_family == AF_INET6 )
+		addrlen = sizeof(struct sockaddr_in6);
+	else
+#endif /* LDAP_PF_INET6 */
+		addrlen = sizeof(struct sockaddr_in);
+
+	s = socket( sl->sl_sa.sa_addr.sa_family, SOCK_STREAM, 0 );
+	if ( s == AC_SOCKET_INVALID ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: shard %d socket() failed errno=%d (%s)\n",
+			shard, err, sock_errstr(err) );
+		return NULL;
+	}
+	if ( SLAP_SOCKNEW( s ) >= dtblsize ) {
+		tcp_close( s );
+		return NULL;
+	}
+
+	tmp = 1;
+	(void)setsockopt( s, SOL_SOCKET, SO_REUSEADDR, (char *) &tmp, sizeof(tmp) );
+	rc = setsockopt( s, SOL_SOCKET, SLAP_SO_REUSEPORT, (char *) &tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+	if ( rc == 0 && sl->sl_sa.sa_addr.sa_family == AF_INET6 ) {
+		rc = setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *) &tmp, sizeof(tmp) );
+	}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+	if ( rc == 0 ) {
+		rc = bind( s, &sl->sl_sa.sa_addr, addrlen );
+	}
+	if ( rc ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: shard %d of %s failed (%s)\n",
+			shard, sl->sl_url.bv_val, sock_errstr(err) );
+		tcp_close( s );
+		return NULL;
+	}
+
+	li = ch_malloc( sizeof( Listener ) );
+	*li = *sl;
+	li->sl_sd = SLAP_SOCKNEW( s );
+	li->sl_shard = shard;
+	ber_dupbv( &li->sl_url, &sl->sl_url );
+	ber_dupbv( &li->sl_name, &sl->sl_name );
+
+	return li;
+}
+
+/*
+ * Renumber a shard's descriptor so that DAEMON_ID() assigns it to
+ * daemon thread tid.
+ */
+static int
+slap_listener_shard_sd(
+	Listener *sl,
+	int tid )
+{
+	ber_socket_t n, want = tid;
+
+	while ( DAEMON_ID( sl->sl_sd ) != tid ) {
+		n = fcntl( SLAP_FD2SOCK( sl->sl_sd ), F_DUPFD, want );
+		if ( n < 0 || n >= dtblsize ) {
+			if ( n >= 0 ) close( n );
+			return -1;
+		}
+		if ( DAEMON_ID( n ) == tid ) {
+			slapd_close( sl->sl_sd );
+			sl->sl_sd = SLAP_SOCKNEW( n );
+			break;
+		}
+		close( n );
+		/* next descriptor above n belonging to tid */
+		want = ( n & ~slapd_daemon_mask ) + slapd_daemon_mask + 1 + tid;
+	}
+
+	return 0;
+}
+#endif /* SLAP_REUSEPORT_URLEXT */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1535,6 +1673,7 @@ slap_open_listener(
 	int err, addrlen = 0;
 	struct sockaddr **sal, **psal;
 	int socktype = SOCK_STREAM;	/* default to COTS */
+	int nshards = 1;
 	ber_socket_t s;
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
@@ -1556,6 +1695,7 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = -1;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1612,13 +1752,20 @@ slap_open_listener(
 #endif /* LDAP_CONNECTIONLESS */
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
+	l.sl_perms = S_IRWXU | S_IRWXO;
 	if ( lud->lud_exts ) {
 		err = get_url_perms( lud->lud_exts, &l.sl_perms, &crit );
-	} else {
-		l.sl_perms = S_IRWXU | S_IRWXO;
 	}
 #endif /* LDAP_PF_LOCAL || SLAP_X_LISTENER_MOD */
 
+#ifdef SLAP_REUSEPORT_URLEXT
+	/* daemon threads aren't configured yet, so open a shard for
+	 * every possible one and drop the excess when we start */
+	if ( tmp == LDAP_PROTO_TCP && get_url_reuseport( lud->lud_exts ) ) {
+		nshards = MAX_DAEMON_THREADS;
+	}
+#endif /* SLAP_REUSEPORT_URLEXT */
+
 	ldap_free_urldesc( lud );
 	if ( err ) return -1;
 
@@ -1626,6 +1773,7 @@ slap_open_listener(
 	 * for it in the slap_listeners array.
 	 */
 	for ( num=0; sal[num]; num++ ) /* empty */;
+	num *= nshards;
 	if ( num > 1 ) {
 		*listeners += num-1;
 		slap_listeners = ch_realloc( slap_listeners,
@@ -1696,6 +1844,23 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+
+#ifdef SLAP_REUSEPORT_URLEXT
+			l.sl_shard = -1;
+			if ( nshards > 1 ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SLAP_SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				} else {
+					l.sl_shard = 0;
+				}
+			}
+#endif /* SLAP_REUSEPORT_URLEXT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1802,6 +1967,19 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+
+#ifdef SLAP_REUSEPORT_URLEXT
+		if ( li->sl_shard == 0 ) {
+			int shard;
+
+			for ( shard = 1; shard < nshards; shard++ ) {
+				Listener *ls = slap_open_listener_shard( li, shard );
+				if ( ls == NULL ) break;
+				slap_listeners[*cur] = ls;
+				(*cur)++;
+			}
+		}
+#endif /* SLAP_REUSEPORT_URLEXT */
 		sal++;
 	}
 
@@ -2379,6 +2557,27 @@ slapd_daemon_task(
 	for ( l = 0; slap_listeners[l] != NULL; l++ ) {
 		if ( slap_listeners[l]->sl_sd == AC_SOCKET_INVALID ) continue;
 
+#ifdef SLAP_REUSEPORT_URLEXT
+		/* Keep one shard per daemon thread, each polled by its own
+		 * thread. Unused shards never listen, so the kernel doesn't
+		 * route any connections to them.
+		 */
+		if ( slap_listeners[l]->sl_shard >= slapd_daemon_threads ) {
+			slapd_close( slap_listeners[l]->sl_sd );
+			slap_listeners[l]->sl_sd = AC_SOCKET_INVALID;
+			continue;
+		}
+		if ( slap_listeners[l]->sl_shard >= 0 &&
+			slap_listener_shard_sd( slap_listeners[l],
+				slap_listeners[l]->sl_shard ) )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: unable to move shard %d of %s to its thread\n",
+				slap_listeners[l]->sl_shard,
+				slap_listeners[l]->sl_url.bv_val, 0 );
+		}
+#endif /* SLAP_REUSEPORT_URLEXT */
+
 #ifdef LDAP_CONNECTIONLESS
 		/* Since this is connectionless, the data port is the
 		 * listening port. The listen() and accept() calls
@@ -55,6 +55,173 @@
 
 int slap_DN_strict = SLAP_AD_NOINSERT;
 
+/*
+ * Cache of the results of dnNormalize() and dnPrettyNormal(), keyed
+ * by the DN as received.  Each shard holds at most DN_CACHE_SIZE
+ * results (see keycache.c).  The DN and its pretty and normalized
+ * forms are kept in a single allocation.  The results depend on the
+ * attribute types, so the cache is emptied whenever one is added or
+ * removed.
+ */
+#define DN_CACHE_SHARDS	16
+#define DN_CACHE_SIZE	64
+#define DN_CACHE_MAXLEN	512	/* longer DNs are not cached */
+
+typedef struct dn_cache_t {
+	struct berval	dc_pretty;	/* NULL if only normalized */
+	struct berval	dc_normal;
+} dn_cache_t;
+
+static slap_keycache_t	dn_cache;
+
+static void
+dn_cache_free( slap_keycache_entry_t *ke )
+{
+	/* the key and the results follow the dn_cache_t */
+	ch_free( ke->ke_data );
+}
+
+static int
+dn_cache_cacheable( struct berval *val )
+{
+	/* unknown attributes may be allowed while reading the config */
+	return val->bv_len != 0 && val->bv_len <= DN_CACHE_MAXLEN
+		&& slap_DN_strict == SLAP_AD_NOINSERT;
+}
+
+/*
+ * Look val up; pretty may be NULL if only the normalized form is
+ * wanted.  On a hit, copies of the results are returned in ctx.
+ */
+static int
+dn_cache_get(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx )
+{
+	slap_keycache_shard_t	*ks;
+	slap_keycache_entry_t	*ke;
+	dn_cache_t	*dc = NULL;
+	unsigned	hash;
+
+	if ( !dn_cache_cacheable( val ) ||
+		( ks = slap_keycache_shard( &dn_cache, val, &hash ) ) == NULL )
+	{
+		return 0;
+	}
+
+	ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+	ke = slap_keycache_find( &dn_cache, ks, val, hash );
+	if ( ke != NULL ) {
+		dc = ke->ke_data;
+		if ( pretty != NULL && BER_BVISNULL( &dc->dc_pretty ) ) {
+			dc = NULL;
+		}
+	}
+	if ( dc != NULL ) {
+		if ( pretty != NULL ) {
+			ber_dupbv_x( pretty, &dc->dc_pretty, ctx );
+		}
+		ber_dupbv_x( normal, &dc->dc_normal, ctx );
+		ke->ke_used = 1;
+		ks->ks_hits++;
+
+	} else {
+		ks->ks_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+
+	return dc != NULL;
+}
+
+static void
+dn_cache_put(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal )
+{
+	slap_keycache_shard_t	*ks;
+	slap_keycache_entry_t	*ke;
+	dn_cache_t	*dc;
+	unsigned	hash;
+	char		*ptr;
+
+	if ( !dn_cache_cacheable( val ) ||
+		( ks = slap_keycache_shard( &dn_cache, val, &hash ) ) == NULL )
+	{
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+	ke = slap_keycache_find( &dn_cache, ks, val, hash );
+	if ( ke != NULL ) {
+		dc = ke->ke_data;
+		/* only worth replacing to add the pretty form */
+		if ( pretty == NULL || !BER_BVISNULL( &dc->dc_pretty ) ) {
+			goto done;
+		}
+		dn_cache_free( ke );
+
+	} else {
+		ke = slap_keycache_slot( &dn_cache, ks, hash );
+		if ( ke == NULL ) {
+			goto done;
+		}
+	}
+
+	dc = ch_malloc( sizeof( dn_cache_t ) + val->bv_len + 1
+		+ normal->bv_len + 1 + ( pretty ? pretty->bv_len + 1 : 0 ) );
+	ptr = (char *)&dc[ 1 ];
+	ke->ke_data = dc;
+	ke->ke_key.bv_val = ptr;
+	ke->ke_key.bv_len = val->bv_len;
+	AC_MEMCPY( ptr, val->bv_val, val->bv_len );
+	ptr += val->bv_len;
+	*ptr++ = '\0';
+
+	dc->dc_normal.bv_val = ptr;
+	dc->dc_normal.bv_len = normal->bv_len;
+	AC_MEMCPY( ptr, normal->bv_val, normal->bv_len );
+	ptr += normal->bv_len;
+	*ptr++ = '\0';
+
+	if ( pretty != NULL ) {
+		dc->dc_pretty.bv_val = ptr;
+		dc->dc_pretty.bv_len = pretty->bv_len;
+		AC_MEMCPY( ptr, pretty->bv_val, pretty->bv_len );
+		ptr[ pretty->bv_len ] = '\0';
+
+	} else {
+		BER_BVZERO( &dc->dc_pretty );
+	}
+
+done:;
+	ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+}
+
+/* the attribute types changed */
+void
+dn_cache_invalidate( void )
+{
+	slap_keycache_clear( &dn_cache );
+}
+
+void
+dn_cache_init( void )
+{
+	slap_keycache_init( &dn_cache, "DN", DN_CACHE_SHARDS, DN_CACHE_SIZE,
+		dn_cache_free );
+}
+
+/* schema teardown may still invalidate the cache, which is a no-op
+ * once it is destroyed */
+void
+dn_cache_destroy( void )
+{
+	slap_keycache_destroy( &dn_cache );
+}
+
 static int
 LDAPRDN_validate( LDAPRDN rdn )
 {
@@ -426,7 +593,10 @@ dnNormalize(
 
 	Debug( LDAP_DEBUG_TRACE, ">>> dnNormalize: <%s>\n", val->bv_val ? val->bv_val : "", 0, 0 );
 
-	if ( val->bv_len != 0 ) {
+	if ( dn_cache_get( val, NULL, out, ctx ) ) {
+		/* normalized before */
+
+	} else if ( val->bv_len != 0 ) {
 		LDAPDN		dn = NULL;
 		int		rc;
 
@@ -459,6 +629,8 @@ dnNormalize(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, NULL, out );
 	} else {
 		ber_dupbv_x( out, val, ctx );
 	}
@@ -725,6 +897,10 @@ dnPrettyNormal(
 		pretty->bv_len = 0;
 		normal->bv_len = 0;
 
+		if ( dn_cache_get( val, pretty, normal, ctx ) ) {
+			goto done;
+		}
+
 		/* FIXME: should be liberal in what we accept */
 		rc = ldap_bv2dn_x( val, &dn, LDAP_DN_FORMAT_LDAP, ctx );
 		if ( rc != LDAP_SUCCESS ) {
@@ -767,8 +943,11 @@ dnPrettyNormal(
 			pretty->bv_len = 0;
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, pretty, normal );
 	}
 
+done:;
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPrettyNormal: <%s>, <%s>\n",
 		pretty->bv_val ? pretty->bv_val : "",
 		normal->bv_val ? normal->bv_val : "", 0 );
@@ -483,6 +483,55 @@ entry2str_wrap(
 	return( ebuf );
 }
 
+/*
+ * Like entry2str_wrap(), but usable by several threads at once:
+ * the returned buffer is allocated for the caller, who frees it
+ * with ch_free().
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap )
+{
+	Attribute	*a;
+	struct berval	*bv;
+	char		*buf, *cur;
+	ber_len_t	size = 1;
+	int		i;
+
+	assert( e != NULL );
+
+	if ( e->e_dn != NULL ) {
+		size += LDIF_SIZE_NEEDED_WRAP( 2, e->e_name.bv_len, wrap );
+	}
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+			size += LDIF_SIZE_NEEDED_WRAP( a->a_desc->ad_cname.bv_len,
+				a->a_vals[i].bv_len, wrap );
+		}
+	}
+
+	cur = buf = ch_malloc( size );
+
+	if ( e->e_dn != NULL ) {
+		ldif_sput_wrap( &cur, LDIF_PUT_VALUE, "dn", e->e_dn,
+			e->e_name.bv_len, wrap );
+	}
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+			bv = &a->a_vals[i];
+			ldif_sput_wrap( &cur, LDIF_PUT_VALUE,
+				a->a_desc->ad_cname.bv_val,
+				bv->bv_val, bv->bv_len, wrap );
+		}
+	}
+	*cur = '\0';
+	*len = cur - buf;
+
+	return buf;
+}
+
 void
 entry_clean( Entry *e )
 {
@@ -968,6 +1017,120 @@ int entry_decode(EntryHeader *eh, Entry **e)
 	return 0;
 }
 
+/* Decode only the DN and the attributes whose type name matches one of
+ * the given names, e.g. to evaluate a filter before decoding the rest.
+ * The values are not sorted. The result shares the EntryHeader's buffer
+ * without owning it: the caller must zero e_name and e_nname before
+ * freeing it with entry_free(), and may still entry_decode() the header
+ * afterwards.
+ */
+int entry_decode_attrs(EntryHeader *eh, Entry **e, BerVarray types)
+{
+	int i, j, k, nattrs;
+	int rc;
+	Attribute *a, **ap;
+	Entry *x;
+	const char *text;
+	AttributeDescription *ad;
+	unsigned char *ptr;
+	BerVarray bptr;
+
+	nattrs = eh->nattrs;
+	x = entry_alloc();
+	ptr = (unsigned char *)eh->data;
+	i = entry_getlen(&ptr);
+	x->e_name.bv_val = (char *) ptr;
+	x->e_name.bv_len = i;
+	ptr += i+1;
+	i = entry_getlen(&ptr);
+	x->e_nname.bv_val = (char *) ptr;
+	x->e_nname.bv_len = i;
+	ptr += i+1;
+
+	ap = &x->e_attrs;
+	bptr = (BerVarray)eh->bv.bv_val;
+
+	for ( ; nattrs > 0 && (i = entry_getlen(&ptr)); nattrs-- ) {
+		struct berval bv;
+		bv.bv_len = i;
+		bv.bv_val = (char *) ptr;
+		ptr += i + 1;
+
+		/* compare the type name, without options */
+		for ( j = 0; j < i && bv.bv_val[j] != ';'; j++ );
+		for ( k = 0; !BER_BVISNULL( &types[k] ); k++ ) {
+			if ( types[k].bv_len == j &&
+				!strncasecmp( types[k].bv_val, bv.bv_val, j ))
+				break;
+		}
+		if ( BER_BVISNULL( &types[k] )) {
+			/* skip the values and the normalized values */
+			for ( k = 0; k < 2; k++ ) {
+				for ( j = entry_getlen(&ptr); j; j-- ) {
+					i = entry_getlen(&ptr);
+					ptr += i+1;
+				}
+			}
+			continue;
+		}
+
+		ad = NULL;
+		rc = slap_bv2ad( &bv, &ad, &text );
+		if( rc != LDAP_SUCCESS ) {
+			rc = slap_bv2undef_ad( &bv, &ad, &text, 0 );
+			if( rc != LDAP_SUCCESS ) {
+				Debug( LDAP_DEBUG_ANY,
+					"<= entry_decode_attrs: slap_str2undef_ad(%s): %s\n",
+						bv.bv_val, text, 0 );
+				BER_BVZERO( &x->e_name );
+				BER_BVZERO( &x->e_nname );
+				entry_free( x );
+				return rc;
+			}
+		}
+		a = attr_alloc( ad );
+		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		j = entry_getlen(&ptr);
+		a->a_numvals = j;
+		a->a_vals = bptr;
+
+		while (j) {
+			i = entry_getlen(&ptr);
+			bptr->bv_len = i;
+			bptr->bv_val = (char *)ptr;
+			ptr += i+1;
+			bptr++;
+			j--;
+		}
+		bptr->bv_val = NULL;
+		bptr->bv_len = 0;
+		bptr++;
+
+		j = entry_getlen(&ptr);
+		if (j) {
+			a->a_nvals = bptr;
+			while (j) {
+				i = entry_getlen(&ptr);
+				bptr->bv_len = i;
+				bptr->bv_val = (char *)ptr;
+				ptr += i+1;
+				bptr++;
+				j--;
+			}
+			bptr->bv_val = NULL;
+			bptr->bv_len = 0;
+			bptr++;
+		} else {
+			a->a_nvals = a->a_vals;
+		}
+		*ap = a;
+		ap = &a->a_next;
+	}
+
+	*e = x;
+	return 0;
+}
+
 Entry *
 entry_dup2( Entry *dest, Entry *source )
 {
@@ -984,3 +984,643 @@ test_substrings_filter(
 		rc, 0, 0 );
 	return rc;
 }
+
+/*
+ * Compiled filters. A filter that is tested against many entries,
+ * e.g. by a search or a persistent search, can be compiled once into
+ * a flat program: AND/OR groups become jumps past their operands,
+ * NOTs are folded into their operand, and computed or undefined
+ * components are folded into their enclosing groups.
+ *
+ * Equality, ordering and substrings components also keep the matching
+ * rule of their attribute type. The values of attributes of that type
+ * are then matched without looking the rule up again, and the rules
+ * that compare normalized values octet by octet are done inline:
+ * equality by length and memcmp(), substrings after checking that the
+ * value is long enough for all the components, finding each any
+ * component by scanning with memchr() for the byte of it that is
+ * expected to be rarest in values, chosen once per program.
+ * Attributes of other types (subtypes) go through test_filter()'s
+ * own functions.
+ *
+ * The program still refers to the original Filter, which must outlive
+ * it. test_filter_prog() returns the same results as test_filter().
+ */
+
+int filter_compile_use = 1;	/* "filter_compile off" never compiles */
+
+/* How a leaf is tested */
+#define	FI_GENERIC	0	/* as test_filter() does */
+#define	FI_AVA		1	/* equality or ordering with fi_mr */
+#define	FI_AVA_OCTET	2	/* equality with octetStringMatch, inline */
+#define	FI_SUBSTR	3	/* octet substrings, inline */
+
+typedef struct FilterInsn {
+	ber_tag_t	fi_choice;	/* AND, OR, COMPUTED, or a leaf filter type */
+	int		fi_neg;		/* negate the result */
+	int		fi_end;		/* AND/OR: index past the last operand */
+	int		fi_result;	/* COMPUTED: the result */
+	int		fi_kind;	/* leaf: FI_* */
+	Filter		*fi_f;		/* leaf filter */
+	AttributeType	*fi_type;	/* leaf: type the rule was taken from */
+	MatchingRule	*fi_mr;		/* FI_AVA*: its matching rule */
+	ber_len_t	fi_minlen;	/* FI_SUBSTR: shortest value that can match */
+	ber_len_t	*fi_rare;	/* FI_SUBSTR: one per any component */
+} FilterInsn;
+
+struct FilterProg {
+	Filter		*fp_filter;
+	int		fp_len;
+	int		fp_depth;	/* deepest nesting of AND/OR groups */
+	ber_len_t	*fp_rare;	/* next unused rare byte offset */
+	FilterInsn	fp_insn[1];
+	/* rare byte offsets follow the instructions */
+};
+
+/* Nesting the evaluator handles without recursion; deeper
+ * programs fall back to test_filter()
+ */
+#define	FILTER_PROG_DEPTH	32
+
+static int
+filter_negate( int rc )
+{
+	/* Flip true to false and false to true
+	 * but leave Undefined alone.
+	 */
+	switch( rc ) {
+	case LDAP_COMPARE_TRUE:
+		return LDAP_COMPARE_FALSE;
+	case LDAP_COMPARE_FALSE:
+		return LDAP_COMPARE_TRUE;
+	}
+	return rc;
+}
+
+/* number of instructions, and of any components in *nany */
+static int
+filter_count( Filter *f, int *nany )
+{
+	int i, n = 1;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return n;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next )
+			n += filter_count( f, nany );
+		break;
+	case LDAP_FILTER_NOT:
+		n = filter_count( f->f_not, nany );
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		if ( f->f_sub_any ) {
+			for ( i = 0; !BER_BVISNULL( &f->f_sub_any[i] ); i++ )
+				(*nany)++;
+		}
+		break;
+	}
+	return n;
+}
+
+/* Bytes of normalized values, roughly from the most to the least
+ * frequent; all other bytes count as rarer still
+ */
+static const char filter_common[] =
+	" eaionrstlcdhum0123456789pgbyfvw.-,@kjxqz";
+
+/* offset of the byte of bv least likely to occur in values */
+static ber_len_t
+filter_rare( struct berval *bv )
+{
+	ber_len_t i, rare = 0;
+	int rank, best = -1;
+	char *c;
+
+	for ( i = 0; i < bv->bv_len; i++ ) {
+		c = bv->bv_val[i] ? strchr( filter_common, bv->bv_val[i] ) : NULL;
+		rank = c ? c - filter_common : sizeof( filter_common );
+		if ( rank > best ) {
+			best = rank;
+			rare = i;
+		}
+	}
+	return rare;
+}
+
+/* whether directoryStringSubstringsMatch() could let the byte after
+ * the component, normally the terminating NUL, match a space
+ */
+static int
+filter_space_after( struct berval *bv )
+{
+	return !BER_BVISEMPTY( bv ) && ASCII_SPACE( bv->bv_val[bv->bv_len] );
+}
+
+static void
+filter_emit_leaf( FilterProg *fp, FilterInsn *fi )
+{
+	Filter *f = fi->fi_f;
+	AttributeDescription *ad;
+	MatchingRule *mr;
+
+	fi->fi_kind = FI_GENERIC;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		if ( ad == slap_schema.si_ad_hasSubordinates ||
+			ad == slap_schema.si_ad_entryDN )
+			break;
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_ava->aa_cf )
+			break;
+#endif
+		mr = f->f_choice == LDAP_FILTER_EQUALITY ?
+			ad->ad_type->sat_equality : ad->ad_type->sat_ordering;
+		if ( mr == NULL )
+			break;
+
+		fi->fi_kind = FI_AVA;
+		fi->fi_type = ad->ad_type;
+		fi->fi_mr = mr;
+		if ( f->f_choice == LDAP_FILTER_EQUALITY &&
+			mr->smr_match == octetStringMatch &&
+			!( ad->ad_type->sat_flags & SLAP_AT_ORDERED ))
+			fi->fi_kind = FI_AVA_OCTET;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS: {
+		ber_len_t len = 0;
+		int i;
+
+		ad = f->f_sub_desc;
+		mr = ad->ad_type->sat_substr;
+		if ( mr == NULL )
+			break;
+		if ( mr->smr_match == directoryStringSubstringsMatch ) {
+			if ( filter_space_after( &f->f_sub_initial ))
+				break;
+			for ( i = 0; f->f_sub_any &&
+				!BER_BVISNULL( &f->f_sub_any[i] ); i++ )
+			{
+				if ( filter_space_after( &f->f_sub_any[i] ))
+					break;
+			}
+			if ( f->f_sub_any && !BER_BVISNULL( &f->f_sub_any[i] ))
+				break;
+		} else if ( mr->smr_match != octetStringSubstringsMatch ) {
+			break;
+		}
+
+		if ( !BER_BVISNULL( &f->f_sub_initial ))
+			len += f->f_sub_initial.bv_len;
+		if ( !BER_BVISNULL( &f->f_sub_final ))
+			len += f->f_sub_final.bv_len;
+		if ( f->f_sub_any ) {
+			fi->fi_rare = fp->fp_rare;
+			for ( i = 0; !BER_BVISNULL( &f->f_sub_any[i] ); i++ ) {
+				len += f->f_sub_any[i].bv_len;
+				*fp->fp_rare++ = filter_rare( &f->f_sub_any[i] );
+			}
+		}
+		fi->fi_kind = FI_SUBSTR;
+		fi->fi_type = ad->ad_type;
+		fi->fi_minlen = len;
+		} break;
+	}
+}
+
+static void
+filter_emit_result( FilterProg *fp, int pos, int rc )
+{
+	FilterInsn *fi = &fp->fp_insn[pos];
+
+	fi->fi_choice = SLAPD_FILTER_COMPUTED;
+	fi->fi_neg = 0;
+	fi->fi_result = rc;
+	fi->fi_f = NULL;
+	fp->fp_len = pos + 1;
+}
+
+static void
+filter_emit( FilterProg *fp, Filter *f, int neg, int depth )
+{
+	int pos = fp->fp_len;
+	FilterInsn *fi = &fp->fp_insn[pos];
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		filter_emit_result( fp, pos, SLAPD_COMPARE_UNDEFINED );
+		return;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		filter_emit_result( fp, pos,
+			neg ? filter_negate( f->f_result ) : f->f_result );
+		break;
+
+	case LDAP_FILTER_NOT:
+		filter_emit( fp, f->f_not, !neg, depth );
+		break;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR: {
+		/* an operand with this result decides the group,
+		 * one with the other result doesn't matter
+		 */
+		int decide = f->f_choice == LDAP_FILTER_AND ?
+			LDAP_COMPARE_FALSE : LDAP_COMPARE_TRUE;
+		int ignore = filter_negate( decide );
+		Filter *fl;
+
+		if ( ++depth > fp->fp_depth )
+			fp->fp_depth = depth;
+		fp->fp_len++;
+		for ( fl = f->f_list; fl; fl = fl->f_next ) {
+			int op = fp->fp_len;
+			FilterInsn *fo = &fp->fp_insn[op];
+
+			filter_emit( fp, fl, 0, depth );
+			if ( fo->fi_choice != SLAPD_FILTER_COMPUTED )
+				continue;
+			if ( fo->fi_result == decide ) {
+				filter_emit_result( fp, pos,
+					neg ? filter_negate( decide ) : decide );
+				return;
+			}
+			if ( fo->fi_result == ignore )
+				fp->fp_len = op;
+		}
+		if ( fp->fp_len == pos + 1 ) {
+			/* empty groups are True for AND, False for OR */
+			filter_emit_result( fp, pos,
+				neg ? filter_negate( ignore ) : ignore );
+			return;
+		}
+		fi->fi_choice = f->f_choice;
+		fi->fi_neg = neg;
+		fi->fi_end = fp->fp_len;
+		fi->fi_f = f;
+		} break;
+
+	default:
+		fi->fi_choice = f->f_choice;
+		fi->fi_neg = neg;
+		fi->fi_f = f;
+		filter_emit_leaf( fp, fi );
+		fp->fp_len++;
+		break;
+	}
+}
+
+/* Returns NULL if compiling is turned off; callers then use
+ * test_filter() on the filter itself.
+ */
+FilterProg *
+filter_compile( Filter *f, void *memctx )
+{
+	FilterProg *fp;
+	int n, nany = 0;
+
+	if ( f == NULL || !filter_compile_use )
+		return NULL;
+
+	n = filter_count( f, &nany );
+	fp = slap_sl_malloc( sizeof( FilterProg ) +
+		( n - 1 ) * sizeof( FilterInsn ) +
+		nany * sizeof( ber_len_t ), memctx );
+	fp->fp_filter = f;
+	fp->fp_len = 0;
+	fp->fp_depth = 0;
+	fp->fp_rare = (ber_len_t *) &fp->fp_insn[n];
+	filter_emit( fp, f, 0, 0 );
+
+	return fp;
+}
+
+void
+filter_prog_free( FilterProg *fp, void *memctx )
+{
+	if ( fp )
+		slap_sl_free( fp, memctx );
+}
+
+static int
+test_ava_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterInsn	*fi )
+{
+	AttributeAssertion *ava = fi->fi_f->f_ava;
+	int type = fi->fi_choice;
+	int use = type == LDAP_FILTER_EQUALITY ?
+		SLAP_MR_EQUALITY : SLAP_MR_ORDERING;
+	Attribute *a;
+	int rc;
+
+	if ( !access_allowed( op, e,
+		ava->aa_desc, &ava->aa_value, ACL_SEARCH, NULL ) )
+	{
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for(a = attrs_find( e->e_attrs, ava->aa_desc );
+		a != NULL;
+		a = attrs_find( a->a_next, ava->aa_desc ) )
+	{
+		struct berval *bv;
+
+		/* a subtype may have other matching rules; start
+		 * over, the attributes seen so far didn't match
+		 */
+		if ( a->a_desc->ad_type != fi->fi_type )
+			return test_ava_filter( op, e, ava, type );
+
+		if (( ava->aa_desc != a->a_desc ) && !access_allowed( op,
+			e, a->a_desc, &ava->aa_value, ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		if ( a->a_flags & SLAP_ATTR_SORTED_VALS ) {
+			unsigned slot;
+			int ret;
+
+			if ( use == SLAP_MR_ORDERING ) {
+				const char *text;
+				int match, which;
+				which = (type == LDAP_FILTER_LE) ? 0 : a->a_numvals-1;
+				ret = value_match( &match, a->a_desc, fi->fi_mr, use,
+					&a->a_nvals[which], &ava->aa_value, &text );
+				if ( ret != LDAP_SUCCESS ) return ret;
+				if (( type == LDAP_FILTER_LE && match <= 0 ) ||
+					( type == LDAP_FILTER_GE && match >= 0 ))
+					return LDAP_COMPARE_TRUE;
+				continue;
+			}
+			ret = attr_valfind( a, use | SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+				SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+				&ava->aa_value, &slot, NULL );
+			if ( ret == LDAP_SUCCESS )
+				return LDAP_COMPARE_TRUE;
+			else if ( ret != LDAP_NO_SUCH_ATTRIBUTE )
+				return ret;
+			continue;
+		}
+
+		if ( fi->fi_kind == FI_AVA_OCTET ) {
+			for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+				if ( bv->bv_len == ava->aa_value.bv_len &&
+					memcmp( bv->bv_val, ava->aa_value.bv_val,
+						bv->bv_len ) == 0 )
+					return LDAP_COMPARE_TRUE;
+			}
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			int ret, match;
+			const char *text;
+
+			ret = ordered_value_match( &match, a->a_desc, fi->fi_mr, use,
+				bv, &ava->aa_value, &text );
+
+			if( ret != LDAP_SUCCESS ) {
+				rc = ret;
+				break;
+			}
+
+			switch ( type ) {
+			case LDAP_FILTER_EQUALITY:
+				if ( match == 0 ) return LDAP_COMPARE_TRUE;
+				break;
+
+			case LDAP_FILTER_GE:
+				if ( match >= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+
+			case LDAP_FILTER_LE:
+				if ( match <= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+			}
+		}
+	}
+
+	return rc;
+}
+
+/* the first occurrence of pat in [p, end), or NULL; only the
+ * places where its rare byte, at offset rare, occurs are compared
+ */
+static char *
+filter_find( char *p, char *end, struct berval *pat, ber_len_t rare )
+{
+	char *q;
+
+	while ( (ber_len_t)( end - p ) >= pat->bv_len ) {
+		q = memchr( p + rare, pat->bv_val[rare],
+			end - p - pat->bv_len + 1 );
+		if ( q == NULL )
+			return NULL;
+		p = q - rare;
+		if ( memcmp( p, pat->bv_val, pat->bv_len ) == 0 )
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+static int
+filter_substr_match( FilterInsn *fi, struct berval *bv )
+{
+	Filter *f = fi->fi_f;
+	char *p = bv->bv_val, *end = p + bv->bv_len;
+	int i;
+
+	if ( bv->bv_len < fi->fi_minlen )
+		return 0;
+
+	if ( !BER_BVISNULL( &f->f_sub_initial )) {
+		if ( memcmp( p, f->f_sub_initial.bv_val,
+			f->f_sub_initial.bv_len ))
+			return 0;
+		p += f->f_sub_initial.bv_len;
+	}
+
+	if ( !BER_BVISNULL( &f->f_sub_final )) {
+		end -= f->f_sub_final.bv_len;
+		if ( memcmp( end, f->f_sub_final.bv_val,
+			f->f_sub_final.bv_len ))
+			return 0;
+	}
+
+	/* the leftmost occurrence of each leaves the most room
+	 * for the next ones
+	 */
+	for ( i = 0; f->f_sub_any && !BER_BVISNULL( &f->f_sub_any[i] ); i++ ) {
+		if ( BER_BVISEMPTY( &f->f_sub_any[i] ))
+			continue;
+		p = filter_find( p, end, &f->f_sub_any[i], fi->fi_rare[i] );
+		if ( p == NULL )
+			return 0;
+		p += f->f_sub_any[i].bv_len;
+	}
+
+	return 1;
+}
+
+static int
+test_substrings_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterInsn	*fi )
+{
+	Filter *f = fi->fi_f;
+	Attribute *a;
+	int rc;
+
+	if ( !access_allowed( op, e,
+		f->f_sub_desc, NULL, ACL_SEARCH, NULL ) )
+	{
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for(a = attrs_find( e->e_attrs, f->f_sub_desc );
+		a != NULL;
+		a = attrs_find( a->a_next, f->f_sub_desc ) )
+	{
+		struct berval *bv;
+
+		/* as in test_ava_prog() */
+		if ( a->a_desc->ad_type != fi->fi_type )
+			return test_substrings_filter( op, e, f );
+
+		if (( f->f_sub_desc != a->a_desc ) && !access_allowed( op,
+			e, a->a_desc, NULL, ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			if ( filter_substr_match( fi, bv ))
+				return LDAP_COMPARE_TRUE;
+		}
+	}
+
+	return rc;
+}
+
+int
+test_filter_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterProg	*fp )
+{
+	struct {
+		ber_tag_t	choice;
+		int		neg;
+		int		end;
+		int		rtn;
+	} stack[FILTER_PROG_DEPTH];
+	FilterInsn *fi;
+	int sp = 0, pc = 0, rc;
+
+	if ( fp->fp_depth > FILTER_PROG_DEPTH )
+		return test_filter( op, e, fp->fp_filter );
+
+	Debug( LDAP_DEBUG_FILTER, "=> test_filter_prog\n", 0, 0, 0 );
+
+	for (;;) {
+		fi = &fp->fp_insn[pc++];
+
+		switch ( fi->fi_choice ) {
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+			/* groups always have operands, evaluate the first */
+			stack[sp].choice = fi->fi_choice;
+			stack[sp].neg = fi->fi_neg;
+			stack[sp].end = fi->fi_end;
+			stack[sp].rtn = fi->fi_choice == LDAP_FILTER_AND ?
+				LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+			sp++;
+			continue;
+
+		case SLAPD_FILTER_COMPUTED:
+			rc = fi->fi_result;
+			break;
+
+		case LDAP_FILTER_EQUALITY:
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+			if ( fi->fi_kind != FI_GENERIC ) {
+				rc = test_ava_prog( op, e, fi );
+				break;
+			}
+			/* FALLTHRU */
+		case LDAP_FILTER_APPROX:
+			rc = test_ava_filter( op, e, fi->fi_f->f_ava, fi->fi_choice );
+			break;
+
+		case LDAP_FILTER_SUBSTRINGS:
+			if ( fi->fi_kind == FI_SUBSTR )
+				rc = test_substrings_prog( op, e, fi );
+			else
+				rc = test_substrings_filter( op, e, fi->fi_f );
+			break;
+
+		case LDAP_FILTER_PRESENT:
+			rc = test_presence_filter( op, e, fi->fi_f->f_desc );
+			break;
+
+		case LDAP_FILTER_EXT:
+			rc = test_mra_filter( op, e, fi->fi_f->f_mra );
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "    unknown filter type %lu\n",
+				fi->fi_choice, 0, 0 );
+			rc = LDAP_PROTOCOL_ERROR;
+		}
+		if ( fi->fi_neg )
+			rc = filter_negate( rc );
+
+		/* hand the result to the enclosing groups, jumping
+		 * past the rest of those it decides
+		 */
+		while ( sp ) {
+			int decide = stack[sp-1].choice == LDAP_FILTER_AND ?
+				LDAP_COMPARE_FALSE : LDAP_COMPARE_TRUE;
+
+			if ( rc == decide ) {
+				stack[sp-1].rtn = rc;
+				pc = stack[sp-1].end;
+			} else if ( rc != filter_negate( decide )) {
+				/* Undefined unless a later operand decides */
+				stack[sp-1].rtn = rc;
+			}
+			if ( pc < stack[sp-1].end )
+				break;
+
+			sp--;
+			rc = stack[sp].rtn;
+			if ( stack[sp].neg )
+				rc = filter_negate( rc );
+		}
+		if ( !sp )
+			break;
+	}
+
+	Debug( LDAP_DEBUG_FILTER, "<= test_filter_prog %d\n", rc, 0, 0 );
+	return rc;
+}
@@ -109,6 +109,7 @@ frontend_init( void )
 	frontendDB->be_def_limit.lms_s_pr_total = 0;			/* number of total entries returned by pagedResults equal to hard limit */
 
 	ldap_pvt_thread_mutex_init( &frontendDB->be_pcl_mutex );
+	backend_db_stats_init( frontendDB );
 
 	/* suffix */
 	frontendDB->be_suffix = ch_calloc( 2, sizeof( struct berval ) );
@@ -60,6 +60,7 @@ BerVarray default_referral = NULL;
  */
 ldap_pvt_thread_pool_t	connection_pool;
 int			connection_pool_max = SLAP_MAX_WORKER_THREADS;
+int			connection_pool_queues = 1;
 int		slap_tool_thread_max = 1;
 
 slap_counters_t			slap_counters, *slap_counters_list;
@@ -92,6 +93,8 @@ slap_init( int mode, const char *name )
 
 	slap_op_init();
 
+	dn_cache_init();
+
 #ifdef SLAPD_MODULES
 	if ( module_init() != 0 ) {
 		slap_debug |= LDAP_DEBUG_NONE;
@@ -257,6 +260,9 @@ int slap_destroy(void)
 	root_dse_destroy();
 	entry_destroy();
 
+	acl_cache_destroy();
+	dn_cache_destroy();
+
 	switch ( slapMode & SLAP_MODE ) {
 	case SLAP_SERVER_MODE:
 	case SLAP_TOOL_MODE:
@@ -298,6 +304,11 @@ void slap_counters_init( slap_counters_t *sc )
 		ldap_pvt_mp_init( sc->sc_ops_initiated_[ i ] );
 		ldap_pvt_mp_init( sc->sc_ops_completed_[ i ] );
 	}
+	memset( sc->sc_ops_wait_, 0, sizeof( sc->sc_ops_wait_ ) );
+	memset( sc->sc_ops_run_, 0, sizeof( sc->sc_ops_run_ ) );
+	memset( sc->sc_ops_time_, 0, sizeof( sc->sc_ops_time_ ) );
+	sc->sc_db_time_ = NULL;
+	sc->sc_db_nslots = 0;
 #endif /* SLAPD_MONITOR */
 }
 
@@ -319,6 +330,9 @@ void slap_counters_destroy( slap_counters_t *sc )
 		ldap_pvt_mp_clear( sc->sc_ops_initiated_[ i ] );
 		ldap_pvt_mp_clear( sc->sc_ops_completed_[ i ] );
 	}
+	ch_free( sc->sc_db_time_ );
+	sc->sc_db_time_ = NULL;
+	sc->sc_db_nslots = 0;
 #endif /* SLAPD_MONITOR */
 }
 
@@ -0,0 +1,224 @@
+/* keycache.c - sharded caches of values looked up by string keys */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2011 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lutil.h"
+#include "lutil_hash.h"
+
+/*
+ * A keycache is split in shards, each with its own lock, picked by a
+ * hash of the key.  Each shard holds at most kc_size entries, replaced
+ * on a second chance basis; entries pinned by a reference count are
+ * skipped.  The users look entries up and fill them in with their
+ * shard locked, and count their own hits and misses in it.
+ */
+
+/* all the keycaches, for cn=Caches,cn=Monitor */
+slap_keycache_t	*slap_keycaches;
+
+int
+slap_keycache_init(
+	slap_keycache_t *kc,
+	char *name,
+	int nshards,
+	int size,
+	slap_keycache_free_func *freef )
+{
+	int	i;
+
+	kc->kc_name = name;
+	kc->kc_nshards = nshards;
+	kc->kc_size = size;
+	kc->kc_free = freef;
+	kc->kc_shards = ch_calloc( nshards, sizeof( slap_keycache_shard_t ) );
+	for ( i = 0; i < nshards; i++ ) {
+		slap_keycache_shard_t	*ks = &kc->kc_shards[ i ];
+
+		ldap_pvt_thread_mutex_init( &ks->ks_mutex );
+		ks->ks_entries = ch_calloc( size, sizeof( slap_keycache_entry_t ) );
+	}
+
+	kc->kc_next = slap_keycaches;
+	slap_keycaches = kc;
+
+	return 0;
+}
+
+/* Free all the entries, pinned or not */
+void
+slap_keycache_clear( slap_keycache_t *kc )
+{
+	int	i, j;
+
+	for ( i = 0; i < kc->kc_nshards; i++ ) {
+		slap_keycache_shard_t	*ks = &kc->kc_shards[ i ];
+
+		ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+		for ( j = 0; j < kc->kc_size; j++ ) {
+			slap_keycache_entry_t	*ke = &ks->ks_entries[ j ];
+
+			if ( !BER_BVISNULL( &ke->ke_key ) ) {
+				kc->kc_free( ke );
+				BER_BVZERO( &ke->ke_key );
+				ke->ke_data = NULL;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+	}
+}
+
+/* Once destroyed, the cache is empty and caches nothing */
+void
+slap_keycache_destroy( slap_keycache_t *kc )
+{
+	slap_keycache_t	**kcp;
+	int	i;
+
+	slap_keycache_clear( kc );
+
+	for ( kcp = &slap_keycaches; *kcp; kcp = &(*kcp)->kc_next ) {
+		if ( *kcp == kc ) {
+			*kcp = kc->kc_next;
+			break;
+		}
+	}
+
+	for ( i = 0; i < kc->kc_nshards; i++ ) {
+		ldap_pvt_thread_mutex_destroy( &kc->kc_shards[ i ].ks_mutex );
+		ch_free( kc->kc_shards[ i ].ks_entries );
+	}
+	ch_free( kc->kc_shards );
+	kc->kc_shards = NULL;
+	kc->kc_nshards = 0;
+}
+
+/* The shard of key, NULL if the cache is not set up */
+slap_keycache_shard_t *
+slap_keycache_shard(
+	slap_keycache_t *kc,
+	struct berval *key,
+	unsigned *hashp )
+{
+	lutil_HASH_CTX	ctx;
+	unsigned char	digest[ LUTIL_HASH_BYTES ];
+	unsigned	hash;
+
+	if ( kc->kc_shards == NULL ) {
+		return NULL;
+	}
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (const unsigned char *)key->bv_val, key->bv_len );
+	lutil_HASHFinal( digest, &ctx );
+
+	hash = digest[0] | ( digest[1] << 8 ) | ( digest[2] << 16 )
+		| ( (unsigned)digest[3] << 24 );
+	*hashp = hash;
+
+	return &kc->kc_shards[ hash % kc->kc_nshards ];
+}
+
+/* must be called with the shard locked */
+slap_keycache_entry_t *
+slap_keycache_find(
+	slap_keycache_t *kc,
+	slap_keycache_shard_t *ks,
+	struct berval *key,
+	unsigned hash )
+{
+	int	i;
+
+	for ( i = 0; i < kc->kc_size; i++ ) {
+		slap_keycache_entry_t	*ke = &ks->ks_entries[ i ];
+
+		if ( ke->ke_hash == hash && ke->ke_key.bv_len == key->bv_len
+			&& !BER_BVISNULL( &ke->ke_key )
+			&& memcmp( ke->ke_key.bv_val, key->bv_val, key->bv_len ) == 0 )
+		{
+			return ke;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Free a slot for a new entry with the given hash, for the caller to
+ * set ke_key and ke_data in; NULL if every entry is pinned.  Must be
+ * called with the shard locked.
+ */
+slap_keycache_entry_t *
+slap_keycache_slot(
+	slap_keycache_t *kc,
+	slap_keycache_shard_t *ks,
+	unsigned hash )
+{
+	slap_keycache_entry_t	*ke;
+	int	i;
+
+	for ( i = 0; i < 2 * kc->kc_size; i++ ) {
+		ke = &ks->ks_entries[ ks->ks_hand ];
+		ks->ks_hand = ( ks->ks_hand + 1 ) % kc->kc_size;
+		if ( BER_BVISNULL( &ke->ke_key ) ) {
+			goto found;
+		}
+		if ( ke->ke_refcnt ) {
+			continue;
+		}
+		if ( ke->ke_used ) {
+			ke->ke_used = 0;
+			continue;
+		}
+		kc->kc_free( ke );
+		BER_BVZERO( &ke->ke_key );
+		ke->ke_data = NULL;
+		goto found;
+	}
+
+	return NULL;
+
+found:;
+	ke->ke_hash = hash;
+	ke->ke_refcnt = 0;
+	ke->ke_used = 0;
+
+	return ke;
+}
+
+void
+slap_keycache_counters(
+	slap_keycache_t *kc,
+	unsigned long *hits,
+	unsigned long *misses )
+{
+	int	i;
+
+	*hits = *misses = 0;
+	for ( i = 0; i < kc->kc_nshards; i++ ) {
+		slap_keycache_shard_t	*ks = &kc->kc_shards[ i ];
+
+		ldap_pvt_thread_mutex_lock( &ks->ks_mutex );
+		*hits += ks->ks_hits;
+		*misses += ks->ks_misses;
+		ldap_pvt_thread_mutex_unlock( &ks->ks_mutex );
+	}
+}
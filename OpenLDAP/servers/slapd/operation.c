@@ -41,14 +41,20 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+slap_slowlog_t	slap_slowlog;
+
 void slap_op_init(void)
 {
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
+	ldap_pvt_thread_mutex_init( &slap_slowlog.sl_mutex );
+	slap_slowlog.sl_size = SLAP_SLOWOP_ENTRIES;
 }
 
 void slap_op_destroy(void)
 {
 	ldap_pvt_thread_mutex_destroy( &slap_op_mutex );
+	slap_slowlog_resize( 0 );
+	ldap_pvt_thread_mutex_destroy( &slap_slowlog.sl_mutex );
 }
 
 static void
@@ -206,6 +212,7 @@ slap_op_alloc(
 	op->o_tag = tag;
 
 	slap_op_time( &op->o_time, &op->o_tincr );
+	gettimeofday( &op->o_qtime, NULL );
 	op->o_opid = id;
 
 #if defined( LDAP_SLAPI )
@@ -245,3 +252,242 @@ slap_req2op( ber_tag_t tag )
 
 	return SLAP_OP_LAST;
 }
+
+/* Microseconds from *t0 to *t1, 0 if the clock went backwards */
+unsigned long
+slap_timeval_diff( struct timeval *t0, struct timeval *t1 )
+{
+	long sec = t1->tv_sec - t0->tv_sec;
+	long usec = t1->tv_usec - t0->tv_usec;
+
+	if ( sec < 0 || ( sec == 0 && usec < 0 ))
+		return 0;
+	return (unsigned long)sec * 1000000UL + usec;
+}
+
+static int
+slap_histogram_bucket( unsigned long usec )
+{
+	int e;
+
+	if ( usec < SLAP_HIST_SUB )
+		return usec;
+
+	/* e = index of the highest bit set, at most 31 */
+	for ( e = SLAP_HIST_SUB_BITS; e < 31 && ( usec >> ( e + 1 )); e++ )
+		;
+	return ( e - SLAP_HIST_SUB_BITS + 1 ) * SLAP_HIST_SUB +
+		(( usec >> ( e - SLAP_HIST_SUB_BITS )) & ( SLAP_HIST_SUB - 1 ));
+}
+
+/* Smallest value counted in bucket i */
+unsigned long
+slap_histogram_bound( int i )
+{
+	int e;
+
+	if ( i < SLAP_HIST_SUB )
+		return i;
+
+	e = i / SLAP_HIST_SUB + SLAP_HIST_SUB_BITS - 1;
+	return (unsigned long)( SLAP_HIST_SUB + i % SLAP_HIST_SUB )
+		<< ( e - SLAP_HIST_SUB_BITS );
+}
+
+void
+slap_histogram_add( slap_histogram_t *h, unsigned long usec )
+{
+	h->sh_buckets[ slap_histogram_bucket( usec ) ]++;
+	h->sh_count++;
+	if ( usec > h->sh_max )
+		h->sh_max = usec;
+}
+
+void
+slap_histogram_merge( slap_histogram_t *dst, slap_histogram_t *src )
+{
+	int i;
+
+	for ( i = 0; i < SLAP_HIST_BUCKETS; i++ )
+		dst->sh_buckets[ i ] += src->sh_buckets[ i ];
+	dst->sh_count += src->sh_count;
+	if ( src->sh_max > dst->sh_max )
+		dst->sh_max = src->sh_max;
+}
+
+/* Upper bound of the value below which permille/1000 of the samples fall */
+unsigned long
+slap_histogram_quantile( slap_histogram_t *h, int permille )
+{
+	unsigned long rank, n = 0, bound;
+	int i;
+
+	if ( h->sh_count == 0 )
+		return 0;
+
+	rank = ( h->sh_count / 1000 ) * permille +
+		( h->sh_count % 1000 ) * permille / 1000;
+	if ( rank == 0 )
+		rank = 1;
+
+	for ( i = 0; i < SLAP_HIST_BUCKETS - 1; i++ ) {
+		n += h->sh_buckets[ i ];
+		if ( n >= rank )
+			break;
+	}
+	if ( i == SLAP_HIST_BUCKETS - 1 )
+		return h->sh_max;
+
+	bound = slap_histogram_bound( i + 1 ) - 1;
+	return bound < h->sh_max ? bound : h->sh_max;
+}
+
+#ifdef SLAPD_MONITOR
+/*
+ * The response time histograms of database slot id in the counters,
+ * growing them as needed; the caller holds sc->sc_mutex, or
+ * slap_counters.sc_mutex if sc is &slap_counters.
+ */
+slap_histogram_t *
+slap_counters_db_time( slap_counters_t *sc, int id )
+{
+	if ( id > sc->sc_db_nslots ) {
+		sc->sc_db_time_ = ch_realloc( sc->sc_db_time_,
+			id * sizeof( sc->sc_db_time_[ 0 ] ));
+		memset( &sc->sc_db_time_[ sc->sc_db_nslots ], 0,
+			( id - sc->sc_db_nslots ) * sizeof( sc->sc_db_time_[ 0 ] ));
+		sc->sc_db_nslots = id;
+	}
+	return sc->sc_db_time_[ id - 1 ];
+}
+
+/* Forget the response times of database slot id in all counters */
+void
+slap_counters_db_clear( int id )
+{
+	slap_counters_t *sc;
+
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	for ( sc = &slap_counters; sc; sc = sc->sc_next ) {
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+		}
+		if ( id <= sc->sc_db_nslots ) {
+			memset( sc->sc_db_time_[ id - 1 ], 0,
+				sizeof( sc->sc_db_time_[ 0 ] ));
+		}
+		if ( sc != &slap_counters ) {
+			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+}
+#endif /* SLAPD_MONITOR */
+
+static void
+slap_slowop_clear( slap_slowop_t *so )
+{
+	if ( !BER_BVISNULL( &so->so_suffix ) )
+		ch_free( so->so_suffix.bv_val );
+	if ( !BER_BVISNULL( &so->so_base ) )
+		ch_free( so->so_base.bv_val );
+	if ( !BER_BVISNULL( &so->so_filter ) )
+		ch_free( so->so_filter.bv_val );
+	memset( so, 0, sizeof( *so ));
+}
+
+/* Set the number of slow operations kept, and forget those seen so far */
+void
+slap_slowlog_resize( int size )
+{
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &slap_slowlog.sl_mutex );
+	if ( slap_slowlog.sl_ring ) {
+		for ( i = 0; i < slap_slowlog.sl_size; i++ )
+			slap_slowop_clear( &slap_slowlog.sl_ring[ i ] );
+		ch_free( slap_slowlog.sl_ring );
+		slap_slowlog.sl_ring = NULL;
+	}
+	slap_slowlog.sl_size = size;
+	slap_slowlog.sl_next = 0;
+	slap_slowlog.sl_total = 0;
+	ldap_pvt_thread_mutex_unlock( &slap_slowlog.sl_mutex );
+}
+
+static void
+slap_slowlog_record( Operation *op, SlapReply *rs, slap_op_t type,
+	unsigned long usec )
+{
+	slap_slowop_t *so;
+
+	ldap_pvt_thread_mutex_lock( &slap_slowlog.sl_mutex );
+	slap_slowlog.sl_total++;
+	if ( slap_slowlog.sl_size == 0 ) {
+		ldap_pvt_thread_mutex_unlock( &slap_slowlog.sl_mutex );
+		return;
+	}
+	if ( slap_slowlog.sl_ring == NULL ) {
+		slap_slowlog.sl_ring = ch_calloc( slap_slowlog.sl_size,
+			sizeof( slap_slowop_t ));
+	}
+
+	so = &slap_slowlog.sl_ring[ slap_slowlog.sl_next ];
+	if ( ++slap_slowlog.sl_next == slap_slowlog.sl_size )
+		slap_slowlog.sl_next = 0;
+	slap_slowop_clear( so );
+
+	so->so_time = slap_get_time();
+	so->so_connid = op->o_connid;
+	so->so_opid = op->o_opid;
+	so->so_type = type;
+	so->so_err = rs->sr_err;
+	so->so_usec = usec;
+	if ( op->o_bd && op->o_bd->be_suffix )
+		ber_dupbv( &so->so_suffix, &op->o_bd->be_suffix[ 0 ] );
+	ber_dupbv( &so->so_base, &op->o_req_dn );
+	if ( type == SLAP_OP_SEARCH ) {
+		so->so_scope = op->ors_scope;
+		ber_dupbv( &so->so_filter, &op->ors_filterstr );
+		so->so_nentries = rs->sr_nentries;
+		so->so_ncandidates = rs->sr_ncandidates;
+		so->so_nexamined = rs->sr_nexamined;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_slowlog.sl_mutex );
+}
+
+/*
+ * Called once the final response to an operation has been sent:
+ * account its response time to the operation type and to the
+ * database, and keep it in the slow operation log if it took
+ * longer than the threshold.
+ */
+void
+slap_op_response_time( Operation *op, SlapReply *rs )
+{
+	slap_op_t type = slap_req2op( op->o_tag );
+	struct timeval now;
+	unsigned long usec;
+
+	if ( type == SLAP_OP_LAST || op->o_qtime.tv_sec == 0 )
+		return;
+
+	gettimeofday( &now, NULL );
+	usec = slap_timeval_diff( &op->o_qtime, &now );
+
+#ifdef SLAPD_MONITOR
+	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
+	slap_histogram_add( &op->o_counters->sc_ops_time_[ type ], usec );
+	if ( op->o_bd && op->o_bd->be_statsid ) {
+		slap_histogram_add( &slap_counters_db_time( op->o_counters,
+			op->o_bd->be_statsid )[ type ], usec );
+	}
+	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+#endif /* SLAPD_MONITOR */
+
+	if ( slap_slowlog.sl_threshold &&
+		usec / 1000 >= slap_slowlog.sl_threshold )
+	{
+		slap_slowlog_record( op, rs, type, usec );
+	}
+}
@@ -16,84 +16,41 @@ typedef struct adpair {
 	AttributeDescription *memberAttr;
 	AttributeDescription *expandAttr;
 	AttributeDescription *uuidAttr;
+	Avlnode		*ap_cache;	/* ngclosure by group DN */
+	int		ap_cachecount;
+	int		ap_cachesize;
+	unsigned long	ap_gen;	/* bumped whenever the cache is flushed */
+	ldap_pvt_thread_mutex_t	ap_mutex;
 } adpair;
 
+/* The transitive closure of a group: the normalized values of
+ * memberAttr and expandAttr of the group and of every group nested
+ * in it, sorted, so that a compare is a single binary search.
+ */
+typedef struct ngclosure {
+	struct berval	nc_ndn;
+	BerVarray	nc_vals;
+	int		nc_nvals;
+} ngclosure;
+
+/* State of one closure expansion */
+typedef struct ngexpand {
+	adpair		*ne_ap;
+	BackendDB	*ne_be;		/* the database of the group compared */
+	int		ne_nocache;	/* the closure must not be cached */
+	Avlnode		*ne_visited;	/* DNs of the groups expanded so far */
+	BerVarray	ne_vals;
+	int		ne_nvals;
+	int		ne_size;
+} ngexpand;
+
+#define NG_DEFAULT_CACHESIZE	1000
+
 typedef struct nestedgroup_id_to_dn_t {
 	int				found;
 	struct berval	target_dn;
 } nestedgroup_id_to_dn_t;
 
-typedef struct nestedgroup_ismember_t {
-	int				found;
-} nestedgroup_ismember_t;
-
-nestedgroup_is_member_cb (
-	Operation	*op,
-	SlapReply	*rs
-)
-{
-	Debug(LDAP_DEBUG_ANY, "nestedgroup_is_member_cb sr_type[%d] sr_err[%d]\n", rs->sr_type, rs->sr_err, 0);
-	nestedgroup_ismember_t *ismember = (nestedgroup_ismember_t *)op->o_callback->sc_private;
-	
-	if (rs->sr_err == LDAP_COMPARE_TRUE)
-		ismember->found = 1;
-	else
-		ismember->found = 0;
-	
-	return 0;
-}
-
-
-static int __attribute__ ((noinline))
-nestedgroup_is_member (
-	Operation	*op,
-	struct berval* groupDN,
-	AttributeDescription *searchAttr,
-	struct berval* searchID,
-	int * result)
-{
-	Operation nop = *op;
-	AttributeAssertion	ava = { NULL, BER_BVNULL };
-	SlapReply 		sreply = {REP_RESULT};
-	slap_callback cb = { NULL, nestedgroup_is_member_cb, NULL, NULL };
-	BackendDB	*target_bd = NULL;
-	nestedgroup_ismember_t ismember =  {0};
-	int rc = 0;
-	
-	target_bd = select_backend(&op->o_req_ndn, 0);
-	
-	if (!target_bd || !target_bd->be_compare)
-		return LDAP_NOT_SUPPORTED;
-	
-	sreply.sr_entry = NULL;
-	sreply.sr_nentries = 0;
-	
-	nop.orc_ava = &ava;
-	nop.orc_ava->aa_desc = searchAttr;
-	nop.orc_ava->aa_value = *searchID;
-	
-	nop.o_tag = LDAP_REQ_COMPARE;
-	nop.o_protocol = LDAP_VERSION3;
-	nop.o_callback = &cb;
-	nop.o_time = slap_get_time();
-	nop.o_do_not_cache = 0;
-	nop.o_dn = target_bd->be_rootdn;
-	nop.o_ndn = target_bd->be_rootndn;
-	nop.o_bd = target_bd;
-
-	nop.o_req_dn = *groupDN;
-	nop.o_req_ndn = *groupDN;
-	cb.sc_private = &ismember;
-
- 	rc = nop.o_bd->be_compare( &nop, &sreply );
-	Debug(LDAP_DEBUG_ANY, "nestedgroup_is_member be_compare[%d] ismember[%d]\n", rc, ismember.found, 0);
-	if (ismember.found)
-		*result = 1;
-	else
-		*result = 0;
-	return 0;
-}
-
 static int
 nestedgroup_id_to_dn_cb (
 	Operation	*op,
@@ -173,67 +130,207 @@ nestedgroup_id_to_dn (
 
 	rc = nop.o_bd->be_search( &nop, &sreply );
 	Debug(LDAP_DEBUG_ANY, "nestedgroup_id_to_dn be_search[%d]\n", rc, 0, 0);
-	if (dn_result.found)
-		ber_dupbv(resultDN, &dn_result.target_dn );
-	return 0;
+	if ( rc != LDAP_SUCCESS )
+		return rc;
+	if ( !dn_result.found )
+		return LDAP_NO_SUCH_OBJECT;
+	ber_dupbv(resultDN, &dn_result.target_dn );
+	return LDAP_SUCCESS;
 }
 
-static int __attribute__ ((noinline))
+static int
+nestedgroup_bv_cmp( const void *v1, const void *v2 )
+{
+	return ber_bvcmp( (const struct berval *)v1, (const struct berval *)v2 );
+}
+
+static int
+nestedgroup_closure_cmp( const void *v1, const void *v2 )
+{
+	const ngclosure *nc1 = v1, *nc2 = v2;
+
+	return ber_bvcmp( &nc1->nc_ndn, &nc2->nc_ndn );
+}
+
+static void
+nestedgroup_closure_free( void *v )
+{
+	ngclosure *nc = v;
+
+	ber_bvarray_free( nc->nc_vals );
+	ch_free( nc );
+}
+
+/* Drop all cached closures. Enter with ap->ap_mutex locked. */
+static void
+nestedgroup_cache_flush( adpair *ap )
+{
+	avl_free( ap->ap_cache, nestedgroup_closure_free );
+	ap->ap_cache = NULL;
+	ap->ap_cachecount = 0;
+	ap->ap_gen++;
+}
+
+static void
+nestedgroup_addvals( ngexpand *ne, BerVarray vals )
+{
+	int i;
+
+	for ( i = 0; vals[i].bv_val; i++ ) {
+		if ( ne->ne_nvals + 1 >= ne->ne_size ) {
+			ne->ne_size = ne->ne_size ? ne->ne_size * 2 : 16;
+			ne->ne_vals = ch_realloc( ne->ne_vals,
+				ne->ne_size * sizeof(struct berval) );
+		}
+		ber_dupbv( &ne->ne_vals[ne->ne_nvals++], &vals[i] );
+	}
+}
+
+/* Collect the values of a group and of the groups nested in it.
+ * Each group is expanded once, so membership cycles terminate.
+ * Writes to a group held in another database don't go through this
+ * overlay instance, so a closure reaching one is not cached; neither
+ * is one missing a nested group whose lookup failed.
+ */
+static void
+nestedgroup_expand( Operation *op, ngexpand *ne, struct berval *ndn )
+{
+	adpair *ap = ne->ne_ap;
+	Entry *e = NULL;
+	Attribute *a;
+	BerVarray nested = NULL;
+	struct berval *bv;
+	int i;
+
+	bv = ber_dupbv( NULL, ndn );
+	if ( avl_insert( &ne->ne_visited, bv, nestedgroup_bv_cmp, avl_dup_error ) ) {
+		ber_bvfree( bv );
+		return;
+	}
+
+	if ( select_backend( ndn, 0 ) != ne->ne_be )
+		ne->ne_nocache = 1;
+
+	if ( be_entry_get_rw( op, ndn, NULL, NULL, 0, &e ) != LDAP_SUCCESS || e == NULL )
+		return;
+	a = attr_find( e->e_attrs, ap->memberAttr );
+	if ( a )
+		nestedgroup_addvals( ne, a->a_nvals );
+	a = attr_find( e->e_attrs, ap->expandAttr );
+	if ( a ) {
+		nestedgroup_addvals( ne, a->a_nvals );
+		ber_bvarray_dup_x( &nested, a->a_nvals, NULL );
+	}
+	be_entry_release_rw( op, e, 0 );
+
+	for ( i = 0; nested && nested[i].bv_val; i++ ) {
+		struct berval member_dn = BER_BVNULL;
+		int rc;
+
+		rc = nestedgroup_id_to_dn( op, ap->uuidAttr, &nested[i], &member_dn );
+		if ( rc != LDAP_SUCCESS ) {
+			if ( rc != LDAP_NO_SUCH_OBJECT )
+				ne->ne_nocache = 1;
+			continue;
+		}
+		nestedgroup_expand( op, ne, &member_dn );
+		ber_memfree( member_dn.bv_val );
+	}
+	ber_bvarray_free( nested );
+}
+
+static ngclosure *
+nestedgroup_closure_build( Operation *op, adpair *ap, struct berval *ndn,
+	int *cacheable )
+{
+	ngexpand ne = { ap, NULL, 0, NULL, NULL, 0, 0 };
+	ngclosure *nc;
+	int i, j;
+
+	ne.ne_be = op->o_bd;
+	nestedgroup_expand( op, &ne, ndn );
+	avl_free( ne.ne_visited, (AVL_FREE)ber_bvfree );
+	*cacheable = !ne.ne_nocache;
+
+	if ( ne.ne_nvals ) {
+		qsort( ne.ne_vals, ne.ne_nvals, sizeof(struct berval), nestedgroup_bv_cmp );
+		for ( i = 1, j = 1; i < ne.ne_nvals; i++ ) {
+			if ( bvmatch( &ne.ne_vals[j-1], &ne.ne_vals[i] ) )
+				ch_free( ne.ne_vals[i].bv_val );
+			else
+				ne.ne_vals[j++] = ne.ne_vals[i];
+		}
+		ne.ne_nvals = j;
+		BER_BVZERO( &ne.ne_vals[j] );
+	}
+
+	nc = ch_malloc( sizeof(ngclosure) + ndn->bv_len + 1 );
+	nc->nc_ndn.bv_val = (char *)(nc + 1);
+	nc->nc_ndn.bv_len = ndn->bv_len;
+	AC_MEMCPY( nc->nc_ndn.bv_val, ndn->bv_val, ndn->bv_len + 1 );
+	nc->nc_vals = ne.ne_vals;
+	nc->nc_nvals = ne.ne_nvals;
+	Debug(LDAP_DEBUG_TRACE, "=> nestedgroup_closure_build [%s] %d values\n",
+		ndn->bv_val, nc->nc_nvals, 0);
+	return nc;
+}
+
+static int
+nestedgroup_closure_test( ngclosure *nc, struct berval *val )
+{
+	return nc->nc_nvals && bsearch( val, nc->nc_vals, nc->nc_nvals,
+		sizeof(struct berval), nestedgroup_bv_cmp ) != NULL;
+}
+
+static int
 nestedgroup_getgroup(Operation *op, adpair *ap, int *isMember )
 {
 	int rc = LDAP_COMPARE_FALSE;
-	Entry *e = NULL;	
-	Attribute *members = NULL;
 	BackendDB	*be = op->o_bd;
-	int i;
+	struct berval *val;
+	ngclosure *nc, nc_key;
+	unsigned long gen;
+	int cacheable;
 	
 	if (!op || !ap || !isMember) {
 		goto cleanup;
 	};
 	
 	*isMember = 0;
+	val = &op->oq_compare.rs_ava->aa_value;
 	op->o_bd = select_backend( &op->o_req_ndn, 0);
 	
 	if (op->o_bd) {
-		rc = be_entry_get_rw( op, &op->o_req_ndn, NULL, ap->expandAttr, 0, &e );
-		if ( e != NULL ) {
-			dump_slap_entry(e);
-			members = attr_find(e->e_attrs, ap->expandAttr );
-			if (members) {
-				dump_slap_attr(members);
-				// is the target a direct relative? applies to groups (isgroupcheck?)
-				rc = value_find_ex( ap->expandAttr,
-					SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH |
-					SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH,
-					members->a_nvals, &op->oq_compare.rs_ava->aa_value,
-					op->o_tmpmemctx );
-				if (rc != LDAP_SUCCESS) {
-					for ( i = 0 ; members->a_nvals[i].bv_val; i++) {
-						dump_berval( &(members->a_nvals[i]) );
-						struct berval member_dn = BER_BVNULL;
-						
-						nestedgroup_id_to_dn (op, ap->uuidAttr, &(members->a_nvals[i]), &member_dn);
-						if (!BER_BVISNULL(&member_dn)) {
-							*isMember = 0;
-							nestedgroup_is_member (op, &member_dn, op->oq_compare.rs_ava->aa_desc, &op->oq_compare.rs_ava->aa_value, isMember);
-							ber_memfree(member_dn.bv_val);
-							if (*isMember) {
-								rc = LDAP_COMPARE_TRUE;
-								break;
-							} else {
-								rc = LDAP_COMPARE_FALSE;
-							}
-						}
-
-					}
-				} else {
-					*isMember = 1;
-					rc = LDAP_COMPARE_TRUE;
-					Debug(LDAP_DEBUG_ANY, "=> nestedgroup_getgroup  FOUND member\n", rc, 0, 0);
+		nc_key.nc_ndn = op->o_req_ndn;
+		ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+		nc = avl_find( ap->ap_cache, &nc_key, nestedgroup_closure_cmp );
+		if ( nc )
+			*isMember = nestedgroup_closure_test( nc, val );
+		gen = ap->ap_gen;
+		ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+
+		if ( !nc ) {
+			nc = nestedgroup_closure_build( op, ap, &op->o_req_ndn, &cacheable );
+			*isMember = nestedgroup_closure_test( nc, val );
+
+			/* Don't cache a closure if a write flushed the cache while
+			 * it was being built, it may predate that write.
+			 */
+			ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+			if ( cacheable && gen == ap->ap_gen && ap->ap_cachesize > 0 ) {
+				if ( ap->ap_cachecount >= ap->ap_cachesize )
+					nestedgroup_cache_flush( ap );
+				if ( avl_insert( &ap->ap_cache, nc, nestedgroup_closure_cmp, avl_dup_error ) == 0 ) {
+					ap->ap_cachecount++;
+					nc = NULL;
 				}
-			}			
-			be_entry_release_rw( op, e, 0 );
+			}
+			ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+			if ( nc )
+				nestedgroup_closure_free( nc );
 		}
+		if ( *isMember )
+			rc = LDAP_COMPARE_TRUE;
 	}
 	op->o_bd = be;
 	
@@ -244,12 +341,50 @@ cleanup:
 	return rc;
 }
 
+/* Flush the closures on any write that can change a group, a nested
+ * group reference, or the entry a reference resolves to.
+ */
+static void
+nestedgroup_invalidate( Operation *op, adpair *ap )
+{
+	for ( ; ap; ap = ap->ap_next ) {
+		if ( !ap->memberAttr )
+			continue;
+		if ( op->o_tag == LDAP_REQ_MODIFY ) {
+			Modifications *ml;
+
+			for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+				if ( is_ad_subtype( ml->sml_desc, ap->memberAttr ) ||
+					is_ad_subtype( ml->sml_desc, ap->expandAttr ) ||
+					is_ad_subtype( ml->sml_desc, ap->uuidAttr ) )
+					break;
+			}
+			if ( !ml )
+				continue;
+		}
+		ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+		nestedgroup_cache_flush( ap );
+		ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+	}
+}
+
 static int
 nestedgroup_response( Operation *op, SlapReply *rs )
 {
 	slap_overinst *on = (slap_overinst *) op->o_bd->bd_info;
 	adpair *ap = on->on_bi.bi_private;
 
+	if ( ap && rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+			nestedgroup_invalidate( op, ap );
+			break;
+		}
+	}
+
 	/* If we've been configured and the current response is
 	 * what we're looking for...
 	 */
@@ -311,7 +446,9 @@ static int nestedgroup_config(
 			return( 1 );
 		}
 
-		a2 = ch_malloc( sizeof(adpair) );
+		a2 = ch_calloc( 1, sizeof(adpair) );
+		ldap_pvt_thread_mutex_init( &a2->ap_mutex );
+		a2->ap_cachesize = NG_DEFAULT_CACHESIZE;
 		a2->ap_next = on->on_bi.bi_private;
 		a2->memberAttr = ap.memberAttr;
 		a2->expandAttr = ap.expandAttr;
@@ -323,9 +460,43 @@ static int nestedgroup_config(
 	return 0;
 }
 
+static int
+nestedgroup_db_init(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	adpair *ap;
+
+	ap = ch_calloc( 1, sizeof(adpair) );
+	ldap_pvt_thread_mutex_init( &ap->ap_mutex );
+	ap->ap_cachesize = NG_DEFAULT_CACHESIZE;
+	on->on_bi.bi_private = ap;
+	return 0;
+}
+
 static int
 nestedgroup_close(
-	BackendDB *be
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	adpair *ap;
+
+	for ( ap = on->on_bi.bi_private; ap; ap = ap->ap_next ) {
+		ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+		nestedgroup_cache_flush( ap );
+		ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+	}
+	return 0;
+}
+
+static int
+nestedgroup_db_destroy(
+	BackendDB *be,
+	ConfigReply *cr
 )
 {
 	slap_overinst *on = (slap_overinst *) be->bd_info;
@@ -333,9 +504,11 @@ nestedgroup_close(
 
 	for ( ap = on->on_bi.bi_private; ap; ap = a2 ) {
 		a2 = ap->ap_next;
-        if(ap)
-            ch_free( ap );
+		avl_free( ap->ap_cache, nestedgroup_closure_free );
+		ldap_pvt_thread_mutex_destroy( &ap->ap_mutex );
+		ch_free( ap );
 	}
+	on->on_bi.bi_private = NULL;
 	return 0;
 }
 
@@ -348,6 +521,7 @@ static slap_overinst nestedgroup;
 
 enum {
 	NG_EXPANDATTRIBUTE = 1,
+	NG_CACHESIZE,
 	NG_LAST
 };
 
@@ -361,6 +535,12 @@ static ConfigTable ngcfg[] = {
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )",
 			NULL, NULL },
+	{ "nestedgroup-cachesize", "groups",
+		2, 2, 0, ARG_INT|ARG_MAGIC|NG_CACHESIZE, ng_cfgen,
+				"( OLcfgOvAt:701.2 NAME 'olcNestedGroupCacheSize' "
+			"DESC 'Nested Group configuration: number of group closures to cache' "
+			"SYNTAX OMsInteger SINGLE-VALUE )",
+			NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -369,7 +549,7 @@ static ConfigOCs ngocs[] = {
 		"NAME 'olcNestedGroup' "
 		"DESC 'Nested Group configuration' "
 		"SUP olcOverlayConfig "
-		"MAY (olcExpandAttribute) )",
+		"MAY (olcExpandAttribute $ olcNestedGroupCacheSize) )",
 		Cft_Overlay, ngcfg, NULL, NULL },
 	{ NULL, 0, NULL }
 };
@@ -397,6 +577,10 @@ ng_cfgen( ConfigArgs *c )
 			}
 			break;
 
+		case NG_CACHESIZE:
+			c->value_int = ap->ap_cachesize;
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -404,6 +588,11 @@ ng_cfgen( ConfigArgs *c )
 
 		return rc;
 
+	} else if ( c->op == LDAP_MOD_DELETE && c->type == NG_CACHESIZE ) {
+		ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+		ap->ap_cachesize = NG_DEFAULT_CACHESIZE;
+		ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+		return rc;
 	}
 
 	switch( c->type ) {
@@ -445,8 +634,26 @@ ng_cfgen( ConfigArgs *c )
 			aplist->memberAttr = targetAD;
 			aplist->expandAttr = expandedAD;
 			aplist->uuidAttr = uuidAttr;
+			ldap_pvt_thread_mutex_lock( &aplist->ap_mutex );
+			nestedgroup_cache_flush( aplist );
+			ldap_pvt_thread_mutex_unlock( &aplist->ap_mutex );
 		} break;
 
+		case NG_CACHESIZE:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"\"nestedgroup-cachesize <groups>\": "
+					"invalid size %d", c->value_int );
+				Debug( LDAP_DEBUG_CONFIG, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				return ARG_BAD_CONF;
+			}
+			ldap_pvt_thread_mutex_lock( &ap->ap_mutex );
+			ap->ap_cachesize = c->value_int;
+			nestedgroup_cache_flush( ap );
+			ldap_pvt_thread_mutex_unlock( &ap->ap_mutex );
+			break;
+
 		default:
 			rc = 1;
 			break;
@@ -459,13 +666,10 @@ ng_cfgen( ConfigArgs *c )
 int nestedgroup_initialize() {
 	int rc = -1;
 
-	adpair	*ad;
-
-	ad = ch_calloc(1, sizeof(adpair));
-	nestedgroup.on_bi.bi_private = ad;
-	
 	nestedgroup.on_bi.bi_type = "nestedgroup";
+	nestedgroup.on_bi.bi_db_init = nestedgroup_db_init;
 	nestedgroup.on_bi.bi_db_close = nestedgroup_close;
+	nestedgroup.on_bi.bi_db_destroy = nestedgroup_db_destroy;
 	nestedgroup.on_response = nestedgroup_response;
 	nestedgroup.on_bi.bi_db_config = config_generic_wrapper;
 	nestedgroup.on_bi.bi_cf_ocs = ngocs;
@@ -23,6 +23,7 @@
 #ifdef SLAPD_OVER_SYNCPROV
 
 #include <ac/string.h>
+#include <ac/errno.h>
 #include "lutil.h"
 #include "slap.h"
 #include "config.h"
@@ -32,6 +33,15 @@
 #define	CHECK_CSN	1
 #endif
 
+/* Publish psearch match counters under cn=Monitor */
+#ifdef SLAPD_MONITOR
+#define	SYNCPROV_MONITOR
+#endif
+
+#ifdef SYNCPROV_MONITOR
+#include "../back-monitor/back-monitor.h"
+#endif
+
 /* A modify request on a particular entry */
 typedef struct modinst {
 	struct modinst *mi_next;
@@ -66,6 +76,13 @@ typedef struct syncops {
 	int		s_rid;
 	int		s_sid;
 	struct berval s_filterstr;
+	FilterProg	*s_prog;	/* compiled filter, once detached */
+	struct syncops *s_basenext;	/* next psearch with the same base */
+	struct syncops *s_keynext;	/* next psearch with the same key */
+	AttributeType	*s_keytype;	/* equality assertion the filter */
+	struct berval	s_keyval;	/* requires, if any */
+	unsigned long	s_basegen;	/* last write below the base */
+	unsigned long	s_keygen;	/* last write with the key value */
 	int		s_flags;	/* search status */
 #define	PS_IS_REFRESHING	0x01
 #define	PS_IS_DETACHED		0x02
@@ -105,24 +122,42 @@ typedef struct syncmatches {
 
 /* Session log data */
 typedef struct slog_entry {
-	struct slog_entry *se_next;
 	struct berval se_uuid;
 	struct berval se_csn;
 	int	se_sid;
+	int	se_merged;	/* replaced older records of this entry */
 	ber_tag_t	se_tag;
 } slog_entry;
 
+/* The log keeps one record per entry and server ID, the latest one,
+ * in a threaded tree in csn order. A playback starts at the oldest
+ * csn of the consumer's cookie instead of at the head of the log.
+ */
 typedef struct sessionlog {
 	BerVarray	sl_mincsn;
 	int		*sl_sids;
 	int		sl_numcsns;
 	int		sl_num;
 	int		sl_size;
-	slog_entry *sl_head;
-	slog_entry *sl_tail;
+	int		*sl_logsids;	/* server IDs seen in the log */
+	int		sl_numlogsids;
+	Avlnode	*sl_entries;	/* records by csn */
+	Avlnode	*sl_uuids;	/* records by entryUUID and server ID */
 	ldap_pvt_thread_mutex_t sl_mutex;
 } sessionlog;
 
+/* Persistent searches by base DN, and by an equality assertion
+ * their filter requires. A write only needs to evaluate the
+ * psearches found under its target DN or one of its ancestors,
+ * and under one of the target entry's values, if they have a key.
+ */
+typedef struct psindex {
+	AttributeType	*pi_type;	/* NULL for a base DN */
+	struct berval	pi_val;		/* base DN or normalized value */
+	syncops		*pi_ops;
+	int		pi_count;	/* psearches keyed on pi_type */
+} psindex;
+
 /* The main state for this overlay */
 typedef struct syncprov_info_t {
 	syncops		*si_ops;
@@ -140,7 +175,17 @@ typedef struct syncprov_info_t {
 						 * have been made without updating the csn. */
 	time_t	si_chklast;	/* time of last checkpoint */
 	Avlnode	*si_mods;	/* entries being modified */
+	Avlnode	*si_psindex;	/* psearches by base and by key */
+	Avlnode	*si_pstypes;	/* attribute types of the keys */
+	unsigned long	si_psgen;	/* writes matched against psearches */
+	unsigned long	si_psevaluated;	/* psearches evaluated for writes */
+	unsigned long	si_pspruned;	/* psearches skipped for writes */
+#ifdef SYNCPROV_MONITOR
+	void		*si_monitor_cb;
+	struct berval	si_monitor_ndn;
+#endif
 	sessionlog	*si_logs;
+	char		*si_logfile;	/* keeps the session log across restarts */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
@@ -381,6 +426,213 @@ sp_avl_cmp( const void *c1, const void *c2 )
 	return ber_bvcmp( &m1->mt_dn, &m2->mt_dn );
 }
 
+/* Find a psindex in an AVL tree */
+static int
+sp_psindex_cmp( const void *c1, const void *c2 )
+{
+	const psindex *p1, *p2;
+	int rc;
+
+	p1 = c1; p2 = c2;
+	if ( p1->pi_type != p2->pi_type )
+		return p1->pi_type < p2->pi_type ? -1 : 1;
+	rc = p1->pi_val.bv_len - p2->pi_val.bv_len;
+
+	if ( rc ) return rc;
+	return memcmp( p1->pi_val.bv_val, p2->pi_val.bv_val, p1->pi_val.bv_len );
+}
+
+/* Find the equality assertion a psearch filter requires, if its
+ * normalized value can only match identical normalized values.
+ */
+static AttributeAssertion *
+syncprov_filter_key( Filter *f )
+{
+	AttributeAssertion *ava;
+	MatchingRule *mr;
+
+	if ( f->f_choice == LDAP_FILTER_AND ) {
+		for ( f = f->f_and; f; f = f->f_next ) {
+			ava = syncprov_filter_key( f );
+			if ( ava ) return ava;
+		}
+		return NULL;
+	}
+	if ( f->f_choice != LDAP_FILTER_EQUALITY )
+		return NULL;
+
+	ava = f->f_ava;
+#ifdef LDAP_COMP_MATCH
+	if ( ava->aa_cf )
+		return NULL;
+#endif
+	/* objectClass matches subclasses, the others are computed */
+	if ( ava->aa_desc == slap_schema.si_ad_objectClass ||
+		ava->aa_desc == slap_schema.si_ad_structuralObjectClass ||
+		ava->aa_desc == slap_schema.si_ad_entryDN ||
+		ava->aa_desc == slap_schema.si_ad_hasSubordinates ||
+		ava->aa_desc == slap_schema.si_ad_subschemaSubentry ||
+		ava->aa_desc->ad_type == slap_schema.si_at_undefined ||
+		ava->aa_desc->ad_type == slap_schema.si_at_proxied )
+		return NULL;
+
+	mr = ava->aa_desc->ad_type->sat_equality;
+	if ( !mr || !mr->smr_normalize ||
+		mr->smr_syntax != ava->aa_desc->ad_type->sat_syntax )
+		return NULL;
+
+	return ava;
+}
+
+static psindex *
+syncprov_psindex_get( Avlnode **root, AttributeType *at, struct berval *val )
+{
+	psindex *pi, key;
+
+	key.pi_type = at;
+	key.pi_val = *val;
+	pi = avl_find( *root, &key, sp_psindex_cmp );
+	if ( !pi ) {
+		pi = ch_malloc( sizeof( psindex ) + val->bv_len + 1 );
+		pi->pi_type = at;
+		pi->pi_val.bv_val = (char *)(pi + 1);
+		pi->pi_val.bv_len = val->bv_len;
+		AC_MEMCPY( pi->pi_val.bv_val, val->bv_val, val->bv_len );
+		pi->pi_val.bv_val[val->bv_len] = '\0';
+		pi->pi_ops = NULL;
+		pi->pi_count = 0;
+		avl_insert( root, pi, sp_psindex_cmp, avl_dup_error );
+	}
+	return pi;
+}
+
+static void
+syncprov_psindex_put( Avlnode **root, psindex *pi )
+{
+	if ( !pi->pi_ops && !pi->pi_count ) {
+		avl_delete( root, pi, sp_psindex_cmp );
+		ch_free( pi );
+	}
+}
+
+/* Index a new psearch, with si_ops_mutex held */
+static void
+syncprov_psindex_add( syncprov_info_t *si, syncops *so )
+{
+	psindex *pi;
+
+	pi = syncprov_psindex_get( &si->si_psindex, NULL, &so->s_base );
+	so->s_basenext = pi->pi_ops;
+	pi->pi_ops = so;
+
+	if ( so->s_keytype ) {
+		pi = syncprov_psindex_get( &si->si_psindex, so->s_keytype,
+			&so->s_keyval );
+		so->s_keynext = pi->pi_ops;
+		pi->pi_ops = so;
+		pi = syncprov_psindex_get( &si->si_pstypes, so->s_keytype,
+			(struct berval *)&slap_empty_bv );
+		pi->pi_count++;
+	}
+}
+
+/* Remove a psearch from the index, with si_ops_mutex held */
+static void
+syncprov_psindex_del( syncprov_info_t *si, syncops *so )
+{
+	psindex *pi, key;
+	syncops **sp;
+
+	key.pi_type = NULL;
+	key.pi_val = so->s_base;
+	pi = avl_find( si->si_psindex, &key, sp_psindex_cmp );
+	if ( pi ) {
+		for ( sp = &pi->pi_ops; *sp; sp = &(*sp)->s_basenext ) {
+			if ( *sp == so ) {
+				*sp = so->s_basenext;
+				break;
+			}
+		}
+		syncprov_psindex_put( &si->si_psindex, pi );
+	}
+
+	if ( so->s_keytype ) {
+		key.pi_type = so->s_keytype;
+		key.pi_val = so->s_keyval;
+		pi = avl_find( si->si_psindex, &key, sp_psindex_cmp );
+		if ( pi ) {
+			for ( sp = &pi->pi_ops; *sp; sp = &(*sp)->s_keynext ) {
+				if ( *sp == so ) {
+					*sp = so->s_keynext;
+					break;
+				}
+			}
+			syncprov_psindex_put( &si->si_psindex, pi );
+		}
+		key.pi_val = slap_empty_bv;
+		pi = avl_find( si->si_pstypes, &key, sp_psindex_cmp );
+		if ( pi ) {
+			pi->pi_count--;
+			syncprov_psindex_put( &si->si_pstypes, pi );
+		}
+	}
+}
+
+/* Mark the psearches that may be affected by a write of entry e
+ * at ndn, with si_ops_mutex held. Returns the mark.
+ */
+static unsigned long
+syncprov_psindex_mark( syncprov_info_t *si, Entry *e, struct berval *ndn )
+{
+	unsigned long gen = ++si->si_psgen;
+	psindex *pi, key;
+	syncops *ss;
+	Attribute *a;
+	AttributeType *at;
+	struct berval dn = *ndn, pdn;
+	unsigned i;
+
+	/* psearches based at the DN or one of its ancestors */
+	key.pi_type = NULL;
+	for (;;) {
+		key.pi_val = dn;
+		pi = avl_find( si->si_psindex, &key, sp_psindex_cmp );
+		if ( pi ) {
+			for ( ss = pi->pi_ops; ss; ss = ss->s_basenext )
+				ss->s_basegen = gen;
+		}
+		if ( BER_BVISEMPTY( &dn ))
+			break;
+		dnParent( &dn, &pdn );
+		dn = pdn;
+	}
+
+	/* psearches keyed on one of the entry's values, or on a
+	 * supertype's value if the matching rule is the same
+	 */
+	if ( !si->si_pstypes || !e )
+		return gen;
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		for ( at = a->a_desc->ad_type; at; at = at->sat_sup ) {
+			if ( at->sat_equality != a->a_desc->ad_type->sat_equality )
+				break;
+			key.pi_type = at;
+			key.pi_val = slap_empty_bv;
+			if ( !avl_find( si->si_pstypes, &key, sp_psindex_cmp ))
+				continue;
+			for ( i = 0; i < a->a_numvals; i++ ) {
+				key.pi_val = a->a_nvals[i];
+				pi = avl_find( si->si_psindex, &key, sp_psindex_cmp );
+				if ( pi ) {
+					for ( ss = pi->pi_ops; ss; ss = ss->s_keynext )
+						ss->s_keygen = gen;
+				}
+			}
+		}
+	}
+	return gen;
+}
+
 /* syncprov_findbase:
  *   finds the true DN of the base of a search (with alias dereferencing) and
  * checks to make sure the base entry doesn't get replaced with a different
@@ -806,6 +1058,7 @@ syncprov_free_syncop( syncops *so )
 	}
 	ldap_pvt_thread_mutex_unlock( &so->s_mutex );
 	if ( so->s_flags & PS_IS_DETACHED ) {
+		filter_prog_free( so->s_prog, NULL );
 		filter_free( so->s_op->ors_filter );
 		for ( ga = so->s_op->o_groups; ga; ga=gnext ) {
 			gnext = ga->ga_next;
@@ -814,6 +1067,7 @@ syncprov_free_syncop( syncops *so )
 		ch_free( so->s_op );
 	}
 	ch_free( so->s_base.bv_val );
+	ch_free( so->s_keyval.bv_val );
 	for ( sr=so->s_res; sr; sr=srnext ) {
 		srnext = sr->s_next;
 		if ( sr->s_e ) {
@@ -1135,6 +1389,7 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 			so->s_op->o_msgid == op->orn_msgid ) {
 				so->s_op->o_abandon = 1;
 				soprev->s_next = so->s_next;
+				syncprov_psindex_del( si, so );
 				break;
 		}
 	}
@@ -1174,6 +1429,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	int rc;
 	struct berval newdn;
 	int freefdn = 0;
+	unsigned long gen;
 	BackendDB *b0 = op->o_bd, db;
 
 	fc.fdn = &op->o_req_ndn;
@@ -1231,12 +1487,14 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 
 	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	gen = syncprov_psindex_mark( si, e, fc.fdn );
 	for (ss = si->si_ops, sprev = (syncops *)&si->si_ops; ss;
 		sprev = ss, ss=snext)
 	{
 		Operation op2;
 		Opheader oh;
 		syncmatches *sm;
+		FilterProg *fprog;
 		int found = 0;
 
 		snext = ss->s_next;
@@ -1262,13 +1520,25 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 		fc.fbase = 0;
 		fc.fscope = 0;
 
-		/* If the base of the search is missing, signal a refresh */
-		rc = syncprov_findbase( op, &fc );
+		if ( ss->s_basegen != gen ||
+			( ss->s_keytype && ss->s_keygen != gen )) {
+			/* Not in scope, or the entry lacks the value
+			 * the filter requires. The base is only looked
+			 * up when the psearch starts, so it's still valid.
+			 */
+			si->si_pspruned++;
+			rc = LDAP_SUCCESS;
+		} else {
+			si->si_psevaluated++;
+			/* If the base of the search is missing, signal a refresh */
+			rc = syncprov_findbase( op, &fc );
+		}
 		if ( rc != LDAP_SUCCESS ) {
 			SlapReply rs = {REP_RESULT};
 			send_ldap_error( ss->s_op, &rs, LDAP_SYNC_REFRESH_REQUIRED,
 				"search base has changed" );
 			sprev->s_next = snext;
+			syncprov_psindex_del( si, ss );
 			syncprov_drop_psearch( ss, 1 );
 			ss = sprev;
 			continue;
@@ -1312,8 +1582,12 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 				   phase otherwise (ITS#6555) */
 				op2.ors_filter = ss->s_op->ors_filter->f_and->f_next;
 			}
+			fprog = ss->s_prog;
 			ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
-			rc = test_filter( &op2, e, op2.ors_filter );
+			if ( fprog )
+				rc = test_filter_prog( &op2, e, fprog );
+			else
+				rc = test_filter( &op2, e, op2.ors_filter );
 		}
 
 		Debug( LDAP_DEBUG_TRACE, "syncprov_matchops: sid %03x fscope %d rc %d\n",
@@ -1493,6 +1767,155 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 #endif
 }
 
+static int
+syncprov_slog_csncmp( const void *v1, const void *v2 )
+{
+	const slog_entry *s1 = v1, *s2 = v2;
+	int rc;
+
+	rc = ber_bvcmp( &s1->se_csn, &s2->se_csn );
+	if ( rc == 0 )
+		rc = ber_bvcmp( &s1->se_uuid, &s2->se_uuid );
+	return rc;
+}
+
+static int
+syncprov_slog_uuidcmp( const void *v1, const void *v2 )
+{
+	const slog_entry *s1 = v1, *s2 = v2;
+	int rc;
+
+	rc = ber_bvcmp( &s1->se_uuid, &s2->se_uuid );
+	if ( rc == 0 )
+		rc = s1->se_sid - s2->se_sid;
+	return rc;
+}
+
+/* Drop all records. Enter with sl->sl_mutex locked. */
+static void
+syncprov_slog_wipe( sessionlog *sl )
+{
+	avl_free( sl->sl_uuids, NULL );
+	tavl_free( sl->sl_entries, ch_free );
+	sl->sl_uuids = NULL;
+	sl->sl_entries = NULL;
+	sl->sl_num = 0;
+	if ( sl->sl_logsids ) {
+		ch_free( sl->sl_logsids );
+		sl->sl_logsids = NULL;
+	}
+	sl->sl_numlogsids = 0;
+}
+
+/* Drop all records and the csns the log starts from.
+ * Enter with sl->sl_mutex locked.
+ */
+static void
+syncprov_slog_reset( sessionlog *sl )
+{
+	syncprov_slog_wipe( sl );
+	if ( sl->sl_mincsn ) {
+		ber_bvarray_free( sl->sl_mincsn );
+		sl->sl_mincsn = NULL;
+	}
+	if ( sl->sl_sids ) {
+		ch_free( sl->sl_sids );
+		sl->sl_sids = NULL;
+	}
+	sl->sl_numcsns = 0;
+}
+
+/* Add a record, replacing any older record of the same entry from
+ * the same server, and trim the log to its size. Records of other
+ * servers are kept, since a consumer may be behind on one server ID
+ * and not on another. Enter with sl->sl_mutex locked.
+ */
+static void
+syncprov_slog_insert( sessionlog *sl, slog_entry *se )
+{
+	slog_entry *old;
+	int i;
+
+	old = avl_find( sl->sl_uuids, se, syncprov_slog_uuidcmp );
+	if ( old ) {
+		if ( ber_bvcmp( &old->se_csn, &se->se_csn ) > 0 ) {
+			/* a later change was already logged */
+			old->se_merged = 1;
+			ch_free( se );
+			return;
+		}
+		avl_delete( &sl->sl_uuids, old, syncprov_slog_uuidcmp );
+		tavl_delete( &sl->sl_entries, old, syncprov_slog_csncmp );
+		ch_free( old );
+		sl->sl_num--;
+		se->se_merged = 1;
+	}
+	avl_insert( &sl->sl_uuids, se, syncprov_slog_uuidcmp, avl_dup_error );
+	tavl_insert( &sl->sl_entries, se, syncprov_slog_csncmp, avl_dup_error );
+	sl->sl_num++;
+
+	for ( i=0; i<sl->sl_numlogsids; i++ )
+		if ( sl->sl_logsids[i] == se->se_sid )
+			break;
+	if ( i == sl->sl_numlogsids ) {
+		sl->sl_logsids = ch_realloc( sl->sl_logsids,
+			( sl->sl_numlogsids + 1 ) * sizeof( int ));
+		sl->sl_logsids[sl->sl_numlogsids++] = se->se_sid;
+	}
+
+	if ( !sl->sl_mincsn ) {
+		sl->sl_numcsns = 1;
+		sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
+		sl->sl_sids = ch_malloc( sizeof( int ));
+		sl->sl_sids[0] = se->se_sid;
+		ber_dupbv( sl->sl_mincsn, &se->se_csn );
+		BER_BVZERO( &sl->sl_mincsn[1] );
+	}
+
+	while ( sl->sl_num > sl->sl_size ) {
+		Avlnode *head = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+
+		se = head->avl_data;
+		for ( i=0; i<sl->sl_numcsns; i++ )
+			if ( sl->sl_sids[i] >= se->se_sid )
+				break;
+		if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
+			slap_insert_csn_sids( (struct sync_cookie *)sl,
+				i, se->se_sid, &se->se_csn );
+		} else {
+			ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
+		}
+		avl_delete( &sl->sl_uuids, se, syncprov_slog_uuidcmp );
+		tavl_delete( &sl->sl_entries, se, syncprov_slog_csncmp );
+		ch_free( se );
+		sl->sl_num--;
+	}
+}
+
+static slog_entry *
+syncprov_slog_alloc( struct berval *uuid, struct berval *csn, ber_tag_t tag )
+{
+	slog_entry *se;
+
+	/* Allocate a record. UUIDs are not NUL-terminated. */
+	se = ch_malloc( sizeof( slog_entry ) + uuid->bv_len + 
+		csn->bv_len + 1 );
+	se->se_tag = tag;
+	se->se_merged = 0;
+
+	se->se_uuid.bv_val = (char *)(&se[1]);
+	AC_MEMCPY( se->se_uuid.bv_val, uuid->bv_val, uuid->bv_len );
+	se->se_uuid.bv_len = uuid->bv_len;
+
+	se->se_csn.bv_val = se->se_uuid.bv_val + uuid->bv_len;
+	AC_MEMCPY( se->se_csn.bv_val, csn->bv_val, csn->bv_len );
+	se->se_csn.bv_val[csn->bv_len] = '\0';
+	se->se_csn.bv_len = csn->bv_len;
+	se->se_sid = slap_parse_csn_sid( &se->se_csn );
+
+	return se;
+}
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1511,80 +1934,176 @@ syncprov_add_slog( Operation *op )
 			 * wipe out anything in the log if we see them.
 			 */
 			ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-			while ( se = sl->sl_head ) {
-				sl->sl_head = se->se_next;
-				ch_free( se );
-			}
-			sl->sl_tail = NULL;
-			sl->sl_num = 0;
+			syncprov_slog_wipe( sl );
 			ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 			return;
 		}
 
-		/* Allocate a record. UUIDs are not NUL-terminated. */
-		se = ch_malloc( sizeof( slog_entry ) + opc->suuid.bv_len + 
-			op->o_csn.bv_len + 1 );
-		se->se_next = NULL;
-		se->se_tag = op->o_tag;
+		se = syncprov_slog_alloc( &opc->suuid, &op->o_csn, op->o_tag );
+
+		ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
+		syncprov_slog_insert( sl, se );
+		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+	}
+}
+
+/* Save the session log, along with the contextCSN it leads up to,
+ * for the next syncprov_slog_load().
+ */
+static void
+syncprov_slog_save( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	char uuid[LDAP_LUTIL_UUIDSTR_BUFSIZE];
+	char *tmp;
+	FILE *fp;
+	Avlnode *n;
+	int i, rc;
+
+	tmp = ch_malloc( strlen( si->si_logfile ) + STRLENOF( ".tmp" ) + 1 );
+	sprintf( tmp, "%s.tmp", si->si_logfile );
+	fp = fopen( tmp, "w" );
+	if ( fp == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			"syncprov_slog_save: cannot open \"%s\": %s\n",
+			tmp, strerror( errno ), 0 );
+		ch_free( tmp );
+		return;
+	}
 
-		se->se_uuid.bv_val = (char *)(&se[1]);
-		AC_MEMCPY( se->se_uuid.bv_val, opc->suuid.bv_val, opc->suuid.bv_len );
-		se->se_uuid.bv_len = opc->suuid.bv_len;
+	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
+	for ( i=0; i<si->si_numcsns; i++ )
+		fprintf( fp, "contextCSN: %s\n", si->si_ctxcsn[i].bv_val );
+	for ( i=0; i<sl->sl_numcsns; i++ )
+		fprintf( fp, "minCSN: %s\n", sl->sl_mincsn[i].bv_val );
+	for ( n = tavl_end( sl->sl_entries, TAVL_DIR_LEFT ); n;
+		n = tavl_next( n, TAVL_DIR_RIGHT )) {
+		slog_entry *se = n->avl_data;
+
+		lutil_uuidstr_from_normalized( se->se_uuid.bv_val,
+			se->se_uuid.bv_len, uuid, sizeof( uuid ));
+		fprintf( fp, "entry: %lu %d %s %s\n", (unsigned long)se->se_tag,
+			se->se_merged, se->se_csn.bv_val, uuid );
+	}
+	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 
-		se->se_csn.bv_val = se->se_uuid.bv_val + opc->suuid.bv_len;
-		AC_MEMCPY( se->se_csn.bv_val, op->o_csn.bv_val, op->o_csn.bv_len );
-		se->se_csn.bv_val[op->o_csn.bv_len] = '\0';
-		se->se_csn.bv_len = op->o_csn.bv_len;
-		se->se_sid = slap_parse_csn_sid( &se->se_csn );
+	rc = ferror( fp );
+	if ( fclose( fp ) != 0 || rc ||
+		rename( tmp, si->si_logfile ) != 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"syncprov_slog_save: cannot write \"%s\"\n",
+			si->si_logfile, 0, 0 );
+		unlink( tmp );
+	}
+	ch_free( tmp );
+}
 
-		ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-		if ( sl->sl_head ) {
-			/* Keep the list in csn order. */
-			if ( ber_bvcmp( &sl->sl_tail->se_csn, &se->se_csn ) <= 0 ) {
-				sl->sl_tail->se_next = se;
-				sl->sl_tail = se;
-			} else {
-				slog_entry **sep;
+/* Reload a session log saved by syncprov_slog_save(). It is only
+ * used if the database is still at the contextCSN it was saved at.
+ * The file is removed once read, since the log it holds is no
+ * longer complete after the next write.
+ */
+static int
+syncprov_slog_load( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	AttributeType *at = slap_schema.si_ad_entryUUID->ad_type;
+	char buf[256], *ptr;
+	FILE *fp;
+	int i, nctx = 0, rc = 0;
+
+	fp = fopen( si->si_logfile, "r" );
+	if ( fp == NULL )
+		return -1;
 
-				for ( sep = &sl->sl_head; *sep; sep = &(*sep)->se_next ) {
-					if ( ber_bvcmp( &se->se_csn, &(*sep)->se_csn ) < 0 ) {
-						se->se_next = *sep;
-						*sep = se;
-						break;
-					}
-				}
+	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
+	syncprov_slog_reset( sl );
+	while ( fgets( buf, sizeof( buf ), fp ) != NULL ) {
+		struct berval csn;
+
+		ptr = strchr( buf, '\n' );
+		if ( ptr == NULL ) {
+			rc = -1;
+			break;
+		}
+		*ptr = '\0';
+
+		if ( !strncmp( buf, "contextCSN: ", STRLENOF( "contextCSN: " ))) {
+			ber_str2bv( buf + STRLENOF( "contextCSN: " ), 0, 0, &csn );
+			if ( nctx >= si->si_numcsns ||
+				!bvmatch( &csn, &si->si_ctxcsn[nctx] )) {
+				rc = -1;
+				break;
 			}
-		} else {
-			sl->sl_head = se;
-			sl->sl_tail = se;
-			if ( !sl->sl_mincsn ) {
-				sl->sl_numcsns = 1;
-				sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
-				sl->sl_sids = ch_malloc( sizeof( int ));
-				sl->sl_sids[0] = se->se_sid;
-				ber_dupbv( sl->sl_mincsn, &se->se_csn );
-				BER_BVZERO( &sl->sl_mincsn[1] );
+			nctx++;
+
+		} else if ( !strncmp( buf, "minCSN: ", STRLENOF( "minCSN: " ))) {
+			ber_str2bv( buf + STRLENOF( "minCSN: " ), 0, 0, &csn );
+			i = slap_parse_csn_sid( &csn );
+			if ( i < 0 ) {
+				rc = -1;
+				break;
 			}
-		}
-		sl->sl_num++;
-		while ( sl->sl_num > sl->sl_size ) {
-			int i, j;
-			se = sl->sl_head;
-			sl->sl_head = se->se_next;
-			for ( i=0; i<sl->sl_numcsns; i++ )
-				if ( sl->sl_sids[i] >= se->se_sid )
-					break;
-			if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
-				slap_insert_csn_sids( (struct sync_cookie *)sl,
-					i, se->se_sid, &se->se_csn );
-			} else {
-				ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
+			slap_insert_csn_sids( (struct sync_cookie *)sl,
+				sl->sl_numcsns, i, &csn );
+
+		} else if ( !strncmp( buf, "entry: ", STRLENOF( "entry: " ))) {
+			struct berval uuid, nuuid;
+			unsigned long tag;
+			int merged;
+			slog_entry *se;
+
+			ptr = buf + STRLENOF( "entry: " );
+			tag = strtoul( ptr, &ptr, 10 );
+			merged = strtol( ptr, &ptr, 10 );
+			if ( *ptr++ != ' ' ) {
+				rc = -1;
+				break;
 			}
-			ch_free( se );
-			sl->sl_num--;
+			csn.bv_val = ptr;
+			ptr = strchr( ptr, ' ' );
+			if ( ptr == NULL ) {
+				rc = -1;
+				break;
+			}
+			csn.bv_len = ptr - csn.bv_val;
+			ber_str2bv( ptr + 1, 0, 0, &uuid );
+			if ( nctx != si->si_numcsns ||
+				uuid.bv_len != STRLENOF( "BADBADBA-DBAD-0123-4567-BADBADBADBAD" ) ||
+				slap_parse_csn_sid( &csn ) < 0 ||
+				at->sat_equality->smr_normalize(
+					SLAP_MR_VALUE_OF_ATTRIBUTE_SYNTAX, at->sat_syntax,
+					at->sat_equality, &uuid, &nuuid, NULL ) != LDAP_SUCCESS ) {
+				rc = -1;
+				break;
+			}
+			se = syncprov_slog_alloc( &nuuid, &csn, (ber_tag_t)tag );
+			se->se_merged = merged;
+			slap_sl_free( nuuid.bv_val, NULL );
+			syncprov_slog_insert( sl, se );
+
+		} else {
+			rc = -1;
+			break;
 		}
-		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 	}
+	fclose( fp );
+	unlink( si->si_logfile );
+
+	if ( rc == 0 && ( nctx != si->si_numcsns || !sl->sl_mincsn ))
+		rc = -1;
+	if ( rc ) {
+		syncprov_slog_reset( sl );
+		Debug( LDAP_DEBUG_ANY,
+			"syncprov_slog_load: ignoring outdated session log \"%s\"\n",
+			si->si_logfile, 0, 0 );
+	} else {
+		Debug( LDAP_DEBUG_SYNC,
+			"syncprov_slog_load: loaded %d records from \"%s\"\n",
+			sl->sl_num, si->si_logfile, 0 );
+	}
+	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+	return rc;
 }
 
 /* Just set a flag if we found the matching entry */
@@ -1597,6 +2116,14 @@ playlog_cb( Operation *op, SlapReply *rs )
 	return rs->sr_err;
 }
 
+static int
+syncprov_uuid_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *b1 = v1, *b2 = v2;
+
+	return memcmp( b1->bv_val, b2->bv_val, UUID_LEN );
+}
+
 /* enter with sl->sl_mutex locked, release before returning */
 static void
 syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
@@ -1604,7 +2131,9 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 {
 	slap_overinst		*on = (slap_overinst *)op->o_bd->bd_info;
 	slog_entry *se;
-	int i, j, ndel, num, nmods, mmods;
+	Avlnode *node;
+	struct berval *start;
+	int i, j, k, ndel, num, nmods, mmods;
 	char cbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	BerVarray uuids;
 	struct berval delcsn[2];
@@ -1626,14 +2155,42 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 	delcsn[0].bv_val = cbuf;
 	BER_BVZERO(&delcsn[1]);
 
+	/* Skip the records older than anything in the consumer's cookie.
+	 * If the cookie lacks a server ID of the log, all of its records
+	 * are new to the consumer and the whole log is scanned.
+	 */
+	start = NULL;
+	for ( j=0; j<sl->sl_numlogsids; j++ ) {
+		for ( k=0; k<srs->sr_state.numcsns; k++ ) {
+			if ( srs->sr_state.sids[k] == sl->sl_logsids[j] )
+				break;
+		}
+		if ( k == srs->sr_state.numcsns )
+			break;
+		if ( !start || ber_bvcmp( &srs->sr_state.ctxcsn[k], start ) < 0 )
+			start = &srs->sr_state.ctxcsn[k];
+	}
+	if ( start && j == sl->sl_numlogsids ) {
+		slog_entry key;
+		int cmp;
+
+		key.se_csn = *start;
+		BER_BVZERO( &key.se_uuid );
+		node = tavl_find3( sl->sl_entries, &key, syncprov_slog_csncmp, &cmp );
+		if ( node && cmp > 0 )
+			node = tavl_next( node, TAVL_DIR_RIGHT );
+	} else {
+		node = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+	}
+
 	/* Make a copy of the relevant UUIDs. Put the Deletes up front
 	 * and everything else at the end. Do this first so we can
 	 * unlock the list mutex.
 	 */
 	Debug( LDAP_DEBUG_SYNC, "srs csn %s\n",
 		srs->sr_state.ctxcsn[0].bv_val, 0, 0 );
-	for ( se=sl->sl_head; se; se=se->se_next ) {
-		int k;
+	for ( ; node; node = tavl_next( node, TAVL_DIR_RIGHT )) {
+		se = node->avl_data;
 		Debug( LDAP_DEBUG_SYNC, "log csn %s\n", se->se_csn.bv_val, 0, 0 );
 		ndel = 1;
 		for ( k=0; k<srs->sr_state.numcsns; k++ ) {
@@ -1655,16 +2212,21 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 		}
 		if ( ndel > 0 ) {
 			Debug( LDAP_DEBUG_SYNC, "cmp %d, too new\n", ndel, 0, 0 );
-			break;
+			/* It may stand in for older changes of the entry that
+			 * the consumer has not seen; check the entry instead.
+			 */
+			if ( !se->se_merged )
+				continue;
 		}
-		if ( se->se_tag == LDAP_REQ_DELETE ) {
+		if ( se->se_tag == LDAP_REQ_DELETE && ndel <= 0 ) {
 			j = i;
 			i++;
 			AC_MEMCPY( cbuf, se->se_csn.bv_val, se->se_csn.bv_len );
 			delcsn[0].bv_len = se->se_csn.bv_len;
 			delcsn[0].bv_val[delcsn[0].bv_len] = '\0';
 		} else {
-			if ( se->se_tag == LDAP_REQ_ADD )
+			/* an Add that replaced a Delete is checked like a mod */
+			if ( se->se_tag == LDAP_REQ_ADD && !se->se_merged )
 				continue;
 			nmods++;
 			j = num - nmods;
@@ -1677,6 +2239,17 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 
 	ndel = i;
 
+	/* An entry has a record per server ID, so it may still be listed
+	 * more than once. Sort the Deletes and drop the repeats.
+	 */
+	qsort( uuids, ndel, sizeof( struct berval ), syncprov_uuid_cmp );
+	for ( i=0, j=0; i<ndel; i++ ) {
+		if ( j && !syncprov_uuid_cmp( &uuids[j-1], &uuids[i] ))
+			continue;
+		uuids[j++] = uuids[i];
+	}
+	ndel = j;
+
 	/* Zero out unused slots */
 	for ( i=ndel; i < num - nmods; i++ )
 		uuids[i].bv_len = 0;
@@ -1686,21 +2259,14 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 
 	mmods = nmods;
 	/* Strip any duplicates */
-	for ( i=0; i<nmods; i++ ) {
-		for ( j=0; j<ndel; j++ ) {
-			if ( bvmatch( &uuids[j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
-		}
-		if ( uuids[num - 1 - i].bv_len == 0 ) continue;
-		for ( j=0; j<i; j++ ) {
-			if ( bvmatch( &uuids[num - 1 - j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
+	qsort( uuids + num - nmods, nmods, sizeof( struct berval ),
+		syncprov_uuid_cmp );
+	for ( i=num - nmods; i<num; i++ ) {
+		if (( i > num - nmods && !syncprov_uuid_cmp( &uuids[i-1], &uuids[i] )) ||
+			bsearch( &uuids[i], uuids, ndel, sizeof( struct berval ),
+				syncprov_uuid_cmp )) {
+			uuids[i].bv_len = 0;
+			mmods --;
 		}
 	}
 
@@ -2283,6 +2849,7 @@ syncprov_detach_op( Operation *op, syncops *so, slap_overinst *on )
 		op2->ors_filter = op->ors_filter;
 	}
 	op2->ors_filter = filter_dup( op2->ors_filter, NULL );
+	so->s_prog = filter_compile( op2->ors_filter, NULL );
 	so->s_op = op2;
 
 	/* Copy any cached group ACLs individually */
@@ -2509,6 +3076,13 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		ldap_pvt_thread_mutex_init( &sop->s_mutex );
 		sop->s_rid = srs->sr_state.rid;
 		sop->s_sid = srs->sr_state.sid;
+		{
+			AttributeAssertion *ava = syncprov_filter_key( op->ors_filter );
+			if ( ava ) {
+				sop->s_keytype = ava->aa_desc->ad_type;
+				ber_dupbv( &sop->s_keyval, &ava->aa_value );
+			}
+		}
 		/* set refcount=2 to prevent being freed out from under us
 		 * by abandons that occur while we're running here
 		 */
@@ -2524,6 +3098,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 			 */
 			ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 			if ( slapd_shutdown ) {
+				ch_free( sop->s_keyval.bv_val );
 				ch_free( sop );
 				return SLAPD_ABANDON;
 			}
@@ -2533,6 +3108,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		}
 		sop->s_next = si->si_ops;
 		si->si_ops = sop;
+		syncprov_psindex_add( si, sop );
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 	}
 
@@ -2634,7 +3210,9 @@ bailout:
 					while ( *sp != sop )
 						sp = &(*sp)->s_next;
 					*sp = sop->s_next;
+					syncprov_psindex_del( si, sop );
 					ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+					ch_free( sop->s_keyval.bv_val );
 					ch_free( sop );
 				}
 				rs->sr_ctrls = NULL;
@@ -2889,6 +3467,12 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.4 NAME 'olcSpReloadHint' "
 			"DESC 'Observe Reload Hint in Request control' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-file", "filename", 2, 2, 0,
+		ARG_STRING|ARG_OFFSET,
+		(void *)offsetof(syncprov_info_t, si_logfile),
+		"( OLcfgOvAt:1.5 NAME 'olcSpSessionlogFile' "
+			"DESC 'File holding the session log across restarts' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -2901,6 +3485,7 @@ static ConfigOCs spocs[] = {
 			"$ olcSpSessionlog "
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
+			"$ olcSpSessionlogFile "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3033,7 +3618,10 @@ sp_cf_gen(ConfigArgs *c)
 			sl->sl_sids = NULL;
 			sl->sl_num = 0;
 			sl->sl_numcsns = 0;
-			sl->sl_head = sl->sl_tail = NULL;
+			sl->sl_logsids = NULL;
+			sl->sl_numlogsids = 0;
+			sl->sl_entries = NULL;
+			sl->sl_uuids = NULL;
 			ldap_pvt_thread_mutex_init( &sl->sl_mutex );
 			si->si_logs = sl;
 		}
@@ -3050,6 +3638,275 @@ sp_cf_gen(ConfigArgs *c)
 	return rc;
 }
 
+#ifdef SYNCPROV_MONITOR
+
+static AttributeDescription	*ad_numPsearches, *ad_psEvaluated, *ad_psPruned;
+static ObjectClass		*oc_olmSyncprov;
+
+static struct {
+	char			*name;
+	char			*oid;
+}		s_oid[] = {
+	{ "SyncprovOID",		"1.3.6.1.4.1.4203.666.11.8" },
+	{ "SyncprovAttributes",		"SyncprovOID:1" },
+	{ "SyncprovObjectClasses",	"SyncprovOID:2" },
+
+	{ NULL }
+};
+
+static struct {
+	char	*desc;
+	AttributeDescription **adp;
+} s_ad[] = {
+	{ "( SyncprovAttributes:1 "
+		"NAME 'olmSyncprovPsearches' "
+		"DESC 'Number of persistent searches' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )",
+		&ad_numPsearches },
+	{ "( SyncprovAttributes:2 "
+		"NAME 'olmSyncprovMatchEvaluated' "
+		"DESC 'Number of persistent searches whose scope and filter "
+			"were evaluated for a write' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )",
+		&ad_psEvaluated },
+	{ "( SyncprovAttributes:3 "
+		"NAME 'olmSyncprovMatchPruned' "
+		"DESC 'Number of persistent searches the match index "
+			"skipped for a write' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )",
+		&ad_psPruned },
+
+	{ NULL }
+};
+
+static struct {
+	char		*desc;
+	ObjectClass	**ocp;
+}		s_oc[] = {
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( SyncprovObjectClasses:1 "
+		"NAME ( 'olmSyncprov' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"olmSyncprovPsearches "
+			"$ olmSyncprovMatchEvaluated "
+			"$ olmSyncprovMatchPruned "
+			" ) )",
+		&oc_olmSyncprov },
+
+	{ NULL }
+};
+
+static void
+syncprov_monitor_set( Entry *e, AttributeDescription *ad, unsigned long n )
+{
+	Attribute	*a;
+	char		buf[ SLAP_TEXT_BUFLEN ];
+	struct berval	bv;
+
+	a = attr_find( e->e_attrs, ad );
+	assert( a != NULL );
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", n );
+
+	if ( a->a_nvals != a->a_vals ) {
+		ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+	}
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+}
+
+static int
+syncprov_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	syncprov_info_t	*si = (syncprov_info_t *) priv;
+	syncops		*so;
+	unsigned long	num = 0, evaluated, pruned;
+
+	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	for ( so = si->si_ops; so; so = so->s_next )
+		num++;
+	evaluated = si->si_psevaluated;
+	pruned = si->si_pspruned;
+	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+
+	syncprov_monitor_set( e, ad_numPsearches, num );
+	syncprov_monitor_set( e, ad_psEvaluated, evaluated );
+	syncprov_monitor_set( e, ad_psPruned, pruned );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	int		i;
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmSyncprov->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; s_ad[ i ].desc != NULL; i++ ) {
+		mod.sm_desc = *s_ad[ i ].adp;
+		modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_db_open( BackendDB *be )
+{
+	slap_overinst		*on = (slap_overinst *)be->bd_info;
+	syncprov_info_t		*si = on->on_bi.bi_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0, i;
+	BackendInfo		*mi;
+	monitor_extra_t		*mbe;
+	struct berval		dummy = BER_BVC( "" );
+	struct berval		bv = BER_BVC( "0" );
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		static int warning = 0;
+
+		if ( warning++ == 0 ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_monitor_db_open: "
+				"monitoring disabled; "
+				"configure monitor database to enable\n",
+				0, 0, 0 );
+		}
+
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 3 );
+	if ( a == NULL ) {
+		rc = 1;
+		goto cleanup;
+	}
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmSyncprov->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	for ( i = 0; s_ad[ i ].desc != NULL; i++ ) {
+		next->a_desc = *s_ad[ i ].adp;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = syncprov_monitor_update;
+	cb->mc_free = syncprov_monitor_free;
+	cb->mc_private = (void *)si;
+
+	/* make sure the database is registered; then add monitor attributes */
+	BER_BVZERO( &si->si_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &si->si_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &si->si_monitor_ndn, a, cb,
+			&dummy, -1, &dummy);
+	}
+
+cleanup:;
+	if ( rc != 0 ) {
+		if ( cb != NULL ) {
+			ch_free( cb );
+			cb = NULL;
+		}
+
+		if ( a != NULL ) {
+			attrs_free( a );
+			a = NULL;
+		}
+	}
+
+	/* store for cleanup */
+	si->si_monitor_cb = (void *)cb;
+
+	/* we don't need to keep track of the attributes, because
+	 * syncprov_monitor_free() takes care of everything */
+	if ( a != NULL ) {
+		attrs_free( a );
+	}
+
+	return rc;
+}
+
+static int
+syncprov_monitor_db_close( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+
+	if ( si->si_monitor_cb != NULL ) {
+		BackendInfo		*mi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( mi && mi->bi_extra ) {
+			mbe = mi->bi_extra;
+			mbe->unregister_entry_callback( &si->si_monitor_ndn,
+				(monitor_callback_t *)si->si_monitor_cb,
+				NULL, 0, NULL );
+		}
+		si->si_monitor_cb = NULL;
+	}
+
+	return 0;
+}
+
+#endif /* SYNCPROV_MONITOR */
+
 /* ITS#3456 we cannot run this search on the main thread, must use a
  * child thread in order to insure we have a big enough stack.
  */
@@ -3091,6 +3948,15 @@ syncprov_db_open(
 	}
 
 	if ( slapMode & SLAP_TOOL_MODE ) {
+		/* Tools change the database without recording the changes
+		 * in the session log, and without necessarily moving the
+		 * contextCSN, so the saved log cannot be trusted anymore */
+		if ( si->si_logfile && !( slapMode & SLAP_TOOL_READONLY ) &&
+			unlink( si->si_logfile ) == 0 ) {
+			Debug( LDAP_DEBUG_SYNC,
+				"syncprov_db_open: removed session log \"%s\"\n",
+				si->si_logfile, 0, 0 );
+		}
 		return 0;
 	}
 
@@ -3160,8 +4026,10 @@ syncprov_db_open(
 		si->si_numops++;
 	}
 
-	/* Initialize the sessionlog mincsn */
-	if ( si->si_logs && si->si_numcsns ) {
+	/* Initialize the sessionlog mincsn, unless the log saved
+	 * at the last shutdown can be used */
+	if ( si->si_logs && si->si_numcsns && ( !si->si_logfile ||
+		syncprov_slog_load( si ) != 0 )) {
 		sessionlog *sl = si->si_logs;
 		int i;
 		ber_bvarray_dup_x( &sl->sl_mincsn, si->si_ctxcsn, NULL );
@@ -3173,6 +4041,9 @@ syncprov_db_open(
 
 out:
 	op->o_bd->bd_info = (BackendInfo *)on;
+#ifdef SYNCPROV_MONITOR
+	syncprov_monitor_db_open( be );
+#endif
 	return 0;
 }
 
@@ -3193,6 +4064,9 @@ syncprov_db_close(
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
+#ifdef SYNCPROV_MONITOR
+	syncprov_monitor_db_close( be );
+#endif
 	if ( si->si_numops ) {
 		Connection conn = {0};
 		OperationBuffer opbuf;
@@ -3207,6 +4081,8 @@ syncprov_db_close(
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
 	}
+	if ( si->si_logs && si->si_logfile && si->si_numcsns )
+		syncprov_slog_save( si );
 
 #ifdef SLAP_CONFIG_DELETE
 	if ( !slapd_shutdown ) {
@@ -3215,6 +4091,7 @@ syncprov_db_close(
 			rs.sr_err = LDAP_UNAVAILABLE;
 			send_ldap_result( so->s_op, &rs );
 			sonext=so->s_next;
+			syncprov_psindex_del( si, so );
 			syncprov_drop_psearch( so, 0);
 		}
 		si->si_ops=NULL;
@@ -3256,6 +4133,12 @@ syncprov_db_init(
 	uuid_anlist[0].an_desc = slap_schema.si_ad_entryUUID;
 	uuid_anlist[0].an_name = slap_schema.si_ad_entryUUID->ad_cname;
 
+#ifdef SYNCPROV_MONITOR
+	if ( backend_info( "monitor" ) != NULL ) {
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
+	}
+#endif
+
 	return 0;
 }
 
@@ -3271,25 +4154,19 @@ syncprov_db_destroy(
 	if ( si ) {
 		if ( si->si_logs ) {
 			sessionlog *sl = si->si_logs;
-			slog_entry *se = sl->sl_head;
-
-			while ( se ) {
-				slog_entry *se_next = se->se_next;
-				ch_free( se );
-				se = se_next;
-			}
-			if ( sl->sl_mincsn )
-				ber_bvarray_free( sl->sl_mincsn );
-			if ( sl->sl_sids )
-				ch_free( sl->sl_sids );
 
+			syncprov_slog_reset( sl );
 			ldap_pvt_thread_mutex_destroy(&si->si_logs->sl_mutex);
 			ch_free( si->si_logs );
 		}
+		if ( si->si_logfile )
+			ch_free( si->si_logfile );
 		if ( si->si_ctxcsn )
 			ber_bvarray_free( si->si_ctxcsn );
 		if ( si->si_sids )
 			ch_free( si->si_sids );
+		avl_free( si->si_psindex, ch_free );
+		avl_free( si->si_pstypes, ch_free );
 		ldap_pvt_thread_mutex_destroy( &si->si_resp_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_mods_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_ops_mutex );
@@ -3421,6 +4298,11 @@ int
 syncprov_initialize()
 {
 	int rc;
+#ifdef SYNCPROV_MONITOR
+	int i;
+	ConfigArgs c;
+	char *argv[ 4 ];
+#endif
 
 	rc = register_supported_control( LDAP_CONTROL_SYNC,
 		SLAP_CTRL_SEARCH, NULL,
@@ -3456,6 +4338,46 @@ syncprov_initialize()
 	rc = config_register_schema( spcfg, spocs );
 	if ( rc ) return rc;
 
+#ifdef SYNCPROV_MONITOR
+	argv[ 0 ] = "syncprov monitor";
+	c.argv = argv;
+	c.argc = 3;
+	c.fname = argv[0];
+
+	for ( i = 0; s_oid[ i ].name; i++ ) {
+		c.lineno = i;
+		argv[ 1 ] = s_oid[ i ].name;
+		argv[ 2 ] = s_oid[ i ].oid;
+
+		if ( parse_oidm( &c, 0, NULL ) != 0 ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_initialize: "
+				"unable to add objectIdentifier \"%s=%s\"\n",
+				s_oid[ i ].name, s_oid[ i ].oid, 0 );
+			return 1;
+		}
+	}
+
+	for ( i = 0; s_ad[i].desc != NULL; i++ ) {
+		rc = register_at( s_ad[i].desc, s_ad[i].adp, 0 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"syncprov_initialize: register_at #%d failed\n", i, 0, 0 );
+			return rc;
+		}
+		(*s_ad[i].adp)->ad_type->sat_flags |= SLAP_AT_HIDE;
+	}
+
+	for ( i = 0; s_oc[i].desc != NULL; i++ ) {
+		rc = register_oc( s_oc[i].desc, s_oc[i].ocp, 0 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"syncprov_initialize: register_oc #%d failed\n", i, 0, 0 );
+			return rc;
+		}
+		(*s_oc[i].ocp)->soc_flags |= SLAP_OC_HIDE;
+	}
+#endif /* SYNCPROV_MONITOR */
+
 	return overlay_register( &syncprov );
 }
 
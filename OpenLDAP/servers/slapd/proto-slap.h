@@ -80,6 +80,11 @@ LDAP_SLAPD_F (int) slap_dynacl_register LDAP_P(( slap_dynacl_t *da ));
 LDAP_SLAPD_F (slap_dynacl_t *) slap_dynacl_get LDAP_P(( const char *name ));
 #endif /* SLAP_DYNACL */
 LDAP_SLAPD_F (int) acl_init LDAP_P(( void ));
+LDAP_SLAPD_V (unsigned) acl_cache_size;
+LDAP_SLAPD_V (int) acl_cache_content;
+LDAP_SLAPD_F (void) acl_cache_prepare LDAP_P(( AccessControl *a ));
+LDAP_SLAPD_F (void) acl_cache_invalidate LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_destroy LDAP_P(( void ));
 
 LDAP_SLAPD_F (int) acl_get_part LDAP_P((
 	struct berval	*list,
@@ -113,6 +118,10 @@ LDAP_SLAPD_F (slap_mask_t) str2accessmask LDAP_P(( const char *str ));
 LDAP_SLAPD_F (void) acl_unparse LDAP_P(( AccessControl*, struct berval* ));
 LDAP_SLAPD_F (void) acl_destroy LDAP_P(( AccessControl* ));
 LDAP_SLAPD_F (void) acl_free LDAP_P(( AccessControl *a ));
+LDAP_SLAPD_V (int) acl_index_use;
+LDAP_SLAPD_F (void) acl_index_build LDAP_P(( AccessControl *a ));
+LDAP_SLAPD_F (AccessControl *) acl_index_next LDAP_P(( AccessControl *a,
+	struct berval *ndn, AccessControl **prevp ));
 
 
 /*
@@ -349,6 +358,8 @@ LDAP_SLAPD_F (int) backend_shutdown LDAP_P((Backend *be));
 LDAP_SLAPD_F (int) backend_destroy LDAP_P((void));
 LDAP_SLAPD_F (void) backend_stopdown_one LDAP_P((BackendDB *bd ));
 LDAP_SLAPD_F (void) backend_destroy_one LDAP_P((BackendDB *bd, int dynamic));
+LDAP_SLAPD_F (void) backend_db_stats_init LDAP_P((BackendDB *bd));
+LDAP_SLAPD_F (void) backend_db_stats_destroy LDAP_P((BackendDB *bd));
 
 LDAP_SLAPD_F (BackendInfo *) backend_info LDAP_P(( const char *type ));
 LDAP_SLAPD_F (BackendDB *) backend_db_init LDAP_P(( const char *type,
@@ -910,6 +921,10 @@ LDAP_SLAPD_V (SOCKET *) slapd_ws_sockets;
 #define dn_match(dn1, dn2) 	( ber_bvcmp((dn1), (dn2)) == 0 )
 #define bvmatch(bv1, bv2)	( ((bv1)->bv_len == (bv2)->bv_len) && (memcmp((bv1)->bv_val, (bv2)->bv_val, (bv1)->bv_len) == 0) )
 
+LDAP_SLAPD_F (void) dn_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_invalidate LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_destroy LDAP_P(( void ));
+
 LDAP_SLAPD_F (int) dnValidate LDAP_P((
 	Syntax *syntax, 
 	struct berval *val ));
@@ -1009,6 +1024,7 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (char *) entry2str_wrap_r LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1024,6 +1040,8 @@ LDAP_SLAPD_F (int) entry_decode LDAP_P((
 LDAP_SLAPD_F (int) entry_decode LDAP_P((
 						EntryHeader *eh, Entry **e ));
 #endif
+LDAP_SLAPD_F (int) entry_decode_attrs LDAP_P((
+	EntryHeader *eh, Entry **e, BerVarray types ));
 LDAP_SLAPD_F (int) entry_encode LDAP_P(( Entry *e, struct berval *bv ));
 
 LDAP_SLAPD_F (void) entry_clean LDAP_P(( Entry *e ));
@@ -1124,6 +1142,11 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_V (int) filter_compile_use;
+LDAP_SLAPD_F (FilterProg *) filter_compile LDAP_P(( Filter *f, void *memctx ));
+LDAP_SLAPD_F (void) filter_prog_free LDAP_P(( FilterProg *fp, void *memctx ));
+LDAP_SLAPD_F (int) test_filter_prog LDAP_P((
+	Operation *op, Entry *e, FilterProg *fp ));
 
 /*
  * frontend.c
@@ -1161,6 +1184,24 @@ LDAP_SLAPD_F (void) slap_counters_destroy LDAP_P((slap_counters_t *sc));
 
 LDAP_SLAPD_V (char *)	slap_known_controls[];
 
+/*
+ * keycache.c
+ */
+LDAP_SLAPD_V (slap_keycache_t *) slap_keycaches;
+LDAP_SLAPD_F (int) slap_keycache_init LDAP_P(( slap_keycache_t *kc,
+	char *name, int nshards, int size, slap_keycache_free_func *freef ));
+LDAP_SLAPD_F (void) slap_keycache_clear LDAP_P(( slap_keycache_t *kc ));
+LDAP_SLAPD_F (void) slap_keycache_destroy LDAP_P(( slap_keycache_t *kc ));
+LDAP_SLAPD_F (slap_keycache_shard_t *) slap_keycache_shard LDAP_P((
+	slap_keycache_t *kc, struct berval *key, unsigned *hashp ));
+LDAP_SLAPD_F (slap_keycache_entry_t *) slap_keycache_find LDAP_P((
+	slap_keycache_t *kc, slap_keycache_shard_t *ks,
+	struct berval *key, unsigned hash ));
+LDAP_SLAPD_F (slap_keycache_entry_t *) slap_keycache_slot LDAP_P((
+	slap_keycache_t *kc, slap_keycache_shard_t *ks, unsigned hash ));
+LDAP_SLAPD_F (void) slap_keycache_counters LDAP_P(( slap_keycache_t *kc,
+	unsigned long *hits, unsigned long *misses ));
+
 /*
  * ldapsync.c
  */
@@ -1473,6 +1514,21 @@ LDAP_SLAPD_F (Operation *) slap_op_alloc LDAP_P((
 	ber_tag_t tag, ber_int_t id, void *ctx ));
 
 LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
+LDAP_SLAPD_F (unsigned long) slap_timeval_diff LDAP_P((
+	struct timeval *t0, struct timeval *t1 ));
+LDAP_SLAPD_F (unsigned long) slap_histogram_bound LDAP_P(( int i ));
+LDAP_SLAPD_F (void) slap_histogram_add LDAP_P((
+	slap_histogram_t *h, unsigned long usec ));
+LDAP_SLAPD_F (void) slap_histogram_merge LDAP_P((
+	slap_histogram_t *dst, slap_histogram_t *src ));
+LDAP_SLAPD_F (unsigned long) slap_histogram_quantile LDAP_P((
+	slap_histogram_t *h, int permille ));
+LDAP_SLAPD_F (slap_histogram_t *) slap_counters_db_time LDAP_P((
+	slap_counters_t *sc, int id ));
+LDAP_SLAPD_F (void) slap_counters_db_clear LDAP_P(( int id ));
+LDAP_SLAPD_F (void) slap_slowlog_resize LDAP_P(( int size ));
+LDAP_SLAPD_F (void) slap_op_response_time LDAP_P((
+	Operation *op, SlapReply *rs ));
 
 /*
  * operational.c
@@ -1789,6 +1845,20 @@ LDAP_SLAPD_F( int ) octetStringOrderingMatch LDAP_P((
 	MatchingRule *mr,
 	struct berval *value,
 	void *assertedValue ));
+LDAP_SLAPD_F( int ) octetStringSubstringsMatch LDAP_P((
+	int *matchp,
+	slap_mask_t flags,
+	Syntax *syntax,
+	MatchingRule *mr,
+	struct berval *value,
+	void *assertedValue ));
+LDAP_SLAPD_F( int ) directoryStringSubstringsMatch LDAP_P((
+	int *matchp,
+	slap_mask_t flags,
+	Syntax *syntax,
+	MatchingRule *mr,
+	struct berval *value,
+	void *assertedValue ));
 
 /*
  * schema_prep.c
@@ -2019,6 +2089,7 @@ LDAP_SLAPD_V (unsigned int) index_intlen_strlen;
 
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming_auth;
+LDAP_SLAPD_V (ber_len_t) sockbuf_max_outgoing;
 LDAP_SLAPD_V (int)		slap_conn_max_pending;
 LDAP_SLAPD_V (int)		slap_conn_max_pending_auth;
 
@@ -2043,6 +2114,7 @@ LDAP_SLAPD_V (struct berval)	default_search_base;
 LDAP_SLAPD_V (struct berval)	default_search_nbase;
 
 LDAP_SLAPD_V (slap_counters_t)	slap_counters;
+LDAP_SLAPD_V (slap_slowlog_t)	slap_slowlog;
 
 LDAP_SLAPD_V (char *)		slapd_pid_file;
 LDAP_SLAPD_V (char *)		slapd_args_file;
@@ -2053,6 +2125,7 @@ LDAP_SLAPD_V (time_t)		starttime;
 
 LDAP_SLAPD_V (ldap_pvt_thread_pool_t)	connection_pool;
 LDAP_SLAPD_V (int)			connection_pool_max;
+LDAP_SLAPD_V (int)			connection_pool_queues;
 LDAP_SLAPD_V (int)			slap_tool_thread_max;
 
 LDAP_SLAPD_V (ldap_pvt_thread_mutex_t)	entry2str_mutex;
@@ -284,12 +284,13 @@ static long send_ldap_ber(
 	BerElement *ber )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	struct berval bv;
+	SlapOutbuf *ob;
+	ber_len_t bytes, off = 0;
 	long ret = 0;
 
 	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
-	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
 	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
 		conn->c_writers < 0 ) {
@@ -299,7 +300,9 @@ static long send_ldap_ber(
 
 	conn->c_writers++;
 
-	while ( conn->c_writers > 0 && conn->c_writing ) {
+	/* wait while the client is too far behind reading its output */
+	while ( conn->c_writers > 0 && sockbuf_max_outgoing &&
+		conn->c_outq_bytes >= sockbuf_max_outgoing ) {
 		ldap_pvt_thread_cond_wait( &conn->c_write1_cv, &conn->c_write1_mutex );
 	}
 
@@ -313,81 +316,62 @@ static long send_ldap_ber(
 		return 0;
 	}
 
-	/* Our turn */
-	conn->c_writing = 1;
-
-	/* write the pdu */
-	while( 1 ) {
-		int err;
+	ber_flatten2( ber, &bv, 0 );
 
-		/* lock the connection */ 
-		if ( ldap_pvt_thread_mutex_trylock( &conn->c_mutex )) {
-			if ( !connection_valid(conn)) {
-				ret = 0;
-				break;
-			}
-			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
-			ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-			if ( conn->c_writers < 0 ) {
-				ret = 0;
-				break;
+	/* Nothing queued ahead of us: try to write the pdu right away.
+	 * Never wait for the connection here; if someone else holds it,
+	 * the daemon will write our pdu from the queue.
+	 */
+	if ( LDAP_STAILQ_EMPTY( &conn->c_outq ) &&
+		ldap_pvt_thread_mutex_trylock( &conn->c_mutex ) == 0 )
+	{
+		while ( off < bv.bv_len ) {
+			struct berval rest;
+			ber_slen_t rc;
+			int err;
+
+			rest.bv_val = bv.bv_val + off;
+			rest.bv_len = bv.bv_len - off;
+			rc = ber_pvt_sb_writev( conn->c_sb, &rest, 1 );
+			if ( rc > 0 ) {
+				off += rc;
+				continue;
 			}
-			continue;
-		}
-
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
-			ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
-			ret = bytes;
-			break;
-		}
 
-		err = sock_errno();
-
-		/*
-		 * we got an error.  if it's ewouldblock, we need to
-		 * wait on the socket being writable.  otherwise, figure
-		 * it's a hard error and return.
-		 */
+			/* the GnuTLS and MozNSS layers return 0 when blocked */
+			err = sock_errno();
+			if ( err == EWOULDBLOCK || err == EAGAIN )
+				break;
 
-		Debug( LDAP_DEBUG_CONNS, "ber_flush2 failed errno=%d reason=\"%s\"\n",
-		    err, sock_errstr(err), 0 );
+			Debug( LDAP_DEBUG_CONNS, "send_ldap_ber: write failed errno=%d reason=\"%s\"\n",
+				err, sock_errstr(err), 0 );
 
-		if ( err != EWOULDBLOCK && err != EAGAIN ) {
 			conn->c_writers--;
-			conn->c_writing = 0;
 			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 			connection_closing( conn, "connection lost on write" );
 
 			ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
 			return -1;
 		}
-
-		/* wait for socket to be write-ready */
-		ldap_pvt_thread_mutex_lock( &conn->c_write2_mutex );
-		conn->c_writewaiter = 1;
-		slapd_set_write( conn->c_sd, 2 );
-
-		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
-		ldap_pvt_thread_cond_wait( &conn->c_write2_cv, &conn->c_write2_mutex );
-		conn->c_writewaiter = 0;
-		ldap_pvt_thread_mutex_unlock( &conn->c_write2_mutex );
-		ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-		if ( conn->c_writers < 0 ) {
-			ret = 0;
-			break;
-		}
 	}
 
-	conn->c_writing = 0;
-	if ( conn->c_writers < 0 ) {
-		conn->c_writers++;
-		if ( !conn->c_writers )
-			ldap_pvt_thread_cond_signal( &conn->c_write1_cv );
-	} else {
-		conn->c_writers--;
-		ldap_pvt_thread_cond_signal( &conn->c_write1_cv );
+	/* queue whatever is left for the daemon to write */
+	if ( off < bv.bv_len ) {
+		ob = ch_malloc( sizeof( SlapOutbuf ) + bv.bv_len - off );
+		ob->ob_len = bv.bv_len - off;
+		ob->ob_off = 0;
+		AC_MEMCPY( ob->ob_buf, bv.bv_val + off, ob->ob_len );
+		LDAP_STAILQ_INSERT_TAIL( &conn->c_outq, ob, ob_next );
+		conn->c_outq_bytes += ob->ob_len;
+		if ( !conn->c_writewaiter ) {
+			conn->c_writewaiter = 1;
+			slapd_set_write( conn->c_sd, 2 );
+		}
 	}
+	ret = bytes;
+
+	conn->c_writers--;
 	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 
 	return ret;
@@ -720,6 +704,10 @@ send_ldap_response(
 	ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
 	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
 
+	if ( rs->sr_type != REP_INTERMEDIATE ) {
+		slap_op_response_time( op, rs );
+	}
+
 cleanup:;
 	/* Tell caller that we did this for real, as opposed to being
 	 * overridden by a callback
@@ -855,6 +843,19 @@ abandon:
 		oref = NULL; /* send_ldap_response() will free rs->sr_ref if != NULL */
 	}
 
+	/* a write may change the membership of groups that
+	 * cached access control decisions depend on */
+	if ( acl_cache_content && rs->sr_err == LDAP_SUCCESS ) {
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+			acl_cache_invalidate();
+			break;
+		}
+	}
+
 	if ( send_ldap_response( op, rs ) == SLAP_CB_CONTINUE ) {
 		if ( op->o_tag == LDAP_REQ_SEARCH ) {
 			Statslog( LDAP_DEBUG_STATS,
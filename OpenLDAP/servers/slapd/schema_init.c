@@ -712,7 +712,7 @@ int octetStringFilter(
 	return LDAP_SUCCESS;
 }
 
-static int
+int
 octetStringSubstringsMatch(
 	int *matchp,
 	slap_mask_t flags,
@@ -1864,7 +1864,7 @@ UTF8StringNormalize(
 	return LDAP_SUCCESS;
 }
 
-static int
+int
 directoryStringSubstringsMatch(
 	int *matchp,
 	slap_mask_t flags,
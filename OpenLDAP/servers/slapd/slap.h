@@ -133,9 +133,11 @@ LDAP_BEGIN_DECL
 #define MAXREMATCHES (100)
 
 #define SLAP_MAX_WORKER_THREADS		(20)
+#define SLAP_SLOWOP_ENTRIES		(32)
 
 #define SLAP_SB_MAX_INCOMING_DEFAULT ((1<<18) - 1)
 #define SLAP_SB_MAX_INCOMING_AUTH ((1<<24) - 1)
+#define SLAP_SB_MAX_OUTGOING_DEFAULT (1<<20)
 
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
@@ -345,6 +347,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProg FilterProg;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -1538,6 +1541,11 @@ typedef struct Access {
 	ObjectClass		*a_group_oc;
 	AttributeDescription	*a_group_at;
 
+	/* whether the <who> part can be kept in the ACL cache */
+	int			a_cache;
+#define	ACL_CACHE_WHO		0x01U	/* it does not depend on the entry */
+#define	ACL_CACHE_CONTENT	0x02U	/* it depends on other entries */
+
 	struct Access		*a_next;
 } Access;
 
@@ -1558,6 +1566,10 @@ typedef struct AccessControl {
 	Access	*acl_access;
 
 	struct AccessControl	*acl_next;
+
+	/* index of the targets of the list this acl belongs to */
+	int		acl_pos;
+	struct AclIndex	*acl_index;
 } AccessControl;
 
 typedef struct AccessControlState {
@@ -1984,6 +1996,7 @@ struct BackendDB {
 	struct		be_pcl	*be_pending_csn_list;
 	ldap_pvt_thread_mutex_t					be_pcl_mutex;
 	struct syncinfo_s						*be_syncinfo; /* For syncrepl */
+	int							be_statsid; /* slot of its response times in slap_counters_t */
 
 	void    *be_pb;         /* Netscape plugin */
 	struct ConfigOCs *be_cf_ocs;
@@ -2123,6 +2136,8 @@ typedef struct rep_search_s {
 	AttributeName *r_attrs;
 	int r_nentries;
 	BerVarray r_v2ref;
+	int r_ncandidates;	/* set by backends that compute candidates */
+	int r_nexamined;	/* entries the backend loaded and tested */
 } rep_search_s;
 
 struct SlapReply {
@@ -2167,6 +2182,8 @@ struct SlapReply {
 #define sr_attr_flags sr_un.sru_search.r_attr_flags
 #define	sr_v2ref sr_un.sru_search.r_v2ref
 #define	sr_nentries sr_un.sru_search.r_nentries
+#define	sr_ncandidates sr_un.sru_search.r_ncandidates
+#define	sr_nexamined sr_un.sru_search.r_nexamined
 #define	sr_rspoid sr_un.sru_extended.r_rspoid
 #define	sr_rspdata sr_un.sru_extended.r_rspdata
 #define	sr_sasldata sr_un.sru_sasl.r_sasldata
@@ -2519,6 +2536,22 @@ typedef enum {
 	SLAP_OP_LAST
 } slap_op_t;
 
+/*
+ * Log-linear histogram of durations in microseconds.  Values below
+ * SLAP_HIST_SUB have a bucket each; every larger power of two is
+ * split into SLAP_HIST_SUB buckets, so that a bucket is never wider
+ * than 1/SLAP_HIST_SUB of its values.
+ */
+#define SLAP_HIST_SUB_BITS	2
+#define SLAP_HIST_SUB		(1 << SLAP_HIST_SUB_BITS)
+#define SLAP_HIST_BUCKETS	((32 - SLAP_HIST_SUB_BITS + 1) * SLAP_HIST_SUB)
+
+typedef struct slap_histogram_t {
+	unsigned long	sh_count;
+	unsigned long	sh_max;
+	unsigned long	sh_buckets[SLAP_HIST_BUCKETS];
+} slap_histogram_t;
+
 typedef struct slap_counters_t {
 	struct slap_counters_t	*sc_next;
 	ldap_pvt_thread_mutex_t	sc_mutex;
@@ -2532,9 +2565,76 @@ typedef struct slap_counters_t {
 #ifdef SLAPD_MONITOR
 	ldap_pvt_mp_t		sc_ops_completed_[SLAP_OP_LAST];
 	ldap_pvt_mp_t		sc_ops_initiated_[SLAP_OP_LAST];
+	/* time between receiving and starting an op, and time running it */
+	slap_histogram_t	sc_ops_wait_[SLAP_OP_LAST];
+	slap_histogram_t	sc_ops_run_[SLAP_OP_LAST];
+	/* time between receiving an op and sending its result */
+	slap_histogram_t	sc_ops_time_[SLAP_OP_LAST];
+	/* the same per database, slot be_statsid - 1 */
+	slap_histogram_t	(*sc_db_time_)[SLAP_OP_LAST];
+	int			sc_db_nslots;
 #endif /* SLAPD_MONITOR */
 } slap_counters_t;
 
+/* an operation that took longer than the slowop_threshold */
+typedef struct slap_slowop_t {
+	time_t		so_time;	/* when the result was sent */
+	unsigned long	so_connid;
+	unsigned long	so_opid;
+	slap_op_t	so_type;
+	int		so_err;
+	unsigned long	so_usec;	/* response time */
+	struct berval	so_suffix;	/* database that handled it */
+	struct berval	so_base;
+	int		so_scope;	/* search only, from here on */
+	struct berval	so_filter;
+	int		so_nentries;
+	int		so_ncandidates;
+	int		so_nexamined;
+} slap_slowop_t;
+
+/* ring of the most recent slow operations */
+typedef struct slap_slowlog_t {
+	ldap_pvt_thread_mutex_t	sl_mutex;
+	unsigned long	sl_threshold;	/* milliseconds, 0 disables */
+	int		sl_size;	/* slots in sl_ring */
+	int		sl_next;	/* slot to fill next */
+	unsigned long	sl_total;	/* slow operations seen */
+	slap_slowop_t	*sl_ring;
+} slap_slowlog_t;
+
+/*
+ * A cache of values looked up by string keys, split in shards that
+ * each have their own lock (see keycache.c)
+ */
+typedef struct slap_keycache_entry_t {
+	struct berval	ke_key;		/* NULL if free */
+	void		*ke_data;
+	unsigned	ke_hash;
+	int		ke_refcnt;	/* pinned while in use */
+	int		ke_used;	/* referenced since the hand passed */
+} slap_keycache_entry_t;
+
+typedef struct slap_keycache_shard_t {
+	ldap_pvt_thread_mutex_t	ks_mutex;
+	int		ks_hand;
+	unsigned long	ks_hits;
+	unsigned long	ks_misses;
+	slap_keycache_entry_t	*ks_entries;
+} slap_keycache_shard_t;
+
+/* frees the key and data of an entry that is evicted */
+typedef void (slap_keycache_free_func)( slap_keycache_entry_t *ke );
+
+typedef struct slap_keycache_t {
+	char		*kc_name;	/* RDN value in cn=Caches,cn=Monitor */
+	int		kc_nshards;
+	int		kc_size;	/* entries per shard */
+	slap_keycache_free_func	*kc_free;
+	slap_keycache_shard_t	*kc_shards;
+	struct slap_keycache_t	*kc_next;
+} slap_keycache_t;
+
 /*
  * represents an operation pending from an ldap client
  */
@@ -2612,6 +2712,7 @@ struct Operation {
 	ber_tag_t	o_tag;		/* tag of the request */
 	time_t		o_time;		/* time op was initiated */
 	int			o_tincr;	/* counter for multiple ops with same o_time */
+	struct timeval	o_qtime;	/* when the op was queued for execution */
 
 	BackendDB	*o_bd;	/* backend DB processing this op */
 	struct berval	o_req_dn;	/* DN of target of request */
@@ -2831,6 +2932,19 @@ typedef void (SEND_LDAP_INTERMEDIATE)(
 
 typedef struct Listener Listener;
 
+/*
+ * an encoded PDU waiting in a connection's output queue
+ */
+typedef struct slap_outbuf {
+	LDAP_STAILQ_ENTRY(slap_outbuf) ob_next;
+	ber_len_t	ob_len;		/* length of ob_buf */
+	ber_len_t	ob_off;		/* bytes of ob_buf already written */
+	char		ob_buf[1];
+} SlapOutbuf;
+
+/* max queued PDUs handed to a single writev() */
+#define SLAP_OUTQ_IOV	32
+
 /*
  * represents a connection from an ldap client
  */
@@ -2895,17 +3009,16 @@ struct Connection {
 	LDAP_STAILQ_HEAD(c_o, Operation) c_ops;	/* list of operations being processed */
 	LDAP_STAILQ_HEAD(c_po, Operation) c_pending_ops;	/* list of pending operations */
 
-	ldap_pvt_thread_mutex_t	c_write1_mutex;	/* only one pdu written at a time */
-	ldap_pvt_thread_cond_t	c_write1_cv;	/* only one pdu written at a time */
-	ldap_pvt_thread_mutex_t	c_write2_mutex;	/* used to wait for sd write-ready */
-	ldap_pvt_thread_cond_t	c_write2_cv;	/* used to wait for sd write-ready*/
+	ldap_pvt_thread_mutex_t	c_write1_mutex;	/* protects the output queue */
+	ldap_pvt_thread_cond_t	c_write1_cv;	/* output queue drained */
+	LDAP_STAILQ_HEAD(c_oq, slap_outbuf) c_outq;	/* PDUs awaiting write */
+	ber_len_t	c_outq_bytes;	/* unwritten bytes in c_outq */
 
 	BerElement	*c_currentber;	/* ber we're attempting to read */
 	int			c_writers;		/* number of writers waiting */
-	char		c_writing;		/* someone is writing */
 
 	char		c_sasl_bind_in_progress;	/* multi-op bind in progress */
-	char		c_writewaiter;	/* true if blocked on write */
+	char		c_writewaiter;	/* true if output is queued */
 
 
 #define	CONN_IS_TLS	1
@@ -3005,6 +3118,7 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* SO_REUSEPORT shard (daemon thread), or -1 */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
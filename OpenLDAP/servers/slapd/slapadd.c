@@ -336,6 +336,8 @@ slapadd( int argc, char **argv )
 	int rc = EXIT_SUCCESS;
 
 	struct stat stat_buf;
+	unsigned long nadded = 0;
+	time_t start, now;
 
 	/* default "000" */
 	csnsid = 0;
@@ -411,6 +413,7 @@ slapadd( int argc, char **argv )
 
 	erec.nextline = 0;
 	erec.e = NULL;
+	start = time( NULL );
 
 	for (;;) {
 		ldifrc = getrec( &erec );
@@ -438,6 +441,7 @@ slapadd( int argc, char **argv )
 				if( continuemode ) continue;
 				break;
 			}
+			nadded++;
 			if ( verbose )
 				fprintf( stderr, "added: \"%s\" (%08lx)\n",
 					erec.e->e_dn, (long) id );
@@ -467,6 +471,11 @@ slapadd( int argc, char **argv )
 	if ( enable_meter ) {
 		lutil_meter_update( &meter, ftell( ldiffp->fp ), 1);
 		lutil_meter_close( &meter );
+
+		now = time( NULL );
+		fprintf( stderr, "Added %lu entries in %ld seconds (%lu/s)\n",
+			nadded, (long)( now - start ),
+			nadded / ( now > start ? now - start : 1 ));
 	}
 
 	if ( rc == EXIT_SUCCESS ) {
@@ -478,6 +487,7 @@ slapadd( int argc, char **argv )
 	if ( !dryrun ) {
 		if ( enable_meter ) {
 			fprintf( stderr, "Closing DB..." );
+			start = time( NULL );
 		}
 		if( be->be_entry_close( be ) ) {
 			rc = EXIT_FAILURE;
@@ -487,7 +497,9 @@ slapadd( int argc, char **argv )
 			be->be_sync( be );
 		}
 		if ( enable_meter ) {
-			fprintf( stderr, "\n" );
+			/* pending index writes are completed here */
+			fprintf( stderr, " %ld seconds\n",
+				(long)( time( NULL ) - start ));
 		}
 	}
 
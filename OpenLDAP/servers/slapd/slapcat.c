@@ -28,6 +28,7 @@
 #include <ac/ctype.h>
 #include <ac/socket.h>
 #include <ac/string.h>
+#include <ac/unistd.h>
 
 #include "slapcommon.h"
 #include "ldif.h"
@@ -40,6 +41,125 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/* With -j, the entries read by the main thread are queued in a ring;
+ * the encoding threads take them in order, and the main thread writes
+ * them out from the head of the ring as they are done.
+ */
+typedef struct cat_slot {
+	Entry *cs_e;
+	ID cs_id;
+	char *cs_data;
+	int cs_len;
+	int cs_done;
+} cat_slot;
+
+#define	CAT_SLOTS_PER_THREAD	16
+
+static cat_slot *cat_ring;
+static unsigned long cat_size, cat_head, cat_next, cat_tail;
+static int cat_stop;
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_cond_t cat_work;
+static ldap_pvt_thread_cond_t cat_done;
+
+static void *
+slapcat_encode_thr( void *ctx )
+{
+	cat_slot *cs;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for (;;) {
+		while ( cat_next == cat_tail && !cat_stop )
+			ldap_pvt_thread_cond_wait( &cat_work, &cat_mutex );
+		if ( cat_next == cat_tail )
+			break;
+		cs = &cat_ring[ cat_next++ % cat_size ];
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		cs->cs_data = entry2str_wrap_r( cs->cs_e, &cs->cs_len, ldif_wrap );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cs->cs_done = 1;
+		ldap_pvt_thread_cond_signal( &cat_done );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	return NULL;
+}
+
+/* Write out the encoded entries at the head of the ring, waiting
+ * for the ones before upto; with FILE NULL, just release them */
+static int
+slapcat_drain( const char *progname, Operation *op, FILE *fp,
+	unsigned long upto )
+{
+	cat_slot *cs;
+	int done, rc = 0;
+
+	while ( cat_head != cat_tail ) {
+		cs = &cat_ring[ cat_head % cat_size ];
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		while ( !cs->cs_done && cat_head < upto )
+			ldap_pvt_thread_cond_wait( &cat_done, &cat_mutex );
+		done = cs->cs_done;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		if ( !done )
+			break;
+
+		if ( fp != NULL && rc == 0 ) {
+			if ( verbose ) {
+				printf( "# id=%08lx\n", (long) cs->cs_id );
+			}
+			if ( fwrite( cs->cs_data, 1, cs->cs_len, fp ) != (size_t)cs->cs_len ||
+				fputs( "\n", fp ) == EOF ) {
+				fprintf(stderr, "%s: error writing output.\n",
+					progname);
+				rc = -1;
+			}
+		}
+
+		be_entry_release_r( op, cs->cs_e );
+		ch_free( cs->cs_data );
+		cs->cs_e = NULL;
+		cs->cs_data = NULL;
+		cs->cs_done = 0;
+		cat_head++;
+
+		if ( rc && fp != NULL )
+			break;
+	}
+
+	return rc;
+}
+
+static int
+slapcat_queue( const char *progname, Operation *op, FILE *fp,
+	ID id, Entry *e )
+{
+	cat_slot *cs;
+
+	/* make room */
+	if ( cat_tail - cat_head == cat_size &&
+		slapcat_drain( progname, op, fp, cat_head + 1 ) )
+	{
+		be_entry_release_r( op, e );
+		return -1;
+	}
+
+	cs = &cat_ring[ cat_tail % cat_size ];
+	cs->cs_e = e;
+	cs->cs_id = id;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	cat_tail++;
+	ldap_pvt_thread_cond_signal( &cat_work );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	/* write whatever is ready */
+	return slapcat_drain( progname, op, fp, cat_head );
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -49,6 +169,11 @@ slapcat( int argc, char **argv )
 	const char *progname = "slapcat";
 	int requestBSF;
 	int doBSF = 0;
+	FilterProg *fprog = NULL;
+	FILE *fp;
+	FILE *zfp = NULL;
+	ldap_pvt_thread_t *thrs = NULL;
+	int i;
 
 	slap_tool_init( progname, SLAPCAT, argc, argv );
 
@@ -80,6 +205,41 @@ slapcat( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	fp = ldiffp->fp;
+	if ( compress_cmd != NULL ) {
+		int fd;
+
+		/* the command writes to our output in our place */
+		fflush( fp );
+		fflush( stdout );
+		fd = dup( 1 );
+		if ( fd < 0 || dup2( fileno( fp ), 1 ) < 0 ) {
+			perror( progname );
+			exit( EXIT_FAILURE );
+		}
+		zfp = popen( compress_cmd, "w" );
+		dup2( fd, 1 );
+		close( fd );
+		if ( zfp == NULL ) {
+			fprintf( stderr, "%s: could not run \"%s\".\n",
+				progname, compress_cmd );
+			exit( EXIT_FAILURE );
+		}
+		fp = zfp;
+	}
+
+	if ( jobs > 0 ) {
+		cat_size = jobs * CAT_SLOTS_PER_THREAD;
+		cat_ring = ch_calloc( cat_size, sizeof( cat_slot ));
+		ldap_pvt_thread_mutex_init( &cat_mutex );
+		ldap_pvt_thread_cond_init( &cat_work );
+		ldap_pvt_thread_cond_init( &cat_done );
+		thrs = ch_malloc( jobs * sizeof( ldap_pvt_thread_t ));
+		for ( i = 0; i < jobs; i++ ) {
+			ldap_pvt_thread_create( &thrs[i], 0, slapcat_encode_thr, NULL );
+		}
+	}
+
 	op.o_bd = be;
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
@@ -92,6 +252,7 @@ slapcat( int argc, char **argv )
 		} else {
 			assert( be->be_entry_first != NULL );
 			doBSF = 1;
+			fprog = filter_compile( filter, NULL );
 			id = be->be_entry_first( be );
 		}
 	}
@@ -107,6 +268,11 @@ slapcat( int argc, char **argv )
 
 		e = be->be_entry_get( be, id );
 		if ( e == NULL ) {
+			/* keep the output in order */
+			if ( cat_ring && slapcat_drain( progname, &op, fp, cat_tail ) ) {
+				rc = EXIT_FAILURE;
+				break;
+			}
 			printf("# no data for entry id=%08lx\n\n", (long) id );
 			rc = EXIT_FAILURE;
 			if ( continuemode == 0 ) {
@@ -136,7 +302,8 @@ slapcat( int argc, char **argv )
 
 
 			if ( filter != NULL ) {
-				int rc = test_filter( NULL, e, filter );
+				int rc = fprog ? test_filter_prog( NULL, e, fprog ) :
+					test_filter( NULL, e, filter );
 				if ( rc != LDAP_COMPARE_TRUE ) {
 					be_entry_release_r( &op, e );
 					continue;
@@ -144,6 +311,14 @@ slapcat( int argc, char **argv )
 			}
 		}
 
+		if ( cat_ring ) {
+			if ( slapcat_queue( progname, &op, fp, id, e ) ) {
+				rc = EXIT_FAILURE;
+				break;
+			}
+			continue;
+		}
+
 		if ( verbose ) {
 			printf( "# id=%08lx\n", (long) id );
 		}
@@ -158,8 +333,8 @@ slapcat( int argc, char **argv )
 			break;
 		}
 
-		if ( fputs( data, ldiffp->fp ) == EOF ||
-			fputs( "\n", ldiffp->fp ) == EOF ) {
+		if ( fputs( data, fp ) == EOF ||
+			fputs( "\n", fp ) == EOF ) {
 			fprintf(stderr, "%s: error writing output.\n",
 				progname);
 			rc = EXIT_FAILURE;
@@ -167,7 +342,41 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+	if ( cat_ring ) {
+		/* write the rest, unless something failed */
+		if ( slapcat_drain( progname, &op,
+			rc == EXIT_SUCCESS ? fp : NULL, cat_tail ) )
+		{
+			rc = EXIT_FAILURE;
+		}
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &cat_work );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		for ( i = 0; i < jobs; i++ ) {
+			ldap_pvt_thread_join( thrs[i], NULL );
+		}
+
+		/* release what's left after an error */
+		slapcat_drain( progname, &op, NULL, cat_tail );
+
+		ch_free( thrs );
+		ch_free( cat_ring );
+		cat_ring = NULL;
+		ldap_pvt_thread_cond_destroy( &cat_done );
+		ldap_pvt_thread_cond_destroy( &cat_work );
+		ldap_pvt_thread_mutex_destroy( &cat_mutex );
+	}
+
+	if ( zfp != NULL && pclose( zfp ) != 0 ) {
+		fprintf( stderr, "%s: \"%s\" failed.\n",
+			progname, compress_cmd );
+		rc = EXIT_FAILURE;
+	}
+
 	be->be_entry_close( be );
+	filter_prog_free( fprog, NULL );
 
 	if ( slap_tool_destroy())
 		rc = EXIT_FAILURE;
@@ -80,7 +80,8 @@ usage( int tool, const char *progname )
 
 	case SLAPCAT:
 		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix]"
-			" [-l ldiffile] [-a filter] [-s subtree] [-H url]\n";
+			" [-l ldiffile] [-a filter] [-s subtree] [-H url]\n"
+			"\t[-j threads] [-z command]\n";
 		break;
 
 	case SLAPDN:
@@ -314,7 +315,7 @@ slap_tool_init(
 		break;
 
 	case SLAPCAT:
-		options = "a:b:cd:f:F:gH:l:n:o:s:v";
+		options = "a:b:cd:f:F:gH:j:l:n:o:s:vz:";
 		mode |= SLAP_TOOL_READMAIN | SLAP_TOOL_READONLY;
 		break;
 
@@ -451,8 +452,13 @@ slap_tool_init(
 			ldap_free_urldesc( ludp );
 			} break;
 
-		case 'j':	/* jump to linenumber */
-			if ( lutil_atoi( &jumpline, optarg ) ) {
+		case 'j':	/* jump to linenumber, or encoding threads */
+			if ( tool == SLAPCAT ) {
+				if ( lutil_atoi( &jobs, optarg ) || jobs < 1 ) {
+					usage( tool, progname );
+				}
+
+			} else if ( lutil_atoi( &jumpline, optarg ) ) {
 				usage( tool, progname );
 			}
 			break;
@@ -552,6 +558,10 @@ slap_tool_init(
 			ber_str2bv( optarg, 0, 0, &authzID );
 			break;
 
+		case 'z':	/* filter output through command */
+			compress_cmd = optarg;
+			break;
+
 		default:
 			usage( tool, progname );
 			break;
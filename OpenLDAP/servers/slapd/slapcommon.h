@@ -43,6 +43,8 @@ typedef struct tool_vars {
 	int tv_nosubordinates;
 	int tv_dryrun;
 	int tv_jumpline;
+	int tv_jobs;
+	char *tv_compress_cmd;
 	struct berval tv_sub_ndn;
 	int tv_scope;
 	Filter *tv_filter;
@@ -76,6 +78,8 @@ extern tool_vars tool_globals;
 #define verbose tool_globals.tv_verbose
 #define quiet tool_globals.tv_quiet
 #define jumpline tool_globals.tv_jumpline
+#define jobs tool_globals.tv_jobs
+#define compress_cmd tool_globals.tv_compress_cmd
 #define update_ctxcsn tool_globals.tv_update_ctxcsn
 #define continuemode tool_globals.tv_continuemode
 #define nosubordinates tool_globals.tv_nosubordinates
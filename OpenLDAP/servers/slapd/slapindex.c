@@ -29,6 +29,8 @@
 #include <ac/socket.h>
 #include <ac/unistd.h>
 
+#include <lutil_meter.h>
+
 #include "slapcommon.h"
 
 int
@@ -38,7 +40,11 @@ slapindex( int argc, char **argv )
 	int rc = EXIT_SUCCESS;
 	const char *progname = "slapindex";
 	AttributeDescription *ad, **adv = NULL;
+	lutil_meter_t meter;
+	unsigned long nentries = 0, n = 0;
+	int enable_meter = 0;
 
+	if ( isatty( 2 ) ) enable_meter = 1;
 	slap_tool_init( progname, SLAPINDEX, argc, argv );
 
 	if( !be->be_entry_open ||
@@ -78,6 +84,32 @@ slapindex( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	if ( enable_meter && !verbose
+#ifdef LDAP_DEBUG
+		/* tools default to "none" */
+		&& slap_debug == LDAP_DEBUG_NONE
+#endif
+		)
+	{
+		/* count the entries first; this only reads their headers */
+		if ( be->be_entry_first ) {
+			id = be->be_entry_first( be );
+
+		} else {
+			id = be->be_entry_first_x( be, NULL, LDAP_SCOPE_DEFAULT, NULL );
+		}
+		for ( ; id != NOID; id = be->be_entry_next( be ) )
+			nentries++;
+
+		enable_meter = nentries > 0 && !lutil_meter_open(
+			&meter,
+			&lutil_meter_text_display,
+			&lutil_meter_linear_estimator,
+			nentries );
+	} else {
+		enable_meter = 0;
+	}
+
 	if ( be->be_entry_first ) {
 		id = be->be_entry_first( be );
 
@@ -95,6 +127,10 @@ slapindex( int argc, char **argv )
 
 		rtn =  be->be_entry_reindex( be, id, adv );
 
+		/* linear indexing makes several passes */
+		if ( enable_meter && n < nentries )
+			lutil_meter_update( &meter, ++n, 0 );
+
 		if( rtn != LDAP_SUCCESS ) {
 			rc = EXIT_FAILURE;
 			if( continuemode ) continue;
@@ -102,7 +138,19 @@ slapindex( int argc, char **argv )
 		}
 	}
 
-	(void) be->be_entry_close( be );
+	if ( enable_meter ) {
+		lutil_meter_update( &meter, n, 1 );
+		lutil_meter_close( &meter );
+		fprintf( stderr, "Closing DB..." );
+	}
+
+	/* indexing may still be completing in the backend */
+	if ( be->be_entry_close( be ) )
+		rc = EXIT_FAILURE;
+
+	if ( enable_meter ) {
+		fprintf( stderr, "\n" );
+	}
 
 	if ( slap_tool_destroy())
 		rc = EXIT_FAILURE;
@@ -0,0 +1,251 @@
+/* slapd-idlbench -- time the back-bdb ID list kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2011 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Runs bdb_idl_list_and() and bdb_idl_list_or() over sets of sorted
+ * ID lists shaped like index slots, once for each kernel level the
+ * CPU supports, checks that all levels agree, and reports the time
+ * per operation. Built on demand with "make slapd-idlbench", since it
+ * needs the Berkeley DB headers that back-bdb uses.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "back-bdb.h"
+#include "idl.h"
+
+#include "lutil.h"
+
+#define LOOPS	20
+#define PAIRS	64
+#define ENTRIES	1000000
+
+/* How the two lists of a pair are sized and laid out */
+enum {
+	SHAPE_EQUAL,	/* similar sizes, IDs spread over the database */
+	SHAPE_SKEWED,	/* one short list, one long one */
+	SHAPE_ZIPF,	/* sizes drawn from a long-tailed distribution */
+	SHAPE_CLUSTER	/* IDs in runs, as from entries added in bulk */
+};
+
+static const char *shapes[] = { "equal", "skewed", "zipf", "cluster" };
+
+static unsigned long seed = 1;
+
+static unsigned long
+rnd( void )
+{
+	/* 64 bit LCG, top bits only */
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return seed >> 33;
+}
+
+/* Size in [lo, hi], about evenly spread over powers of two */
+static unsigned
+rnd_size( unsigned lo, unsigned hi )
+{
+	unsigned bits, n;
+
+	for ( bits = 0; ( lo << bits ) < hi; bits++ )
+		;
+	n = lo << ( rnd() % ( bits + 1 ));
+	n += rnd() % n;
+	return n > hi ? hi : n;
+}
+
+/* Fill ids with n sorted distinct IDs from 1..entries */
+static void
+fill( ID *ids, unsigned n, unsigned long entries, int clustered )
+{
+	unsigned long gap = entries / n, id = 0;
+	unsigned i;
+
+	for ( i = 1; i <= n; i++ ) {
+		if ( clustered && ( rnd() & 15 ))
+			id++;
+		else
+			id += 1 + rnd() % ( 2 * gap );
+		ids[i] = id;
+	}
+	ids[0] = n;
+}
+
+static void
+usage( char *name )
+{
+	fprintf( stderr,
+		"usage: %s "
+		"[-e <entries>] "
+		"[-l <loops>] "
+		"[-p <pairs>] "
+		"[-s <seed>] "
+		"[-x <maxlevel>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, shape, op, level, maxlevel;
+	int		loops = LOOPS, npairs = PAIRS, entries = ENTRIES;
+	ID		**pairs, *work;
+	unsigned long	sum[2], ref[2], ops, ids;
+	struct timeval	t0, t1;
+	double		us;
+
+	maxlevel = bdb_idl_simd( -1 );
+
+	while ( (i = getopt( argc, argv, "e:l:p:s:x:" )) != EOF ) {
+		switch ( i ) {
+		case 'e':
+			if ( lutil_atoi( &entries, optarg ) != 0 || entries < 2 )
+				usage( argv[0] );
+			break;
+
+		case 'l':
+			if ( lutil_atoi( &loops, optarg ) != 0 || loops < 1 )
+				usage( argv[0] );
+			break;
+
+		case 'p':
+			if ( lutil_atoi( &npairs, optarg ) != 0 || npairs < 1 )
+				usage( argv[0] );
+			break;
+
+		case 's':
+			if ( lutil_atoul( &seed, optarg ) != 0 )
+				usage( argv[0] );
+			break;
+
+		case 'x':
+			if ( lutil_atoi( &maxlevel, optarg ) != 0 || maxlevel < 0 )
+				usage( argv[0] );
+			break;
+
+		default:
+			usage( argv[0] );
+			break;
+		}
+	}
+
+	pairs = malloc( 2 * npairs * sizeof( ID * ));
+	work = malloc( BDB_IDL_UM_SIZEOF );
+	if ( pairs == NULL || work == NULL ) {
+		perror( "malloc" );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0; i < 2 * npairs; i++ ) {
+		pairs[i] = malloc( BDB_IDL_UM_SIZEOF );
+		if ( pairs[i] == NULL ) {
+			perror( "malloc" );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	printf( "%-8s %-4s %-7s %10s %10s\n",
+		"shape", "op", "kernel", "us/op", "Mids/s" );
+
+	for ( shape = SHAPE_EQUAL; shape <= SHAPE_CLUSTER; shape++ ) {
+		for ( i = 0; i < npairs; i++ ) {
+			unsigned na, nb;
+
+			switch ( shape ) {
+			case SHAPE_EQUAL:
+				na = rnd_size( 1000, BDB_IDL_DB_MAX );
+				nb = na / 2 + rnd() % na;
+				break;
+			case SHAPE_SKEWED:
+				na = rnd_size( 1, 500 );
+				nb = rnd_size( 20000, BDB_IDL_DB_MAX );
+				break;
+			case SHAPE_ZIPF:
+			case SHAPE_CLUSTER:
+				na = rnd_size( 1, BDB_IDL_DB_MAX );
+				nb = rnd_size( 1, BDB_IDL_DB_MAX );
+				break;
+			}
+			if ( nb > BDB_IDL_DB_MAX )
+				nb = BDB_IDL_DB_MAX;
+			if ( na > (unsigned)entries )
+				na = entries;
+			if ( nb > (unsigned)entries )
+				nb = entries;
+			fill( pairs[2*i], na, entries, shape == SHAPE_CLUSTER );
+			fill( pairs[2*i+1], nb, entries, shape == SHAPE_CLUSTER );
+		}
+
+		for ( op = 0; op < 2; op++ ) {
+			for ( level = BDB_IDL_SIMD_NONE; level <= maxlevel; level++ ) {
+				if ( bdb_idl_simd( level ) != level )
+					break;
+
+				ops = ids = 0;
+				sum[0] = sum[1] = 0;
+				gettimeofday( &t0, NULL );
+				while ( ops < (unsigned long)loops * npairs ) {
+					ID *a = pairs[2 * ( ops % npairs )];
+					ID *b = pairs[2 * ( ops % npairs ) + 1];
+
+					AC_MEMCPY( work, a, ( a[0] + 1 ) * sizeof(ID) );
+					if ( op == 0 ) {
+						bdb_idl_list_and( work, b );
+					} else if ( bdb_idl_list_or( work, b ) != 0 ) {
+						fprintf( stderr, "union overflow\n" );
+						exit( EXIT_FAILURE );
+					}
+					ids += a[0] + b[0];
+					if ( ops < (unsigned long)npairs ) {
+						ID k;
+
+						sum[0] += work[0];
+						for ( k = 1; k <= work[0]; k++ )
+							sum[1] += work[k] * k;
+					}
+					ops++;
+				}
+				gettimeofday( &t1, NULL );
+
+				if ( level == BDB_IDL_SIMD_NONE ) {
+					ref[0] = sum[0];
+					ref[1] = sum[1];
+				} else if ( sum[0] != ref[0] || sum[1] != ref[1] ) {
+					fprintf( stderr, "%s %s: %s result differs "
+						"from scalar\n", shapes[shape],
+						op ? "or" : "and",
+						bdb_idl_simd_name( level ));
+					exit( EXIT_FAILURE );
+				}
+
+				us = ( t1.tv_sec - t0.tv_sec ) * 1000000.0 +
+					( t1.tv_usec - t0.tv_usec );
+				printf( "%-8s %-4s %-7s %10.2f %10.1f\n",
+					shapes[shape], op ? "or" : "and",
+					bdb_idl_simd_name( level ),
+					us / ops, ids / us );
+			}
+		}
+	}
+
+	exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,274 @@
+/* slapd-ucnorm -- check and time UTF8bvnormalize() */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2011 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Normalizes a fixed set of strings with and without case folding
+ * and approximate matching, and compares the results with those of
+ * the original liblunicode implementation, without the ASCII fast
+ * path and the normalization quick check. With -l, also reports the
+ * time per call over a few DN shaped corpora.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "lber.h"
+#include "ldap_pvt_uc.h"
+
+#include "lutil.h"
+
+#define CASEFOLD	LDAP_UTF8_CASEFOLD
+#define APPROX	LDAP_UTF8_APPROX
+
+static const struct {
+	const char	*in;
+	unsigned	flags;
+	const char	*out;
+} checks[] = {
+	{ "cn=John Smith,ou=People,dc=example,dc=com", 0,
+		"cn=John Smith,ou=People,dc=example,dc=com" },
+	{ "cn=John Smith,ou=People,dc=example,dc=com", CASEFOLD,
+		"cn=john smith,ou=people,dc=example,dc=com" },
+	{ "cn=John Smith,ou=People,dc=example,dc=com", APPROX,
+		"cn=John Smith,ou=People,dc=example,dc=com" },
+	{ "cn=John Smith,ou=People,dc=example,dc=com", CASEFOLD|APPROX,
+		"cn=john smith,ou=people,dc=example,dc=com" },
+	{ "Caf\xc3\xa9 Ren\xc3\xa9", 0,
+		"Caf\xc3\xa9 Ren\xc3\xa9" },
+	{ "Caf\xc3\xa9 Ren\xc3\xa9", CASEFOLD,
+		"caf\xc3\xa9 ren\xc3\xa9" },
+	{ "Caf\xc3\xa9 Ren\xc3\xa9", APPROX,
+		"Cafe Rene" },
+	{ "Caf\xc3\xa9 Ren\xc3\xa9", CASEFOLD|APPROX,
+		"cafe rene" },
+	{ "\xc3\x85ngstr\xc3\xb6m", 0,
+		"\xc3\x85ngstr\xc3\xb6m" },
+	{ "\xc3\x85ngstr\xc3\xb6m", CASEFOLD,
+		"\xc3\xa5ngstr\xc3\xb6m" },
+	{ "\xc3\x85ngstr\xc3\xb6m", APPROX,
+		"Angstrom" },
+	{ "\xc3\x85ngstr\xc3\xb6m", CASEFOLD|APPROX,
+		"angstrom" },
+	{ "\xe2\x84\xab", 0,
+		"\xc3\x85" },
+	{ "\xe2\x84\xab", CASEFOLD,
+		"\xc3\xa5" },
+	{ "\xe2\x84\xab", APPROX,
+		"A" },
+	{ "\xe2\x84\xab", CASEFOLD|APPROX,
+		"a" },
+	{ "A\xcc\x8angstro\xcc\x88m", 0,
+		"\xc3\x85ngstr\xc3\xb6m" },
+	{ "A\xcc\x8angstro\xcc\x88m", CASEFOLD,
+		"\xc3\xa5ngstr\xc3\xb6m" },
+	{ "A\xcc\x8angstro\xcc\x88m", APPROX,
+		"Angstrom" },
+	{ "A\xcc\x8angstro\xcc\x88m", CASEFOLD|APPROX,
+		"angstrom" },
+	{ "\xef\xac\x81le", 0,
+		"file" },
+	{ "\xef\xac\x81le", CASEFOLD,
+		"file" },
+	{ "\xef\xac\x81le", APPROX,
+		"file" },
+	{ "\xef\xac\x81le", CASEFOLD|APPROX,
+		"file" },
+	{ "\xc2\xbd", 0,
+		"1\xe2\x81\x84" "2" },
+	{ "\xc2\xbd", CASEFOLD,
+		"1\xe2\x81\x84" "2" },
+	{ "\xc2\xbd", APPROX,
+		"12" },
+	{ "\xc2\xbd", CASEFOLD|APPROX,
+		"12" },
+	{ "\xc7\x84", 0,
+		"D\xc5\xbd" },
+	{ "\xc7\x84", CASEFOLD,
+		"d\xc5\xbe" },
+	{ "\xc7\x84", APPROX,
+		"DZ" },
+	{ "\xc7\x84", CASEFOLD|APPROX,
+		"dz" },
+	{ "Stra\xc3\x9f" "e", 0,
+		"Stra\xc3\x9f" "e" },
+	{ "Stra\xc3\x9f" "e", CASEFOLD,
+		"stra\xc3\x9f" "e" },
+	{ "Stra\xc3\x9f" "e", APPROX,
+		"Strae" },
+	{ "Stra\xc3\x9f" "e", CASEFOLD|APPROX,
+		"strae" },
+	{ "\xce\xa9mega \xd0\x96", 0,
+		"\xce\xa9mega \xd0\x96" },
+	{ "\xce\xa9mega \xd0\x96", CASEFOLD,
+		"\xcf\x89mega \xd0\xb6" },
+	{ "\xce\xa9mega \xd0\x96", APPROX,
+		"mega " },
+	{ "\xce\xa9mega \xd0\x96", CASEFOLD|APPROX,
+		"mega " },
+	{ "\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d", 0,
+		"\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d" },
+	{ "\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d", CASEFOLD,
+		"\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d" },
+	{ "\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d", APPROX,
+		"" },
+	{ "\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d", CASEFOLD|APPROX,
+		"" },
+	{ "\xea\xb0\x80\xe1\x84\x80\xe1\x85\xa1", 0,
+		"\xea\xb0\x80\xea\xb0\x80" },
+	{ "\xea\xb0\x80\xe1\x84\x80\xe1\x85\xa1", CASEFOLD,
+		"\xea\xb0\x80\xea\xb0\x80" },
+	{ "\xea\xb0\x80\xe1\x84\x80\xe1\x85\xa1", APPROX,
+		"" },
+	{ "\xea\xb0\x80\xe1\x84\x80\xe1\x85\xa1", CASEFOLD|APPROX,
+		"" },
+	{ "\xe1\xbb\x91", 0,
+		"\xe1\xbb\x91" },
+	{ "\xe1\xbb\x91", CASEFOLD,
+		"\xe1\xbb\x91" },
+	{ "\xe1\xbb\x91", APPROX,
+		"o" },
+	{ "\xe1\xbb\x91", CASEFOLD|APPROX,
+		"o" },
+	{ "o\xcc\xa3\xcc\x82", 0,
+		"\xe1\xbb\x99" },
+	{ "o\xcc\xa3\xcc\x82", CASEFOLD,
+		"\xe1\xbb\x99" },
+	{ "o\xcc\xa3\xcc\x82", APPROX,
+		"o" },
+	{ "o\xcc\xa3\xcc\x82", CASEFOLD|APPROX,
+		"o" },
+	{ "\xe0\xa5\x98", 0,
+		"\xe0\xa4\x95\xe0\xa4\xbc" },
+	{ "\xe0\xa5\x98", CASEFOLD,
+		"\xe0\xa4\x95\xe0\xa4\xbc" },
+	{ "\xe0\xa5\x98", APPROX,
+		"" },
+	{ "\xe0\xa5\x98", CASEFOLD|APPROX,
+		"" },
+	{ "uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes", 0,
+		"uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes" },
+	{ "uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes", CASEFOLD,
+		"uid=j\xc3\xa9r\xc3\xb4me,ou=personnes" },
+	{ "uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes", APPROX,
+		"uid=Jerome,ou=Personnes" },
+	{ "uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes", CASEFOLD|APPROX,
+		"uid=jerome,ou=personnes" },
+	{ NULL, 0, NULL }
+};
+
+static const struct {
+	const char	*name;
+	const char	*str;
+} corpora[] = {
+	{ "ascii", "cn=John Smith,ou=People,dc=example,dc=com" },
+	{ "latin", "uid=J\xc3\xa9r\xc3\xb4me,ou=Personnes,dc=exemple,dc=fr" },
+	{ "nfd", "uid=Je\xcc\x81ro\xcc\x82me,ou=Personnes,dc=exemple,dc=fr" },
+	{ "cjk", "cn=\xe4\xb8\xad\xe6\x96\x87\xe5\x90\x8d,dc=example,dc=cn" },
+	{ NULL, NULL }
+};
+
+static const unsigned flags[] = { 0, CASEFOLD, CASEFOLD|APPROX };
+
+static void
+usage( char *name )
+{
+	fprintf( stderr,
+		"usage: %s "
+		"[-l <loops>] "
+		"\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, f, n, loops = 0, errors = 0;
+	struct berval	in, out;
+	struct timeval	t0, t1;
+	double		us;
+
+	while ( (i = getopt( argc, argv, "l:" )) != EOF ) {
+		switch ( i ) {
+		case 'l':
+			if ( lutil_atoi( &loops, optarg ) != 0 || loops < 1 )
+				usage( argv[0] );
+			break;
+
+		default:
+			usage( argv[0] );
+			break;
+		}
+	}
+
+	for ( i = 0; checks[i].in != NULL; i++ ) {
+		ber_str2bv( checks[i].in, 0, 0, &in );
+		if ( UTF8bvnormalize( &in, &out, checks[i].flags, NULL ) == NULL ) {
+			fprintf( stderr, "check %d: normalization failed\n", i );
+			errors++;
+			continue;
+		}
+		if ( out.bv_len != strlen( checks[i].out ) ||
+			memcmp( out.bv_val, checks[i].out, out.bv_len ) != 0 )
+		{
+			fprintf( stderr, "check %d (flags %x): got \"%s\", "
+				"expected \"%s\"\n", i, checks[i].flags,
+				out.bv_val, checks[i].out );
+			errors++;
+		}
+		ber_memfree( out.bv_val );
+	}
+	if ( errors ) {
+		fprintf( stderr, "%d of %d checks failed\n", errors, i );
+		exit( EXIT_FAILURE );
+	}
+	printf( "%d checks passed\n", i );
+
+	if ( loops == 0 ) {
+		exit( EXIT_SUCCESS );
+	}
+
+	printf( "%-8s %-6s %10s %10s\n", "corpus", "flags", "ns/call", "MB/s" );
+
+	for ( i = 0; corpora[i].name != NULL; i++ ) {
+		ber_str2bv( corpora[i].str, 0, 0, &in );
+		for ( f = 0; f < (int)( sizeof( flags ) / sizeof( flags[0] )); f++ ) {
+			gettimeofday( &t0, NULL );
+			for ( n = 0; n < loops; n++ ) {
+				if ( UTF8bvnormalize( &in, &out, flags[f], NULL ) == NULL ) {
+					fprintf( stderr, "%s: normalization failed\n",
+						corpora[i].name );
+					exit( EXIT_FAILURE );
+				}
+				ber_memfree( out.bv_val );
+			}
+			gettimeofday( &t1, NULL );
+
+			us = ( t1.tv_sec - t0.tv_sec ) * 1000000.0 +
+				( t1.tv_usec - t0.tv_usec );
+			printf( "%-8s %-6x %10.1f %10.1f\n",
+				corpora[i].name, flags[f],
+				us * 1000.0 / loops, in.bv_len * (double)loops / us );
+		}
+	}
+
+	exit( EXIT_SUCCESS );
+}
@@ -43,6 +43,7 @@ VALSORT=${AC_valsort-valsortno}
 
 # misc
 WITH_SASL=${AC_WITH_SASL-no}
+WITH_TLS=${AC_WITH_TLS-no}
 USE_SASL=${SLAPD_USE_SASL-no}
 ACI=${AC_ACI_ENABLED-acino}
 THREADS=${AC_THREADS-threadsno}
@@ -134,6 +135,13 @@ PASSWDCONF=$DATADIR/slapd-passwd.conf
 UNDOCONF=$DATADIR/slapd-config-undo.conf
 NAKEDCONF=$DATADIR/slapd-config-naked.conf
 VALREGEXCONF=$DATADIR/slapd-valregex.conf
+TLSCONF=$DATADIR/slapd-tls.conf
+IDLBITMAPCONF=$DATADIR/slapd-idlbitmap.conf
+ACLCACHECONF=$DATADIR/slapd-aclcache.conf
+ACLINDEXCONF=$DATADIR/slapd-aclindex.conf
+DNCACHECONF=$DATADIR/slapd-dncache.conf
+SLOGFILECONF=$DATADIR/slapd-syncprov-slog.conf
+FILTERCOMPILECONF=$DATADIR/slapd-filtercompile.conf
 
 DYNAMICCONF=$DATADIR/slapd-dynamic.ldif
 
@@ -170,6 +178,8 @@ MONITORDATA=$SRCDIR/scripts/monitor_data.sh
 SLAPADD="$TESTWD/../servers/slapd/slapd -Ta -d 0 $LDAP_VERBOSE"
 SLAPCAT="$TESTWD/../servers/slapd/slapd -Tc -d 0 $LDAP_VERBOSE"
 SLAPINDEX="$TESTWD/../servers/slapd/slapd -Ti -d 0 $LDAP_VERBOSE"
+SLAPACL="$TESTWD/../servers/slapd/slapd -Tacl -d 0 $LDAP_VERBOSE"
+SLAPDN="$TESTWD/../servers/slapd/slapd -Tdn -d 0 $LDAP_VERBOSE"
 SLAPPASSWD="$TESTWD/../servers/slapd/slapd -Tpasswd"
 
 unset DIFF_OPTIONS
@@ -193,6 +203,7 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDUCNORM=$PROGDIR/slapd-ucnorm
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 BASEPORT=${SLAPD_BASEPORT-9010}